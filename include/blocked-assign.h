@@ -0,0 +1,365 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  blocked-assign.h
+ *
+ *  Created on: 2014/10/22
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef BLOCKED_ASSIGN_H_
+#define BLOCKED_ASSIGN_H_
+
+#include <iostream>
+#include <algorithm>
+#include <type_traits>
+#include <cfloat>
+#include <cstring>
+#include <cstddef>
+#include "utilities.h"
+#include "simd.h"
+#include "kmeans-workspace.h"
+#include "center-tiles.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The number of data rows in a tile.
+ * It must be a multiple of 4, the height of the dot-product micro-kernel.
+ */
+const int ASSIGN_ROW_BLOCK = 64;
+
+/**
+ * The number of centers in a tile: a tile of centers is kept in
+ * the L2 cache (~128KB) while all row tiles are streamed against it.
+ * @param d the dimensions
+ * @param k the number of centers
+ */
+inline int assign_center_block(
+		int d,
+		int k) {
+	int cb = 32768 / (d > 0 ? d : 1);
+	cb = std::max(16,std::min(cb,256));
+	cb &= ~1; // the micro-kernel takes 2 centers at a time
+	return std::min(cb,k);
+}
+
+/**
+ * Copy a tile of rows into a contiguous float buffer
+ * @param data the input data
+ * @param ids the indices of the rows, nullptr for consecutive rows
+ * @param first the position of the first row of the tile
+ * @param n the number of rows in the tile
+ * @param d the dimensions
+ * @param tile the output buffer
+ * @param ld the distance between two rows of the data in elements
+ * @return a pointer to the float rows of the tile
+ */
+template<typename DataType, typename IndexType>
+inline float * gather_tile(
+		DataType * data,
+		IndexType * ids,
+		int first,
+		int n,
+		int d,
+		float * tile,
+		size_t ld) {
+	// Consecutive float rows are used in place
+	if(is_same<DataType,float>::value && ids == nullptr && ld == static_cast<size_t>(d))
+		return reinterpret_cast<float *>(data) + static_cast<size_t>(first) * d;
+	float * t = tile;
+	for(int r = 0; r < n; r++) {
+		size_t row = static_cast<size_t>(ids == nullptr ? first + r : ids[first + r]);
+		convert_to_float<DataType>(data + row * ld,t,d);
+		t += d;
+	}
+	return tile;
+}
+
+/**
+ * Assign rows to their nearest centers in the L2-metric space over
+ * the transposed centers, for few dimensions and many centers.
+ * The distances are computed directly, so they are exact bounds.
+ * @see blocked_assign
+ */
+template<typename DataType, typename IndexType, typename LabelType>
+inline void tiled_assign(
+		DataType * data,
+		IndexType * ids,
+		float * centers,
+		LabelType * best_id,
+		float * best,
+		float * second,
+		int d,
+		int N,
+		int k,
+		int n_thread,
+		bool verbose,
+		WorkBuffer * scratch,
+		size_t ld) {
+	int n_tiles = (N + ASSIGN_ROW_BLOCK - 1) / ASSIGN_ROW_BLOCK;
+	size_t per_thread = static_cast<size_t>(ASSIGN_ROW_BLOCK) * d;
+	size_t n_centers = center_tiles_size(k,d);
+	float * pool = nullptr, * c_tiles;
+	if(scratch != nullptr)
+		pool = scratch->get<float>(n_centers + per_thread * n_thread);
+	else
+		init_array<float>(pool,n_centers);
+	c_tiles = pool;
+	transpose_centers(centers,k,d,c_tiles);
+	if(verbose)
+		cout << "Assigning " << N << " rows against " << (n_centers / d / SIMD_CENTER_TILE)
+		<< " transposed tiles of " << SIMD_CENTER_TILE << " centers" << endl;
+
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel
+	{
+#endif
+		float * tile, * own = nullptr, b[2];
+		int l[2];
+		if(scratch != nullptr) {
+			int id = 0;
+#ifdef _OPENMP
+			id = omp_get_thread_num();
+#endif
+			tile = pool + n_centers + per_thread * id;
+		} else {
+			init_array<float>(own,per_thread);
+			tile = own;
+		}
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for(int t = 0; t < n_tiles; t++) {
+			int first = t * ASSIGN_ROW_BLOCK;
+			int nr = std::min(ASSIGN_ROW_BLOCK,N - first);
+			float * x = gather_tile<DataType,IndexType>(data,ids,first,nr,d,tile,ld);
+			for(int r = 0; r < nr; r++) {
+				nearest_in_tiles(x + r * d,c_tiles,k,d,DistanceType::NORM_L2,b,l);
+				best_id[first + r] = static_cast<LabelType>(l[0]);
+				if(best != nullptr) best[first + r] = b[0];
+				if(second != nullptr) second[first + r] = b[1];
+			}
+		}
+		::operator delete(own);
+#ifdef _OPENMP
+	}
+#endif
+	if(scratch == nullptr)
+		::operator delete(pool);
+}
+
+/**
+ * Assign rows to their nearest centers in the L2-metric space.
+ * The rows and the centers are tiled to fit in the caches and
+ * the squared distances are expanded as ||x||^2 + ||c||^2 - 2x.c,
+ * so the inner loop is a register-blocked dot-product micro-kernel.
+ * The distances to the nearest and the second nearest centers are
+ * recomputed directly at the end, so they can be used as exact bounds.
+ * With few dimensions and many centers the centers are transposed
+ * instead (tiled_assign).
+ * @param data input data
+ * @param ids the indices of the rows to be assigned, nullptr for all rows
+ * @param centers the centers
+ * @param best_id the nearest center of each row, of any integral label type
+ * @param best the squared distance to the nearest center, could be nullptr
+ * @param second the squared distance to the second nearest center, could be nullptr
+ * @param d the dimensions of the data
+ * @param N the number of rows to be assigned
+ * @param k the number of centers
+ * @param n_thread the number of threads
+ * @param verbose for debugging
+ * @param x_sq the cached squared norms of all rows (indexed as data), could be nullptr
+ * @param c_sq the cached squared norms of the centers, could be nullptr
+ * @param scratch the buffer that the tiles of the threads are taken from, could be nullptr
+ * @param replicas the copies of the centers on the NUMA nodes, could be nullptr
+ * @param ld the distance between two rows of the data in elements, 0 for d
+ */
+template<typename DataType, typename IndexType = int, typename LabelType = int>
+inline void blocked_assign(
+		DataType * data,
+		IndexType * ids,
+		float * centers,
+		LabelType * best_id,
+		float * best,
+		float * second,
+		int d,
+		int N,
+		int k,
+		int n_thread,
+		bool verbose,
+		const float * x_sq = nullptr,
+		const float * c_sq = nullptr,
+		WorkBuffer * scratch = nullptr,
+		const CenterReplicas * replicas = nullptr,
+		size_t ld = 0) {
+	if(N <= 0 || k <= 0 || d <= 0) return;
+	if(ld == 0) ld = d;
+	if(n_thread < 1) n_thread = 1;
+	if(use_center_tiles(d,k)) {
+		tiled_assign<DataType,IndexType,LabelType>(data,ids,replicas != nullptr ? replicas->local(centers) : centers,
+				best_id,best,second,d,N,k,n_thread,verbose,scratch,ld);
+		return;
+	}
+
+	int i, cb = assign_center_block(d,k);
+	DistanceFunction<DataType,float> dis =
+			compare_function<DataType,float>(DistanceType::NORM_L2,d,aligned_rows(data,ld));
+	int n_tiles = (N + ASSIGN_ROW_BLOCK - 1) / ASSIGN_ROW_BLOCK;
+	// The tile, the norms, the dot products, the two minimums and two labels per thread
+	size_t per_thread = static_cast<size_t>(ASSIGN_ROW_BLOCK) * (d + cb + 5);
+	float * pool = nullptr;
+	if(scratch != nullptr)
+		pool = scratch->get<float>(per_thread * n_thread);
+	float * c_norms = nullptr;
+	if(c_sq == nullptr) {
+		init_array<float>(c_norms,k);
+		for(i = 0; i < k; i++)
+			c_norms[i] = simd_dot_f32(centers + static_cast<size_t>(i) * d,
+					centers + static_cast<size_t>(i) * d,d);
+		c_sq = c_norms;
+	}
+	if(verbose)
+		cout << "Assigning " << N << " rows in " << n_tiles
+		<< " tiles of " << ASSIGN_ROW_BLOCK << "x" << cb << endl;
+
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel
+	{
+#endif
+		float * tile, * x_norms, * dots, * b1, * b2, * own = nullptr;
+		float * cs = replicas != nullptr ? replicas->local(centers) : centers;
+		int * l1, * l2;
+		if(pool != nullptr) {
+			int id = 0;
+#ifdef _OPENMP
+			id = omp_get_thread_num();
+#endif
+			tile = pool + per_thread * id;
+		} else {
+			init_array<float>(own,per_thread);
+			tile = own;
+		}
+		x_norms = tile + ASSIGN_ROW_BLOCK * d;
+		dots = x_norms + ASSIGN_ROW_BLOCK;
+		b1 = dots + ASSIGN_ROW_BLOCK * cb;
+		b2 = b1 + ASSIGN_ROW_BLOCK;
+		l1 = reinterpret_cast<int *>(b2 + ASSIGN_ROW_BLOCK);
+		l2 = l1 + ASSIGN_ROW_BLOCK;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for(int t = 0; t < n_tiles; t++) {
+			int first = t * ASSIGN_ROW_BLOCK;
+			int nr = std::min(ASSIGN_ROW_BLOCK,N - first);
+			float * x = gather_tile<DataType,IndexType>(data,ids,first,nr,d,tile,ld);
+			for(int r = 0; r < nr; r++) {
+				if(x_sq != nullptr)
+					x_norms[r] = x_sq[ids == nullptr ? first + r : ids[first + r]];
+				else
+					x_norms[r] = simd_dot_f32(x + r * d,x + r * d,d);
+				b1[r] = b2[r] = FLT_MAX;
+				l1[r] = l2[r] = -1;
+			}
+			for(int c0 = 0; c0 < k; c0 += cb) {
+				int nc = std::min(cb,k - c0);
+				simd_dot_tile_f32(x,nr,cs + static_cast<size_t>(c0) * d,nc,d,dots,cb);
+				for(int r = 0; r < nr; r++) {
+					float * dr = dots + r * cb;
+					float xn = x_norms[r], m1 = b1[r], m2 = b2[r], dis;
+					int j1 = l1[r], j2 = l2[r];
+					for(int j = 0; j < nc; j++) {
+						dis = xn + c_sq[c0 + j] - 2.0f * dr[j];
+						if(dis < m2) {
+							if(dis < m1) {
+								m2 = m1; j2 = j1;
+								m1 = dis; j1 = c0 + j;
+							} else {
+								m2 = dis; j2 = c0 + j;
+							}
+						}
+					}
+					b1[r] = m1; b2[r] = m2;
+					l1[r] = j1; l2[r] = j2;
+				}
+			}
+			if(best == nullptr && second == nullptr) {
+				for(int r = 0; r < nr; r++)
+					best_id[first + r] = static_cast<LabelType>(l1[r]);
+				continue;
+			}
+			// The expansion loses precision when the distances are small
+			// compared with the norms, so the bounds are recomputed directly.
+			for(int r = 0; r < nr; r++) {
+				size_t row = static_cast<size_t>(ids == nullptr ? first + r : ids[first + r]);
+				DataType * xr = data + row * ld;
+				float e1 = static_cast<float>(dis(xr,cs + static_cast<size_t>(l1[r]) * d,d));
+				float e2 = FLT_MAX;
+				if(l2[r] >= 0)
+					e2 = static_cast<float>(dis(xr,cs + static_cast<size_t>(l2[r]) * d,d));
+				if(e2 < e1) {
+					std::swap(e1,e2);
+					std::swap(l1[r],l2[r]);
+				}
+				best_id[first + r] = static_cast<LabelType>(l1[r]);
+				if(best != nullptr) best[first + r] = e1;
+				if(second != nullptr) second[first + r] = e2;
+			}
+		}
+		::operator delete(own);
+#ifdef _OPENMP
+	}
+#endif
+	::operator delete(c_norms);
+}
+
+/**
+ * Assign all rows to their nearest centers in the L2-metric space
+ * @see blocked_assign
+ */
+template<typename DataType, typename LabelType = int>
+inline void blocked_assign(
+		DataType * data,
+		nullptr_t,
+		float * centers,
+		LabelType * best_id,
+		float * best,
+		float * second,
+		int d,
+		int N,
+		int k,
+		int n_thread,
+		bool verbose,
+		const float * x_sq = nullptr,
+		const float * c_sq = nullptr,
+		WorkBuffer * scratch = nullptr,
+		const CenterReplicas * replicas = nullptr,
+		size_t ld = 0) {
+	blocked_assign<DataType,int,LabelType>(data,static_cast<int *>(nullptr),centers,
+			best_id,best,second,d,N,k,n_thread,verbose,x_sq,c_sq,scratch,replicas,ld);
+}
+}
+
+#endif /* BLOCKED_ASSIGN_H_ */
@@ -0,0 +1,123 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  center-tiles.h
+ *
+ *  Created on: 2014/11/03
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef CENTER_TILES_H_
+#define CENTER_TILES_H_
+
+#include <cstddef>
+#include <cstring>
+#include <cfloat>
+#include "utilities.h"
+#include "simd.h"
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The largest dimensions that use the transposed centers. With few
+ * dimensions a row-major distance is too short to fill the vectors,
+ * while a transposed tile scores SIMD_CENTER_TILE centers per pass.
+ */
+const int CENTER_TILE_DIMS = 32;
+
+/**
+ * Check whether the transposed centers should be used
+ * @param d the dimensions
+ * @param k the number of centers
+ */
+inline bool use_center_tiles(
+		int d,
+		int k) {
+	return d > 0 && d <= CENTER_TILE_DIMS && k >= 2 * SIMD_CENTER_TILE;
+}
+
+/**
+ * Get the number of floats of the transposed centers
+ * @param k the number of centers
+ * @param d the dimensions
+ */
+inline size_t center_tiles_size(
+		int k,
+		int d) {
+	size_t n_tiles = (k + SIMD_CENTER_TILE - 1) / SIMD_CENTER_TILE;
+	return n_tiles * SIMD_CENTER_TILE * d;
+}
+
+/**
+ * Transpose the centers into tiles of SIMD_CENTER_TILE centers: tile t keeps
+ * component j of its centers at tiles[(t * d + j) * SIMD_CENTER_TILE + c].
+ * The lanes after the last center are zero and never reported.
+ * @param centers the k centers, one after another
+ * @param k the number of centers
+ * @param d the dimensions
+ * @param tiles the output, center_tiles_size(k,d) floats
+ */
+inline void transpose_centers(
+		const float * centers,
+		int k,
+		int d,
+		float * tiles) {
+	memset(tiles,0,center_tiles_size(k,d) * sizeof(float));
+	for(int i = 0; i < k; i++) {
+		float * t = tiles + static_cast<size_t>(i / SIMD_CENTER_TILE) * SIMD_CENTER_TILE * d
+				+ i % SIMD_CENTER_TILE;
+		const float * c = centers + static_cast<size_t>(i) * d;
+		for(int j = 0; j < d; j++)
+			t[j * SIMD_CENTER_TILE] = c[j];
+	}
+}
+
+/**
+ * Find the two nearest centers of a row over the transposed centers
+ * @param x the row
+ * @param tiles the transposed centers
+ * @param k the number of centers
+ * @param d the dimensions
+ * @param d_type NORM_L2 (squared distances) or NORM_L1
+ * @param best the two smallest distances, FLT_MAX if there is no second center
+ * @param best_id the two nearest centers, -1 if there is no second center
+ */
+inline void nearest_in_tiles(
+		const float * x,
+		const float * tiles,
+		int k,
+		int d,
+		DistanceType d_type,
+		float * best,
+		int * best_id) {
+	best[0] = best[1] = FLT_MAX;
+	best_id[0] = 0;
+	best_id[1] = -1;
+	size_t step = static_cast<size_t>(SIMD_CENTER_TILE) * d;
+	for(int c0 = 0; c0 < k; c0 += SIMD_CENTER_TILE, tiles += step) {
+		int nc = k - c0 < SIMD_CENTER_TILE ? k - c0 : SIMD_CENTER_TILE;
+		if(d_type == DistanceType::NORM_L1)
+			simd_l1_tile_f32(x,tiles,d,nc,c0,best,best_id);
+		else
+			simd_l2_square_tile_f32(x,tiles,d,nc,c0,best,best_id);
+	}
+}
+}
+
+#endif /* CENTER_TILES_H_ */
@@ -0,0 +1,315 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  elkan-kmeans.h
+ *
+ *  Created on: 2014/11/04
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef ELKAN_KMEANS_H_
+#define ELKAN_KMEANS_H_
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include "utilities.h"
+#include "k-means.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The default memory of the N x k lower bounds and the k x k distances
+ * between the centers of Elkan's k-means, in bytes. Above it the k-means
+ * falls back to Hamerly's single lower bound (greg_kmeans).
+ */
+const size_t ELKAN_MEMORY_BUDGET = static_cast<size_t>(1) << 30;
+
+/**
+ * Elkan's k-means: every point keeps an upper bound on the distance to its
+ * center and a lower bound on the distance to each center, and the half
+ * distances between the centers rule out the centers that cannot be closer.
+ * It computes far fewer distances than Hamerly's method for large k and
+ * high dimensions, at the cost of N x k bounds.
+ * @param budget the memory of the lower bounds and the distances between
+ * the centers in bytes; when they do not fit, Hamerly's method
+ * (greg_kmeans) runs instead
+ * @see greg_kmeans for the other parameters
+ */
+template<typename DataType, typename LabelType = int>
+inline void elkan_kmeans(
+		DataType * data,
+		float *& centers,
+		LabelType *& label,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0,
+		size_t budget = ELKAN_MEMORY_BUDGET) {
+	if(ld == 0) ld = d;
+	if(n_thread < 1) n_thread = 1;
+	if(packed_hamming<DataType>(d_type)) {
+		cerr << "Packed binary data are clustered by kmajority" << endl;
+		return;
+	}
+	size_t n_bounds = static_cast<size_t>(N) * k;
+	size_t n_bytes = (n_bounds + static_cast<size_t>(k) * k) * sizeof(float);
+	// Too few points, inner products or too many bounds: Hamerly's method
+	if(N < k || d_type == DistanceType::INNER_PRODUCT || n_bytes > budget) {
+		if(verbose && N >= k && d_type != DistanceType::INNER_PRODUCT)
+			cout << "The lower bounds and the center distances need " << n_bytes
+			<< " bytes, running Hamerly's k-means instead" << endl;
+		greg_kmeans<DataType,LabelType>(data,centers,label,seeds,type,criteria,
+				d_type,ea,N,k,d,n_thread,verbose,ws,ld);
+		return;
+	}
+	if(!label_fits<LabelType>(k)) {
+		cerr << "The label type cannot hold " << k << " clusters" << endl;
+		return;
+	}
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+	// The chordal distance on the unit sphere, as in greg_kmeans
+	DistanceType b_type = d_type == DistanceType::COSINE ? DistanceType::NORM_L2 : d_type;
+	DistanceFunction<DataType,float> p_dis =
+			compare_function<DataType,float>(b_type,d,aligned_rows(data,ld));
+	DistanceFunction<float,float> c_dis = compare_function<float,float>(b_type,d);
+
+	if(seeds == nullptr) {
+		init_array<float>(seeds,static_cast<size_t>(k) * d);
+	}
+
+	// Seeding
+	if (type == KmeansType::RANDOM_SEEDS) {
+		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose,ld);
+	} else if(type == KmeansType::KMEANS_PLUS_SEEDS || type == KmeansType::KMEANS_PAR_SEEDS) {
+		NormCache * cache = nullptr;
+		if(b_type == DistanceType::NORM_L2) {
+			ws->norms.set_data<DataType>(data,N,d,n_thread,ld);
+			cache = &ws->norms;
+		}
+		if(type == KmeansType::KMEANS_PLUS_SEEDS)
+			kmeans_pp_seeds<DataType>(data,seeds,b_type,d,N,k,n_thread,verbose,cache,ws,ld);
+		else
+			kmeans_par_seeds<DataType>(data,seeds,b_type,d,N,k,n_thread,verbose,cache,ws,ld);
+	}
+
+	if(verbose)
+		cout << "Finished seeding" << endl;
+
+	// Criteria's setup
+	int it = 0, count = 0;
+	float e = criteria.accuracy;
+
+	// Variables for Elkan's method
+	float * c_sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	float * moved = ws->moved.get<float>(k);
+	float * half = ws->closest.get<float>(k); // half the distance to the closest other center
+	float * upper = ws->upper.get<float>(N);
+	float * lower = ws->elkan_lower.get<float>(n_bounds);
+	float * cc = ws->center_dist.get<float>(static_cast<size_t>(k) * k); // half the distances between centers
+	int * size = ws->size.get<int>(k);
+	int * new_label = ws->new_label.get<int>(N);
+
+	int i0, i, j;
+	size_t p = N / n_thread, row, base1, base2;
+
+	// Initialize the centers
+	copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+	if(d_type == DistanceType::COSINE)
+		normalize_rows(centers,k,d);
+
+	// The first assignment computes every distance, which are the first lower bounds
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel
+	{
+#pragma omp for private(i,j)
+#endif
+		for(i0 = 0; i0 < n_thread; i0++) {
+			size_t start = p * i0;
+			size_t end = start + p;
+			if(end > static_cast<size_t>(N) || i0 == n_thread - 1) end = N;
+			for(size_t x = start; x < end; x++) {
+				DataType * dt = data + x * ld;
+				float * l = lower + x * k, min = FLT_MAX;
+				int tmp = 0;
+				for(j = 0; j < k; j++) {
+					l[j] = to_metric(p_dis(dt,centers + static_cast<size_t>(j) * d,d),b_type);
+					if(l[j] < min) {
+						min = l[j];
+						tmp = j;
+					}
+				}
+				new_label[x] = tmp;
+				upper[x] = min;
+			}
+		}
+#ifdef _OPENMP
+	}
+#endif
+	memset(size,0,k * sizeof(int));
+	memset(c_sum,0,static_cast<size_t>(k) * d * sizeof(float));
+	for(i = 0; i < N; i++) {
+		label[i] = static_cast<LabelType>(new_label[i]);
+		size[new_label[i]]++;
+		base1 = static_cast<size_t>(new_label[i]) * d;
+		row = static_cast<size_t>(i) * ld;
+		for(j = 0; j < d; j++)
+			c_sum[base1++] += static_cast<float>(data[row++]);
+	}
+
+	// Move the centers of the empty clusters onto points. A moved center
+	// can be anywhere, so its lower bounds drop to zero.
+	auto reset_bounds = [&](int fst, int c) {
+		upper[fst] = 0.0f;
+		for(size_t x = 0; x < static_cast<size_t>(N); x++)
+			lower[x * k + c] = 0.0f;
+	};
+	move_empty_centers<DataType,LabelType>(data,centers,c_sum,size,label,
+			b_type,ea,N,k,d,verbose,ld,reset_bounds);
+	if(verbose)
+		cout << "Finished initialization" << endl;
+
+	while (1) {
+		// Update the half distances between the centers
+		for(i = 0; i < k; i++) {
+			half[i] = FLT_MAX;
+			cc[static_cast<size_t>(i) * k + i] = 0.0f;
+		}
+		for(i = 0; i < k; i++) {
+			float * ci = centers + static_cast<size_t>(i) * d;
+			for(j = i + 1; j < k; j++) {
+				float h = 0.5f * to_metric(c_dis(ci,centers + static_cast<size_t>(j) * d,d),b_type);
+				cc[static_cast<size_t>(i) * k + j] = cc[static_cast<size_t>(j) * k + i] = h;
+				if(half[i] > h) half[i] = h;
+				if(half[j] > h) half[j] = h;
+			}
+		}
+
+		// Assign the data: only the centers that pass both tests are compared
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel
+		{
+#pragma omp for private(j)
+#endif
+			for(i0 = 0; i0 < n_thread; i0++) {
+				size_t start = p * i0;
+				size_t end = start + p;
+				if(end > static_cast<size_t>(N) || i0 == n_thread - 1) end = N;
+				for(size_t x = start; x < end; x++) {
+					int a = static_cast<int>(label[x]);
+					float u = upper[x];
+					new_label[x] = a;
+					if(u <= half[a]) continue;
+					DataType * dt = data + x * ld;
+					float * l = lower + x * k;
+					const float * ca = cc + static_cast<size_t>(a) * k;
+					bool tight = false;
+					for(j = 0; j < k; j++) {
+						if(j == a || u <= l[j] || u <= ca[j]) continue;
+						if(!tight) {
+							// Tighten the upper bound once
+							u = to_metric(p_dis(dt,centers + static_cast<size_t>(a) * d,d),b_type);
+							l[a] = u;
+							tight = true;
+							if(u <= l[j] || u <= ca[j]) continue;
+						}
+						l[j] = to_metric(p_dis(dt,centers + static_cast<size_t>(j) * d,d),b_type);
+						if(l[j] < u) {
+							u = l[j];
+							a = j;
+							ca = cc + static_cast<size_t>(a) * k;
+						}
+					}
+					upper[x] = u;
+					new_label[x] = a;
+				}
+			}
+#ifdef _OPENMP
+		}
+#endif
+
+		// Update the sizes and the vector sums of the points that moved
+		for(i = 0; i < N; i++) {
+			int l = static_cast<int>(label[i]), tmp = new_label[i];
+			if(l == tmp) continue;
+			label[i] = static_cast<LabelType>(tmp);
+			size[tmp]++;
+			size[l]--;
+			if(size[l] == 0) {
+				if(verbose)
+					cout << "An empty cluster was found!"
+					" label = " << l << endl;
+			}
+			row = static_cast<size_t>(i) * ld;
+			base1 = static_cast<size_t>(tmp) * d;
+			base2 = static_cast<size_t>(l) * d;
+			for(j = 0; j < d; j++) {
+				c_sum[base1++] += static_cast<float>(data[row]);
+				c_sum[base2++] -= static_cast<float>(data[row++]);
+			}
+		}
+		// Check for empty clusters
+		move_empty_centers<DataType,LabelType>(data,centers,c_sum,size,label,
+				b_type,ea,N,k,d,verbose,ld,reset_bounds);
+		// Move the centers
+		update_center(c_sum,size,centers,moved,d_type,k,d,n_thread,nullptr,ws);
+		// Update the bounds
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for private(j)
+#endif
+		for(i = 0; i < N; i++) {
+			float * l = lower + static_cast<size_t>(i) * k;
+			upper[i] += moved[label[i]];
+			for(j = 0; j < k; j++) {
+				l[j] -= moved[j];
+				if(l[j] < 0.0f) l[j] = 0.0f;
+			}
+		}
+
+		if(verbose)
+			print_spec(it,size,k);
+		if(bound_converged(data,centers,label,moved,d_type,criteria,
+				e,count,it,N,k,d,verbose,ld)) break;
+	}
+
+	if(verbose)
+		cout << "Finished clustering with error is " <<
+		e << " after " << it << " iterations." << endl;
+}
+}
+
+#endif /* ELKAN_KMEANS_H_ */
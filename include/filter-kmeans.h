@@ -0,0 +1,405 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  filter-kmeans.h
+ *
+ *  Created on: 2014/11/07
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef FILTER_KMEANS_H_
+#define FILTER_KMEANS_H_
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include "utilities.h"
+#include "k-means.h"
+#include "flat-kd-tree.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The number of points in a leaf of the kd-tree of the filtering k-means
+ */
+const int FILTER_LEAF_SIZE = 8;
+
+/**
+ * The largest dimensions that the filtering k-means is meant for: the
+ * bounding boxes of the cells prune fewer centers as d grows
+ */
+const int FILTER_MAX_DIMS = 16;
+
+/**
+ * Compute the bounding box and the vector sum of every node of a tree,
+ * bottom-up: the children of a node come after it
+ * @param tree the kd-tree of the data
+ * @param d the dimensions
+ * @param stats per node, the lower corner, the upper corner and the sum (3 * d floats)
+ */
+template<typename DataType>
+inline void filter_stats(
+		const FlatKDTree<DataType>& tree,
+		int d,
+		float * stats) {
+	size_t row = static_cast<size_t>(3) * d;
+	for(int id = tree.node_count() - 1; id >= 0; id--) {
+		const FlatKDNode& n = tree.node(id);
+		float * lo = stats + id * row, * hi = lo + d, * s = hi + d;
+		if(n.left < 0) {
+			fill(lo,lo + d,FLT_MAX);
+			fill(hi,hi + d,-FLT_MAX);
+			fill(s,s + d,0.0f);
+			for(int i = n.begin; i < n.end; i++) {
+				DataType * x = tree.point(i);
+				for(int j = 0; j < d; j++) {
+					float v = static_cast<float>(x[j]);
+					lo[j] = std::min(lo[j],v);
+					hi[j] = std::max(hi[j],v);
+					s[j] += v;
+				}
+			}
+		} else {
+			float * l = stats + n.left * row, * r = stats + n.right * row;
+			for(int j = 0; j < d; j++) {
+				lo[j] = std::min(l[j],r[j]);
+				hi[j] = std::max(l[d + j],r[d + j]);
+				s[j] = l[2 * d + j] + r[2 * d + j];
+			}
+		}
+	}
+}
+
+/**
+ * Push the candidate centers down a node (Kanungo et al.): the candidate
+ * z* nearest to the middle of the cell removes every candidate z that is
+ * farther than z* from the corner of the cell in the direction z - z*,
+ * hence from the whole cell. A cell that keeps one candidate joins it at
+ * once with its cached sum; the points of a leaf are compared with the
+ * candidates that are left.
+ * @param tree the kd-tree of the data
+ * @param id the node
+ * @param cand the candidates
+ * @param nc the number of candidates
+ * @param stack the candidates of the deeper levels, k per level
+ * @param centers the centers
+ * @param stats the boxes and the sums of the nodes (filter_stats)
+ * @param p_dis the squared L2 distance
+ * @param k the number of centers
+ * @param d the dimensions
+ * @param sum the vector sums of the clusters
+ * @param size the sizes of the clusters
+ * @param labels the labels of the points, none if it is nullptr
+ */
+template<typename DataType>
+inline void filter_node(
+		const FlatKDTree<DataType>& tree,
+		int id,
+		const int * cand,
+		int nc,
+		int * stack,
+		float * centers,
+		const float * stats,
+		DistanceFunction<DataType,float> p_dis,
+		int k,
+		int d,
+		float * sum,
+		int * size,
+		int * labels) {
+	const FlatKDNode& n = tree.node(id);
+	const float * lo = stats + static_cast<size_t>(id) * 3 * d, * hi = lo + d;
+	int i, j, c, zs = cand[0], nn = 0;
+	float v, t, best = FLT_MAX;
+	if(nc > 1) {
+		// The candidate nearest to the middle of the cell
+		for(c = 0; c < nc; c++) {
+			const float * z = centers + static_cast<size_t>(cand[c]) * d;
+			v = 0.0f;
+			for(j = 0; j < d; j++) {
+				t = z[j] - 0.5f * (lo[j] + hi[j]);
+				v += t * t;
+			}
+			if(v < best) {
+				best = v;
+				zs = cand[c];
+			}
+		}
+	}
+	const float * s = centers + static_cast<size_t>(zs) * d;
+	for(c = 0; c < nc; c++) {
+		if(cand[c] == zs) {
+			stack[nn++] = zs;
+			continue;
+		}
+		// |z - v|^2 - |z* - v|^2 at the corner v that favors z the most
+		const float * z = centers + static_cast<size_t>(cand[c]) * d;
+		v = 0.0f;
+		for(j = 0; j < d; j++) {
+			t = z[j] - s[j];
+			v += t * (z[j] + s[j] - 2.0f * (t > 0.0f ? hi[j] : lo[j]));
+		}
+		if(v < 0.0f)
+			stack[nn++] = cand[c];
+	}
+
+	if(nn == 1) {
+		// The whole cell joins z*
+		const float * ns = hi + d;
+		float * cs = sum + static_cast<size_t>(zs) * d;
+		for(j = 0; j < d; j++)
+			cs[j] += ns[j];
+		size[zs] += n.end - n.begin;
+		if(labels != nullptr)
+			for(i = n.begin; i < n.end; i++)
+				labels[tree.index(i)] = zs;
+	} else if(n.left < 0) {
+		for(i = n.begin; i < n.end; i++) {
+			DataType * x = tree.point(i);
+			int b = stack[0];
+			best = FLT_MAX;
+			for(c = 0; c < nn; c++) {
+				v = p_dis(x,centers + static_cast<size_t>(stack[c]) * d,d);
+				if(v < best) {
+					best = v;
+					b = stack[c];
+				}
+			}
+			float * cs = sum + static_cast<size_t>(b) * d;
+			for(j = 0; j < d; j++)
+				cs[j] += static_cast<float>(x[j]);
+			size[b]++;
+			if(labels != nullptr)
+				labels[tree.index(i)] = b;
+		}
+	} else {
+		filter_node<DataType>(tree,n.left,stack,nn,stack + k,centers,stats,
+				p_dis,k,d,sum,size,labels);
+		filter_node<DataType>(tree,n.right,stack,nn,stack + k,centers,stats,
+				p_dis,k,d,sum,size,labels);
+	}
+}
+
+/**
+ * Get the depth of a tree
+ * @param tree the tree
+ * @param id the root of the subtree
+ */
+template<typename DataType>
+inline int tree_depth(
+		const FlatKDTree<DataType>& tree,
+		int id) {
+	const FlatKDNode& n = tree.node(id);
+	if(n.left < 0) return 1;
+	return 1 + std::max(tree_depth(tree,n.left),tree_depth(tree,n.right));
+}
+
+/**
+ * The filtering k-means of Kanungo et al.: a kd-tree of the data with the
+ * bounding box and the vector sum of every cell is built once, and each
+ * iteration pushes the candidate centers down the tree, so that a cell
+ * with one candidate left is assigned as a whole. It is meant for few
+ * dimensions (up to FILTER_MAX_DIMS) and many points; the tree keeps a
+ * copy of the data in leaf order. The threads filter the subtrees below
+ * the first levels. An empty cluster is moved onto a random point.
+ * NORM_L2 only: the other distances run greg_kmeans.
+ * @param labels the labels, allocated if it is nullptr
+ * @see simple_kmeans for the other parameters
+ */
+template<typename DataType>
+inline void filter_kmeans(
+		DataType * data,
+		float *& centers,
+		int *& labels,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
+	if(n_thread < 1) n_thread = 1;
+	if(labels == nullptr)
+		init_array<int>(labels,N);
+	if(N < k || d_type != DistanceType::NORM_L2) {
+		greg_kmeans<DataType>(data,centers,labels,seeds,type,criteria,
+				d_type,ea,N,k,d,n_thread,verbose,ws,ld);
+		return;
+	}
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+
+	if(seeds == nullptr) {
+		init_array<float>(seeds,static_cast<size_t>(k) * d);
+	}
+
+	// Seeding
+	if (type == KmeansType::RANDOM_SEEDS) {
+		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose,ld);
+	} else if(type == KmeansType::KMEANS_PLUS_SEEDS) {
+		ws->norms.set_data<DataType>(data,N,d,n_thread,ld);
+		kmeans_pp_seeds<DataType>(data,seeds,d_type,d,N,k,n_thread,verbose,&ws->norms,ws,ld);
+	} else if(type == KmeansType::KMEANS_PAR_SEEDS) {
+		ws->norms.set_data<DataType>(data,N,d,n_thread,ld);
+		kmeans_par_seeds<DataType>(data,seeds,d_type,d,N,k,n_thread,verbose,&ws->norms,ws,ld);
+	}
+
+	if(verbose)
+		cout << "Finished seeding" << endl;
+
+	// The tree, the boxes and the sums of its cells
+	FlatKDTree<DataType> tree;
+	if(!tree.build(data,N,d,FILTER_LEAF_SIZE,ld)) {
+		cerr << "Cannot build the kd-tree of the data" << endl;
+		return;
+	}
+	float * stats = ws->filter_stats.get<float>(static_cast<size_t>(tree.node_count()) * 3 * d);
+	filter_stats<DataType>(tree,d,stats);
+
+	// The subtrees below the first levels are filtered by the threads
+	vector<int> frontier(1,0), next;
+	while(static_cast<int>(frontier.size()) < 4 * n_thread) {
+		next.clear();
+		for(int id : frontier) {
+			const FlatKDNode& n = tree.node(id);
+			if(n.left < 0) {
+				next.push_back(id);
+			} else {
+				next.push_back(n.left);
+				next.push_back(n.right);
+			}
+		}
+		if(next.size() == frontier.size()) break;
+		frontier.swap(next);
+	}
+	int n_sub = static_cast<int>(frontier.size());
+	int depth = tree_depth(tree,0);
+
+	// Per thread: the sums, the sizes and the candidates of each level
+	float * c_sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	float * moved = ws->moved.get<float>(k);
+	int * size = ws->size.get<int>(k);
+	float * t_sum = ws->tiles.get<float>(static_cast<size_t>(n_thread) * k * d);
+	int * t_size = ws->n_cand.get<int>(static_cast<size_t>(n_thread) * k);
+	int * stacks = ws->cand.get<int>(static_cast<size_t>(n_thread) * (depth + 2) * k);
+	DistanceFunction<DataType,float> p_dis =
+			compare_function<DataType,float>(d_type,d,aligned_rows(data,ld));
+	random_device rd;
+	mt19937 gen(rd());
+	uniform_int_distribution<int> pick(0,N - 1);
+
+	copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+
+	// One pass over the tree
+	auto filter = [&](int * out) {
+		int i0;
+		memset(t_sum,0,static_cast<size_t>(n_thread) * k * d * sizeof(float));
+		memset(t_size,0,static_cast<size_t>(n_thread) * k * sizeof(int));
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for(int s = 0; s < n_sub; s++) {
+			int t = 0;
+#ifdef _OPENMP
+			t = omp_get_thread_num();
+#endif
+			int * st = stacks + static_cast<size_t>(t) * (depth + 2) * k;
+			for(int c = 0; c < k; c++) st[c] = c;
+			filter_node<DataType>(tree,frontier[s],st,k,st + k,centers,stats,p_dis,
+					k,d,t_sum + static_cast<size_t>(t) * k * d,
+					t_size + static_cast<size_t>(t) * k,out);
+		}
+		memset(c_sum,0,static_cast<size_t>(k) * d * sizeof(float));
+		memset(size,0,k * sizeof(int));
+		for(i0 = 0; i0 < n_thread; i0++) {
+			float * ts = t_sum + static_cast<size_t>(i0) * k * d;
+			int * tz = t_size + static_cast<size_t>(i0) * k;
+			for(size_t j = 0; j < static_cast<size_t>(k) * d; j++)
+				c_sum[j] += ts[j];
+			for(int c = 0; c < k; c++)
+				size[c] += tz[c];
+		}
+	};
+
+	if(verbose)
+		cout << "Finished initialization with " << tree.node_count()
+		<< " cells" << endl;
+
+	// Criteria's setup
+	int iters = criteria.iterations, it = 0, count = 0, i;
+	float error = criteria.accuracy, e = error, e_prev;
+	while(1) {
+		filter(nullptr);
+		update_center(c_sum,size,centers,moved,d_type,k,d,n_thread,nullptr,ws);
+		// Move the empty clusters onto random points
+		if(ea != EmptyActs::NONE) {
+			for(i = 0; i < k; i++) {
+				if(size[i] > 0) continue;
+				DataType * x = data + static_cast<size_t>(pick(gen)) * ld;
+				float * c = centers + static_cast<size_t>(i) * d;
+				moved[i] = to_metric(p_dis(x,c,d),d_type);
+				for(int j = 0; j < d; j++)
+					c[j] = static_cast<float>(x[j]);
+				if(verbose)
+					cout << "An empty cluster was found!"
+					" label = " << i << endl;
+			}
+		}
+
+		if(verbose)
+			print_spec(it,size,k);
+
+		// Calculate the distortion
+		e_prev = e;
+		e = 0.0;
+		for(i = 0; i < k; i++) {
+			e += moved[i];
+		}
+		e = sqrt(e);
+		count += (fabs(e-e_prev) < error? 1 : 0);
+		if(verbose)
+			cout << "Iterator " << it
+			<< "-th with error = " << e << endl;
+		it++;
+		if(it >= iters || e < error || count >= 10) break;
+	}
+	// The labels of the final centers
+	filter(labels);
+
+	if(verbose)
+		cout << "Finished clustering with error is " <<
+		e << " after " << it << " iterations." << endl;
+}
+}
+
+#endif /* FILTER_KMEANS_H_ */
@@ -0,0 +1,457 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  flat-kd-tree.h
+ *
+ *  Created on: 2014/10/29
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef FLAT_KD_TREE_H_
+#define FLAT_KD_TREE_H_
+
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include "utilities.h"
+#include "matrix.h"
+#include "kd-tree.h"
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The default number of points in a leaf of a FlatKDTree
+ */
+const int KD_LEAF_SIZE = 32;
+
+/**
+ * A node of a FlatKDTree. The children are indices into the node array
+ * and a leaf keeps a range of the points, which are stored in leaf order.
+ */
+typedef struct {
+	int32_t left, right; // the children, -1 in a leaf
+	int32_t dim; // the cut dimension
+	float split; // the cut value
+	int32_t begin, end; // the range of the points under the node
+} FlatKDNode;
+
+/**
+ * A kd-tree in one arena: the nodes, the indices of the points and
+ * a copy of the points in leaf order are allocated in a single block,
+ * which is freed in one shot. The leaves are buckets of up to leaf_size
+ * points that are scanned contiguously, so a search touches a few dozen
+ * nodes instead of one node per point.
+ */
+template<typename DataType>
+class FlatKDTree {
+private:
+	void * arena;
+	FlatKDNode * nodes;
+	int * ids; // the original index of each point, in leaf order
+	DataType * points; // the points, in leaf order
+	int n_nodes, n_points, dims, leaf;
+
+	FlatKDTree(const FlatKDTree<DataType>&) = delete;
+	FlatKDTree& operator= (const FlatKDTree<DataType>&) = delete;
+
+	/**
+	 * Allocate the arena
+	 * @param N the number of points
+	 * @param d the dimensions
+	 * @param max_nodes the capacity of the node array
+	 */
+	bool allocate(
+			int N,
+			int d,
+			int max_nodes) {
+		size_t b_nodes = static_cast<size_t>(max_nodes) * sizeof(FlatKDNode);
+		size_t b_ids = static_cast<size_t>(N) * sizeof(int);
+		b_ids = (b_ids + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+		b_nodes = (b_nodes + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+		size_t b_points = static_cast<size_t>(N) * d * sizeof(DataType);
+		try {
+			arena = ::operator new(b_nodes + b_ids + b_points + MATRIX_ALIGN);
+		} catch(exception& e) {
+			cerr << "Got an exception: " << e.what() << endl;
+			arena = nullptr;
+			return false;
+		}
+		uintptr_t p = reinterpret_cast<uintptr_t>(arena);
+		p = (p + MATRIX_ALIGN - 1) & ~static_cast<uintptr_t>(MATRIX_ALIGN - 1);
+		nodes = reinterpret_cast<FlatKDNode *>(p);
+		ids = reinterpret_cast<int *>(p + b_nodes);
+		points = reinterpret_cast<DataType *>(p + b_nodes + b_ids);
+		return true;
+	}
+
+	/**
+	 * Split the points in [begin,end) at the median of the dimension
+	 * of the largest spread
+	 * @param row the accessor of the rows of the input
+	 * @return the index of the node
+	 */
+	template<typename Row>
+	int split(
+			Row row,
+			int begin,
+			int end) {
+		int id = n_nodes++;
+		FlatKDNode& node = nodes[id];
+		node.begin = begin;
+		node.end = end;
+		node.left = node.right = -1;
+		node.dim = 0;
+		node.split = 0.0f;
+		if(end - begin <= leaf) return id;
+
+		double spread = 0.0, lo, hi, v;
+		int i, j, dim = 0;
+		for(j = 0; j < dims; j++) {
+			lo = hi = static_cast<double>(row(ids[begin])[j]);
+			for(i = begin + 1; i < end; i++) {
+				v = static_cast<double>(row(ids[i])[j]);
+				if(v < lo) lo = v;
+				else if(v > hi) hi = v;
+			}
+			if(hi - lo > spread) {
+				spread = hi - lo;
+				dim = j;
+			}
+		}
+		// The points are all the same
+		if(spread <= 0.0) return id;
+
+		int mid = begin + ((end - begin) >> 1);
+		nth_element(ids + begin,ids + mid,ids + end,
+				[&row,dim](int a, int b) {
+			return static_cast<double>(row(a)[dim]) < static_cast<double>(row(b)[dim]);
+		});
+		node.dim = dim;
+		node.split = static_cast<float>(row(ids[mid])[dim]);
+		int l = split(row,begin,mid);
+		int r = split(row,mid,end);
+		nodes[id].left = l;
+		nodes[id].right = r;
+		return id;
+	}
+
+	/**
+	 * Build the tree over N rows
+	 * @param row the accessor of the rows of the input
+	 */
+	template<typename Row>
+	bool build_rows(
+			Row row,
+			int N,
+			int d,
+			int leaf_size) {
+		clear();
+		if(N <= 0 || d <= 0) return false;
+		leaf = leaf_size < 1 ? 1 : leaf_size;
+		// Every leaf keeps at least (leaf + 1) / 2 points
+		int max_nodes = 2 * (N / ((leaf + 1) / 2) + 1);
+		if(!allocate(N,d,max_nodes)) return false;
+		n_points = N;
+		dims = d;
+		for(int i = 0; i < N; i++)
+			ids[i] = i;
+		split(row,0,N);
+		for(int i = 0; i < N; i++)
+			memcpy(points + static_cast<size_t>(i) * d,row(ids[i]),d * sizeof(DataType));
+		return true;
+	}
+
+	/**
+	 * The state of a search
+	 */
+	typedef struct {
+		DataType * query;
+		DistanceType d_type;
+		DistanceFunction<DataType,DataType> dis;
+		BoundedDistanceFunction<DataType,DataType> bounded;
+		double alpha;
+		int best;
+		double best_dist; // in the space of compare_distance
+		int visited;
+	} Search;
+
+	/**
+	 * The lower bound of the distances to the points on the far side
+	 * of a cut-plane, in the space of compare_distance
+	 */
+	static double far_bound(
+			double diff,
+			const Search& s) {
+		if(s.d_type == DistanceType::HAMMING)
+			return diff != 0.0 ? s.alpha : 0.0;
+		double b = split_bound(diff,s.d_type);
+		if(b < 0.0) return b;
+		b *= s.alpha;
+		return s.d_type == DistanceType::NORM_L2 ? b * b : b;
+	}
+
+	void search(
+			int id,
+			Search& s) const {
+		const FlatKDNode& node = nodes[id];
+		if(node.left < 0) {
+			// Scan the bucket
+			DataType * p = points + static_cast<size_t>(node.begin) * dims;
+			double d;
+			for(int i = node.begin; i < node.end; i++, p += dims) {
+				if(s.bounded != nullptr)
+					d = s.bounded(s.query,p,dims,s.best_dist);
+				else
+					d = s.dis(s.query,p,dims);
+				if(d < s.best_dist || s.best < 0) {
+					s.best_dist = d;
+					s.best = i;
+				}
+			}
+			s.visited += node.end - node.begin;
+			return;
+		}
+		double diff = static_cast<double>(s.query[node.dim]) - node.split;
+		int near = diff < 0.0 ? node.left : node.right;
+		int far = diff < 0.0 ? node.right : node.left;
+		search(near,s);
+		if(s.best_dist == 0.0) return;
+		if(far_bound(diff,s) >= s.best_dist) return;
+		search(far,s);
+	}
+
+	void run(
+			DataType * query,
+			DistanceType d_type,
+			double alpha,
+			int& best,
+			double& best_dist,
+			int& visited) const {
+		best = -1;
+		best_dist = DBL_MAX;
+		if(n_nodes <= 0) return;
+		Search s;
+		s.query = query;
+		s.d_type = d_type;
+		s.dis = compare_function<DataType,DataType>(d_type,dims);
+		s.bounded = bounded_function<DataType,DataType>(d_type);
+		s.alpha = alpha;
+		s.best = -1;
+		s.best_dist = DBL_MAX;
+		s.visited = 0;
+		search(0,s);
+		visited += s.visited;
+		best = ids[s.best];
+		best_dist = to_metric(s.best_dist,d_type);
+	}
+public:
+	/**
+	 * The default constructor: an empty tree
+	 */
+	FlatKDTree() {
+		arena = nullptr;
+		nodes = nullptr;
+		ids = nullptr;
+		points = nullptr;
+		n_nodes = n_points = dims = 0;
+		leaf = KD_LEAF_SIZE;
+	}
+
+	/**
+	 * The destructor
+	 */
+	virtual ~FlatKDTree() {
+		clear();
+	}
+
+	/**
+	 * Free the arena
+	 */
+	void clear() {
+		::operator delete(arena);
+		arena = nullptr;
+		nodes = nullptr;
+		ids = nullptr;
+		points = nullptr;
+		n_nodes = n_points = dims = 0;
+	}
+
+	/**
+	 * Build the tree over flat data
+	 * @param data N rows of d dimensions, one after another
+	 * @param N the number of rows
+	 * @param d the dimensions
+	 * @param leaf_size the maximum number of points in a leaf
+	 * @param ld the distance between two rows of the data in elements, 0 for d
+	 * @return true if the tree was built successfully, otherwise return false.
+	 */
+	bool build(
+			DataType * data,
+			int N,
+			int d,
+			int leaf_size = KD_LEAF_SIZE,
+			size_t ld = 0) {
+		if(ld == 0) ld = d;
+		return build_rows([data,ld](int i) {
+			return data + static_cast<size_t>(i) * ld;
+		},N,d,leaf_size);
+	}
+
+	/**
+	 * Build the tree over an array of rows
+	 * @param data N rows of d dimensions
+	 * @see build
+	 */
+	bool build(
+			DataType ** data,
+			int N,
+			int d,
+			int leaf_size = KD_LEAF_SIZE) {
+		return build_rows([data](int i) {
+			return data[i];
+		},N,d,leaf_size);
+	}
+
+	/**
+	 * Build the tree over the rows of a Matrix
+	 * @param data the matrix
+	 * @see build
+	 */
+	bool build(
+			const Matrix<DataType>& data,
+			int leaf_size = KD_LEAF_SIZE) {
+		return build(data.row_table(),data.rows(),data.cols(),leaf_size);
+	}
+
+	/**
+	 * Refit the tree to moved points: every point keeps its leaf and
+	 * every cut is clamped between the two sides along its dimension.
+	 * Slowly moving points (e.g. the centers of k-means) keep the order
+	 * of their cuts, so the tree is reused without a new arena.
+	 * @param data the N rows of build, moved, one after another
+	 * @return true if every cut still separates its sides, otherwise
+	 * return false and the tree must be built again
+	 */
+	bool refit(
+			DataType * data) {
+		if(n_nodes <= 0) return false;
+		for(int i = 0; i < n_points; i++)
+			memcpy(points + static_cast<size_t>(i) * dims,
+					data + static_cast<size_t>(ids[i]) * dims,dims * sizeof(DataType));
+		for(int id = 0; id < n_nodes; id++) {
+			FlatKDNode& n = nodes[id];
+			if(n.left < 0) continue;
+			int mid = nodes[n.left].end;
+			double lo = -DBL_MAX, hi = DBL_MAX, v;
+			DataType * p = points + static_cast<size_t>(n.begin) * dims + n.dim;
+			for(int i = n.begin; i < n.end; i++, p += dims) {
+				v = static_cast<double>(*p);
+				if(i < mid) lo = std::max(lo,v);
+				else hi = std::min(hi,v);
+			}
+			if(lo > hi) return false;
+			n.split = static_cast<float>(std::min(std::max(static_cast<double>(n.split),lo),hi));
+		}
+		return true;
+	}
+
+	/**
+	 * Find the nearest neighbor
+	 * @param query the query of d dimensions
+	 * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
+	 * @param best the index of the nearest point in the input
+	 * @param best_dist the distance to the nearest point
+	 * @param visited the number of the points that were compared is added to it
+	 */
+	void nn_search(
+			DataType * query,
+			DistanceType d_type,
+			int& best,
+			double& best_dist,
+			int& visited) const {
+		run(query,d_type,1.0,best,best_dist,visited);
+	}
+
+	/**
+	 * Find an approximate nearest neighbor: a far side is skipped
+	 * when alpha times its bound exceeds the best distance
+	 * @param alpha the approximation factor, at least 1
+	 * @see nn_search
+	 */
+	void ann_search(
+			DataType * query,
+			DistanceType d_type,
+			double alpha,
+			int& best,
+			double& best_dist,
+			int& visited) const {
+		run(query,d_type,alpha,best,best_dist,visited);
+	}
+
+	/**
+	 * Get the number of the points
+	 */
+	int size() const {
+		return n_points;
+	}
+
+	/**
+	 * Get the number of the nodes
+	 */
+	int node_count() const {
+		return n_nodes;
+	}
+
+	/**
+	 * Get the maximum number of points in a leaf
+	 */
+	int leaf_size() const {
+		return leaf;
+	}
+
+	/**
+	 * Get a node
+	 * @param i the index of the node, the root is 0
+	 */
+	const FlatKDNode& node(int i) const {
+		return nodes[i];
+	}
+
+	/**
+	 * Get a point in leaf order: a node keeps the points [begin,end)
+	 * @param i the position of the point in leaf order
+	 */
+	DataType * point(int i) const {
+		return points + static_cast<size_t>(i) * dims;
+	}
+
+	/**
+	 * Get the index in the input of a point in leaf order
+	 * @param i the position of the point in leaf order
+	 */
+	int index(int i) const {
+		return ids[i];
+	}
+};
+}
+
+#endif /* FLAT_KD_TREE_H_ */
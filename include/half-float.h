@@ -0,0 +1,157 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  half-float.h
+ *
+ *  Created on: 2014/10/26
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef HALF_FLOAT_H_
+#define HALF_FLOAT_H_
+
+#include <cstdint>
+#include <cstring>
+
+namespace SimpleCluster {
+
+/**
+ * Convert a float to IEEE half precision, rounding to the nearest even.
+ * A half keeps 11 significant bits, so the relative error of a normal
+ * number is at most 2^-11 (about 4.9e-4).
+ * @param f the float
+ * @return the bits of the half
+ */
+inline uint16_t float_to_half(float f) {
+	uint32_t x, r, rem;
+	memcpy(&x,&f,sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000u;
+	uint32_t m = x & 0x7fffffu;
+	int e = static_cast<int>((x >> 23) & 0xffu);
+	if(e == 0xff) // infinity and NaN
+		return static_cast<uint16_t>(sign | 0x7c00u | (m ? 0x200u : 0u));
+	e = e - 127 + 15;
+	if(e >= 31) // overflow
+		return static_cast<uint16_t>(sign | 0x7c00u);
+	if(e <= 0) {
+		// A subnormal half, or zero
+		if(e < -10) return static_cast<uint16_t>(sign);
+		m |= 0x800000u;
+		int shift = 14 - e;
+		r = m >> shift;
+		rem = m & ((1u << shift) - 1u);
+		uint32_t halfway = 1u << (shift - 1);
+		if(rem > halfway || (rem == halfway && (r & 1u))) r++;
+		return static_cast<uint16_t>(sign | r);
+	}
+	r = (static_cast<uint32_t>(e) << 10) | (m >> 13);
+	rem = m & 0x1fffu;
+	// A carry out of the mantissa rounds up the exponent, or to infinity
+	if(rem > 0x1000u || (rem == 0x1000u && (r & 1u))) r++;
+	return static_cast<uint16_t>(sign | r);
+}
+
+/**
+ * Convert IEEE half precision to a float. The conversion is exact.
+ * @param h the bits of the half
+ * @return the float
+ */
+inline float half_to_float(uint16_t h) {
+	uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+	int e = (h >> 10) & 0x1f;
+	uint32_t m = h & 0x3ffu, x;
+	if(e == 0) {
+		if(m == 0) {
+			x = sign;
+		} else {
+			// Normalize the subnormal
+			e = 1;
+			while(!(m & 0x400u)) {
+				m <<= 1;
+				e--;
+			}
+			m &= 0x3ffu;
+			x = sign | (static_cast<uint32_t>(e + 112) << 23) | (m << 13);
+		}
+	} else if(e == 31) {
+		x = sign | 0x7f800000u | (m << 13);
+	} else {
+		x = sign | (static_cast<uint32_t>(e + 112) << 23) | (m << 13);
+	}
+	float f;
+	memcpy(&f,&x,sizeof(f));
+	return f;
+}
+
+/**
+ * Convert a float to bfloat16, rounding to the nearest even.
+ * A bfloat16 keeps the range of a float but only 8 significant bits,
+ * so the relative error is at most 2^-8 (about 3.9e-3).
+ * @param f the float
+ * @return the bits of the bfloat16
+ */
+inline uint16_t float_to_bfloat16(float f) {
+	uint32_t x;
+	memcpy(&x,&f,sizeof(x));
+	if((x & 0x7fffffffu) > 0x7f800000u) // keep NaN quiet
+		return static_cast<uint16_t>((x >> 16) | 0x40u);
+	x += 0x7fffu + ((x >> 16) & 1u);
+	return static_cast<uint16_t>(x >> 16);
+}
+
+/**
+ * Convert bfloat16 to a float. The conversion is exact.
+ * @param h the bits of the bfloat16
+ * @return the float
+ */
+inline float bfloat16_to_float(uint16_t h) {
+	uint32_t x = static_cast<uint32_t>(h) << 16;
+	float f;
+	memcpy(&f,&x,sizeof(f));
+	return f;
+}
+
+/**
+ * IEEE half precision storage. The values are converted to float
+ * for arithmetic, so it can be used as the DataType of the data
+ * while the centers stay in float.
+ */
+struct half_t {
+	uint16_t bits;
+
+	half_t() : bits(0) {}
+	half_t(float f) : bits(float_to_half(f)) {}
+	operator float() const {
+		return half_to_float(bits);
+	}
+};
+
+/**
+ * bfloat16 storage: the upper half of a float
+ */
+struct bfloat16_t {
+	uint16_t bits;
+
+	bfloat16_t() : bits(0) {}
+	bfloat16_t(float f) : bits(float_to_bfloat16(f)) {}
+	operator float() const {
+		return bfloat16_to_float(bits);
+	}
+};
+}
+
+#endif /* HALF_FLOAT_H_ */
@@ -0,0 +1,289 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  k-majority.h
+ *
+ *  Created on: 2014/10/24
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef K_MAJORITY_H_
+#define K_MAJORITY_H_
+
+#include <iostream>
+#include <random>
+#include <cstring>
+#include <climits>
+#include "utilities.h"
+#include "k-means.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * Create seeds for k-majority from packed binary data.
+ * KMEANS_PLUS_SEEDS samples the seeds by the squared Hamming distances.
+ * @param data the packed input data
+ * @param seeds the packed seeds
+ * @param type the type of seeding method
+ * @param d the number of bytes of a vector
+ * @param N the number of the data
+ * @param k the number of clusters
+ * @param n_thread the number of threads
+ * @param verbose for debugging
+ */
+inline void kmajority_seeds(
+		unsigned char * data,
+		unsigned char * seeds,
+		KmeansType type,
+		int d,
+		int N,
+		int k,
+		int n_thread,
+		bool verbose) {
+	random_device rd;
+	mt19937 gen(rd());
+	int i, j;
+
+	if(type == KmeansType::RANDOM_SEEDS) {
+		// Reservoir sampling of k distinct points
+		int * tmp;
+		init_array<int>(tmp,k);
+		for(i = 0; i < k; i++)
+			tmp[i] = i;
+		for(i = k; i < N; i++) {
+			uniform_int_distribution<int> int_dis(0,i);
+			j = int_dis(gen);
+			if(j < k) tmp[j] = i;
+		}
+		for(i = 0; i < k; i++)
+			memcpy(seeds + static_cast<size_t>(i) * d,
+					data + static_cast<size_t>(tmp[i]) * d,d);
+		::operator delete(tmp);
+		return;
+	}
+
+	uniform_int_distribution<int> int_dis(0,N - 1);
+	memcpy(seeds,data + static_cast<size_t>(int_dis(gen)) * d,d);
+	float * distances;
+	init_array<float>(distances,N);
+	for(i = 0; i < N; i++)
+		distances[i] = FLT_MAX;
+	for(int count = 1; count < k; count++) {
+		unsigned char * last = seeds + static_cast<size_t>(count - 1) * d;
+		double sum = 0.0;
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for reduction(+:sum)
+#endif
+		for(i = 0; i < N; i++) {
+			float h = static_cast<float>(simd_hamming_u8(
+					data + static_cast<size_t>(i) * d,last,d));
+			if(distances[i] > h * h) distances[i] = h * h;
+			sum += distances[i];
+		}
+		uniform_real_distribution<double> real_dis(0.0,sum);
+		double pivot = real_dis(gen);
+		for(i = 0; i < N - 1; i++) {
+			pivot -= distances[i];
+			if(pivot <= 0.0) break;
+		}
+		memcpy(seeds + static_cast<size_t>(count) * d,
+				data + static_cast<size_t>(i) * d,d);
+		if(verbose)
+			cout << "Got " << count << " centers" << endl;
+	}
+	::operator delete(distances);
+}
+
+/**
+ * Add or remove the bits of a packed vector to the bit counters of a cluster
+ * @param x the packed vector
+ * @param counts the bit counters of the cluster, 8*d of them
+ * @param sign +1 to add, -1 to remove
+ * @param d the number of bytes of a vector
+ */
+inline void kmajority_count(
+		unsigned char * x,
+		int * counts,
+		int sign,
+		int d) {
+	for(int j = 0; j < d; j++) {
+		unsigned int b = x[j];
+		int * c = counts + 8 * j;
+		for(int t = 0; t < 8; t++)
+			c[t] += sign * static_cast<int>((b >> t) & 1u);
+	}
+}
+
+/**
+ * k-majority: the k-means of packed binary vectors in the Hamming space.
+ * The points are assigned by popcount and each bit of a center takes
+ * the majority vote of its cluster, so the data are never unpacked.
+ * @param data the packed input data, N vectors of d bytes (8*d bits)
+ * @param centers the packed centers, k vectors of d bytes
+ * @param labels the labels of data points
+ * @param type the type of seeding method. USER_SEEDS takes the seeds from centers
+ * @param criteria the criteria: only the number of iterations is used
+ * @param ea the action for empty clusters
+ * @param N the number of the data
+ * @param k the number of clusters
+ * @param d the number of bytes of a vector
+ * @param n_thread the number of threads
+ * @param verbose for debugging
+ */
+inline void kmajority(
+		unsigned char * data,
+		unsigned char *& centers,
+		int *& labels,
+		KmeansType type,
+		KmeansCriteria criteria,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		int n_thread,
+		bool verbose) {
+	if(n_thread < 1) n_thread = 1;
+	if(centers == nullptr)
+		init_array<unsigned char>(centers,static_cast<size_t>(k) * d);
+	if(labels == nullptr)
+		init_array<int>(labels,N);
+	if(N <= k) {
+		if(verbose)
+			cerr << "There will be some empty clusters!" << endl;
+		for(int i = 0; i < N; i++) {
+			labels[i] = i;
+			memcpy(centers + static_cast<size_t>(i) * d,
+					data + static_cast<size_t>(i) * d,d);
+		}
+		return;
+	}
+
+	if(type != KmeansType::USER_SEEDS)
+		kmajority_seeds(data,centers,type,d,N,k,n_thread,verbose);
+	if(verbose)
+		cout << "Finished seeding" << endl;
+
+	int i, j, it = 0, changed;
+	int nbits = 8 * d;
+	int * counts;
+	int * size;
+	int * new_label;
+	int * dist;
+	init_array<int>(counts,static_cast<size_t>(k) * nbits);
+	init_array<int>(size,k);
+	init_array<int>(new_label,N);
+	init_array<int>(dist,N);
+	memset(counts,0,static_cast<size_t>(k) * nbits * sizeof(int));
+	memset(size,0,k * sizeof(int));
+	for(i = 0; i < N; i++)
+		labels[i] = -1;
+
+	while(1) {
+		// Assign the data by popcount
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for private(j)
+#endif
+		for(i = 0; i < N; i++) {
+			unsigned char * x = data + static_cast<size_t>(i) * d;
+			int min = INT_MAX, tmp = 0, h;
+			for(j = 0; j < k; j++) {
+				h = simd_hamming_u8(x,centers + static_cast<size_t>(j) * d,d);
+				if(h < min) {
+					min = h;
+					tmp = j;
+				}
+			}
+			new_label[i] = tmp;
+			dist[i] = min;
+		}
+
+		// Only the points that moved touch the bit counters
+		changed = 0;
+		for(i = 0; i < N; i++) {
+			if(new_label[i] == labels[i]) continue;
+			unsigned char * x = data + static_cast<size_t>(i) * d;
+			if(labels[i] > -1) {
+				kmajority_count(x,counts + static_cast<size_t>(labels[i]) * nbits,-1,d);
+				size[labels[i]]--;
+			}
+			kmajority_count(x,counts + static_cast<size_t>(new_label[i]) * nbits,1,d);
+			size[new_label[i]]++;
+			labels[i] = new_label[i];
+			changed++;
+		}
+
+		// Check for empty clusters: move them to the farthest points
+		if(ea != EmptyActs::NONE) {
+			for(j = 0; j < k; j++) {
+				if(size[j] > 0) continue;
+				int fst = 0;
+				for(i = 1; i < N; i++)
+					if(dist[i] > dist[fst] && size[labels[i]] > 1) fst = i;
+				unsigned char * x = data + static_cast<size_t>(fst) * d;
+				kmajority_count(x,counts + static_cast<size_t>(labels[fst]) * nbits,-1,d);
+				size[labels[fst]]--;
+				kmajority_count(x,counts + static_cast<size_t>(j) * nbits,1,d);
+				size[j]++;
+				labels[fst] = j;
+				dist[fst] = 0;
+				changed++;
+			}
+		}
+
+		// Each bit of a center takes the majority vote of its cluster
+		for(j = 0; j < k; j++) {
+			if(size[j] <= 0) continue;
+			int * c = counts + static_cast<size_t>(j) * nbits;
+			unsigned char * ctr = centers + static_cast<size_t>(j) * d;
+			for(int b = 0; b < d; b++) {
+				unsigned int v = 0;
+				for(int t = 0; t < 8; t++) {
+					int twice = 2 * c[8 * b + t];
+					// A tie keeps the old bit
+					if(twice > size[j] || (twice == size[j] && ((ctr[b] >> t) & 1u)))
+						v |= 1u << t;
+				}
+				ctr[b] = static_cast<unsigned char>(v);
+			}
+		}
+
+		if(verbose)
+			cout << "Iterator " << it << "-th with "
+			<< changed << " changed labels" << endl;
+		it++;
+		if(changed == 0 || it >= criteria.iterations) break;
+	}
+
+	::operator delete(counts);
+	::operator delete(size);
+	::operator delete(new_label);
+	::operator delete(dist);
+
+	if(verbose)
+		cout << "Finished clustering after " << it << " iterations." << endl;
+}
+}
+
+#endif /* K_MAJORITY_H_ */
@@ -34,8 +34,15 @@
 #include <cstdlib>
 #include <cfloat>
 #include <cmath>
+#include <limits>
+#include <type_traits>
 #include "utilities.h"
 #include "kd-tree.h"
+#include "flat-kd-tree.h"
+#include "blocked-assign.h"
+#include "norm-cache.h"
+#include "kmeans-workspace.h"
+#include "matrix.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -67,7 +74,8 @@ enum class KmeansAssignType {
 enum class KmeansType {
 	RANDOM_SEEDS, // randomly generated seeds
 	KMEANS_PLUS_SEEDS, // k-means++
-	USER_SEEDS // take the seeds from input
+	USER_SEEDS, // take the seeds from input
+	KMEANS_PAR_SEEDS // k-means|| (scalable k-means++)
 };
 
 /**
@@ -88,6 +96,43 @@ typedef struct {
 	int iterations;
 } KmeansCriteria;
 
+/**
+ * Check whether a label type holds the labels of k clusters. Narrow labels
+ * (e.g. unsigned char for k <= 256, unsigned short for k <= 65536) are
+ * read in every bound test and written in every reassignment, so they
+ * save memory bandwidth on large data.
+ * @param k the number of clusters
+ */
+template<typename LabelType>
+inline bool label_fits(int k) {
+	static_assert(is_integral<LabelType>::value, "The labels must be integral");
+	return k <= 0 || static_cast<unsigned long long>(k - 1) <=
+			static_cast<unsigned long long>(numeric_limits<LabelType>::max());
+}
+
+/**
+ * Check whether an index type holds the indices of N points. The points
+ * that fail the bound tests of greg_kmeans are listed by their indices.
+ * @param N the number of points
+ */
+template<typename IndexType>
+inline bool index_fits(int N) {
+	static_assert(is_integral<IndexType>::value, "The indices must be integral");
+	return label_fits<IndexType>(N);
+}
+
+/**
+ * Check whether the k-means over float centers is asked to cluster packed
+ * binary data. HAMMING on integral data compares the bits of packed words,
+ * which a float center and the per-component majority of update_center
+ * cannot represent, so such data are clustered by kmajority (k-majority.h).
+ * @param d_type the type of distance
+ */
+template<typename DataType>
+inline bool packed_hamming(DistanceType d_type) {
+	return d_type == DistanceType::HAMMING && is_integral<DataType>::value;
+}
+
 /**
  * Create random seeds for k-means
  * @param data input data
@@ -97,6 +142,7 @@ typedef struct {
  * @param k the number of clusters
  * @param n_thread the number of threads
  * @param verbose for debugging
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
 template<typename DataType>
 inline void random_seeds(
@@ -106,7 +152,9 @@ inline void random_seeds(
 		int N,
 		int k,
 		int n_thread,
-		bool verbose) {
+		bool verbose,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
 	int i;
 	int j;
 #ifdef _WIN32
@@ -138,9 +186,9 @@ inline void random_seeds(
 	}
 #endif
 
-	int base = 0, base1;
+	size_t base = 0, base1;
 	for(i = 0; i < k; i++) {
-		base1 = tmp[i] * d;
+		base1 = static_cast<size_t>(tmp[i]) * ld;
 		for(j = 0; j < d; j++) {
 			seeds[base++] = static_cast<float>(data[base1++]);
 		}
@@ -155,8 +203,11 @@ inline void random_seeds(
  * @param data input data
  * @param seeds the seeds
  * @param n_thread the number of threads
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param verbose for debugging
+ * @param cache the cached norms of the data, could be nullptr
+ * @param ws the workspace of the scratch buffers, could be nullptr
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
 template<typename DataType>
 inline void kmeans_pp_seeds(
@@ -167,7 +218,31 @@ inline void kmeans_pp_seeds(
 		int N,
 		int k,
 		int n_thread,
-		bool verbose) {
+		bool verbose,
+		NormCache * cache = nullptr,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
+	// Inner products are not distances, so the seeds are sampled by L2
+	if(d_type == DistanceType::INNER_PRODUCT)
+		d_type = DistanceType::NORM_L2;
+	// In L2 the norms skip the points that a new seed cannot get closer to
+	float * x_len = nullptr;
+	const float * lens = nullptr;
+	if(d_type == DistanceType::NORM_L2) {
+		if(cache != nullptr && cache->has_data()) {
+			lens = cache->data_len();
+		} else {
+			if(ws != nullptr)
+				x_len = ws->seed_len.get<float>(N);
+			else
+				init_array<float>(x_len,N);
+			squared_norms<DataType>(data,N,d,x_len,n_thread,ld);
+			for(int i = 0; i < N; i++)
+				x_len[i] = sqrt(x_len[i]);
+			lens = x_len;
+		}
+	}
 	// For generating random numbers
 	random_device rd;
 	mt19937 gen(rd());
@@ -175,16 +250,20 @@ inline void kmeans_pp_seeds(
 	uniform_int_distribution<int> int_dis(0, N - 1);
 	int tmp = int_dis(gen);
 
-	size_t base = static_cast<size_t>(tmp) * static_cast<size_t>(d);
+	size_t base = static_cast<size_t>(tmp) * ld;
 	int i, i0, start, end, p = N / n_thread;
 	for(i = 0; i < d; i++) {
 		seeds[i] = static_cast<float>(data[base++]);
 	}
 
-	float * distances;
-	init_array<float>(distances,N);
-	float * sum_distances;
-	init_array<float>(sum_distances,N);
+	float * distances, * sum_distances;
+	if(ws != nullptr) {
+		distances = ws->seed_dist.get<float>(N);
+		sum_distances = ws->seed_sum.get<float>(N);
+	} else {
+		init_array<float>(distances,N);
+		init_array<float>(sum_distances,N);
+	}
 #ifdef _OPENMP
 	omp_set_num_threads(n_thread);
 #pragma omp parallel
@@ -195,21 +274,21 @@ inline void kmeans_pp_seeds(
 			start = p * i0;
 			end = start + p;
 			if(end >= N || i0 == n_thread - 1) end = N;
-			DataType * d_tmp2 = data + static_cast<size_t>(start) * static_cast<size_t>(d);
+			DataType * d_tmp2 = data + static_cast<size_t>(start) * ld;
 			float * d_tmp = seeds;
 			for(i = start; i < end; i++) {
-				if(d_type == DistanceType::NORM_L2)
-					distances[i] = distance_l2_square<DataType,float>(d_tmp2, d_tmp, d);
-				else if(d_type == DistanceType::NORM_L1)
-					distances[i] = distance_l1<DataType,float>(d_tmp2, d_tmp, d);
+				distances[i] = compare_distance<DataType,float>(d_tmp2,d_tmp,d_type,d);
 				sum_distances[i] = 0.0;
-				d_tmp2 += d;
+				d_tmp2 += ld;
 			}
 		}
 #ifdef _OPENMP
 	}
 #endif
-	float sum, tmp2 = 0.0, sum1, sum2, pivot;
+	// Only a new seed that is closer than the current distance matters
+	BoundedDistanceFunction<float,DataType> bounded =
+			bounded_function<float,DataType>(d_type);
+	float sum, tmp2 = 0.0, sum1, sum2, pivot, s_len = 0.0;
 	int count = 1, j, t;
 	size_t base1, base2;
 	for(count = 1; count < k; count++) {
@@ -228,14 +307,17 @@ inline void kmeans_pp_seeds(
 				break;
 		}
 		j = (i + 1) % N;
-		base1 = count * d;
-		base2 = static_cast<size_t>(j) * d;
+		base1 = static_cast<size_t>(count) * d;
+		base2 = static_cast<size_t>(j) * ld;
 		for(t = 0; t < d; t++) {
 			seeds[base1++] = static_cast<float>(data[base2++]);
 		}
 
 		// Update the distances
 		if(count < k) {
+			if(lens != nullptr)
+				s_len = sqrt(simd_dot_f32(seeds + static_cast<size_t>(count) * d,
+						seeds + static_cast<size_t>(count) * d,d));
 #ifdef _OPENMP
 			omp_set_num_threads(n_thread);
 #pragma omp parallel
@@ -246,15 +328,23 @@ inline void kmeans_pp_seeds(
 					start = p * i0;
 					end = start + p;
 					if(end >= N || i0 == n_thread - 1) end = N;
-					DataType * d_tmp2 = data + static_cast<size_t>(start) * static_cast<size_t>(d);
-					float * d_tmp = seeds + (count - 1) * d; // We only need to compare the old closest distances with the new one
+					DataType * d_tmp2 = data + static_cast<size_t>(start) * ld;
+					float * d_tmp = seeds + static_cast<size_t>(count) * d; // We only need to compare the old closest distances with the new one
 					for(i = start; i < end; i++) {
-						if(d_type == DistanceType::NORM_L2)
-							tmp2 = distance_l2_square<float,DataType>(d_tmp,d_tmp2,d);
-						else if(d_type == DistanceType::NORM_L1)
-							tmp2 = distance_l1<float,DataType>(d_tmp,d_tmp2,d);
+						if(lens != nullptr) {
+							// |(||x|| - ||s||)| <= ||x - s||
+							float lb = lens[i] - s_len;
+							if(lb * lb >= distances[i]) {
+								d_tmp2 += ld;
+								continue;
+							}
+						}
+						if(bounded != nullptr)
+							tmp2 = bounded(d_tmp,d_tmp2,d,distances[i]);
+						else
+							tmp2 = compare_distance<float,DataType>(d_tmp,d_tmp2,d_type,d);
 						if(distances[i] > tmp2) distances[i] = tmp2;
-						d_tmp2 += d;
+						d_tmp2 += ld;
 					}
 				}
 #ifdef _OPENMP
@@ -264,6 +354,52 @@ inline void kmeans_pp_seeds(
 		if(verbose)
 			cout << "Got " << count << " centers" << endl;
 	}
+	if(ws == nullptr) {
+		::operator delete(distances);
+		::operator delete(sum_distances);
+		::operator delete(x_len);
+	}
+}
+
+/**
+ * Move the data to their nearest centers and update the sizes
+ * and the vector sums of the clusters that they leave and join
+ * @param closest the nearest center of each point
+ * @param labels the labels, -1 for a point without a cluster
+ * @see linear_assign for the other parameters
+ */
+template<typename DataType>
+inline void move_points(
+		DataType * data,
+		const int * closest,
+		int * labels,
+		int * size,
+		float * sum,
+		int d,
+		int N,
+		size_t ld) {
+	size_t base1, base2;
+	int i, m, tmp;
+	for(i = 0; i < N; i++) {
+		tmp = closest[i];
+		if(labels[i] == tmp) continue;
+		// Assign the data[i] into cluster tmp
+		if(labels[i] > -1) {
+			size[labels[i]]--;
+			base1 = static_cast<size_t>(labels[i]) * d;
+			base2 = static_cast<size_t>(i) * ld;
+			for(m = 0; m < d; m++) {
+				sum[base1++] -= static_cast<float>(data[base2++]);
+			}
+		}
+		labels[i] = tmp;
+		size[tmp]++;
+		base1 = static_cast<size_t>(tmp) * d;
+		base2 = static_cast<size_t>(i) * ld;
+		for(m = 0; m < d; m++) {
+			sum[base1++] += static_cast<float>(data[base2++]);
+		}
+	}
 }
 
 /**
@@ -276,9 +412,12 @@ inline void kmeans_pp_seeds(
  * @param data input data
  * @param centers the centers
  * @param clusters the clusters
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param n_thread the number of threads
  * @param verbose for debugging
+ * @param cache the cached norms of the data and the centers for NORM_L2, could be nullptr
+ * @param ws the workspace of the scratch buffers, could be nullptr
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
 template<typename DataType>
 inline void linear_assign(
@@ -292,46 +431,273 @@ inline void linear_assign(
 		int N,
 		int k,
 		int n_thread,
-		bool verbose) {
+		bool verbose,
+		NormCache * cache = nullptr,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0) {
 	if(n_thread < 1) n_thread = 1;
-	int i, j, m, i0, start, end;
+	if(ld == 0) ld = d;
+	int i, j;
 	int tmp;
 	DataType * d_tmp;
 	float *  d_tmp1;
-
-	float min = FLT_MAX, min_tmp = 0.0;
-	d_tmp = data;
-	int base1, base2;
-	for(i = 0; i < N; i++) {
-		// Find the minimum distances between d_tmp and a centroid
-		min = FLT_MAX;
-		d_tmp1 = centers;
-		for(j = 0; j < k; j++) {
-			if(d_type == DistanceType::NORM_L2)
-				min_tmp = distance_l2_square<DataType,float>(d_tmp,d_tmp1,d);
-			else if(d_type == DistanceType::NORM_L1)
-				min_tmp = distance_l1<DataType,float>(d_tmp,d_tmp1,d);
-			if(min > min_tmp) {
-				min = min_tmp;
-				tmp = j;
+	int * closest;
+	if(ws != nullptr)
+		closest = ws->nearest.get<int>(N);
+	else
+		init_array<int>(closest,N);
+
+	if(d_type == DistanceType::NORM_L2) {
+		blocked_assign<DataType>(data,nullptr,centers,closest,
+				nullptr,nullptr,d,N,k,n_thread,verbose,
+				cache != nullptr ? cache->data_sq() : nullptr,
+				cache != nullptr ? cache->center_sq() : nullptr,
+				ws != nullptr ? &ws->tiles : nullptr,nullptr,ld);
+	} else if(d_type == DistanceType::NORM_L1 && use_center_tiles(d,k)) {
+		// Few dimensions: each row is scored against the transposed centers
+		float * c_tiles = nullptr, row[CENTER_TILE_DIMS], b[2];
+		int l[2];
+		if(ws != nullptr)
+			c_tiles = ws->center_tiles.get<float>(center_tiles_size(k,d));
+		else
+			init_array<float>(c_tiles,center_tiles_size(k,d));
+		transpose_centers(centers,k,d,c_tiles);
+		for(i = 0; i < N; i++) {
+			convert_to_float<DataType>(data + static_cast<size_t>(i) * ld,row,d);
+			nearest_in_tiles(row,c_tiles,k,d,d_type,b,l);
+			closest[i] = l[0];
+		}
+		if(ws == nullptr) ::operator delete(c_tiles);
+	} else {
+		// NORM_L1 abandons a center once its partial distance exceeds the minimum
+		BoundedDistanceFunction<DataType,float> bounded =
+				bounded_function<DataType,float>(d_type);
+		// The centers and each row are visited in the order of decreasing
+		// variance of the centers, so the partial distances grow fastest
+		// where the centers differ most and abandon sooner
+		bool permuted = bounded != nullptr && d > BOUND_BLOCK && k > 2;
+		float * p_centers = centers;
+		int * order = nullptr;
+		DataType * row = nullptr;
+		double * var = nullptr;
+		if(permuted) {
+			if(ws != nullptr) {
+				order = ws->order.get<int>(d);
+				var = ws->variance.get<double>(2 * static_cast<size_t>(d));
+				p_centers = ws->permuted.get<float>(static_cast<size_t>(k) * d);
+				row = ws->permuted_row.get<DataType>(d);
+			} else {
+				init_array<int>(order,d);
+				init_array<double>(var,2 * static_cast<size_t>(d));
+				init_array<float>(p_centers,static_cast<size_t>(k) * d);
+				init_array<DataType>(row,d);
 			}
-			d_tmp1 += d;
+			variance_order<float>(centers,k,d,order,var);
+			for(j = 0; j < k; j++)
+				permute_vector<float,float>(centers + static_cast<size_t>(j) * d,order,d,
+						p_centers + static_cast<size_t>(j) * d);
 		}
-		// Assign the data[i] into cluster tmp
-		if(labels[i] > -1) {
-			size[labels[i]]--;
-			base1 = labels[i] * d;
-			base2 = i * d;
-			for(m = 0; m < d; m++) {
-				sum[base1++] -= static_cast<float>(data[base2++]);
+		DistanceFunction<DataType,float> dis =
+				compare_function<DataType,float>(d_type,d,!permuted && aligned_rows(data,ld));
+		float min = FLT_MAX, min_tmp = 0.0;
+		d_tmp = data;
+		for(i = 0; i < N; i++) {
+			// Find the minimum distances between d_tmp and a centroid
+			min = FLT_MAX;
+			tmp = 0;
+			DataType * x = d_tmp;
+			if(permuted) {
+				permute_vector<DataType,DataType>(d_tmp,order,d,row);
+				x = row;
 			}
+			d_tmp1 = p_centers;
+			for(j = 0; j < k; j++) {
+				if(bounded != nullptr && j > 0)
+					min_tmp = bounded(x,d_tmp1,d,min);
+				else
+					min_tmp = dis(x,d_tmp1,d);
+				if(min > min_tmp) {
+					min = min_tmp;
+					tmp = j;
+				}
+				d_tmp1 += d;
+			}
+			closest[i] = tmp;
+			d_tmp += ld;
 		}
-		labels[i] = tmp;
-		size[tmp]++;
-		base1 = tmp * d;
-		base2 = i * d;
-		for(m = 0; m < d; m++) {
-			sum[base1++] += static_cast<float>(data[base2++]);
+		if(permuted && ws == nullptr) {
+			::operator delete(order);
+			::operator delete(var);
+			::operator delete(p_centers);
+			::operator delete(row);
+		}
+	}
+
+	move_points<DataType>(data,closest,labels,size,sum,d,N,ld);
+	if(ws == nullptr)
+		::operator delete(closest);
+}
+
+/**
+ * The number of centers in a leaf of the kd-tree of the centers
+ */
+const int KD_CENTER_LEAF_SIZE = 8;
+
+/**
+ * Assign the data by searching a kd-tree of the centers, which is built
+ * once and refit while the centers move (see simple_kmeans)
+ * @param tree the kd-tree of the centers
+ * @param alpha the approximation factor of ann_search, 1 for nn_search
+ * @see linear_assign for the other parameters
+ */
+template<typename DataType>
+inline void tree_assign(
+		DataType * data,
+		const FlatKDTree<float>& tree,
+		int *& labels,
+		int *& size,
+		float *& sum,
+		DistanceType d_type,
+		double alpha,
+		int d,
+		int N,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0) {
+	if(n_thread < 1) n_thread = 1;
+	if(ld == 0) ld = d;
+	int i0, * closest;
+	float * rows;
+	if(ws != nullptr) {
+		closest = ws->nearest.get<int>(N);
+		rows = ws->tiles.get<float>(static_cast<size_t>(n_thread) * d);
+	} else {
+		init_array<int>(closest,N);
+		init_array<float>(rows,static_cast<size_t>(n_thread) * d);
+	}
+	size_t p = N / n_thread;
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel for
+#endif
+	for(i0 = 0; i0 < n_thread; i0++) {
+		size_t start = p * i0;
+		size_t end = start + p;
+		if(end > static_cast<size_t>(N) || i0 == n_thread - 1) end = N;
+		float * x = rows + static_cast<size_t>(i0) * d;
+		int best, visited = 0;
+		double best_dist;
+		for(size_t i = start; i < end; i++) {
+			convert_to_float<DataType>(data + i * ld,x,d);
+			if(alpha > 1.0)
+				tree.ann_search(x,d_type,alpha,best,best_dist,visited);
+			else
+				tree.nn_search(x,d_type,best,best_dist,visited);
+			closest[i] = best;
+		}
+	}
+	if(verbose)
+		cout << "Assigned " << N << " points by the kd-tree of the centers" << endl;
+	move_points<DataType>(data,closest,labels,size,sum,d,N,ld);
+	if(ws == nullptr) {
+		::operator delete(closest);
+		::operator delete(rows);
+	}
+}
+
+/**
+ * Scale the rows to unit length. Zero rows are kept.
+ * @param x the rows
+ * @param n the number of rows
+ * @param d the dimensions
+ */
+inline void normalize_rows(
+		float * x,
+		int n,
+		int d) {
+	for(int i = 0; i < n; i++) {
+		float * r = x + static_cast<size_t>(i) * d;
+		float norm = simd_dot_f32(r,r,d);
+		if(norm <= 0.0f) continue;
+		norm = 1.0f / sqrt(norm);
+		for(int j = 0; j < d; j++)
+			r[j] *= norm;
+	}
+}
+
+/**
+ * The oversampling rounds of k-means||, as in the experiments of
+ * Bahmani et al.
+ */
+const int KMEANS_PAR_ROUNDS = 5;
+
+/**
+ * The Lloyd iterations over the weighted candidates of k-means||
+ */
+const int KMEANS_PAR_ITERATIONS = 10;
+
+/**
+ * Find the nearest of some centers for every row: by blocked_assign in
+ * NORM_L2, otherwise by comparing each row with all centers
+ * @param data the rows
+ * @param N the number of rows
+ * @param centers the centers
+ * @param k the number of centers
+ * @param d_type the type of distance
+ * @param d the dimensions
+ * @param n_thread the number of threads
+ * @param nearest the nearest center of each row
+ * @param dist the distance to it, squared in NORM_L2
+ * @param ws the workspace of the scratch buffers
+ * @param x_sq the squared norms of the rows, could be nullptr
+ * @param ld the distance between two rows of the data in elements
+ */
+template<typename DataType>
+inline void seed_assign(
+		DataType * data,
+		int N,
+		float * centers,
+		int k,
+		DistanceType d_type,
+		int d,
+		int n_thread,
+		int * nearest,
+		float * dist,
+		KmeansWorkspace * ws,
+		const float * x_sq,
+		size_t ld) {
+	int i0, p = N / n_thread;
+	if(d_type == DistanceType::NORM_L2) {
+		blocked_assign<DataType>(data,nullptr,centers,nearest,dist,nullptr,
+				d,N,k,n_thread,false,x_sq,nullptr,&ws->tiles,nullptr,ld);
+		// The expansion by the norms may go slightly below zero
+		for(int i = 0; i < N; i++)
+			if(dist[i] < 0.0f) dist[i] = 0.0f;
+		return;
+	}
+	DistanceFunction<DataType,float> dis =
+			compare_function<DataType,float>(d_type,d,aligned_rows(data,ld));
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel for
+#endif
+	for(i0 = 0; i0 < n_thread; i0++) {
+		int start = p * i0;
+		int end = i0 == n_thread - 1 ? N : start + p;
+		for(int i = start; i < end; i++) {
+			DataType * x = data + static_cast<size_t>(i) * ld;
+			float min = FLT_MAX, tmp;
+			int id = 0;
+			for(int j = 0; j < k; j++) {
+				tmp = dis(x,centers + static_cast<size_t>(j) * d,d);
+				if(tmp < min) {
+					min = tmp;
+					id = j;
+				}
+			}
+			nearest[i] = id;
+			dist[i] = min;
 		}
 	}
 }
@@ -342,10 +708,12 @@ inline void linear_assign(
  * @param size the size of each cluster
  * @param centers the centers of clusters
  * @param moved the distances that centers moved
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. COSINE normalizes the centers
  * @param k the number of clusters
  * @param d the number of dimensions
  * @param n_thread the number of threads
+ * @param cache the norms of the centers are refreshed if it is not nullptr
+ * @param ws the workspace of the scratch buffers, could be nullptr
  * @return nothing
  */
 inline void update_center(
@@ -356,27 +724,314 @@ inline void update_center(
 		DistanceType d_type,
 		int k,
 		int d,
-		int n_thread) {
+		int n_thread,
+		NormCache * cache = nullptr,
+		KmeansWorkspace * ws = nullptr) {
+	// The centers of angles and inner products move in L2
+	DistanceType m_type = (d_type == DistanceType::COSINE
+			|| d_type == DistanceType::INNER_PRODUCT) ? DistanceType::NORM_L2 : d_type;
 	float * c_tmp;
-	init_array<float>(c_tmp,d);
-	int i, base = 0;
-	c_tmp = centers;
+	if(ws != nullptr)
+		c_tmp = ws->old_center.get<float>(d);
+	else
+		init_array<float>(c_tmp,d);
+	int i;
+	size_t base = 0;
 	for(i = 0; i < k; i++) {
-		for(int j = 0; j < d; j++) {
-			centers[base] = static_cast<float>(sum[base++] / size[i]);
+		if(size[i] <= 0) {
+			// An empty cluster keeps its center
+			moved[i] = 0.0f;
+			base += d;
+			continue;
+		}
+		// Keep the old center to measure how far it moves
+		memcpy(c_tmp,centers + base,d * sizeof(float));
+		if(d_type == DistanceType::HAMMING) {
+			// k-majority: each component takes the value of the majority
+			for(int j = 0; j < d; j++) {
+				centers[base] = (2.0f * sum[base] > size[i]) ? 1.0f : 0.0f;
+				base++;
+			}
+		} else {
+			for(int j = 0; j < d; j++) {
+				centers[base] = static_cast<float>(sum[base] / size[i]);
+				base++;
+			}
+			// Spherical k-means: the centers stay on the unit sphere
+			if(d_type == DistanceType::COSINE)
+				normalize_rows(centers + (base - d),1,d);
+		}
+		moved[i] = to_metric(compare_distance<float,float>(c_tmp,
+				centers + (base - d),m_type,d),m_type);
+	}
+	if(ws == nullptr)
+		::operator delete(c_tmp);
+	if(cache != nullptr)
+		cache->set_centers(centers,k,d);
+}
+
+/**
+ * Create seeds by k-means|| (Bahmani et al.): after a uniform first
+ * candidate, each of up to KMEANS_PAR_ROUNDS rounds samples every point
+ * independently with a probability of 2k times its distance to the
+ * candidates over the sum of these distances, so the threads sample
+ * about 2k candidates per round at once. The candidates are weighted by
+ * the points that are nearest to them and reclustered into k seeds by a
+ * greedy weighted k-means++ and KMEANS_PAR_ITERATIONS weighted Lloyd
+ * iterations, whose seeds move as update_center moves the centers of the
+ * distance. The scratch buffers come from the workspace.
+ * @see kmeans_pp_seeds for the parameters
+ */
+template<typename DataType>
+inline void kmeans_par_seeds(
+		DataType * data,
+		float *& seeds,
+		DistanceType d_type,
+		int d,
+		int N,
+		int k,
+		int n_thread,
+		bool verbose,
+		NormCache * cache = nullptr,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
+	if(n_thread < 1) n_thread = 1;
+	// Inner products are not distances, so the seeds are sampled by L2
+	if(d_type == DistanceType::INNER_PRODUCT)
+		d_type = DistanceType::NORM_L2;
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+	const float * x_sq = d_type == DistanceType::NORM_L2 && cache != nullptr
+			&& cache->has_data() ? cache->data_sq() : nullptr;
+	// For generating random numbers
+	random_device rd;
+	mt19937 gen(rd());
+	uniform_int_distribution<int> int_dis(0, N - 1);
+
+	int i, i0, j, p = N / n_thread;
+	float * dist = ws->seed_dist.get<float>(N);
+	float * best = ws->best.get<float>(N);
+	int * owner = ws->seed_owner.get<int>(N);
+	int * nearest = ws->new_label.get<int>(N);
+	int * picked = ws->cand.get<int>(N);
+	int * n_picked = ws->n_cand.get<int>(n_thread);
+	// A point is picked once at most, so there are at most N candidates
+	int * chosen = ws->seed_chosen.get<int>(N);
+	double * partial = ws->seed_sum.get<double>(n_thread);
+	BoundedDistanceFunction<float,DataType> bounded =
+			bounded_function<float,DataType>(d_type);
+
+	// The first candidate
+	int m = 1;
+	chosen[0] = int_dis(gen);
+	float * c = ws->seed_cands.get<float>(d);
+	for(j = 0; j < d; j++)
+		c[j] = static_cast<float>(data[static_cast<size_t>(chosen[0]) * ld + j]);
+	seed_assign<DataType>(data,N,c,1,d_type,d,n_thread,owner,dist,ws,x_sq,ld);
+	dist[chosen[0]] = 0.0f;
+
+	// Oversampling
+	double l = 2.0 * k, phi;
+	int r;
+	for(r = 0; r < KMEANS_PAR_ROUNDS; r++) {
+		unsigned int r_seed = gen();
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for private(i)
+#endif
+		for(i0 = 0; i0 < n_thread; i0++) {
+			int start = p * i0;
+			int end = i0 == n_thread - 1 ? N : start + p;
+			double s = 0.0;
+			for(i = start; i < end; i++)
+				s += dist[i];
+			partial[i0] = s;
+		}
+		phi = 0.0;
+		for(i0 = 0; i0 < n_thread; i0++)
+			phi += partial[i0];
+		// Every point is a candidate already
+		if(phi <= 0.0) break;
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for private(i)
+#endif
+		for(i0 = 0; i0 < n_thread; i0++) {
+			int start = p * i0;
+			int end = i0 == n_thread - 1 ? N : start + p;
+			int n_c = 0;
+			mt19937 t_gen(r_seed + i0);
+			uniform_real_distribution<double> real_dis(0.0,1.0);
+			for(i = start; i < end; i++)
+				if(real_dis(t_gen) * phi < l * dist[i])
+					picked[start + n_c++] = i;
+			n_picked[i0] = n_c;
 		}
+		int base = m;
+		for(i0 = 0; i0 < n_thread; i0++) {
+			memcpy(chosen + m,picked + p * i0,n_picked[i0] * sizeof(int));
+			m += n_picked[i0];
+		}
+		int n_new = m - base;
+		if(verbose)
+			cout << "Round " << r << " with cost = " << phi
+			<< " sampled " << n_new << " candidates" << endl;
+		if(n_new == 0) continue;
+
+		// Only the new candidates can get closer to the points
+		c = ws->seed_cands.get<float>(static_cast<size_t>(n_new) * d);
+		for(i = 0; i < n_new; i++)
+			for(j = 0; j < d; j++)
+				c[static_cast<size_t>(i) * d + j] = static_cast<float>(
+						data[static_cast<size_t>(chosen[base + i]) * ld + j]);
 		if(d_type == DistanceType::NORM_L2)
-			moved[i] = distance_l2<float>(c_tmp,centers + (base - d),d);
-		else if(d_type == DistanceType::NORM_L1)
-			moved[i] = distance_l1<float>(c_tmp,centers + (base - d),d);
-		c_tmp += d;
+			seed_assign<DataType>(data,N,c,n_new,d_type,d,n_thread,nearest,best,ws,x_sq,ld);
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for private(i)
+#endif
+		for(i0 = 0; i0 < n_thread; i0++) {
+			int start = p * i0;
+			int end = i0 == n_thread - 1 ? N : start + p;
+			for(i = start; i < end; i++) {
+				if(d_type == DistanceType::NORM_L2) {
+					if(best[i] < dist[i]) {
+						dist[i] = best[i];
+						owner[i] = base + nearest[i];
+					}
+					continue;
+				}
+				// Only a candidate that is closer than the current distance matters
+				DataType * x = data + static_cast<size_t>(i) * ld;
+				for(int t = 0; t < n_new; t++) {
+					float * ct = c + static_cast<size_t>(t) * d;
+					float tmp = bounded != nullptr ? bounded(ct,x,d,dist[i])
+							: compare_distance<float,DataType>(ct,x,d_type,d);
+					if(tmp < dist[i]) {
+						dist[i] = tmp;
+						owner[i] = base + t;
+					}
+				}
+			}
+		}
+		// A candidate is its own nearest candidate, even if the norms
+		// leave a rounding error, and it is never sampled again
+		for(i = base; i < m; i++) {
+			dist[chosen[i]] = 0.0f;
+			owner[chosen[i]] = i;
+		}
+	}
+
+	// The weight of a candidate is the number of points nearest to it
+	int * w = ws->seed_weight.get<int>(m);
+	memset(w,0,m * sizeof(int));
+	for(i = 0; i < N; i++)
+		w[owner[i]]++;
+	float * cands = ws->seed_cands.get<float>(static_cast<size_t>(m) * d);
+	for(i = 0; i < m; i++)
+		for(j = 0; j < d; j++)
+			cands[static_cast<size_t>(i) * d + j] = static_cast<float>(
+					data[static_cast<size_t>(chosen[i]) * ld + j]);
+	if(verbose)
+		cout << "Got " << m << " candidates after " << r << " rounds" << endl;
+
+	// Too few candidates: the rest of the seeds are random points
+	if(m <= k) {
+		copy_array<float>(cands,seeds,static_cast<size_t>(m) * d);
+		for(i = m; i < k; i++) {
+			size_t row = static_cast<size_t>(int_dis(gen)) * ld;
+			for(j = 0; j < d; j++)
+				seeds[static_cast<size_t>(i) * d + j] = static_cast<float>(data[row + j]);
+		}
+		return;
+	}
+
+	// Greedy weighted k-means++ over the candidates: a few candidates are
+	// drawn per seed and the one that lowers the weighted cost most is kept.
+	// The distances to the seeds, of the current trial and of the best trial
+	// share one buffer, and so do the prefix sums of the weighted costs.
+	int trials = 2 + static_cast<int>(log(static_cast<double>(k)));
+	float * c_dist = ws->seed_cost.get<float>(3 * static_cast<size_t>(m));
+	float * t_dist = c_dist + m, * b_dist = t_dist + m;
+	double * c_sum = ws->seed_sum.get<double>(m);
+	double sum = 0.0;
+	for(i = 0; i < m; i++) {
+		sum += w[i];
+		c_sum[i] = sum;
 	}
+	int t = static_cast<int>(upper_bound(c_sum,c_sum + m,
+			uniform_real_distribution<double>(0,sum)(gen)) - c_sum);
+	if(t >= m) t = m - 1;
+	copy_array<float>(cands + static_cast<size_t>(t) * d,seeds,d);
+	for(i = 0; i < m; i++)
+		c_dist[i] = compare_distance<float,float>(cands + static_cast<size_t>(i) * d,
+				seeds,d_type,d);
+	for(int count = 1; count < k; count++) {
+		double cost, b_cost = DBL_MAX;
+		sum = 0.0;
+		for(i = 0; i < m; i++) {
+			sum += w[i] * c_dist[i];
+			c_sum[i] = sum;
+		}
+		int b_t = 0;
+		for(int tr = 0; tr < trials; tr++) {
+			if(sum > 0.0) {
+				uniform_real_distribution<double> real_dis(0,sum);
+				t = static_cast<int>(upper_bound(c_sum,c_sum + m,real_dis(gen)) - c_sum);
+				if(t >= m) t = m - 1;
+			} else {
+				t = uniform_int_distribution<int>(0,m - 1)(gen);
+			}
+			cost = 0.0;
+			for(i = 0; i < m; i++) {
+				t_dist[i] = std::min<float>(c_dist[i],compare_distance<float,float>(
+						cands + static_cast<size_t>(i) * d,cands + static_cast<size_t>(t) * d,d_type,d));
+				cost += w[i] * t_dist[i];
+			}
+			if(cost < b_cost) {
+				b_cost = cost;
+				b_t = t;
+				std::swap(t_dist,b_dist);
+			}
+		}
+		float * s = seeds + static_cast<size_t>(count) * d;
+		copy_array<float>(cands + static_cast<size_t>(b_t) * d,s,d);
+		std::swap(c_dist,b_dist);
+	}
+
+	// Weighted Lloyd iterations over the candidates: a candidate counts as
+	// its weight in points, and update_center moves the seeds by the metric
+	int * lab = ws->seed_label.get<int>(2 * static_cast<size_t>(m));
+	int * lab_new = lab + m;
+	float * s_sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	float * moved = ws->moved.get<float>(k);
+	int * s_w = ws->size.get<int>(k);
+	fill(lab,lab + m,-1);
+	for(int it = 0; it < KMEANS_PAR_ITERATIONS; it++) {
+		seed_assign<float>(cands,m,seeds,k,d_type,d,n_thread,lab_new,
+				c_dist,ws,nullptr,d);
+		if(memcmp(lab,lab_new,m * sizeof(int)) == 0) break;
+		std::swap(lab,lab_new);
+		memset(s_sum,0,static_cast<size_t>(k) * d * sizeof(float));
+		memset(s_w,0,k * sizeof(int));
+		for(i = 0; i < m; i++) {
+			const float * x = cands + static_cast<size_t>(i) * d;
+			float * s = s_sum + static_cast<size_t>(lab[i]) * d;
+			for(j = 0; j < d; j++)
+				s[j] += w[i] * x[j];
+			s_w[lab[i]] += w[i];
+		}
+		update_center(s_sum,s_w,seeds,moved,d_type,k,d,n_thread,nullptr,ws);
+	}
+	if(verbose)
+		cout << "Got " << k << " centers" << endl;
 }
 
 /**
  * Update the bounds
  * @param moved the distances that centers moved
- * @param label the labels of point data
+ * @param label the labels of point data, of any integral label type
  * @param upper
  * @param lower
  * @param N
@@ -384,9 +1039,10 @@ inline void update_center(
  * @param d
  * @param n_thread the number of threads
  */
+template<typename LabelType>
 inline void update_bounds(
 		float * moved,
-		int * label,
+		LabelType * label,
 		float *& upper,
 		float *& lower,
 		int N,
@@ -436,9 +1092,10 @@ inline void update_bounds(
  * @param data input data
  * @param centers the centers
  * @param clusters the clusters
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param n_thread the number of threads
  * @param verbose for debugging
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
 template<typename DataType>
 inline float distortion(
@@ -449,18 +1106,18 @@ inline float distortion(
 		int d,
 		int N,
 		int k,
-		bool verbose) {
+		bool verbose,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
 	float e = 0.0;
 	int j;
 	DataType * tmp = data;
 	for(j = 0; j < N; j++) {
-		if(d_type == DistanceType::NORM_L2)
-			e += distance_l2_square<DataType,float>(tmp,centers + label[j] * d,d);
-		else if(d_type == DistanceType::NORM_L1)
-			e += distance_l1<DataType,float>(tmp,centers + label[j] * d,d);
-		tmp += d;
+		e += compare_distance<DataType,float>(tmp,centers + static_cast<size_t>(label[j]) * d,d_type,d);
+		tmp += ld;
 	}
-	return sqrt(e);
+	// The sum of negative inner products has no root
+	return d_type == DistanceType::INNER_PRODUCT ? e : sqrt(e);
 }
 
 
@@ -473,28 +1130,29 @@ inline float distortion(
 		int d,
 		int N,
 		int k,
-		bool verbose) {
+		bool verbose,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
 	float e = 0.0;
 	int j;
 	DataType1 * tmp = data;
 	for(j = 0; j < N; j++) {
-		if(d_type == DistanceType::NORM_L2)
-			e += distance_l2_square<DataType1,float>(tmp,centers + label[j] * d,d);
-		else if(d_type == DistanceType::NORM_L1)
-			e += distance_l1<DataType1,float>(tmp,centers + label[j] * d,d);
-		tmp += d;
+		e += compare_distance<DataType1,float>(tmp,centers + static_cast<size_t>(label[j]) * d,d_type,d);
+		tmp += ld;
 	}
-	return sqrt(e);
+	// The sum of negative inner products has no root
+	return d_type == DistanceType::INNER_PRODUCT ? e : sqrt(e);
 }
 
 /**
  * Update the farthest distances
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
-template<typename DataType>
+template<typename DataType, typename LabelType = int>
 inline void find_farthest(
 		DataType * data,
 		float * centers,
-		int * labels,
+		LabelType * labels,
 		DistanceType d_type,
 		int id,
 		float& dfst,
@@ -502,65 +1160,206 @@ inline void find_farthest(
 		int N,
 		int k,
 		int d,
-		bool verbose) {
+		bool verbose,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
 	int i;
 	float d_tmp;
-	dfst = -1.0f;
+	dfst = -FLT_MAX;
 	DataType * tmp = data;
 	for(i = 0; i < N; i++) {
-		if(labels[i] == id) {
-			if(d_type == DistanceType::NORM_L2)
-				d_tmp = distance_l2_square<DataType,float>(tmp,centers,d);
-			else if(d_type == DistanceType::NORM_L1)
-				d_tmp = distance_l1<DataType,float>(tmp,centers,d);
+		if(static_cast<int>(labels[i]) == id) {
+			d_tmp = compare_distance<DataType,float>(tmp,centers,d_type,d);
 			if(dfst < d_tmp) {
 				dfst = d_tmp;
 				fst = i;
 			}
 		}
-		tmp += d;
+		tmp += ld;
 	}
-	dfst = sqrt(dfst);
+	dfst = to_metric(dfst,d_type);
 }
 
 /**
  * Find a lonely observer
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
-template<typename DataType>
+template<typename DataType, typename LabelType = int>
 inline void find_lonely(
 		DataType * data,
 		float * centers,
-		int * labels,
+		LabelType * labels,
 		DistanceType d_type,
 		float& dfst,
 		int& fst,
 		int N,
 		int k,
 		int d,
-		bool verbose) {
+		bool verbose,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
 	int i;
 	float d_tmp;
-	dfst = -1.0f;
+	dfst = -FLT_MAX;
 	DataType * tmp = data;
 	for(i = 0; i < N; i++) {
-		if(d_type == DistanceType::NORM_L2)
-			d_tmp = distance_l2_square<DataType,float>(tmp,centers + labels[i] * d,d);
-		else if(d_type == DistanceType::NORM_L1)
-			d_tmp = distance_l1<DataType,float>(tmp,centers + labels[i] * d,d);
+		d_tmp = compare_distance<DataType,float>(tmp,centers + static_cast<size_t>(labels[i]) * d,d_type,d);
 		if(dfst < d_tmp) {
 			dfst = d_tmp;
 			fst = i;
 		}
-		tmp += d;
+		tmp += ld;
+	}
+	dfst = to_metric(dfst,d_type);
+}
+
+/**
+ * Move the centers of the empty clusters onto points, which leave their
+ * clusters: the point farthest from its center for SINGLETON, the point
+ * of the largest cluster farthest from the empty center for SINGLETON_2
+ * @param sum the vector sums of the clusters, updated with the sizes and the labels
+ * @param moved called with each moved point and its new cluster
+ * @param ld the distance between two rows of the data in elements, 0 for d
+ */
+template<typename DataType, typename LabelType, typename Moved>
+inline void move_empty_centers(
+		DataType * data,
+		float * centers,
+		float * sum,
+		int * size,
+		LabelType * label,
+		DistanceType d_type,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		bool verbose,
+		size_t ld,
+		Moved moved) {
+	if(ea == EmptyActs::NONE) return;
+	if(ld == 0) ld = d;
+	int fst = 0, s_max = 0, l_tmp;
+	float dfst;
+	size_t base, row, base2;
+	for(int i = 0; i < k; i++) {
+		if(size[i] > 0) continue;
+		if(ea == EmptyActs::SINGLETON_2) {
+			l_tmp = 0;
+			for(int j = 0; j < k; j++) {
+				if(l_tmp < size[j]) {
+					l_tmp = size[j];
+					s_max = j;
+				}
+			}
+		}
+		// Move the centers
+		base = static_cast<size_t>(i) * d;
+		if(ea == EmptyActs::SINGLETON)
+			find_lonely<DataType,LabelType>(data,centers,label,d_type,
+					dfst,fst,N,k,d,verbose,ld);
+		else
+			find_farthest<DataType,LabelType>(data,centers + base,label,d_type,
+					s_max,dfst,fst,N,k,d,verbose,ld);
+		row = static_cast<size_t>(fst) * ld;
+		base2 = static_cast<size_t>(label[fst]) * d;
+		for(int j = 0; j < d; j++) {
+			centers[base] = static_cast<float>(data[row++]);
+			sum[base] = centers[base];
+			sum[base2++] -= centers[base++];
+		}
+		size[i] = 1;
+		size[label[fst]]--;
+		label[fst] = static_cast<LabelType>(i);
+		moved(fst,i);
 	}
-	dfst = sqrt(dfst);
+}
+
+/**
+ * Move the centers of the empty clusters onto points
+ * @see move_empty_centers above
+ */
+template<typename DataType, typename LabelType>
+inline void move_empty_centers(
+		DataType * data,
+		float * centers,
+		float * sum,
+		int * size,
+		LabelType * label,
+		DistanceType d_type,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		bool verbose,
+		size_t ld = 0) {
+	move_empty_centers<DataType,LabelType>(data,centers,sum,size,label,
+			d_type,ea,N,k,d,verbose,ld,[](int,int){});
+}
+
+/**
+ * Print the sizes of the clusters after an iteration
+ */
+inline void print_spec(
+		int it,
+		const int * size,
+		int k) {
+	cout << "Spec " << it << ":";
+	for(int i = 0; i < k; i++) {
+		cout << size[i] << " ";
+	}
+	cout << endl;
+}
+
+/**
+ * The end of an iteration of the bounded k-means methods: the error is the
+ * root of the summed moves of the centers, and the iterations stop when it
+ * falls under the accuracy or stays put ten times
+ * @param moved the moves of the centers in the iteration
+ * @param e the error, updated
+ * @param count the number of iterations the error stayed put, updated
+ * @param it the iteration, advanced
+ * @return true if the iterations stop
+ */
+template<typename DataType, typename LabelType>
+inline bool bound_converged(
+		DataType * data,
+		float * centers,
+		LabelType * label,
+		const float * moved,
+		DistanceType d_type,
+		const KmeansCriteria& criteria,
+		float& e,
+		int& count,
+		int& it,
+		int N,
+		int k,
+		int d,
+		bool verbose,
+		size_t ld = 0) {
+	float error = criteria.accuracy, e_prev = e;
+	e = 0.0;
+	for(int i = 0; i < k; i++) {
+		e += moved[i];
+	}
+	e = sqrt(e);
+	count += (fabs(e-e_prev) < error? 1 : 0);
+	if(verbose)
+		cout << "Iterator " << it
+		<< "-th with error = " << e
+		<< " and distortion = "
+		<< distortion(data,centers,label,d_type,d,N,k,false,ld)
+		<< endl;
+	it++;
+	return it >= criteria.iterations || e < error || count >= 10;
 }
 
 /**
  * The k-means method: a description of the method can be found at
  * http://home.deib.polimi.it/matteucc/Clustering/tutorial_html/kmeans.html
  * @param type the type of seeding method
- * @param assign the type of assigning method
+ * @param assign the type of assigning method: LINEAR scans all centers, NN_KD_TREE and
+ * ANN_KD_TREE (with the factor criteria.alpha) search a kd-tree of the centers for
+ * NORM_L1, NORM_L2 and HAMMING
  * @param d the dimensions of the data
  * @param N the number of the data
  * @param k the number of clusters
@@ -569,18 +1368,21 @@ inline void find_lonely(
  * @param centers the centers
  * @param label the labels of data points
  * @param seeds the initial centers = the seeds
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param n_thread the number of threads
  * @param verbose for debugging
+ * @param cache the cached norms of the data and the centers for NORM_L2, could be nullptr
+ * @param scratch the buffer of the tiles of blocked_assign, could be nullptr
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
-template<typename DataType>
+template<typename DataType, typename LabelType = int>
 inline void greg_initialize(
 		DataType * data,
 		float * centers,
 		float *& sum,
 		float *& upper,
 		float *& lower,
-		int *& label,
+		LabelType *& label,
 		int *& size,
 		DistanceType d_type,
 		EmptyActs ea,
@@ -588,7 +1390,11 @@ inline void greg_initialize(
 		int k,
 		int d,
 		int n_thread,
-		bool verbose) {
+		bool verbose,
+		NormCache * cache = nullptr,
+		WorkBuffer * scratch = nullptr,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
 	size_t base = 0, p = N / n_thread;
 	// Initializing size and vector sum
 	for(int i = 0; i < k; i++) {
@@ -598,104 +1404,215 @@ inline void greg_initialize(
 		}
 	}
 
-	float min, min2, d_tmp;
-	int tmp;
+	if(d_type == DistanceType::NORM_L2) {
+		blocked_assign<DataType>(data,nullptr,centers,label,
+				upper,lower,d,N,k,n_thread,verbose,
+				cache != nullptr ? cache->data_sq() : nullptr,
+				cache != nullptr ? cache->center_sq() : nullptr,scratch,nullptr,ld);
+		for(int i = 0; i < N; i++) {
+			upper[i] = sqrt(upper[i]); // Update the upper bound on this distance
+			lower[i] = sqrt(lower[i]); // Update the lower bound on this distance
+		}
+	} else {
+		DistanceFunction<DataType,float> dis =
+				compare_function<DataType,float>(d_type,d,aligned_rows(data,ld));
+		float min, min2, d_tmp;
+		int tmp;
 #ifdef _OPENMP
-	omp_set_num_threads(n_thread);
+		omp_set_num_threads(n_thread);
 #pragma omp parallel
-	{
+		{
 #pragma omp for private(d_tmp,min,min2,tmp)
 #endif
-		for(int i0 = 0; i0 < n_thread; i0++) {
-			size_t start = p * i0;
-			size_t end = start + p;
-			size_t base1 = 0, base2 = 0;
-			if(end > N || i0 == n_thread - 1) end = N;
-			DataType * dt = data + start * static_cast<size_t>(d);
-			for(size_t i = start; i < end; i++) {
-				min = FLT_MAX;
-				min2 = FLT_MAX;
-				d_tmp = 0.0;
-				tmp = -1;
-				for(size_t j = 0; j < k; j++) {
-					if(d_type == DistanceType::NORM_L2) {
-						d_tmp = distance_l2_square<float,DataType>(centers + j * d,dt,d);
-					} else if(d_type == DistanceType::NORM_L1) {
-						d_tmp = distance_l1<float,DataType>(centers + j * d,dt,d);
-					}
-					if(min >= d_tmp) {
-						min2 = min;
-						min = d_tmp;
-						tmp = j;
-					} else {
-						if(min2 >= d_tmp) min2 = d_tmp;
+			for(int i0 = 0; i0 < n_thread; i0++) {
+				size_t start = p * i0;
+				size_t end = start + p;
+				if(end > static_cast<size_t>(N) || i0 == n_thread - 1) end = N;
+				DataType * dt = data + start * ld;
+				for(size_t i = start; i < end; i++) {
+					min = FLT_MAX;
+					min2 = FLT_MAX;
+					d_tmp = 0.0;
+					tmp = -1;
+					for(int j = 0; j < k; j++) {
+						d_tmp = dis(dt,centers + static_cast<size_t>(j) * d,d);
+						if(min >= d_tmp) {
+							min2 = min;
+							min = d_tmp;
+							tmp = j;
+						} else {
+							if(min2 >= d_tmp) min2 = d_tmp;
+						}
 					}
-				}
-
-				label[i] = tmp; // Update the label
-				upper[i] = sqrt(min); // Update the upper bound on this distance
-				lower[i] = sqrt(min2); // Update the lower bound on this distance
 
-				// Update the size
-				size[tmp]++;
-
-				// Update the vector sum
-				base1 = tmp * d;
-				base2 = i * d;
-				for(size_t j = 0; j < d; j++) {
-					sum[base1++] += static_cast<float>(data[base2++]);
+					label[i] = static_cast<LabelType>(tmp); // Update the label
+					upper[i] = min; // Update the upper bound on this distance
+					lower[i] = min2; // Update the lower bound on this distance
+					dt += ld;
 				}
-				dt += d;
 			}
-		}
 #ifdef _OPENMP
-	}
+		}
 #endif
-	
-    size_t s_max, l_tmp, base3, base4;
-    int fst;
-	float dfst;
+	}
+
+	// Update the sizes and the vector sums
+	size_t base1, base2;
+	for(int i = 0; i < N; i++) {
+		size[label[i]]++;
+		base1 = static_cast<size_t>(label[i]) * d;
+		base2 = static_cast<size_t>(i) * ld;
+		for(int j = 0; j < d; j++) {
+			sum[base1++] += static_cast<float>(data[base2++]);
+		}
+	}
+
 	// Check for empty clusters
-	if(ea != EmptyActs::NONE) {
-		for(int i = 0; i < k; i++) {
-			if(size[i] <= 0) {
-				if(ea == EmptyActs::SINGLETON_2) {
-					l_tmp = 0;
-					for(int j = 0; j < k; j++) {
-						if(l_tmp < size[j]) {
-							l_tmp = size[j];
-							s_max = j;
-						}
-					}
-				}
-				// Move the centers
-				base = i * d;
-				if(ea == EmptyActs::SINGLETON)
-					find_lonely<DataType>(data,centers,label,d_type,
-							dfst,fst,N,k,d,verbose);
-				else if(ea == EmptyActs::SINGLETON_2)
-					find_farthest<DataType>(data,centers + base,label,d_type,
-							s_max,dfst,fst,N,k,d,verbose);
-				base3 = static_cast<size_t>(fst) * d;
-				base4 = label[fst] * d;
-				for(int j = 0; j < d; j++) {
-					centers[base] = static_cast<float>(data[base3++]);
-					sum[base] = centers[base];
-					sum[base4++] -= centers[base++];
-				}
-				size[i] = 1;
-				size[label[fst]]--;
-				label[fst] = i;
-			}
+	move_empty_centers<DataType,LabelType>(data,centers,sum,size,label,
+			d_type,ea,N,k,d,verbose,ld);
+}
+
+/**
+ * A center seen from another center: its distance and its index
+ */
+struct CenterRing {
+	float dist;
+	int id;
+};
+
+/**
+ * The largest k whose centers are sorted around each center: the rings
+ * take k * (k - 1) entries. Larger k scan all centers.
+ */
+const int RING_MAX_CENTERS = 4096;
+
+/**
+ * Sort the other centers by their distance from each center (the annuli
+ * of the Exponion method) and find the distance to the closest one
+ * @param centers the centers
+ * @param k the number of centers
+ * @param d the dimensions
+ * @param b_type the type of distance, a metric
+ * @param closest the distance from each center to its closest center
+ * @param rings the k - 1 sorted centers of each center, one row after another
+ * @param n_thread the number of threads
+ */
+inline void center_rings(
+		float * centers,
+		int k,
+		int d,
+		DistanceType b_type,
+		float * closest,
+		CenterRing * rings,
+		int n_thread) {
+	DistanceFunction<float,float> c_dis = compare_function<float,float>(b_type,d);
+	int i;
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+	for(i = 0; i < k; i++) {
+		CenterRing * r = rings + static_cast<size_t>(i) * (k - 1);
+		float * ci = centers + static_cast<size_t>(i) * d;
+		for(int j = 0, n = 0; j < k; j++) {
+			if(j == i) continue;
+			r[n].dist = to_metric(c_dis(ci,centers + static_cast<size_t>(j) * d,d),b_type);
+			r[n++].id = j;
 		}
+		sort(r,r + k - 1,[](const CenterRing& a, const CenterRing& b) {
+			return a.dist < b.dist;
+		});
+		closest[i] = k > 1 ? r[0].dist : FLT_MAX;
 	}
 }
 
+/**
+ * Find the two nearest centers of a point by scanning the ring of its
+ * center outwards: a center c is nearer than the second nearest m2 only if
+ * d(c_a,c) <= u + m2, so the scan stops at the first center farther away
+ * @param x the point
+ * @param cs the centers
+ * @param ring the sorted centers around the center a of the point
+ * @param p_dis the distance function
+ * @param b_type the type of distance, a metric
+ * @param a the center of the point
+ * @param u the distance from the point to its center
+ * @param k the number of centers
+ * @param d the dimensions
+ * @param best the distance to the nearest center
+ * @param second the distance to the second nearest center
+ * @return the nearest center
+ */
 template<typename DataType>
+inline int ring_nearest(
+		DataType * x,
+		float * cs,
+		const CenterRing * ring,
+		DistanceFunction<DataType,float> p_dis,
+		DistanceType b_type,
+		int a,
+		float u,
+		int k,
+		int d,
+		float& best,
+		float& second) {
+	float m1 = u, m2 = FLT_MAX, v;
+	int b = a;
+	for(int r = 0; r < k - 1; r++) {
+		if(ring[r].dist > u + m2) break;
+		v = to_metric(p_dis(x,cs + static_cast<size_t>(ring[r].id) * d,d),b_type);
+		if(v < m1) {
+			m2 = m1;
+			m1 = v;
+			b = ring[r].id;
+		} else if(v < m2) {
+			m2 = v;
+		}
+	}
+	best = m1;
+	second = m2;
+	return b;
+}
+
+// greg_kmeans falls back to the linear k-means for inner products
+template<typename DataType>
+inline void simple_kmeans(
+		DataType * data,
+		float *& centers,
+		int *& labels,
+		float *& seeds,
+		KmeansType type,
+		KmeansAssignType assign,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0);
+
+/**
+ * Greg Hamerly's k-means: the points keep an upper bound on the distance
+ * to their center and a lower bound on the distance to the second closest
+ * center, and only the points that fail the bound tests are reassigned.
+ * @param ws the workspace of the scratch buffers. A workspace that is kept
+ * for repeated runs makes them free of heap allocations; without one
+ * the buffers live for one run.
+ * @param ld the distance between two rows of the data in elements, 0 for d,
+ * so that the rows of a strided view (e.g. a mapped file) are clustered in place
+ * @param label the labels, of an integral LabelType that holds k - 1 (label_fits)
+ * @see simple_kmeans for the other parameters.
+ * IndexType is the type of the indices of the points that fail the bound tests,
+ * which holds N - 1 (index_fits).
+ */
+template<typename DataType, typename LabelType = int, typename IndexType = int>
 inline void greg_kmeans(
 		DataType * data,
 		float *& centers,
-		int *& label,
+		LabelType *& label,
 		float *& seeds,
 		KmeansType type,
 		KmeansCriteria criteria,
@@ -705,229 +1622,321 @@ inline void greg_kmeans(
 		int k,
 		int d,
 		int n_thread,
-		bool verbose) {
+		bool verbose,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
+	if(!label_fits<LabelType>(k)) {
+		cerr << "The label type cannot hold " << k << " clusters" << endl;
+		return;
+	}
+	if(!index_fits<IndexType>(N)) {
+		cerr << "The index type cannot hold " << N << " points" << endl;
+		return;
+	}
+	if(packed_hamming<DataType>(d_type)) {
+		cerr << "Packed binary data are clustered by kmajority" << endl;
+		return;
+	}
 	// Pre-check conditions
 	if (N < k) {
 		if(verbose)
 			cerr << "There will be some empty clusters!" << endl;
-		// Create a new infinite point
-		float * inf = (float *)::operator new(d * sizeof(float));
-		fill(inf, inf + d, FLT_MAX);
+		// The centers without a point are infinite
 		for(int i = 0; i < k; i++) {
-			label[i] = i;
+			label[i] = static_cast<LabelType>(i);
 			if(i < N) {
-				memcpy(centers + i * d, data + i * d, d * sizeof(float));
+				copy(data + i * ld, data + i * ld + d, centers + static_cast<size_t>(i) * d);
 			} else {
-				memcpy(centers + i * d, inf, d * sizeof(float));
+				fill(centers + static_cast<size_t>(i) * d,
+						centers + static_cast<size_t>(i + 1) * d, FLT_MAX);
 			}
 		}
 
 		return;
 	}
 
+	// Inner products break the triangle inequality of the bounds
+	if(d_type == DistanceType::INNER_PRODUCT) {
+		int * labels = reinterpret_cast<int *>(label);
+		if(!is_same<LabelType,int>::value)
+			init_array<int>(labels,N);
+		simple_kmeans<DataType>(data,centers,labels,seeds,type,
+				KmeansAssignType::LINEAR,criteria,d_type,ea,
+				N,k,d,n_thread,verbose,ws,ld);
+		if(!is_same<LabelType,int>::value) {
+			for(int i = 0; i < N; i++)
+				label[i] = static_cast<LabelType>(labels[i]);
+			::operator delete(labels);
+		}
+		return;
+	}
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+	// On the unit sphere the chordal distance sqrt(2 - 2cos) ranks the centers
+	// as the cosine does and keeps the triangle inequality for the bounds
+	DistanceType b_type = d_type == DistanceType::COSINE ? DistanceType::NORM_L2 : d_type;
+	// The distance functions are selected once, for the dimensions of the data
+	DistanceFunction<DataType,float> p_dis =
+			compare_function<DataType,float>(b_type,d,aligned_rows(data,ld));
+	DistanceFunction<float,float> c_dis = compare_function<float,float>(b_type,d);
+	// The norms of the data are computed once and those of the centers per move
+	NormCache * cache = nullptr;
+	if(b_type == DistanceType::NORM_L2) {
+		ws->norms.set_data<DataType>(data,N,d,n_thread,ld);
+		cache = &ws->norms;
+	}
+
 	if(seeds == nullptr) {
-		init_array<float>(seeds,k * d);
+		init_array<float>(seeds,static_cast<size_t>(k) * d);
 	}
 
 	// Seeding
 	if (type == KmeansType::RANDOM_SEEDS) {
-		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose);
+		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose,ld);
 	} else if(type == KmeansType::KMEANS_PLUS_SEEDS) {
-		kmeans_pp_seeds<DataType>(data,seeds,d_type,d,N,k,n_thread,verbose);
+		kmeans_pp_seeds<DataType>(data,seeds,b_type,d,N,k,n_thread,verbose,cache,ws,ld);
+	} else if(type == KmeansType::KMEANS_PAR_SEEDS) {
+		kmeans_par_seeds<DataType>(data,seeds,b_type,d,N,k,n_thread,verbose,cache,ws,ld);
 	}
 
 	if(verbose)
 		cout << "Finished seeding" << endl;
 
 	// Criteria's setup
-	int iters = criteria.iterations, it = 0, count = 0;
-	float error = criteria.accuracy, e = error, e_prev;
+	int it = 0, count = 0;
+	float e = criteria.accuracy;
 
 	// Variables for Greg's method
-	float * c_sum;
-	float * moved;
-	float * closest;
-	float * upper;
-	float * lower;
-	int * size;
-
-	init_array<float>(c_sum,k * d);
-	init_array<float>(moved,k);
-	init_array<float>(closest,k);
-	init_array<float>(upper,N);
-	init_array<float>(lower,N);
-	init_array<int>(size,k);
-
-	int i0, i, j, s_max, l_tmp, fst, base, base0, base1, base2;
-	size_t p = N / n_thread;
+	float * c_sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	float * moved = ws->moved.get<float>(k);
+	float * closest = ws->closest.get<float>(k);
+	float * upper = ws->upper.get<float>(N);
+	float * lower = ws->lower.get<float>(N);
+	int * size = ws->size.get<int>(k);
+
+	// The points that failed the bound tests are assigned in batches
+	IndexType * cand = ws->cand.get<IndexType>(N);
+	int * n_cand = ws->n_cand.get<int>(n_thread);
+	int * new_label = ws->new_label.get<int>(N);
+	float * best = ws->best.get<float>(N);
+	float * second = ws->second.get<float>(N);
+	int n_assign = 0;
+	// The sorted centers around each center narrow the scan of these points.
+	// With few dimensions the tiles scan all centers fast and the k^2 rings
+	// of each iteration pay off only with many more points than that.
+	CenterRing * rings = nullptr;
+	if(k > 1 && k <= RING_MAX_CENTERS
+			&& !(use_center_tiles(d,k) && static_cast<size_t>(k) * k > static_cast<size_t>(N)))
+		rings = ws->rings.get<CenterRing>(static_cast<size_t>(k) * (k - 1));
+
+	int i0, i, j;
+	size_t base0, base1;
+	size_t p = N / n_thread, row;
 	float * fpt1, * fpt2;
 	DataType * dpt = data;
 	int tmp = 0;
 	float min, min2, min_tmp = 0.0,
-			d_tmp = 0.0, m, dfst;
+			d_tmp = 0.0, m;
 
 	// Initialize the centers
-	copy_array<float>(seeds,centers,k * d);
-	greg_initialize<DataType>(data,centers,c_sum,upper,lower,
-			label,size,d_type,ea,N,k,d,n_thread,verbose);
+	copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+	if(d_type == DistanceType::COSINE)
+		normalize_rows(centers,k,d);
+	if(cache != nullptr)
+		cache->set_centers(centers,k,d);
+	greg_initialize<DataType,LabelType>(data,centers,c_sum,upper,lower,
+			label,size,b_type,ea,N,k,d,n_thread,verbose,cache,&ws->tiles,ld);
+	// The empty clusters may have been moved onto data points
+	if(cache != nullptr && ea != EmptyActs::NONE)
+		cache->set_centers(centers,k,d);
+	// A placed workspace keeps a copy of the centers on each NUMA node
+	const CenterReplicas * replicas = nullptr;
+	if(ws->placed()) {
+		ws->replicas.resize(static_cast<size_t>(k) * d,ws->page_mode());
+		ws->replicas.sync(centers,static_cast<size_t>(k) * d);
+		replicas = &ws->replicas;
+	}
 	if(verbose)
 		cout << "Finished initialization" << endl;
 
 	while (1) {
 		// Update the closest distances
-		fpt1 = centers;
-		for(i = 0; i < k; i++) {
-			min2 = min = FLT_MAX;
-			fpt2 = centers;
-			for(j = 0; j < k; j++) {
-				if(j != i) {
-					if(d_type == DistanceType::NORM_L2)
-						min_tmp = distance_l2_square<float>(fpt1,fpt2,d);
-					else if(d_type == DistanceType::NORM_L1)
-						min_tmp = distance_l1<float>(fpt1,fpt2,d);
-					if(min > min_tmp) min = min_tmp;
+		if(rings != nullptr) {
+			center_rings(centers,k,d,b_type,closest,rings,n_thread);
+		} else {
+			fpt1 = centers;
+			for(i = 0; i < k; i++) {
+				min2 = min = FLT_MAX;
+				fpt2 = centers;
+				for(j = 0; j < k; j++) {
+					if(j != i) {
+						min_tmp = c_dis(fpt1,fpt2,d);
+						if(min > min_tmp) min = min_tmp;
+					}
+					fpt2 += d;
 				}
-				fpt2 += d;
+				closest[i] = to_metric(min,b_type);
+				fpt1 += d;
 			}
-			closest[i] = sqrt(min);
-			fpt1 += d;
 		}
 
 #ifdef _OPENMP
 		omp_set_num_threads(n_thread);
 #pragma omp parallel
 		{
-#pragma omp for private(i,j,d_tmp,m,min,min2,tmp)
+#pragma omp for private(i,d_tmp,m)
 #endif
 			for(i0 = 0; i0 < n_thread; i0++) {
 				size_t start = p * i0;
 				size_t end = start + p;
-				if(end > N || i0 == n_thread - 1) end = N;
-				int l;
-				for(i = start; i < end; i++) {
+				if(end > static_cast<size_t>(N) || i0 == n_thread - 1) end = N;
+				int n_c = 0;
+				float * cs = replicas != nullptr ? replicas->local(centers) : centers;
+				for(i = static_cast<int>(start); i < static_cast<int>(end); i++) {
 					// Update m for bound test
 					d_tmp = closest[label[i]]/2.0;
 					m = std::max(d_tmp,lower[i]);
 					// First bound test
 					if(upper[i] > m) {
 						// We need to tighten the upper bound
-						if(d_type == DistanceType::NORM_L2)
-							upper[i] = distance_l2<DataType,float>(data + i * d,centers + label[i] * d,d);
-						else if(d_type == DistanceType::NORM_L1)
-							upper[i] = distance_l1<DataType,float>(data + i * d,centers + label[i] * d,d);
-						// Second bound test
-						if(upper[i] > m) {
-							l = label[i];
-							min2 = min = FLT_MAX;
-							tmp = -1;
-							// Assign the data to clusters
-							fpt1 = centers;
-							for(j = 0; j < k; j++) {
-								if(d_type == DistanceType::NORM_L2)
-									d_tmp = distance_l2_square<float,DataType>(fpt1,data + i * d,d);
-								else if(d_type == DistanceType::NORM_L1)
-									d_tmp = distance_l1<float,DataType>(fpt1,data + i * d,d);
-								if(min >= d_tmp) {
-									min2 = min;
-									min = d_tmp;
-									tmp = j;
-								} else {
-									if(min2 > d_tmp) min2 = d_tmp;
-								}
-								fpt1 += d;
-							}
-
-							// Assign the data[i] into cluster tmp
-							label[i] = tmp; // Update the label
-							upper[i] = sqrt(min); // Update the upper bound on this distance
-							lower[i] = sqrt(min2); // Update the lower bound on this distance
-
-							if(l != tmp) {
-								size[tmp]++;
-								size[l]--;
-								if(size[l] == 0) {
-									if(verbose)
-										cout << "An empty cluster was found!"
-										" label = " << l << endl;
-								}
-								base = i * d;
-								base0 = tmp * d;
-								base1 = l * d;
-								for(j = 0; j < d; j++) {
-									c_sum[base0++] += static_cast<float>(data[base]);
-									c_sum[base1++] -= static_cast<float>(data[base++]);
-								}
-							}
-						}
+						upper[i] = to_metric(p_dis(data + i * ld,
+								cs + static_cast<size_t>(label[i]) * d,d),b_type);
+						// Second bound test: the point must be compared with all centers
+						if(upper[i] > m)
+							cand[start + n_c++] = i;
 					}
 				}
+				n_cand[i0] = n_c;
 			}
 #ifdef _OPENMP
 		}
 #endif
-		// Check for empty clusters
-		if(ea != EmptyActs::NONE) {
-			for(i = 0; i < k; i++) {
-				if(size[i] <= 0) {
-					if(ea == EmptyActs::SINGLETON_2) {
-						l_tmp = 0;
-						for(j = 0; j < k; j++) {
-							if(l_tmp < size[j]) {
-								l_tmp = size[j];
-								s_max = j;
-							}
+		// Gather the points that failed both bound tests
+		n_assign = 0;
+		for(i0 = 0; i0 < n_thread; i0++) {
+			size_t start = p * i0;
+			memmove(cand + n_assign,cand + start,n_cand[i0] * sizeof(IndexType));
+			n_assign += n_cand[i0];
+		}
+
+		// Assign the data to clusters
+		if(rings != nullptr) {
+#ifdef _OPENMP
+#pragma omp parallel
+			{
+#endif
+				float * cs = replicas != nullptr ? replicas->local(centers) : centers;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+				for(int c = 0; c < n_assign; c++) {
+					size_t x = cand[c];
+					int a = static_cast<int>(label[x]);
+					new_label[c] = ring_nearest<DataType>(data + x * ld,cs,
+							rings + static_cast<size_t>(a) * (k - 1),p_dis,b_type,
+							a,upper[x],k,d,best[c],second[c]);
+				}
+#ifdef _OPENMP
+			}
+#endif
+		} else if(b_type == DistanceType::NORM_L2) {
+			blocked_assign<DataType>(data,cand,centers,new_label,
+					best,second,d,n_assign,k,n_thread,verbose,
+					cache->data_sq(),cache->center_sq(),&ws->tiles,replicas,ld);
+			for(i = 0; i < n_assign; i++) {
+				best[i] = sqrt(best[i]);
+				second[i] = sqrt(second[i]);
+			}
+		} else if(b_type == DistanceType::NORM_L1 && use_center_tiles(d,k)) {
+			float * c_tiles = ws->center_tiles.get<float>(center_tiles_size(k,d));
+			transpose_centers(centers,k,d,c_tiles);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+			for(int c = 0; c < n_assign; c++) {
+				float row[CENTER_TILE_DIMS], b[2];
+				int l[2];
+				convert_to_float<DataType>(data + static_cast<size_t>(cand[c]) * ld,row,d);
+				nearest_in_tiles(row,c_tiles,k,d,b_type,b,l);
+				new_label[c] = l[0];
+				best[c] = b[0];
+				second[c] = b[1];
+			}
+		} else {
+#ifdef _OPENMP
+#pragma omp parallel
+			{
+#endif
+				float * cs = replicas != nullptr ? replicas->local(centers) : centers;
+#ifdef _OPENMP
+#pragma omp for private(i,j,d_tmp,min,min2,tmp,fpt1,dpt)
+#endif
+				for(i = 0; i < n_assign; i++) {
+					min2 = min = FLT_MAX;
+					tmp = -1;
+					fpt1 = cs;
+					dpt = data + static_cast<size_t>(cand[i]) * ld;
+					for(j = 0; j < k; j++) {
+						d_tmp = p_dis(dpt,fpt1,d);
+						if(min >= d_tmp) {
+							min2 = min;
+							min = d_tmp;
+							tmp = j;
+						} else {
+							if(min2 > d_tmp) min2 = d_tmp;
 						}
+						fpt1 += d;
 					}
-					// Move the centers
-					base = i * d;
-					if(ea == EmptyActs::SINGLETON)
-						find_lonely<DataType>(data,centers,label,d_type,
-								dfst,fst,N,k,d,verbose);
-					else if(ea == EmptyActs::SINGLETON_2)
-						find_farthest<DataType>(data,centers + base,label,d_type,
-								s_max,dfst,fst,N,k,d,verbose);
-					base1 = fst * d;
-					base2 = label[fst] * d;
-					for(j = 0; j < d; j++) {
-						centers[base] = static_cast<float>(data[base1++]);
-						c_sum[base] = centers[base];
-						c_sum[base2++] -= centers[base++];
-					}
-					size[i] = 1;
-					size[label[fst]]--;
-					label[fst] = i;
+					new_label[i] = tmp;
+					best[i] = min;
+					second[i] = min2;
 				}
+#ifdef _OPENMP
 			}
+#endif
 		}
-		// Move the centers
-		update_center(c_sum,size,centers,moved,d_type,k,d,n_thread);
-		// Update the bounds
-		update_bounds(moved,label,upper,lower,N,k,n_thread);
 
-		if(verbose) {
-			cout << "Spec " << it << ":";
-			for(i = 0; i < k; i++) {
-				cout << size[i] << " ";
+		for(int c = 0; c < n_assign; c++) {
+			i = cand[c];
+			int l = label[i];
+			tmp = new_label[c];
+			// Assign the data[i] into cluster tmp
+			label[i] = static_cast<LabelType>(tmp); // Update the label
+			upper[i] = best[c]; // Update the upper bound on this distance
+			lower[i] = second[c]; // Update the lower bound on this distance
+
+			if(l != tmp) {
+				size[tmp]++;
+				size[l]--;
+				if(size[l] == 0) {
+					if(verbose)
+						cout << "An empty cluster was found!"
+						" label = " << l << endl;
+				}
+				row = static_cast<size_t>(i) * ld;
+				base0 = static_cast<size_t>(tmp) * d;
+				base1 = static_cast<size_t>(l) * d;
+				for(j = 0; j < d; j++) {
+					c_sum[base0++] += static_cast<float>(data[row]);
+					c_sum[base1++] -= static_cast<float>(data[row++]);
+				}
 			}
-			cout << endl;
 		}
+		// Check for empty clusters
+		move_empty_centers<DataType,LabelType>(data,centers,c_sum,size,label,
+				b_type,ea,N,k,d,verbose,ld);
+		// Move the centers
+		update_center(c_sum,size,centers,moved,d_type,k,d,n_thread,cache,ws);
+		if(replicas != nullptr)
+			ws->replicas.sync(centers,static_cast<size_t>(k) * d);
+		// Update the bounds
+		update_bounds(moved,label,upper,lower,N,k,n_thread);
 
-		// Calculate the distortion
-		e_prev = e;
-		e = 0.0;
-		for(i = 0; i < k; i++) {
-			e += moved[i];
-		}
-		e = sqrt(e);
-		count += (fabs(e-e_prev) < error? 1 : 0);
 		if(verbose)
-			cout << "Iterator " << it
-			<< "-th with error = " << e
-			<< " and distortion = "
-			<< distortion(data,centers,label,d_type,d,N,k,false)
-			<< endl;
-		it++;
-		if(it >= iters || e < error || count >= 10) break;
+			print_spec(it,size,k);
+		if(bound_converged(data,centers,label,moved,d_type,criteria,
+				e,count,it,N,k,d,verbose,ld)) break;
 	}
 
 	if(verbose)
@@ -947,11 +1956,18 @@ inline void greg_kmeans(
  * @param criteria the criteria
  * @param data input data
  * @param centers the centers
- * @param label the labels of data points
+ * @param label the labels of data points, allocated if it is nullptr.
+ * They stay int, since the linear and the kd-tree assignments mark the
+ * points without a center by -1; narrow labels are taken by greg_kmeans,
+ * elkan_kmeans and yinyang_kmeans.
  * @param seeds the initial centers = the seeds
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT.
+ * HAMMING compares the components of real data; packed binary data (integral
+ * DataType) are rejected and should be clustered by kmajority.
  * @param n_thread the number of threads
  * @param verbose for debugging
+ * @param ws the workspace of the scratch buffers, could be nullptr
+ * @param ld the distance between two rows of the data in elements, 0 for d
  */
 template<typename DataType>
 inline void simple_kmeans(
@@ -968,35 +1984,52 @@ inline void simple_kmeans(
 		int k,
 		int d,
 		int n_thread,
-		bool verbose) {
+		bool verbose,
+		KmeansWorkspace * ws,
+		size_t ld) {
+	if(ld == 0) ld = d;
+	if(packed_hamming<DataType>(d_type)) {
+		cerr << "Packed binary data are clustered by kmajority" << endl;
+		return;
+	}
 	// Pre-check conditions
 	if (N < k) {
 		if(verbose)
 			cerr << "There will be some empty clusters!" << endl;
-		// Create a new infinite point
-		float * inf = (float *)::operator new(d * sizeof(float));
-		fill(inf, inf + d, FLT_MAX);
+		// The centers without a point are infinite
 		for(int i = 0; i < k; i++) {
 			labels[i] = i;
 			if(i < N) {
-				memcpy(centers + i * d, data + i * d, d * sizeof(float));
+				copy(data + i * ld, data + i * ld + d, centers + static_cast<size_t>(i) * d);
 			} else {
-				memcpy(centers + i * d, inf, d * sizeof(float));
+				fill(centers + static_cast<size_t>(i) * d,
+						centers + static_cast<size_t>(i + 1) * d, FLT_MAX);
 			}
 		}
 
 		return;
 	}
 
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+	// The norms of the data are computed once and those of the centers per move
+	NormCache * cache = nullptr;
+	if(d_type == DistanceType::NORM_L2) {
+		ws->norms.set_data<DataType>(data,N,d,n_thread,ld);
+		cache = &ws->norms;
+	}
+
 	if(seeds == nullptr) {
-		init_array<float>(seeds,k*d);
+		init_array<float>(seeds,static_cast<size_t>(k) * d);
 	}
 
 	// Seeding
 	if (type == KmeansType::RANDOM_SEEDS) {
-		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose);
+		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose,ld);
 	} else if(type == KmeansType::KMEANS_PLUS_SEEDS) {
-		kmeans_pp_seeds<DataType>(data,seeds,d_type,d,N,k,n_thread,verbose);
+		kmeans_pp_seeds<DataType>(data,seeds,d_type,d,N,k,n_thread,verbose,cache,ws,ld);
+	} else if(type == KmeansType::KMEANS_PAR_SEEDS) {
+		kmeans_par_seeds<DataType>(data,seeds,d_type,d,N,k,n_thread,verbose,cache,ws,ld);
 	}
 
 	if(verbose)
@@ -1004,86 +2037,63 @@ inline void simple_kmeans(
 
 	// Criteria's setup
 	int iters = criteria.iterations, it = 0, count = 0;
-	float error = criteria.accuracy, e = error, e_prev,
-			d_tmp, dfst;
-	int i, j, f_tmp, fst,s_max, l_tmp;
+	float error = criteria.accuracy, e = error, e_prev;
+	int i, j;
 
 	// Initialize the centers
-	copy_array<float>(seeds,centers,k*d);
-	init_array<int>(labels,N);
+	copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+	if(d_type == DistanceType::COSINE)
+		normalize_rows(centers,k,d);
+	if(cache != nullptr)
+		cache->set_centers(centers,k,d);
+	// The labels of the caller are reused
+	if(labels == nullptr)
+		init_array<int>(labels,N);
 	for(i = 0; i < N; i++) labels[i] = -1;
-	int * size;
-	init_array<int>(size,k);
-	float * sum;
-	float * c_tmp;
-	init_array<float>(c_tmp,d);
-	init_array<float>(sum,k*d);
-	int base = 0, base1, base2;
+	int * size = ws->size.get<int>(k);
+	float * sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	float * moved = ws->moved.get<float>(k);
+	size_t base = 0;
 	for(i = 0; i < k; i++) {
 		for(j = 0; j < d; j++)
 			sum[base++] = 0.0;
 		size[i] = 0;
 	}
+	// The kd-tree of the centers is built once and refit after each move.
+	// A cut bounds neither the angle nor the inner product.
+	FlatKDTree<float> tree;
+	bool use_tree = assign != KmeansAssignType::LINEAR
+			&& d_type != DistanceType::COSINE && d_type != DistanceType::INNER_PRODUCT;
+	double alpha = assign == KmeansAssignType::ANN_KD_TREE ?
+			std::max(1.0,static_cast<double>(criteria.alpha)) : 1.0;
+	if(use_tree)
+		use_tree = tree.build(centers,k,d,KD_CENTER_LEAF_SIZE);
 	if(verbose)
 		cout << "Finished initialization" << endl;
 
 	while (1) {
 		// Assigning
-		linear_assign<DataType>(data,centers,labels,size,sum,
-				d_type,d,N,k,n_thread,verbose);
+		if(use_tree)
+			tree_assign<DataType>(data,tree,labels,size,sum,
+					d_type,alpha,d,N,n_thread,verbose,ws,ld);
+		else
+			linear_assign<DataType>(data,centers,labels,size,sum,
+					d_type,d,N,k,n_thread,verbose,cache,ws,ld);
 		// Check for empty clusters
-		if(ea != EmptyActs::NONE) {
-			for(i = 0; i < k; i++) {
-				if(size[i] <= 0) {
-					if(ea == EmptyActs::SINGLETON_2) {
-						l_tmp = 0;
-						for(j = 0; j < k; j++) {
-							if(l_tmp < size[j]) {
-								l_tmp = size[j];
-								s_max = j;
-							}
-						}
-					}
-					// Move the centers
-					base = i * d;
-					if(ea == EmptyActs::SINGLETON)
-						find_lonely<DataType>(data,centers,labels,d_type,
-								dfst,fst,N,k,d,verbose);
-					else if(ea == EmptyActs::SINGLETON_2)
-						find_farthest<DataType>(data,centers + base,labels,d_type,
-								s_max,dfst,fst,N,k,d,verbose);
-					base1 = fst * d;
-					base2 = labels[fst] * d;
-					for(j = 0; j < d; j++) {
-						centers[base] = static_cast<float>(data[base1++]);
-						sum[base] = centers[base];
-						sum[base2++] -= centers[base++];
-					}
-					size[i] = 1;
-					size[labels[fst]]--;
-					labels[fst] = i;
-				}
-			}
-		}
+		move_empty_centers<DataType,int>(data,centers,sum,size,labels,
+				d_type,ea,N,k,d,verbose,ld);
 
-		if(verbose) {
-			cout << "Spec " << it << ":";
-			for(i = 0; i < k; i++) {
-				cout << size[i] << " ";
-			}
-			cout << endl;
-		}
+		if(verbose)
+			print_spec(it,size,k);
 
 		// Update centers
 		e_prev = e;
 		e = 0.0;
-		base = 0;
+		update_center(sum,size,centers,moved,d_type,k,d,n_thread,cache,ws);
+		if(use_tree && !tree.refit(centers))
+			use_tree = tree.build(centers,k,d,KD_CENTER_LEAF_SIZE);
 		for(i = 0; i < k; i++) {
-			for(j = 0; j < d; j++) {
-				c_tmp[j] = centers[base];
-				centers[base] = sum[base++] / size[i];
-			}
-			e += distance_l2_square<float>(c_tmp,centers + (base - d),d);
+			e += moved[i] * moved[i];
 		}
 		e = sqrt(e);
 		count += (fabs(e-e_prev) < error? 1 : 0);
@@ -1093,7 +2103,7 @@ inline void simple_kmeans(
 			<< "-th with error = " << e
 			<< " and distortion = " <<
 			distortion(data,centers,labels,d_type,
-					d,N,k,false)
+					d,N,k,false,ld)
 					<< endl;
 		it++;
 
@@ -1108,6 +2118,103 @@ inline void simple_kmeans(
 		cout << "Finished clustering with error is " <<
 		e << " after " << it << " iterations." << endl;
 }
+
+/**
+ * Spherical k-means: the k-means of directions. The data are normalized once
+ * and the centers are kept on the unit sphere, so that the nearest center
+ * in the cosine distance is found by inner products (the blocked dot-product
+ * kernels) and Greg's bounds are kept in the chordal distance sqrt(2 - 2cos).
+ * @param data input data
+ * @param centers the centers, of unit length
+ * @param labels the labels of data points
+ * @param seeds the initial centers = the seeds
+ * @param type the type of seeding method
+ * @param criteria the criteria
+ * @param ea the action for empty clusters
+ * @param N the number of the data
+ * @param k the number of clusters
+ * @param d the dimensions of the data
+ * @param n_thread the number of threads
+ * @param verbose for debugging
+ * @param ws the workspace of the scratch buffers, could be nullptr
+ */
+template<typename DataType>
+inline void spherical_kmeans(
+		DataType * data,
+		float *& centers,
+		int *& labels,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr) {
+	float * unit;
+	if(ws != nullptr)
+		unit = ws->converted.get<float>(static_cast<size_t>(N) * d);
+	else
+		init_array<float>(unit,static_cast<size_t>(N) * d);
+	for(int i = 0; i < N; i++)
+		convert_to_float<DataType>(data + static_cast<size_t>(i) * d,
+				unit + static_cast<size_t>(i) * d,d);
+	normalize_rows(unit,N,d);
+	greg_kmeans<float>(unit,centers,labels,seeds,type,criteria,
+			DistanceType::COSINE,ea,N,k,d,n_thread,verbose,ws);
+	if(ws == nullptr)
+		::operator delete(unit);
+}
+
+/**
+ * Greg's k-means on the rows of a Matrix, in place: the rows
+ * are clustered in data.cols() dimensions, data.stride() elements apart
+ * @param data the matrix
+ * @see greg_kmeans
+ */
+template<typename DataType, typename LabelType = int>
+inline void greg_kmeans(
+		Matrix<DataType>& data,
+		float *& centers,
+		LabelType *& label,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int k,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr) {
+	greg_kmeans<DataType,LabelType>(data.data(),centers,label,seeds,type,criteria,
+			d_type,ea,data.rows(),k,data.cols(),n_thread,verbose,ws,data.stride());
+}
+
+/**
+ * The k-means method on the rows of a Matrix, in place
+ * @param data the matrix
+ * @see simple_kmeans
+ */
+template<typename DataType>
+inline void simple_kmeans(
+		Matrix<DataType>& data,
+		float *& centers,
+		int *& labels,
+		float *& seeds,
+		KmeansType type,
+		KmeansAssignType assign,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int k,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr) {
+	simple_kmeans<DataType>(data.data(),centers,labels,seeds,type,assign,criteria,
+			d_type,ea,data.rows(),k,data.cols(),n_thread,verbose,ws,data.stride());
+}
 }
 
 #endif /* K_MEANS_H_ */
@@ -29,6 +29,7 @@
 #include <cmath>
 #include <cfloat>
 #include "utilities.h"
+#include "matrix.h"
 
 using namespace std;
 
@@ -42,6 +43,7 @@ class KDNode {
 private:
 	DataType * data;
 	int dimension;
+	bool owned; // whether data was allocated by the node
 public:
 	int id;
 	KDNode<DataType> * left, * right;
@@ -53,17 +55,20 @@ public:
 	KDNode(const KDNode<DataType>& other) {
 		dimension = other.size();
 		data = other.get_data();
+		owned = false;
 		left = other.left;
 		right = other.right;
 		id = other.id;
 	}
 
 	/**
-	 * The default constructor
+	 * The default constructor. The vector is allocated
+	 * only when a component is added.
 	 */
 	KDNode(int _d) {
 		dimension = _d;
-		data = (DataType *)::operator new(_d * sizeof(DataType));
+		data = nullptr;
+		owned = false;
 		id = 0;
 		left = right = nullptr;
 	}
@@ -85,6 +90,8 @@ public:
 	 * The destructor
 	 */
 	virtual ~KDNode() {
+		if(owned)
+			::operator delete(data);
 	}
 
 	/**
@@ -94,8 +101,12 @@ public:
 	void add_data(
 			DataType _d,
 			int pos) {
-		if(pos >= 0 && pos < dimension)
-			data[pos] = _d;
+		if(pos < 0 || pos >= dimension) return;
+		if(data == nullptr) {
+			data = (DataType *)::operator new(dimension * sizeof(DataType));
+			owned = true;
+		}
+		data[pos] = _d;
 	}
 
 	/**
@@ -104,7 +115,10 @@ public:
 	 * @param N the size of the input
 	 */
 	void add_data(DataType * _d) {
+		if(owned)
+			::operator delete(data);
 		data = _d;
+		owned = false;
 	}
 
 	/**
@@ -175,7 +189,7 @@ inline void kd_insert(
 /**
  * Calculate the distances between two KDNode
  * @param _a, _b the input KDNode
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param verbose Just for debugging
  * @return the distance between two KDNode if no error occurs, otherwise return DBL_MAX
  */
@@ -196,9 +210,24 @@ inline double kd_distance(
 		}
 		exit(1);
 	}
-	if(d_type == DistanceType::NORM_L1)
-		return distance_l1<DataType>(a,b,N);
-	return distance_l2<DataType>(a,b,N);
+	return to_metric(compare_distance<DataType,DataType>(a,b,d_type,N),d_type);
+}
+
+/**
+ * Calculate the distance between two nodes with a distance function
+ * that was selected for the run
+ * @param _a, _b two nodes
+ * @param dis the distance function, from compare_function
+ * @param d_type the type of distance
+ * @return the distance between two nodes
+ */
+template<typename DataType>
+inline double kd_distance(
+		KDNode<DataType> * _a,
+		KDNode<DataType> * _b,
+		DistanceFunction<DataType,DataType> dis,
+		DistanceType d_type) {
+	return to_metric(dis(_a->get_data(),_b->get_data(),_a->size()),d_type);
 }
 
 /**
@@ -235,7 +264,7 @@ inline int find_median(
 		return -1;
 	}
 	id = id % N;
-	DataType * arr = (DataType *)::operator new(M * sizeof(float));
+	DataType * arr = (DataType *)::operator new(M * sizeof(DataType));
 	for(int i = 0; i < M; i++) {
 		arr[i] = data[i][id];
 	}
@@ -307,17 +336,73 @@ inline void make_random_tree(
 			M - id - 1,N,base+id+1,verbose);
 }
 
+/**
+ * Create a balanced kd-tree over the rows of a Matrix
+ * @param root the root node of the tree
+ * @param data the matrix
+ * @param level the cut-plane level
+ * @param base the base index to be added
+ * @param verbose just for debugging
+ */
+template<typename DataType>
+inline void make_balanced_tree(
+		KDNode<DataType> *& root,
+		const Matrix<DataType>& data,
+		int level,
+		int base,
+		bool verbose) {
+	make_balanced_tree<DataType>(root,data.row_table(),data.rows(),
+			data.cols(),level,base,verbose);
+}
+
+/**
+ * Create a random kd-tree over the rows of a Matrix
+ * @param root the root node of the tree
+ * @param data the matrix
+ * @param base the base index to be added
+ * @param verbose just for debugging
+ */
+template<typename DataType>
+inline void make_random_tree(
+		KDNode<DataType> *& root,
+		const Matrix<DataType>& data,
+		int base,
+		bool verbose) {
+	make_random_tree<DataType>(root,data.row_table(),data.rows(),
+			data.cols(),base,verbose);
+}
+
+/**
+ * The lower bound of the distances between the query and
+ * the points on the other side of a cut-plane
+ * @param d1 the distance between the query and the cut-plane along its axis
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
+ * @return the lower bound
+ */
+inline double split_bound(
+		double d1,
+		DistanceType d_type) {
+	// For HAMMING we only know that the component differs in at least one bit
+	if(d_type == DistanceType::HAMMING)
+		return 1.0;
+	// A single component bounds neither the angle nor the inner product
+	if(d_type == DistanceType::COSINE || d_type == DistanceType::INNER_PRODUCT)
+		return -DBL_MAX;
+	return fabs(d1);
+}
+
 /**
  * Search for the nearest neighbor in the kd-tree
  * @param root the root node of the tree
  * @param query the data of the query
  * @param result the nearest neighbor
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param best_dist the best distance
  * @param N the size of the input
  * @param level the cut-plane level
  * @param visited (for debugging) to detect how many nodes are visited
  * @param verbose for debugging
+ * @param dis the distance function, selected from d_type and N when it is nullptr
  */
 template<typename DataType>
 inline void nn_search(
@@ -329,7 +414,8 @@ inline void nn_search(
 		int N,
 		int level,
 		int& visited,
-		bool verbose) {
+		bool verbose,
+		DistanceFunction<DataType,DataType> dis = nullptr) {
 	if(best_dist == 0.0) return;
 	if(root == nullptr || root->size() != N) {
 		if(verbose) {
@@ -341,8 +427,10 @@ inline void nn_search(
 	if(verbose)
 		cout << "Visting node " << root->id << " with best is " << best_dist << endl;
 
-	double d = kd_distance<DataType>(root,query,d_type,verbose);
-	double d1 = static_cast<double>(root->at(level) - query->at(level));
+	// The distance function is selected once, at the root
+	if(dis == nullptr) dis = compare_function<DataType,DataType>(d_type,N);
+	double d = kd_distance<DataType>(root,query,dis,d_type);
+	double d1 = static_cast<double>(root->at(level)) - static_cast<double>(query->at(level));
 	visited++;
 
 	if(result == nullptr || d < best_dist) {
@@ -352,19 +440,19 @@ inline void nn_search(
 
 	int l = (level + 1) % N;
 	if(d1 >= 0.0) {
-		nn_search<DataType>(root->left,query,result,d_type,best_dist,N,l,visited,verbose);
+		nn_search<DataType>(root->left,query,result,d_type,best_dist,N,l,visited,verbose,dis);
 	} else {
-		nn_search<DataType>(root->right,query,result,d_type,best_dist,N,l,visited,verbose);
+		nn_search<DataType>(root->right,query,result,d_type,best_dist,N,l,visited,verbose,dis);
 	}
 
-	if(fabs(d1) >= best_dist) return;
+	if(split_bound(d1,d_type) >= best_dist) return;
 	if(verbose)
 		cout << "Right branch of node " << root->id << endl;
 
 	if(d1 >= 0.0) {
-		nn_search<DataType>(root->right,query,result,d_type,best_dist,N,l,visited,verbose);
+		nn_search<DataType>(root->right,query,result,d_type,best_dist,N,l,visited,verbose,dis);
 	} else {
-		nn_search<DataType>(root->left,query,result,d_type,best_dist,N,l,visited,verbose);
+		nn_search<DataType>(root->left,query,result,d_type,best_dist,N,l,visited,verbose,dis);
 	}
 }
 
@@ -373,13 +461,14 @@ inline void nn_search(
  * @param root the root node of the tree
  * @param query the data of the query
  * @param result the nearest neighbor
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param best_dist the best distance
  * @param alpha the parameter that set the quality of nearest neighbor
  * @param N the size of the input
  * @param level the cut-plane level
  * @param visited (for debugging) to detect how many nodes are visited
  * @param verbose for debugging
+ * @param dis the distance function, selected from d_type and N when it is nullptr
  */
 template<typename DataType>
 inline void ann_search(
@@ -392,7 +481,8 @@ inline void ann_search(
 		int N,
 		int level,
 		int& visited,
-		bool verbose) {
+		bool verbose,
+		DistanceFunction<DataType,DataType> dis = nullptr) {
 	if(best_dist == 0.0) return;
 	if(root == nullptr || root->size() != N) {
 		if(verbose) {
@@ -404,8 +494,10 @@ inline void ann_search(
 	if(verbose)
 		cout << "Visting node " << root->id << endl;
 
-	double d = kd_distance<DataType>(root,query,d_type,verbose);
-	double d1 = static_cast<double>(root->at(level) - query->at(level));
+	// The distance function is selected once, at the root
+	if(dis == nullptr) dis = compare_function<DataType,DataType>(d_type,N);
+	double d = kd_distance<DataType>(root,query,dis,d_type);
+	double d1 = static_cast<double>(root->at(level)) - static_cast<double>(query->at(level));
 	visited++;
 
 	if(result == nullptr || d < best_dist) {
@@ -415,17 +507,17 @@ inline void ann_search(
 
 	level = (level + 1) % N;
 	if(d1 >= 0.0) {
-		ann_search<DataType>(root->left,query,result,d_type,best_dist,alpha,N,level,visited,verbose);
+		ann_search<DataType>(root->left,query,result,d_type,best_dist,alpha,N,level,visited,verbose,dis);
 	} else {
-		ann_search<DataType>(root->right,query,result,d_type,best_dist,alpha,N,level,visited,verbose);
+		ann_search<DataType>(root->right,query,result,d_type,best_dist,alpha,N,level,visited,verbose,dis);
 	}
 
-	if(fabs(d1) * alpha > best_dist) return;
+	if(split_bound(d1,d_type) * alpha > best_dist) return;
 
 	if(d1 >= 0.0) {
-		ann_search<DataType>(root->right,query,result,d_type,best_dist,alpha,N,level,visited,verbose);
+		ann_search<DataType>(root->right,query,result,d_type,best_dist,alpha,N,level,visited,verbose,dis);
 	} else {
-		ann_search<DataType>(root->left,query,result,d_type,best_dist,alpha,N,level,visited,verbose);
+		ann_search<DataType>(root->left,query,result,d_type,best_dist,alpha,N,level,visited,verbose,dis);
 	}
 }
 
@@ -433,12 +525,16 @@ inline void ann_search(
  * A linear solution for NNS
  * @param data the database
  * @param query the input query
- * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
  * @param best the index of the NNS
  * @param best_dist the best distance
  * @param N the size of database
  * @param d the dimensions
  * @param verbose for debugging
+ * @param order the order of the dimensions from variance_order when the rows
+ * of the database are permuted by permute_vector, so the bounded L1 and L2
+ * distances abandon sooner; the query is permuted the same way. nullptr if
+ * the rows are not permuted.
  */
 template<typename DataType>
 inline void linear_search(
@@ -449,28 +545,53 @@ inline void linear_search(
 		double& best_dist,
 		int N,
 		int d,
-		bool verbose) {
+		bool verbose,
+		const int * order = nullptr) {
 	if(N <= 0 || d <= 0) {
 		if(verbose)
 			cerr << "Wrong size" << endl;
 		return;
 	}
+	vector<DataType> permuted;
+	if(order != nullptr) {
+		permuted.resize(d);
+		permute_vector<DataType,DataType>(query,order,d,permuted.data());
+		query = permuted.data();
+	}
+	// L1 and L2 abandon a candidate once its partial distance exceeds the best
+	BoundedDistanceFunction<DataType,DataType> bounded =
+			bounded_function<DataType,DataType>(d_type);
 	best = 0;
-	if(d_type == DistanceType::NORM_L2)
-		best_dist = distance_l2<DataType>(query,data[0],d);
-	else if(d_type == DistanceType::NORM_L1)
-		best_dist = distance_l1<DataType>(query,data[0],d);
-	float tmp = 0.0;
+	best_dist = compare_distance<DataType,DataType>(query,data[0],d_type,d);
+	double tmp = 0.0;
 	for(int i = 1; i < N; i++) {
-		if(d_type == DistanceType::NORM_L2)
-			tmp = distance_l2<DataType>(query,data[i],d);
-		else if(d_type == DistanceType::NORM_L1)
-			tmp = distance_l1<DataType>(query,data[i],d);
+		if(bounded != nullptr)
+			tmp = bounded(query,data[i],d,best_dist);
+		else
+			tmp = compare_distance<DataType,DataType>(query,data[i],d_type,d);
 		if(tmp < best_dist) {
 			best_dist = tmp;
 			best = i;
 		}
 	}
+	best_dist = to_metric(best_dist,d_type);
+}
+
+/**
+ * A linear solution for NNS over the rows of a Matrix
+ * @param data the database
+ * @see linear_search
+ */
+template<typename DataType>
+inline void linear_search(
+		const Matrix<DataType>& data,
+		DataType * query,
+		DistanceType d_type,
+		int& best,
+		double& best_dist,
+		bool verbose) {
+	linear_search<DataType>(data.row_table(),query,d_type,best,best_dist,
+			data.rows(),data.cols(),verbose);
 }
 
 /**
@@ -0,0 +1,252 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  kmeans-workspace.h
+ *
+ *  Created on: 2014/10/30
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef KMEANS_WORKSPACE_H_
+#define KMEANS_WORKSPACE_H_
+
+#include <cstddef>
+#include "norm-cache.h"
+#include "numa-memory.h"
+
+namespace SimpleCluster {
+
+/**
+ * A scratch buffer that only grows: it is reallocated when a larger
+ * size is asked for and keeps its memory otherwise.
+ * A placed buffer is allocated by page_alloc and zeroed by first_touch.
+ */
+class WorkBuffer {
+private:
+	void * ptr;
+	size_t bytes;
+	PageMode mode;
+	int touch; // the threads of first_touch, 0 if the buffer is not placed
+
+	WorkBuffer(const WorkBuffer&) = delete;
+	WorkBuffer& operator= (const WorkBuffer&) = delete;
+public:
+	WorkBuffer() {
+		ptr = nullptr;
+		bytes = 0;
+		mode = PageMode::DEFAULT;
+		touch = 0;
+	}
+
+	virtual ~WorkBuffer() {
+		release();
+	}
+
+	/**
+	 * Get a buffer of at least n elements. The content is kept
+	 * only if the buffer does not grow.
+	 * @param n the number of elements
+	 * @return the buffer
+	 */
+	template<typename DataType>
+	DataType * get(size_t n) {
+		size_t b = (n > 0 ? n : 1) * sizeof(DataType);
+		if(b > bytes) {
+			release();
+			if(touch > 0) {
+				ptr = page_alloc(b,mode);
+				first_touch<DataType>(static_cast<DataType *>(ptr),n,1,touch);
+			} else {
+				ptr = ::operator new(b);
+			}
+			bytes = b;
+		}
+		return static_cast<DataType *>(ptr);
+	}
+
+	/**
+	 * Place the buffer: its next allocation is backed by the pages of
+	 * a mode and split among the threads by first_touch, as the arrays
+	 * of N elements are split by the k-means loops.
+	 * The current memory is freed.
+	 * @param page_mode the page mode
+	 * @param n_thread the number of threads, 0 to allocate from the heap again
+	 */
+	void place(
+			PageMode page_mode,
+			int n_thread) {
+		release();
+		mode = page_mode;
+		touch = n_thread > 0 ? n_thread : 0;
+	}
+
+	/**
+	 * Get the capacity in bytes
+	 */
+	size_t capacity() const {
+		return bytes;
+	}
+
+	/**
+	 * Free the memory
+	 */
+	void release() {
+		if(touch > 0)
+			page_free(ptr);
+		else
+			::operator delete(ptr);
+		ptr = nullptr;
+		bytes = 0;
+	}
+};
+
+/**
+ * All scratch buffers of the k-means methods. A workspace that is passed
+ * to repeated runs on data of similar sizes grows to the largest run and
+ * then serves every run without any heap allocation.
+ */
+class KmeansWorkspace {
+private:
+	PageMode mode;
+	int touch;
+
+	KmeansWorkspace(const KmeansWorkspace&) = delete;
+	KmeansWorkspace& operator= (const KmeansWorkspace&) = delete;
+
+	/**
+	 * Visit every scratch buffer of a workspace, const or not.
+	 * A new buffer is listed here only.
+	 * @param ws the workspace
+	 * @param visit called with each buffer
+	 */
+	template<typename Workspace, typename Visitor>
+	static void for_each_buffer(
+			Workspace& ws,
+			Visitor visit) {
+		decltype(&ws.sum) all[] = {&ws.sum, &ws.size, &ws.moved,
+				&ws.closest, &ws.upper, &ws.lower,
+				&ws.cand, &ws.n_cand, &ws.new_label, &ws.best, &ws.second,
+				&ws.nearest, &ws.old_center, &ws.tiles, &ws.center_tiles,
+				&ws.order, &ws.variance, &ws.permuted, &ws.permuted_row,
+				&ws.elkan_lower, &ws.center_dist, &ws.group_lower, &ws.groups,
+				&ws.rings, &ws.batch, &ws.counts, &ws.filter_stats,
+				&ws.seed_dist, &ws.seed_sum, &ws.seed_len,
+				&ws.seed_owner, &ws.seed_cands, &ws.seed_chosen,
+				&ws.seed_weight, &ws.seed_cost, &ws.seed_label, &ws.converted};
+		for(auto b : all)
+			visit(*b);
+	}
+public:
+	// The vector sums, the sizes and the movements of the clusters
+	WorkBuffer sum, size, moved;
+	// Greg's bounds: the half distances to the closest centers, upper and lower
+	WorkBuffer closest, upper, lower;
+	// The points that failed the bound tests and their new assignment
+	WorkBuffer cand, n_cand, new_label, best, second;
+	// The nearest centers of linear_assign and the old center of update_center
+	WorkBuffer nearest, old_center;
+	// The per-thread tiles of blocked_assign
+	WorkBuffer tiles;
+	// The transposed centers of the NORM_L1 assignments
+	WorkBuffer center_tiles;
+	// The dimensions by decreasing variance, and the centers and the row
+	// permuted in that order, of the bounded NORM_L1 assignment
+	WorkBuffer order, variance, permuted, permuted_row;
+	// Elkan's lower bounds to every center and the half distances between the centers
+	WorkBuffer elkan_lower, center_dist;
+	// The Yinyang lower bounds per group and the groups of the centers
+	WorkBuffer group_lower, groups;
+	// The sorted centers around each center of greg_kmeans
+	WorkBuffer rings;
+	// The rows of a mini-batch and the rows that each center has received
+	WorkBuffer batch, counts;
+	// The boxes and the sums of the cells of the filtering k-means
+	WorkBuffer filter_stats;
+	// The distances and their prefix sums of k-means++
+	WorkBuffer seed_dist, seed_sum, seed_len;
+	// The nearest candidate of each point and the candidates of k-means||,
+	// their indices, weights, distances to the seeds and labels
+	WorkBuffer seed_owner, seed_cands, seed_chosen, seed_weight, seed_cost, seed_label;
+	// The normalized float copy of the data of spherical k-means
+	WorkBuffer converted;
+	// The norms of the data and the centers
+	NormCache norms;
+	// The copies of the centers on the NUMA nodes, when the workspace is placed
+	CenterReplicas replicas;
+
+	KmeansWorkspace() {
+		mode = PageMode::DEFAULT;
+		touch = 0;
+	}
+
+	virtual ~KmeansWorkspace() {}
+
+	/**
+	 * Free all buffers
+	 */
+	void clear() {
+		for_each_buffer(*this,[](WorkBuffer& b) { b.release(); });
+		norms.clear();
+		replicas.clear();
+	}
+
+	/**
+	 * Place the buffers for a NUMA machine: the per-point bounds, labels
+	 * and candidates are placed by first_touch in the static blocks of
+	 * n_thread threads, and greg_kmeans keeps a copy of the centers on
+	 * each node. The data should be placed the same way, by numa_array
+	 * or Matrix::resize with the same number of threads.
+	 * @param page_mode the page mode of the buffers
+	 * @param n_thread the threads of the runs, 0 to go back to the heap
+	 */
+	void place(
+			PageMode page_mode,
+			int n_thread) {
+		for_each_buffer(*this,[page_mode,n_thread](WorkBuffer& b) {
+			b.place(page_mode,n_thread);
+		});
+		replicas.clear();
+		mode = page_mode;
+		touch = n_thread > 0 ? n_thread : 0;
+	}
+
+	/**
+	 * Check whether the workspace is placed
+	 */
+	bool placed() const {
+		return touch > 0;
+	}
+
+	/**
+	 * Get the page mode of a placed workspace
+	 */
+	PageMode page_mode() const {
+		return mode;
+	}
+
+	/**
+	 * Get the memory held by the buffers in bytes, without the norms
+	 */
+	size_t capacity() const {
+		size_t bytes = 0;
+		for_each_buffer(*this,[&bytes](const WorkBuffer& b) { bytes += b.capacity(); });
+		return bytes;
+	}
+};
+}
+
+#endif /* KMEANS_WORKSPACE_H_ */
@@ -0,0 +1,300 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  matrix.h
+ *
+ *  Created on: 2014/10/28
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef MATRIX_H_
+#define MATRIX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "utilities.h"
+#include "numa-memory.h"
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The alignment of the rows of a Matrix: a cache line,
+ * which is also the width of an AVX-512 register
+ */
+const size_t MATRIX_ALIGN = 64;
+
+/**
+ * The stride of the rows of d elements: d is padded up to
+ * a multiple of MATRIX_ALIGN bytes
+ * @param d the dimensions
+ * @return the stride in elements
+ */
+template<typename DataType>
+inline int matrix_stride(int d) {
+	size_t width = MATRIX_ALIGN / sizeof(DataType);
+	if(width == 0 || MATRIX_ALIGN % sizeof(DataType) != 0)
+		return d;
+	return static_cast<int>((d + width - 1) / width * width);
+}
+
+/**
+ * A dataset of N rows of d dimensions in one contiguous block.
+ * Each row starts on a MATRIX_ALIGN boundary and is padded with zeros
+ * up to the stride, so the rows can be streamed by the prefetcher
+ * and loaded by aligned SIMD loads. The k-means methods take the rows
+ * in place, d = cols() dimensions ld = stride() elements apart.
+ * The zero padding adds nothing to the L1, L2, HAMMING and
+ * inner-product distances of whole rows.
+ * The table of row pointers is kept for the kd-tree, which takes
+ * DataType ** rows.
+ */
+template<typename DataType>
+class Matrix {
+private:
+	void * block; // the allocated memory, before the alignment
+	DataType * elems;
+	DataType ** table;
+	int n_rows, n_cols, n_stride;
+	bool paged; // the block is from page_alloc
+
+	Matrix(const Matrix<DataType>&) = delete;
+	Matrix& operator= (const Matrix<DataType>&) = delete;
+
+	/**
+	 * Release the memory
+	 */
+	void release() {
+		if(paged)
+			page_free(block);
+		else
+			::operator delete(block);
+		::operator delete(table);
+		block = nullptr;
+		elems = nullptr;
+		table = nullptr;
+		n_rows = n_cols = n_stride = 0;
+		paged = false;
+	}
+public:
+	/**
+	 * The default constructor: an empty matrix
+	 */
+	Matrix() {
+		block = nullptr;
+		elems = nullptr;
+		table = nullptr;
+		n_rows = n_cols = n_stride = 0;
+		paged = false;
+	}
+
+	/**
+	 * A matrix of zeros
+	 * @param N the number of rows
+	 * @param d the dimensions of the rows
+	 */
+	Matrix(int N, int d) : Matrix() {
+		resize(N,d);
+	}
+
+	/**
+	 * Copy the rows of a flat array
+	 * @param src N rows of d elements, one after another
+	 * @param N the number of rows
+	 * @param d the dimensions of the rows
+	 */
+	Matrix(const DataType * src, int N, int d) : Matrix() {
+		resize(N,d);
+		for(int i = 0; i < N; i++)
+			memcpy(row(i),src + static_cast<size_t>(i) * d,d * sizeof(DataType));
+	}
+
+	/**
+	 * The move constructor
+	 * @param other another matrix, which is left empty
+	 */
+	Matrix(Matrix<DataType>&& other) {
+		block = other.block;
+		elems = other.elems;
+		table = other.table;
+		n_rows = other.n_rows;
+		n_cols = other.n_cols;
+		n_stride = other.n_stride;
+		paged = other.paged;
+		other.paged = false;
+		other.block = nullptr;
+		other.elems = nullptr;
+		other.table = nullptr;
+		other.n_rows = other.n_cols = other.n_stride = 0;
+	}
+
+	/**
+	 * The destructor
+	 */
+	virtual ~Matrix() {
+		release();
+	}
+
+	/**
+	 * Reallocate the matrix with zeros
+	 * @param N the number of rows
+	 * @param d the dimensions of the rows
+	 * @param n_thread the threads that zero the rows by first_touch, so the
+	 * static block of each thread of the k-means loops is placed on its NUMA
+	 * node; 0 to zero them in the calling thread
+	 * @param mode the page mode, used when n_thread > 0
+	 * @return true if the matrix was allocated successfully, otherwise return false.
+	 */
+	bool resize(
+			int N,
+			int d,
+			int n_thread = 0,
+			PageMode mode = PageMode::DEFAULT) {
+		release();
+		if(N <= 0 || d <= 0)
+			return false;
+		n_stride = matrix_stride<DataType>(d);
+		size_t bytes = static_cast<size_t>(N) * n_stride * sizeof(DataType);
+		try {
+			if(n_thread > 0) {
+				block = page_alloc(bytes,mode);
+				paged = true;
+			} else {
+				block = ::operator new(bytes + MATRIX_ALIGN);
+			}
+			table = (DataType **)::operator new(N * sizeof(DataType *));
+		} catch(exception& e) {
+			cerr << "Got an exception: " << e.what() << endl;
+			release();
+			return false;
+		}
+		uintptr_t p = reinterpret_cast<uintptr_t>(block);
+		p = (p + MATRIX_ALIGN - 1) & ~static_cast<uintptr_t>(MATRIX_ALIGN - 1);
+		elems = reinterpret_cast<DataType *>(p);
+		if(n_thread > 0)
+			first_touch<DataType>(elems,N,n_stride,n_thread);
+		else
+			memset(static_cast<void *>(elems),0,bytes);
+		n_rows = N;
+		n_cols = d;
+		for(int i = 0; i < N; i++)
+			table[i] = elems + static_cast<size_t>(i) * n_stride;
+		return true;
+	}
+
+	/**
+	 * Get the number of rows
+	 */
+	int rows() const {
+		return n_rows;
+	}
+
+	/**
+	 * Get the dimensions of the rows
+	 */
+	int cols() const {
+		return n_cols;
+	}
+
+	/**
+	 * Get the distance between two rows in elements
+	 */
+	int stride() const {
+		return n_stride;
+	}
+
+	/**
+	 * Check whether the rows are padded
+	 */
+	bool padded() const {
+		return n_stride != n_cols;
+	}
+
+	/**
+	 * Get the first element of the first row
+	 */
+	DataType * data() const {
+		return elems;
+	}
+
+	/**
+	 * Get a row
+	 * @param i the index of the row
+	 */
+	DataType * row(int i) const {
+		return elems + static_cast<size_t>(i) * n_stride;
+	}
+
+	DataType * operator[] (int i) const {
+		return row(i);
+	}
+
+	/**
+	 * Get the table of the row pointers, for the kd-tree
+	 */
+	DataType ** row_table() const {
+		return table;
+	}
+};
+
+/**
+ * Copy the first d columns of strided rows into a flat array
+ * @param src the rows, stride elements apart
+ * @param dst the flat array of N rows of d elements
+ * @param N the number of rows
+ * @param d the dimensions
+ * @param stride the stride of src
+ */
+template<typename DataType>
+inline void unpad_rows(
+		const DataType * src,
+		DataType * dst,
+		int N,
+		int d,
+		int stride) {
+	for(int i = 0; i < N; i++)
+		memcpy(dst + static_cast<size_t>(i) * d,
+				src + static_cast<size_t>(i) * stride,d * sizeof(DataType));
+}
+
+/**
+ * Copy a flat array into strided rows, padding them with zeros
+ * @param src the flat array of N rows of d elements
+ * @param dst the rows, stride elements apart
+ * @param N the number of rows
+ * @param d the dimensions
+ * @param stride the stride of dst
+ */
+template<typename DataType>
+inline void pad_rows(
+		const DataType * src,
+		DataType * dst,
+		int N,
+		int d,
+		int stride) {
+	for(int i = 0; i < N; i++) {
+		DataType * r = dst + static_cast<size_t>(i) * stride;
+		memcpy(r,src + static_cast<size_t>(i) * d,d * sizeof(DataType));
+		memset(static_cast<void *>(r + d),0,(stride - d) * sizeof(DataType));
+	}
+}
+}
+
+#endif /* MATRIX_H_ */
@@ -0,0 +1,246 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  minibatch-kmeans.h
+ *
+ *  Created on: 2014/11/06
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef MINIBATCH_KMEANS_H_
+#define MINIBATCH_KMEANS_H_
+
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include "utilities.h"
+#include "k-means.h"
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The default number of rows in a mini-batch
+ */
+const int MINIBATCH_SIZE = 1024;
+
+/**
+ * The rows that are sampled per center for the k-means++ seeding
+ */
+const int MINIBATCH_SAMPLE_PER_CENTER = 16;
+
+/**
+ * The steps between two checks of the held-out rows
+ */
+const int MINIBATCH_CHECK_STEPS = 10;
+
+/**
+ * Copy some rows of the data into a contiguous buffer
+ * @param data the data
+ * @param rows the indices of the rows
+ * @param n the number of rows
+ * @param d the dimensions
+ * @param ld the distance between two rows of the data in elements
+ * @param buf the n rows, one after another
+ */
+template<typename DataType>
+inline void gather_rows(
+		DataType * data,
+		const int * rows,
+		int n,
+		int d,
+		size_t ld,
+		DataType * buf) {
+	for(int i = 0; i < n; i++)
+		memcpy(buf + static_cast<size_t>(i) * d,
+				data + static_cast<size_t>(rows[i]) * ld,d * sizeof(DataType));
+}
+
+/**
+ * Sculley's mini-batch k-means: each step assigns a uniform sample of
+ * batch rows by linear_assign and moves every center towards the mean of
+ * its rows with a learning rate of one over the number of rows that it has
+ * ever received, so a center is the running mean of its rows.
+ * The distortion of a fixed sample of 2 * batch rows that are never trained
+ * on (when N is large enough) is checked every MINIBATCH_CHECK_STEPS steps,
+ * and the method stops when it improves by less than criteria.accuracy
+ * (relatively) 3 times, or after criteria.iterations steps.
+ * The k-means++ and k-means|| seeds are drawn from
+ * MINIBATCH_SAMPLE_PER_CENTER * k rows.
+ * @param labels the labels of all rows by the final centers, one more pass
+ * over the data, skipped if it is nullptr
+ * @param batch the number of rows in a step, 0 for MINIBATCH_SIZE
+ * @see simple_kmeans for the other parameters
+ */
+template<typename DataType>
+inline void minibatch_kmeans(
+		DataType * data,
+		float *& centers,
+		int * labels,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		int N,
+		int k,
+		int d,
+		int batch,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
+	if(n_thread < 1) n_thread = 1;
+	if(batch <= 0) batch = MINIBATCH_SIZE;
+	if(packed_hamming<DataType>(d_type)) {
+		cerr << "Packed binary data are clustered by kmajority" << endl;
+		return;
+	}
+	if (N < k) {
+		if(verbose)
+			cerr << "There will be some empty clusters!" << endl;
+		// The centers without a point are infinite
+		for(int i = 0; i < k; i++) {
+			if(i < N) {
+				if(labels != nullptr) labels[i] = i;
+				for(int j = 0; j < d; j++)
+					centers[static_cast<size_t>(i) * d + j] = static_cast<float>(data[i * ld + j]);
+			} else {
+				fill(centers + static_cast<size_t>(i) * d,
+						centers + static_cast<size_t>(i + 1) * d, FLT_MAX);
+			}
+		}
+		return;
+	}
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+	random_device rd;
+	mt19937_64 gen(rd());
+	uniform_int_distribution<int> pick(0,N - 1);
+
+	// The held-out rows, sorted, so that the batches can skip them
+	int h = static_cast<int>(std::min<size_t>(N,2 * static_cast<size_t>(batch)));
+	bool held_out = static_cast<size_t>(N) >= 4 * static_cast<size_t>(h);
+	int m = static_cast<int>(std::min<size_t>(N,
+			static_cast<size_t>(k) * MINIBATCH_SAMPLE_PER_CENTER));
+	int n_rows = std::max(std::max(batch,h),m);
+	int * rows = ws->cand.get<int>(static_cast<size_t>(batch) + h);
+	int * held = rows + batch;
+	DataType * buf = ws->batch.get<DataType>(static_cast<size_t>(n_rows) * d);
+	for(int i = 0; i < h; i++)
+		held[i] = pick(gen);
+	sort(held,held + h);
+
+	if(seeds == nullptr) {
+		init_array<float>(seeds,static_cast<size_t>(k) * d);
+	}
+
+	// Seeding
+	if (type == KmeansType::RANDOM_SEEDS) {
+		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose,ld);
+	} else if(type == KmeansType::KMEANS_PLUS_SEEDS || type == KmeansType::KMEANS_PAR_SEEDS) {
+		for(int i = 0; i < m; i++) {
+			int r = pick(gen);
+			gather_rows<DataType>(data,&r,1,d,ld,buf + static_cast<size_t>(i) * d);
+		}
+		// The held-out rows are in the workspace, so the seeding has its own
+		if(type == KmeansType::KMEANS_PLUS_SEEDS)
+			kmeans_pp_seeds<DataType>(buf,seeds,d_type,d,m,k,n_thread,verbose);
+		else
+			kmeans_par_seeds<DataType>(buf,seeds,d_type,d,m,k,n_thread,verbose);
+	}
+
+	if(verbose)
+		cout << "Finished seeding" << endl;
+
+	int * size = ws->size.get<int>(k);
+	float * sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	int * b_label = ws->new_label.get<int>(n_rows);
+	long long * count = ws->counts.get<long long>(k);
+	copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+	if(d_type == DistanceType::COSINE)
+		normalize_rows(centers,k,d);
+	fill(count,count + k,0LL);
+
+	int iters = criteria.iterations, it = 0, slow = 0, i, j;
+	float error = criteria.accuracy, e, e_best = FLT_MAX;
+	while(1) {
+		// Sample a batch, without the held-out rows
+		for(i = 0; i < batch; i++) {
+			do {
+				rows[i] = pick(gen);
+			} while(held_out && binary_search(held,held + h,rows[i]));
+		}
+		gather_rows<DataType>(data,rows,batch,d,ld,buf);
+		fill(b_label,b_label + batch,-1);
+		memset(size,0,k * sizeof(int));
+		memset(sum,0,static_cast<size_t>(k) * d * sizeof(float));
+		linear_assign<DataType>(buf,centers,b_label,size,sum,
+				d_type,d,batch,k,n_thread,verbose,nullptr,ws);
+
+		// Move the centers with the per-center learning rates
+		for(i = 0; i < k; i++) {
+			if(size[i] == 0) continue;
+			count[i] += size[i];
+			float * c = centers + static_cast<size_t>(i) * d;
+			float * s = sum + static_cast<size_t>(i) * d;
+			float rate = 1.0f / static_cast<float>(count[i]);
+			for(j = 0; j < d; j++)
+				c[j] += (s[j] - size[i] * c[j]) * rate;
+			// Spherical k-means: the centers stay on the unit sphere
+			if(d_type == DistanceType::COSINE)
+				normalize_rows(c,1,d);
+		}
+		it++;
+
+		// Check the held-out rows
+		if(it % MINIBATCH_CHECK_STEPS == 0) {
+			gather_rows<DataType>(data,held,h,d,ld,buf);
+			fill(b_label,b_label + h,-1);
+			memset(size,0,k * sizeof(int));
+			memset(sum,0,static_cast<size_t>(k) * d * sizeof(float));
+			linear_assign<DataType>(buf,centers,b_label,size,sum,
+					d_type,d,h,k,n_thread,verbose,nullptr,ws);
+			e = distortion<DataType>(buf,centers,b_label,d_type,d,h,k,false);
+			if(verbose)
+				cout << "Step " << it << " with held-out distortion = " << e << endl;
+			slow = e_best - e < error * e_best ? slow + 1 : 0;
+			if(e < e_best) e_best = e;
+			if(slow >= 3) break;
+		}
+		if(it >= iters) break;
+	}
+
+	// Assign all rows to the final centers
+	if(labels != nullptr) {
+		fill(labels,labels + N,-1);
+		memset(size,0,k * sizeof(int));
+		memset(sum,0,static_cast<size_t>(k) * d * sizeof(float));
+		linear_assign<DataType>(data,centers,labels,size,sum,
+				d_type,d,N,k,n_thread,verbose,nullptr,ws,ld);
+	}
+
+	if(verbose)
+		cout << "Finished clustering after " << it << " steps." << endl;
+}
+}
+
+#endif /* MINIBATCH_KMEANS_H_ */
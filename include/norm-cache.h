@@ -0,0 +1,236 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  norm-cache.h
+ *
+ *  Created on: 2014/10/27
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef NORM_CACHE_H_
+#define NORM_CACHE_H_
+
+#include <cmath>
+#include <cstddef>
+#include "utilities.h"
+#include "simd.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * Calculate the squared L2 norms of the rows
+ * @param data the rows
+ * @param N the number of rows
+ * @param d the dimensions
+ * @param out the N squared norms
+ * @param n_thread the number of threads
+ * @param ld the distance between two rows in elements, 0 for d
+ */
+template<typename DataType>
+inline void squared_norms(
+		DataType * data,
+		int N,
+		int d,
+		float * out,
+		int n_thread,
+		size_t ld = 0) {
+	if(n_thread < 1) n_thread = 1;
+	if(ld == 0) ld = d;
+	int i;
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel for private(i)
+#endif
+	for(i = 0; i < N; i++) {
+		DataType * x = data + static_cast<size_t>(i) * ld;
+		out[i] = static_cast<float>(inner_product<DataType>(x,x,d));
+	}
+}
+
+/**
+ * The squared L2 norms of the data and of the centers, and their roots.
+ * The norms of the data are computed once for a run and the norms of the
+ * centers are refreshed whenever the centers move, so that
+ * - the squared distances are expanded as ||x||^2 + ||c||^2 - 2x.c
+ *   without touching the vectors again for the norms,
+ * - (||x|| - ||c||)^2 <= ||x - c||^2 skips a center without any
+ *   dot product.
+ */
+class NormCache {
+private:
+	float * x_sq, * x_len;
+	float * c_sq, * c_len;
+	int n_data, n_centers;
+	int x_cap, c_cap; // the capacities, so that the norms are reallocated only to grow
+
+	NormCache(const NormCache&) = delete;
+	NormCache& operator= (const NormCache&) = delete;
+
+	/**
+	 * Keep the roots of the squared norms
+	 */
+	static void roots(
+			const float * sq,
+			float * len,
+			int n) {
+		for(int i = 0; i < n; i++)
+			len[i] = sqrt(sq[i]);
+	}
+public:
+	/**
+	 * The default constructor: an empty cache
+	 */
+	NormCache() {
+		x_sq = x_len = c_sq = c_len = nullptr;
+		n_data = n_centers = 0;
+		x_cap = c_cap = 0;
+	}
+
+	/**
+	 * The destructor
+	 */
+	virtual ~NormCache() {
+		clear();
+	}
+
+	/**
+	 * Free all norms
+	 */
+	void clear() {
+		::operator delete(x_sq);
+		::operator delete(x_len);
+		::operator delete(c_sq);
+		::operator delete(c_len);
+		x_sq = x_len = c_sq = c_len = nullptr;
+		n_data = n_centers = 0;
+		x_cap = c_cap = 0;
+	}
+
+	/**
+	 * Compute the norms of the data, once for a run
+	 * @param data the data
+	 * @param N the number of the data
+	 * @param d the dimensions
+	 * @param n_thread the number of threads
+	 * @param ld the distance between two rows in elements, 0 for d
+	 */
+	template<typename DataType>
+	void set_data(
+			DataType * data,
+			int N,
+			int d,
+			int n_thread,
+			size_t ld = 0) {
+		if(N > x_cap) {
+			::operator delete(x_sq);
+			::operator delete(x_len);
+			init_array<float>(x_sq,N);
+			init_array<float>(x_len,N);
+			x_cap = N;
+		}
+		n_data = N;
+		squared_norms<DataType>(data,N,d,x_sq,n_thread,ld);
+		roots(x_sq,x_len,N);
+	}
+
+	/**
+	 * Refresh the norms of the centers after they moved
+	 * @param centers the centers
+	 * @param k the number of centers
+	 * @param d the dimensions
+	 */
+	void set_centers(
+			float * centers,
+			int k,
+			int d) {
+		if(k > c_cap) {
+			::operator delete(c_sq);
+			::operator delete(c_len);
+			init_array<float>(c_sq,k);
+			init_array<float>(c_len,k);
+			c_cap = k;
+		}
+		n_centers = k;
+		squared_norms<float>(centers,k,d,c_sq,1);
+		roots(c_sq,c_len,k);
+	}
+
+	/**
+	 * Check whether the norms of the data were computed
+	 */
+	bool has_data() const {
+		return x_sq != nullptr;
+	}
+
+	/**
+	 * Check whether the norms of the centers were computed
+	 */
+	bool has_centers() const {
+		return c_sq != nullptr;
+	}
+
+	/**
+	 * Get the squared norms of the data, nullptr if there are none
+	 */
+	const float * data_sq() const {
+		return x_sq;
+	}
+
+	/**
+	 * Get the norms of the data, nullptr if there are none
+	 */
+	const float * data_len() const {
+		return x_len;
+	}
+
+	/**
+	 * Get the squared norms of the centers, nullptr if there are none
+	 */
+	const float * center_sq() const {
+		return c_sq;
+	}
+
+	/**
+	 * Get the norms of the centers, nullptr if there are none
+	 */
+	const float * center_len() const {
+		return c_len;
+	}
+
+	/**
+	 * A lower bound on the squared L2 distance between a data point
+	 * and a center, from their norms only
+	 * @param i the index of the data point
+	 * @param j the index of the center
+	 * @return (||x_i|| - ||c_j||)^2
+	 */
+	float lower_bound(
+			int i,
+			int j) const {
+		float t = x_len[i] - c_len[j];
+		return t * t;
+	}
+};
+}
+
+#endif /* NORM_CACHE_H_ */
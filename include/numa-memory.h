@@ -0,0 +1,401 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  numa-memory.h
+ *
+ *  Created on: 2014/10/31
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef NUMA_MEMORY_H_
+#define NUMA_MEMORY_H_
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <exception>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The backing pages of a large allocation
+ */
+enum class PageMode {
+	DEFAULT, // the heap
+	TRANSPARENT_HUGE, // anonymous pages, advised to be backed by transparent huge pages
+	EXPLICIT_HUGE // pages of the huge page pool (MAP_HUGETLB), transparent if the pool is empty
+};
+
+/**
+ * The size of a huge page
+ */
+const size_t HUGE_PAGE_SIZE = static_cast<size_t>(2) << 20;
+
+/**
+ * The header in front of a page allocation. It is as large as a cache line,
+ * so the memory given to the caller keeps a 64-byte alignment.
+ */
+typedef struct {
+	void * base; // the start of the allocation
+	size_t bytes; // the mapped bytes, with the header
+	PageMode mode; // the pages that were obtained
+	char pad[64 - sizeof(void *) - sizeof(size_t) - sizeof(PageMode)];
+} PageHeader;
+
+/**
+ * Get the number of NUMA nodes of the machine, 1 if it is unknown
+ */
+inline int numa_node_count() {
+	static int n_nodes = 0;
+	if(n_nodes > 0) return n_nodes;
+	int n = 1;
+#ifdef __linux__
+	// The online nodes are listed as ranges, e.g. "0-1" or "0,2-3"
+	ifstream in("/sys/devices/system/node/online");
+	string s;
+	if(in >> s) {
+		int v = 0;
+		for(size_t i = 0; i <= s.size(); i++) {
+			if(i < s.size() && s[i] >= '0' && s[i] <= '9') {
+				v = v * 10 + (s[i] - '0');
+			} else {
+				if(v + 1 > n) n = v + 1;
+				v = 0;
+			}
+		}
+	}
+#endif
+	n_nodes = n;
+	return n_nodes;
+}
+
+/**
+ * Get the NUMA node of the CPU that the calling thread runs on
+ */
+inline int current_numa_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned cpu = 0, node = 0;
+	if(syscall(SYS_getcpu,&cpu,&node,nullptr) == 0)
+		return static_cast<int>(node);
+#endif
+	return 0;
+}
+
+/**
+ * Prefer a NUMA node for the pages of a range that were not touched yet
+ * @param ptr the range, aligned to a page
+ * @param bytes the length of the range
+ * @param node the node
+ * @return true if the kernel took the policy, otherwise return false.
+ */
+inline bool prefer_numa_node(
+		void * ptr,
+		size_t bytes,
+		int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+	const int MPOL_PREFERRED_ = 1;
+	unsigned long mask[16] = {0};
+	if(node < 0 || node >= static_cast<int>(sizeof(mask) * 8)) return false;
+	mask[node / (sizeof(unsigned long) * 8)] = 1UL << (node % (sizeof(unsigned long) * 8));
+	return syscall(SYS_mbind,ptr,bytes,MPOL_PREFERRED_,mask,sizeof(mask) * 8,0) == 0;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Get the NUMA node of the page behind an address
+ * @param ptr the address, which must have been touched
+ * @return the node, -1 if it is unknown
+ */
+inline int numa_node_of(const void * ptr) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+	const unsigned long MPOL_F_NODE_ = 1, MPOL_F_ADDR_ = 2;
+	int node = -1;
+	if(syscall(SYS_get_mempolicy,&node,nullptr,0,ptr,MPOL_F_NODE_ | MPOL_F_ADDR_) == 0)
+		return node;
+#endif
+	return -1;
+}
+
+/**
+ * Allocate memory of a page mode. Without a node the pages are not
+ * touched, so they are placed on the node of the thread that writes
+ * them first. It falls back to the heap where the pages are not available.
+ * @param bytes the number of bytes
+ * @param mode the page mode
+ * @param node the NUMA node that the pages prefer, -1 for none. The policy
+ * is set before the header is written, so it covers the first page too.
+ * @return a 64-byte aligned block that is freed by page_free
+ */
+inline void * page_alloc(
+		size_t bytes,
+		PageMode mode,
+		int node = -1) {
+	size_t total = bytes + sizeof(PageHeader);
+	void * base = nullptr;
+	PageMode got = PageMode::DEFAULT;
+#ifdef __linux__
+	if(mode != PageMode::DEFAULT) {
+		size_t mapped = (total + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+		if(mode == PageMode::EXPLICIT_HUGE) {
+			base = mmap(nullptr,mapped,PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0);
+			if(base == MAP_FAILED) base = nullptr;
+			else got = PageMode::EXPLICIT_HUGE;
+		}
+#endif
+		if(base == nullptr) {
+			base = mmap(nullptr,mapped,PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+			if(base == MAP_FAILED) {
+				base = nullptr;
+			} else {
+				got = PageMode::TRANSPARENT_HUGE;
+#ifdef MADV_HUGEPAGE
+				madvise(base,mapped,MADV_HUGEPAGE);
+#endif
+			}
+		}
+		if(base != nullptr) {
+			total = mapped;
+			if(node >= 0)
+				prefer_numa_node(base,mapped,node);
+		}
+	}
+#endif
+	PageHeader * h = static_cast<PageHeader *>(base);
+	if(base == nullptr) {
+		base = ::operator new(total + sizeof(PageHeader));
+		got = PageMode::DEFAULT;
+		uintptr_t p = reinterpret_cast<uintptr_t>(base);
+		p = (p + sizeof(PageHeader) - 1) & ~static_cast<uintptr_t>(sizeof(PageHeader) - 1);
+		h = reinterpret_cast<PageHeader *>(p);
+	}
+	h->base = base;
+	h->bytes = total;
+	h->mode = got;
+	return h + 1;
+}
+
+/**
+ * Free a block of page_alloc
+ * @param ptr the block, could be nullptr
+ */
+inline void page_free(void * ptr) {
+	if(ptr == nullptr) return;
+	PageHeader * h = static_cast<PageHeader *>(ptr) - 1;
+#ifdef __linux__
+	if(h->mode != PageMode::DEFAULT) {
+		munmap(h->base,h->bytes);
+		return;
+	}
+#endif
+	::operator delete(h->base);
+}
+
+/**
+ * Get the pages that backed a block of page_alloc
+ * @param ptr the block
+ */
+inline PageMode page_mode(const void * ptr) {
+	return (static_cast<const PageHeader *>(ptr) - 1)->mode;
+}
+
+/**
+ * Zero an array in the static blocks of the k-means loops: thread i0
+ * writes rows [p * i0, p * (i0 + 1)) with p = N / n_thread and the last
+ * thread the rest, so each page is placed on the node of the thread
+ * that will read it.
+ * @param arr the array
+ * @param N the number of rows
+ * @param row the number of elements of a row
+ * @param n_thread the number of threads
+ */
+template<typename DataType>
+inline void first_touch(
+		DataType * arr,
+		size_t N,
+		size_t row,
+		int n_thread) {
+	if(n_thread < 1) n_thread = 1;
+	size_t p = N / n_thread;
+	int i0;
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel for schedule(static) private(i0)
+#endif
+	for(i0 = 0; i0 < n_thread; i0++) {
+		size_t start = p * i0;
+		size_t end = start + p;
+		if(end > N || i0 == n_thread - 1) end = N;
+		if(end > start)
+			memset(static_cast<void *>(arr + start * row),0,(end - start) * row * sizeof(DataType));
+	}
+}
+
+/**
+ * Allocate an array of N rows that is placed by first_touch
+ * @param arr the array, freed by page_free
+ * @param N the number of rows
+ * @param row the number of elements of a row
+ * @param n_thread the number of threads of the loops over the rows
+ * @param mode the page mode
+ * @return true if the array was allocated successfully, otherwise return false.
+ */
+template<typename DataType>
+inline bool numa_array(
+		DataType *& arr,
+		size_t N,
+		size_t row,
+		int n_thread,
+		PageMode mode = PageMode::DEFAULT) {
+	try {
+		arr = static_cast<DataType *>(page_alloc((N > 0 ? N : 1) * row * sizeof(DataType),mode));
+	} catch(exception& e) {
+		cerr << "Got an exception: " << e.what() << endl;
+		arr = nullptr;
+		return false;
+	}
+	first_touch<DataType>(arr,N,row,n_thread);
+	return true;
+}
+
+/**
+ * A copy of the centers on each NUMA node. The centers are read by all
+ * threads in every assignment, so each thread reads the copy of its node
+ * instead of pulling the lines over the interconnect.
+ * On a single node there are no copies and the centers are used in place.
+ */
+class CenterReplicas {
+private:
+	float ** copies;
+	int n_copies;
+	size_t n_floats;
+
+	CenterReplicas(const CenterReplicas&) = delete;
+	CenterReplicas& operator= (const CenterReplicas&) = delete;
+public:
+	/**
+	 * The default constructor: no copies
+	 */
+	CenterReplicas() {
+		copies = nullptr;
+		n_copies = 0;
+		n_floats = 0;
+	}
+
+	/**
+	 * The destructor
+	 */
+	virtual ~CenterReplicas() {
+		clear();
+	}
+
+	/**
+	 * Free the copies
+	 */
+	void clear() {
+		for(int i = 0; i < n_copies; i++)
+			page_free(copies[i]);
+		::operator delete(copies);
+		copies = nullptr;
+		n_copies = 0;
+		n_floats = 0;
+	}
+
+	/**
+	 * Allocate a copy per node, each preferring its node
+	 * @param n the number of floats of the centers
+	 * @param mode the page mode
+	 * @param nodes the number of copies, numa_node_count() by default
+	 */
+	void resize(
+			size_t n,
+			PageMode mode,
+			int nodes = 0) {
+		if(nodes <= 0) nodes = numa_node_count();
+		if(nodes == n_copies && n <= n_floats) return;
+		clear();
+		if(nodes <= 1) return;
+		copies = (float **)::operator new(nodes * sizeof(float *));
+		for(int i = 0; i < nodes; i++) {
+			copies[i] = static_cast<float *>(page_alloc(n * sizeof(float),
+					mode == PageMode::DEFAULT ? PageMode::TRANSPARENT_HUGE : mode,i));
+			memset(static_cast<void *>(copies[i]),0,n * sizeof(float));
+		}
+		n_copies = nodes;
+		n_floats = n;
+	}
+
+	/**
+	 * Copy the centers to every node after they moved
+	 * @param centers the centers
+	 * @param n the number of floats, at most the size of resize
+	 */
+	void sync(
+			const float * centers,
+			size_t n) {
+		for(int i = 0; i < n_copies; i++)
+			memcpy(copies[i],centers,n * sizeof(float));
+	}
+
+	/**
+	 * Get the copy of the node of the calling thread
+	 * @param centers the centers, which are used when there are no copies
+	 */
+	float * local(float * centers) const {
+		if(n_copies <= 1) return centers;
+		int node = current_numa_node();
+		return node < n_copies ? copies[node] : centers;
+	}
+
+	/**
+	 * Get a copy
+	 * @param i the index of the node
+	 */
+	float * copy(int i) const {
+		return copies[i];
+	}
+
+	/**
+	 * Get the number of copies, 0 on a single node
+	 */
+	int size() const {
+		return n_copies;
+	}
+};
+}
+
+#endif /* NUMA_MEMORY_H_ */
@@ -0,0 +1,182 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  simd.h
+ *
+ *  Created on: 2014/10/20
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <cstdint>
+
+namespace SimpleCluster {
+
+/**
+ * Instruction sets that the distance kernels can be dispatched to
+ */
+enum class SimdLevel {
+	SCALAR,
+	SSE2,
+	AVX2,
+	AVX512
+};
+
+/**
+ * The number of dimensions that have fixed-dimension kernels
+ */
+const int SIMD_FIXED_DIMS = 5;
+
+/**
+ * The number of centers in a transposed center tile: one AVX-512 register
+ */
+const int SIMD_CENTER_TILE = 16;
+
+/**
+ * The alignment in bytes of the rows that the fixed-dimension kernels
+ * load by aligned loads: the width of an AVX-512 register
+ */
+const int SIMD_ALIGN = 64;
+
+/**
+ * A fixed-dimension kernel, with the signature of DistanceFunction<float,float>
+ */
+typedef double (*SimdFixedKernel)(float *, float *, int);
+
+SimdLevel simd_level();
+SimdLevel simd_detect();
+SimdLevel simd_set_level(SimdLevel);
+const char * simd_level_name(SimdLevel);
+
+float simd_l2_square_f32(
+		const float *,
+		const float *,
+		int);
+float simd_l1_f32(
+		const float *,
+		const float *,
+		int);
+float simd_dot_f32(
+		const float *,
+		const float *,
+		int);
+void simd_dot_tile_f32(
+		const float *,
+		int,
+		const float *,
+		int,
+		int,
+		float *,
+		int);
+int simd_hamming_u8(
+		const unsigned char *,
+		const unsigned char *,
+		int);
+int simd_l2_square_u8(
+		const unsigned char *,
+		const unsigned char *,
+		int);
+int simd_l1_u8(
+		const unsigned char *,
+		const unsigned char *,
+		int);
+float simd_l2_square_u8f32(
+		const unsigned char *,
+		const float *,
+		int);
+float simd_l1_u8f32(
+		const unsigned char *,
+		const float *,
+		int);
+float simd_l2_square_f16f32(
+		const uint16_t *,
+		const float *,
+		int);
+float simd_l1_f16f32(
+		const uint16_t *,
+		const float *,
+		int);
+float simd_l2_square_f16(
+		const uint16_t *,
+		const uint16_t *,
+		int);
+float simd_l1_f16(
+		const uint16_t *,
+		const uint16_t *,
+		int);
+void simd_f16_to_f32(
+		const uint16_t *,
+		float *,
+		int);
+float simd_l2_square_bf16f32(
+		const uint16_t *,
+		const float *,
+		int);
+float simd_l1_bf16f32(
+		const uint16_t *,
+		const float *,
+		int);
+float simd_l2_square_bf16(
+		const uint16_t *,
+		const uint16_t *,
+		int);
+float simd_l1_bf16(
+		const uint16_t *,
+		const uint16_t *,
+		int);
+void simd_bf16_to_f32(
+		const uint16_t *,
+		float *,
+		int);
+bool simd_has_fixed(int);
+SimdFixedKernel simd_l2_square_f32_fixed(
+		int,
+		bool);
+SimdFixedKernel simd_l1_f32_fixed(
+		int,
+		bool);
+float simd_l2_square_f32_bounded(
+		const float *,
+		const float *,
+		int,
+		float);
+float simd_l1_f32_bounded(
+		const float *,
+		const float *,
+		int,
+		float);
+void simd_l2_square_tile_f32(
+		const float *,
+		const float *,
+		int,
+		int,
+		int,
+		float *,
+		int *);
+void simd_l1_tile_f32(
+		const float *,
+		const float *,
+		int,
+		int,
+		int,
+		float *,
+		int *);
+}
+
+#endif /* SIMD_H_ */
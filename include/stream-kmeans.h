@@ -0,0 +1,620 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  stream-kmeans.h
+ *
+ *  Created on: 2014/11/02
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef STREAM_KMEANS_H_
+#define STREAM_KMEANS_H_
+
+#include <iostream>
+#include <string>
+#include <functional>
+#include <thread>
+#include <random>
+#include <cstdio>
+#include <cstdint>
+#include <cfloat>
+#include "utilities.h"
+#include "k-means.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The default number of rows in a chunk of the streaming k-means
+ */
+const int STREAM_CHUNK_ROWS = 65536;
+
+/**
+ * The rows that are sampled per center for the k-means++ seeding of
+ * the streaming k-means
+ */
+const int STREAM_SAMPLE_PER_CENTER = 16;
+
+/**
+ * A source of the rows of a dataset that does not fit in the memory.
+ * The rows are read in chunks, in order, once per pass; read is called
+ * from a background thread while the previous chunk is clustered.
+ */
+template<typename DataType>
+class ChunkReader {
+public:
+	virtual ~ChunkReader() {}
+
+	/**
+	 * Get the number of rows
+	 */
+	virtual size_t rows() const = 0;
+
+	/**
+	 * Get the dimensions of the rows
+	 */
+	virtual int dims() const = 0;
+
+	/**
+	 * Read a chunk of rows
+	 * @param buf the rows, one after another
+	 * @param first the index of the first row, 0 at the start of a pass
+	 * @param n the number of rows to be read
+	 * @return the number of rows that were read, negative on an error
+	 */
+	virtual int read(
+			DataType * buf,
+			size_t first,
+			int n) = 0;
+};
+
+/**
+ * The callback of a CallbackChunkReader
+ * @see ChunkReader::read
+ */
+template<typename DataType>
+using ChunkCallback = function<int(DataType *, size_t, int)>;
+
+/**
+ * The chunks of a callback, e.g. a generator or a database cursor
+ */
+template<typename DataType>
+class CallbackChunkReader : public ChunkReader<DataType> {
+private:
+	ChunkCallback<DataType> callback;
+	size_t n_rows;
+	int n_dims;
+public:
+	/**
+	 * @param cb the callback
+	 * @param N the number of rows
+	 * @param d the dimensions
+	 */
+	CallbackChunkReader(
+			ChunkCallback<DataType> cb,
+			size_t N,
+			int d) : callback(cb), n_rows(N), n_dims(d) {}
+
+	virtual ~CallbackChunkReader() {}
+
+	size_t rows() const {
+		return n_rows;
+	}
+
+	int dims() const {
+		return n_dims;
+	}
+
+	int read(
+			DataType * buf,
+			size_t first,
+			int n) {
+		return callback(buf,first,n);
+	}
+};
+
+/**
+ * The chunks of a .fvecs, .ivecs or .bvecs file, read sequentially
+ * with the buffered stdio, so only one chunk is in the memory
+ */
+template<typename DataType>
+class VecsChunkReader : public ChunkReader<DataType> {
+private:
+	FILE * f;
+	size_t n_rows, row_bytes, next; // next is the row at the file position
+	int n_dims;
+
+	VecsChunkReader(const VecsChunkReader<DataType>&) = delete;
+	VecsChunkReader& operator= (const VecsChunkReader<DataType>&) = delete;
+public:
+	/**
+	 * The default constructor: no file
+	 */
+	VecsChunkReader() {
+		f = nullptr;
+		n_rows = row_bytes = next = 0;
+		n_dims = 0;
+	}
+
+	/**
+	 * Open a file
+	 * @param path the path of the file
+	 */
+	VecsChunkReader(const string& path) : VecsChunkReader() {
+		open(path);
+	}
+
+	virtual ~VecsChunkReader() {
+		close();
+	}
+
+	/**
+	 * Open a file
+	 * @param path the path of the file
+	 * @return true if the file was opened successfully, otherwise return false.
+	 */
+	bool open(const string& path) {
+		close();
+		f = fopen(path.c_str(),"rb");
+		if(f == nullptr) {
+			cerr << "Cannot open " << path << endl;
+			return false;
+		}
+		int32_t d = 0;
+		if(fread(&d,sizeof(int32_t),1,f) != 1 || d <= 0) {
+			cerr << "Wrong format of " << path << endl;
+			close();
+			return false;
+		}
+		row_bytes = sizeof(int32_t) + static_cast<size_t>(d) * sizeof(DataType);
+		fseeko(f,0,SEEK_END);
+		size_t bytes = static_cast<size_t>(ftello(f));
+		if(bytes % row_bytes != 0) {
+			cerr << "Wrong format of " << path << endl;
+			close();
+			return false;
+		}
+		fseeko(f,0,SEEK_SET);
+		n_dims = d;
+		n_rows = bytes / row_bytes;
+		next = 0;
+		return true;
+	}
+
+	/**
+	 * Close the file
+	 */
+	void close() {
+		if(f != nullptr)
+			fclose(f);
+		f = nullptr;
+		n_rows = row_bytes = next = 0;
+		n_dims = 0;
+	}
+
+	size_t rows() const {
+		return n_rows;
+	}
+
+	int dims() const {
+		return n_dims;
+	}
+
+	int read(
+			DataType * buf,
+			size_t first,
+			int n) {
+		if(f == nullptr) return -1;
+		if(first != next) {
+			if(fseeko(f,static_cast<long long>(first * row_bytes),SEEK_SET) != 0)
+				return -1;
+			next = first;
+		}
+		int32_t d;
+		int i;
+		for(i = 0; i < n && next < n_rows; i++, next++) {
+			if(fread(&d,sizeof(int32_t),1,f) != 1 || d != n_dims ||
+					fread(buf + static_cast<size_t>(i) * n_dims,sizeof(DataType),
+							n_dims,f) != static_cast<size_t>(n_dims))
+				return -1;
+		}
+		return i;
+	}
+};
+
+/**
+ * The labels of a streaming k-means, written in the .ivecs format
+ * (one row of one label per point) to a memory-mapped file
+ */
+class LabelFile {
+private:
+	int32_t * map;
+	size_t n_rows;
+#ifdef _WIN32
+	FILE * f;
+#endif
+
+	LabelFile(const LabelFile&) = delete;
+	LabelFile& operator= (const LabelFile&) = delete;
+public:
+	LabelFile() {
+		map = nullptr;
+		n_rows = 0;
+#ifdef _WIN32
+		f = nullptr;
+#endif
+	}
+
+	virtual ~LabelFile() {
+		close();
+	}
+
+	/**
+	 * Create the file
+	 * @param path the path of the file
+	 * @param N the number of labels
+	 * @return true if the file was created successfully, otherwise return false.
+	 */
+	bool open(
+			const string& path,
+			size_t N) {
+		close();
+		size_t bytes = N * 2 * sizeof(int32_t);
+#ifndef _WIN32
+		int fd = ::open(path.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+		if(fd < 0 || ftruncate(fd,static_cast<off_t>(bytes)) != 0) {
+			cerr << "Cannot create " << path << endl;
+			if(fd >= 0) ::close(fd);
+			return false;
+		}
+		void * p = N > 0 ? mmap(nullptr,bytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0) : nullptr;
+		::close(fd);
+		if(p == MAP_FAILED) {
+			cerr << "Cannot map " << path << endl;
+			return false;
+		}
+		map = static_cast<int32_t *>(p);
+#else
+		f = fopen(path.c_str(),"wb");
+		if(f == nullptr) {
+			cerr << "Cannot create " << path << endl;
+			return false;
+		}
+#endif
+		n_rows = N;
+		return true;
+	}
+
+	/**
+	 * Write the labels of a chunk
+	 * @param first the index of the first row of the chunk
+	 * @param labels the labels
+	 * @param n the number of labels
+	 */
+	void write(
+			size_t first,
+			const int * labels,
+			int n) {
+#ifndef _WIN32
+		if(map == nullptr) return;
+		int32_t * p = map + 2 * first;
+		for(int i = 0; i < n; i++) {
+			*p++ = 1;
+			*p++ = labels[i];
+		}
+#else
+		if(f == nullptr) return;
+		fseek(f,static_cast<long>(first * 2 * sizeof(int32_t)),SEEK_SET);
+		for(int i = 0; i < n; i++) {
+			int32_t row[2] = {1,labels[i]};
+			fwrite(row,sizeof(int32_t),2,f);
+		}
+#endif
+	}
+
+	/**
+	 * Flush and close the file
+	 */
+	void close() {
+#ifndef _WIN32
+		if(map != nullptr)
+			munmap(map,n_rows * 2 * sizeof(int32_t));
+#else
+		if(f != nullptr)
+			fclose(f);
+		f = nullptr;
+#endif
+		map = nullptr;
+		n_rows = 0;
+	}
+};
+
+/**
+ * Draw a uniform sample of the rows in one pass (reservoir sampling)
+ * @param source the rows
+ * @param sample the m sampled rows
+ * @param m the size of the sample, at most the number of rows
+ * @param buf a buffer of chunk rows
+ * @param chunk the number of rows of buf
+ * @return true if the rows were read successfully, otherwise return false.
+ */
+template<typename DataType>
+inline bool sample_rows(
+		ChunkReader<DataType>& source,
+		DataType * sample,
+		int m,
+		DataType * buf,
+		int chunk) {
+	random_device rd;
+	mt19937_64 gen(rd());
+	size_t N = source.rows(), first = 0, row_bytes = source.dims() * sizeof(DataType);
+	int d = source.dims();
+	while(first < N) {
+		int n = source.read(buf,first,static_cast<int>(std::min<size_t>(chunk,N - first)));
+		if(n <= 0) return false;
+		for(int i = 0; i < n; i++) {
+			size_t t = first + i, slot = t;
+			if(t >= static_cast<size_t>(m)) {
+				uniform_int_distribution<size_t> dis(0,t);
+				slot = dis(gen);
+			}
+			if(slot < static_cast<size_t>(m))
+				memcpy(sample + slot * d,buf + static_cast<size_t>(i) * d,row_bytes);
+		}
+		first += n;
+	}
+	return true;
+}
+
+/**
+ * The k-means of a dataset that does not fit in the memory: every iteration
+ * is one sequential pass over the chunks of the source, and only the centers,
+ * the vector sums and the sizes of the clusters stay in the memory with two
+ * chunks, one that is clustered by linear_assign while the next one is read
+ * by a background thread. The centers move by update_center after each pass.
+ * The seeds are drawn from a sample of the rows that is taken in one pass:
+ * k rows for RANDOM_SEEDS and STREAM_SAMPLE_PER_CENTER * k rows for k-means++
+ * and k-means||.
+ * An empty cluster is moved onto the row of the last chunk that is the farthest
+ * from its center, for both SINGLETON and SINGLETON_2.
+ * @param source the rows
+ * @param centers the k centers
+ * @param seeds the seeds, allocated if it is nullptr
+ * @param type the type of seeding method
+ * @param criteria the criteria
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
+ * @param ea the action on the empty clusters
+ * @param k the number of clusters
+ * @param chunk the number of rows in a chunk
+ * @param n_thread the number of threads
+ * @param verbose for debugging
+ * @param label_path the file of the labels of the last pass in the .ivecs format, none if it is empty
+ * @param ws the workspace of the scratch buffers, could be nullptr
+ * @return true if the rows were read successfully, otherwise return false.
+ */
+template<typename DataType>
+inline bool stream_kmeans(
+		ChunkReader<DataType>& source,
+		float *& centers,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int k,
+		int chunk,
+		int n_thread,
+		bool verbose,
+		const string& label_path = "",
+		KmeansWorkspace * ws = nullptr) {
+	size_t N = source.rows();
+	int d = source.dims();
+	if(N == 0 || d <= 0 || k <= 0) return false;
+	if(packed_hamming<DataType>(d_type)) {
+		cerr << "Packed binary data are clustered by kmajority" << endl;
+		return false;
+	}
+	if(chunk <= 0) chunk = STREAM_CHUNK_ROWS;
+	if(static_cast<size_t>(chunk) > N) chunk = static_cast<int>(N);
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+
+	DataType * buf[2] = {nullptr,nullptr}, * sample = nullptr;
+	int * labels = nullptr;
+	init_array<DataType>(buf[0],static_cast<size_t>(chunk) * d);
+	init_array<DataType>(buf[1],static_cast<size_t>(chunk) * d);
+	init_array<int>(labels,chunk);
+	bool ok = true;
+	if(seeds == nullptr)
+		init_array<float>(seeds,static_cast<size_t>(k) * d);
+
+	// Seeding from a sample
+	if(type != KmeansType::USER_SEEDS || N < static_cast<size_t>(k)) {
+		size_t m = type == KmeansType::KMEANS_PLUS_SEEDS || type == KmeansType::KMEANS_PAR_SEEDS ?
+				static_cast<size_t>(k) * STREAM_SAMPLE_PER_CENTER : k;
+		if(m > N) m = N;
+		init_array<DataType>(sample,m * d);
+		ok = sample_rows<DataType>(source,sample,static_cast<int>(m),buf[0],chunk);
+		if(ok) {
+			if(N < static_cast<size_t>(k)) {
+				// The centers without a point are infinite
+				for(int i = 0; i < k; i++) {
+					size_t b = static_cast<size_t>(i) * d;
+					if(static_cast<size_t>(i) < N)
+						for(int j = 0; j < d; j++)
+							seeds[b + j] = static_cast<float>(sample[b + j]);
+					else
+						fill(seeds + b,seeds + b + d,FLT_MAX);
+				}
+			} else if(type == KmeansType::KMEANS_PLUS_SEEDS) {
+				kmeans_pp_seeds<DataType>(sample,seeds,d_type,d,static_cast<int>(m),k,
+						n_thread,verbose);
+			} else if(type == KmeansType::KMEANS_PAR_SEEDS) {
+				kmeans_par_seeds<DataType>(sample,seeds,d_type,d,static_cast<int>(m),k,
+						n_thread,verbose);
+			} else {
+				for(size_t i = 0; i < static_cast<size_t>(k) * d; i++)
+					seeds[i] = static_cast<float>(sample[i]);
+			}
+		}
+		::operator delete(sample);
+	}
+	if(verbose)
+		cout << "Finished seeding" << endl;
+
+	LabelFile out;
+	if(ok && !label_path.empty())
+		ok = out.open(label_path,N);
+
+	// Only the centers, the sums and the sizes are kept
+	int * size = ws->size.get<int>(k);
+	float * sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	float * moved = ws->moved.get<float>(k);
+	NormCache * cache = d_type == DistanceType::NORM_L2 ? &ws->norms : nullptr;
+	copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+	if(d_type == DistanceType::COSINE)
+		normalize_rows(centers,k,d);
+	if(cache != nullptr)
+		cache->set_centers(centers,k,d);
+
+	int iters = criteria.iterations, it = 0, count = 0, i, j, fst;
+	float error = criteria.accuracy, e = error, e_prev, dfst;
+	while(ok && N >= static_cast<size_t>(k)) {
+		fill(size,size + k,0);
+		fill(sum,sum + static_cast<size_t>(k) * d,0.0f);
+
+		// One pass: chunk c is clustered while chunk 1 - c is read
+		size_t first = 0;
+		int c = 0, n = source.read(buf[0],0,chunk), n_next = 0;
+		if(n <= 0) ok = false;
+		while(ok && n > 0) {
+			size_t next = first + n;
+			int want = static_cast<int>(std::min<size_t>(chunk,N - next));
+			n_next = 0;
+			thread reader;
+			if(want > 0)
+				reader = thread([&]() {
+					n_next = source.read(buf[1 - c],next,want);
+				});
+			for(i = 0; i < n; i++) labels[i] = -1;
+			if(cache != nullptr)
+				cache->set_data<DataType>(buf[c],n,d,n_thread);
+			linear_assign<DataType>(buf[c],centers,labels,size,sum,
+					d_type,d,n,k,n_thread,verbose,cache,ws);
+			out.write(first,labels,n);
+			if(reader.joinable()) reader.join();
+			if(want > 0 && n_next <= 0) {
+				ok = false;
+				break;
+			}
+			first = next;
+			if(want <= 0) break;
+			c = 1 - c;
+			n = n_next;
+		}
+		if(!ok) break;
+
+		// Move the empty clusters onto the rows of the last chunk
+		if(ea != EmptyActs::NONE) {
+			for(i = 0; i < k; i++) {
+				if(size[i] > 0) continue;
+				find_lonely<DataType>(buf[c],centers,labels,d_type,
+						dfst,fst,n,k,d,verbose);
+				if(size[labels[fst]] <= 1) continue;
+				DataType * x = buf[c] + static_cast<size_t>(fst) * d;
+				float * s = sum + static_cast<size_t>(labels[fst]) * d;
+				size_t b = static_cast<size_t>(i) * d;
+				for(j = 0; j < d; j++) {
+					centers[b + j] = sum[b + j] = static_cast<float>(x[j]);
+					s[j] -= centers[b + j];
+				}
+				size[i] = 1;
+				size[labels[fst]]--;
+				labels[fst] = i;
+			}
+		}
+
+		if(verbose)
+			print_spec(it,size,k);
+
+		e_prev = e;
+		e = 0.0;
+		update_center(sum,size,centers,moved,d_type,k,d,n_thread,cache,ws);
+		for(i = 0; i < k; i++)
+			e += moved[i] * moved[i];
+		e = sqrt(e);
+		count += (fabs(e-e_prev) < error? 1 : 0);
+		if(verbose)
+			cout << "Iterator " << it << "-th with error = " << e << endl;
+		it++;
+		if(it >= iters || fabs(e-e_prev) < error || count >= 10) break;
+	}
+	if(ok && N < static_cast<size_t>(k)) {
+		copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+		for(i = 0; i < static_cast<int>(N); i++)
+			labels[i] = i;
+		out.write(0,labels,static_cast<int>(N));
+	}
+	out.close();
+
+	::operator delete(buf[0]);
+	::operator delete(buf[1]);
+	::operator delete(labels);
+	if(verbose)
+		cout << "Finished clustering with error is " <<
+		e << " after " << it << " iterations." << endl;
+	return ok;
+}
+
+/**
+ * The streaming k-means of a .fvecs, .ivecs or .bvecs file
+ * @param path the path of the file
+ * @see stream_kmeans
+ */
+template<typename DataType>
+inline bool stream_kmeans(
+		const string& path,
+		float *& centers,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int k,
+		int chunk,
+		int n_thread,
+		bool verbose,
+		const string& label_path = "",
+		KmeansWorkspace * ws = nullptr) {
+	VecsChunkReader<DataType> source;
+	if(!source.open(path)) return false;
+	return stream_kmeans<DataType>(source,centers,seeds,type,criteria,d_type,ea,
+			k,chunk,n_thread,verbose,label_path,ws);
+}
+}
+
+#endif /* STREAM_KMEANS_H_ */
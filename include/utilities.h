@@ -26,10 +26,15 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <exception>
 #include <cmath>
 #include <cstring>
 #include <cstdio>
+#include <cstdint>
+#include <type_traits>
+#include "simd.h"
+#include "half-float.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -51,7 +56,9 @@ namespace SimpleCluster {
 enum class DistanceType {
 	NORM_L1,
 	NORM_L2,
-	HAMMING
+	HAMMING,
+	COSINE, // 1 - the cosine similarity
+	INNER_PRODUCT // the negative inner product, so that smaller is closer
 };
 
 void check_env();
@@ -105,6 +112,71 @@ inline double distance_l1(
 	return dis;
 }
 
+/**
+ * The float version of the L1-metric distance,
+ * dispatched to the best SIMD kernel of the CPU
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<>
+inline double distance_l1<float>(
+		float * x,
+		float * y,
+		int d) {
+	return simd_l1_f32(x,y,d);
+}
+
+template<>
+inline double distance_l1<float,float>(
+		float * x,
+		float * y,
+		int d) {
+	return simd_l1_f32(x,y,d);
+}
+
+/**
+ * The byte versions of the L1-metric distance: byte-byte distances
+ * are summed exactly in integers, byte-float distances convert
+ * the bytes in registers
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<>
+inline double distance_l1<unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return simd_l1_u8(x,y,d);
+}
+
+template<>
+inline double distance_l1<unsigned char,unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return simd_l1_u8(x,y,d);
+}
+
+template<>
+inline double distance_l1<unsigned char,float>(
+		unsigned char * x,
+		float * y,
+		int d) {
+	return simd_l1_u8f32(x,y,d);
+}
+
+template<>
+inline double distance_l1<float,unsigned char>(
+		float * x,
+		unsigned char * y,
+		int d) {
+	return simd_l1_u8f32(y,x,d);
+}
+
 /**
  * Calculate the L1-metric distance between two vectors with multi-threading
  * @param x
@@ -229,6 +301,119 @@ inline double distance_l2_square(
 	return dis;
 }
 
+/**
+ * The float versions of the L2-metric distances,
+ * dispatched to the best SIMD kernel of the CPU
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<>
+inline double distance_l2_square<float>(
+		float * x,
+		float * y,
+		int d) {
+	return simd_l2_square_f32(x,y,d);
+}
+
+template<>
+inline double distance_l2_square<float,float>(
+		float * x,
+		float * y,
+		int d) {
+	return simd_l2_square_f32(x,y,d);
+}
+
+template<>
+inline double distance_l2<float>(
+		float * x,
+		float * y,
+		int d) {
+	return sqrt(simd_l2_square_f32(x,y,d));
+}
+
+template<>
+inline double distance_l2<float,float>(
+		float * x,
+		float * y,
+		int d) {
+	return sqrt(simd_l2_square_f32(x,y,d));
+}
+
+/**
+ * The byte versions of the L2-metric distances: byte-byte distances
+ * are summed exactly in integers, byte-float distances convert
+ * the bytes in registers
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<>
+inline double distance_l2_square<unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return simd_l2_square_u8(x,y,d);
+}
+
+template<>
+inline double distance_l2_square<unsigned char,unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return simd_l2_square_u8(x,y,d);
+}
+
+template<>
+inline double distance_l2_square<unsigned char,float>(
+		unsigned char * x,
+		float * y,
+		int d) {
+	return simd_l2_square_u8f32(x,y,d);
+}
+
+template<>
+inline double distance_l2_square<float,unsigned char>(
+		float * x,
+		unsigned char * y,
+		int d) {
+	return simd_l2_square_u8f32(y,x,d);
+}
+
+template<>
+inline double distance_l2<unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return sqrt(static_cast<double>(simd_l2_square_u8(x,y,d)));
+}
+
+template<>
+inline double distance_l2<unsigned char,unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return sqrt(static_cast<double>(simd_l2_square_u8(x,y,d)));
+}
+
+template<>
+inline double distance_l2<unsigned char,float>(
+		unsigned char * x,
+		float * y,
+		int d) {
+	return sqrt(simd_l2_square_u8f32(x,y,d));
+}
+
+template<>
+inline double distance_l2<float,unsigned char>(
+		float * x,
+		unsigned char * y,
+		int d) {
+	return sqrt(simd_l2_square_u8f32(y,x,d));
+}
+
 /**
  * Calculate the L2-metric distance between two vectors with multi-threading
  * @param x
@@ -299,6 +484,678 @@ inline double distance_l2_square_thread(
 	return dis;
 }
 
+/**
+ * The half precision versions of the L1 and squared L2 distances.
+ * The components are converted to floats in registers,
+ * so the data can be stored in half the memory of floats.
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<>
+inline double distance_l2_square<half_t>(
+		half_t * x,
+		half_t * y,
+		int d) {
+	return simd_l2_square_f16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l2_square<half_t,half_t>(
+		half_t * x,
+		half_t * y,
+		int d) {
+	return simd_l2_square_f16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l2_square<half_t,float>(
+		half_t * x,
+		float * y,
+		int d) {
+	return simd_l2_square_f16f32(reinterpret_cast<const uint16_t *>(x),y,d);
+}
+
+template<>
+inline double distance_l2_square<float,half_t>(
+		float * x,
+		half_t * y,
+		int d) {
+	return simd_l2_square_f16f32(reinterpret_cast<const uint16_t *>(y),x,d);
+}
+
+template<>
+inline double distance_l1<half_t>(
+		half_t * x,
+		half_t * y,
+		int d) {
+	return simd_l1_f16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l1<half_t,half_t>(
+		half_t * x,
+		half_t * y,
+		int d) {
+	return simd_l1_f16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l1<half_t,float>(
+		half_t * x,
+		float * y,
+		int d) {
+	return simd_l1_f16f32(reinterpret_cast<const uint16_t *>(x),y,d);
+}
+
+template<>
+inline double distance_l1<float,half_t>(
+		float * x,
+		half_t * y,
+		int d) {
+	return simd_l1_f16f32(reinterpret_cast<const uint16_t *>(y),x,d);
+}
+
+/**
+ * The bfloat16 versions of the L1 and squared L2 distances.
+ * The components are converted to floats in registers,
+ * so the data can be stored in half the memory of floats.
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<>
+inline double distance_l2_square<bfloat16_t>(
+		bfloat16_t * x,
+		bfloat16_t * y,
+		int d) {
+	return simd_l2_square_bf16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l2_square<bfloat16_t,bfloat16_t>(
+		bfloat16_t * x,
+		bfloat16_t * y,
+		int d) {
+	return simd_l2_square_bf16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l2_square<bfloat16_t,float>(
+		bfloat16_t * x,
+		float * y,
+		int d) {
+	return simd_l2_square_bf16f32(reinterpret_cast<const uint16_t *>(x),y,d);
+}
+
+template<>
+inline double distance_l2_square<float,bfloat16_t>(
+		float * x,
+		bfloat16_t * y,
+		int d) {
+	return simd_l2_square_bf16f32(reinterpret_cast<const uint16_t *>(y),x,d);
+}
+
+template<>
+inline double distance_l1<bfloat16_t>(
+		bfloat16_t * x,
+		bfloat16_t * y,
+		int d) {
+	return simd_l1_bf16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l1<bfloat16_t,bfloat16_t>(
+		bfloat16_t * x,
+		bfloat16_t * y,
+		int d) {
+	return simd_l1_bf16(reinterpret_cast<const uint16_t *>(x),
+			reinterpret_cast<const uint16_t *>(y),d);
+}
+
+template<>
+inline double distance_l1<bfloat16_t,float>(
+		bfloat16_t * x,
+		float * y,
+		int d) {
+	return simd_l1_bf16f32(reinterpret_cast<const uint16_t *>(x),y,d);
+}
+
+template<>
+inline double distance_l1<float,bfloat16_t>(
+		float * x,
+		bfloat16_t * y,
+		int d) {
+	return simd_l1_bf16f32(reinterpret_cast<const uint16_t *>(y),x,d);
+}
+
+/**
+ * Count the set bits of a 64-bit word
+ * @param v the word
+ * @return the number of set bits
+ */
+inline int popcount64(uint64_t v) {
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * The Hamming distance between two integer components: the different bits
+ */
+template<typename DataType1, typename DataType2>
+inline int hamming_element(
+		DataType1 a,
+		DataType2 b,
+		true_type) {
+	uint64_t ua = static_cast<typename make_unsigned<DataType1>::type>(a);
+	uint64_t ub = static_cast<typename make_unsigned<DataType2>::type>(b);
+	return popcount64(ua ^ ub);
+}
+
+/**
+ * The Hamming distance between two real components: 0 if they are equal, 1 otherwise
+ */
+template<typename DataType1, typename DataType2>
+inline int hamming_element(
+		DataType1 a,
+		DataType2 b,
+		false_type) {
+	return static_cast<double>(a) != static_cast<double>(b) ? 1 : 0;
+}
+
+/**
+ * Calculate the Hamming distance with two different data types.
+ * Integer vectors are compared bit by bit, so a vector of d unsigned char
+ * is a packed binary vector of 8*d bits. Otherwise the vectors are compared
+ * component by component, i.e. they are unpacked binary vectors.
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<typename DataType1, typename DataType2>
+inline double distance_hamming(
+		DataType1 * x,
+		DataType2 * y,
+		int d) {
+	typedef integral_constant<bool,is_integral<DataType1>::value
+			&& is_integral<DataType2>::value> bitwise;
+	int i, dis = 0;
+	for(i = 0; i < d; i++)
+		dis += hamming_element<DataType1,DataType2>(x[i],y[i],bitwise());
+	return static_cast<double>(dis);
+}
+
+/**
+ * Calculate the Hamming distance
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<typename DataType>
+inline double distance_hamming(
+		DataType * x,
+		DataType * y,
+		int d) {
+	return distance_hamming<DataType,DataType>(x,y,d);
+}
+
+/**
+ * The packed binary version of the Hamming distance,
+ * dispatched to the best popcount kernel of the CPU
+ * @param x
+ * @param y
+ * @param d the number of bytes
+ * @return the distance between x and y
+ */
+template<>
+inline double distance_hamming<unsigned char,unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return simd_hamming_u8(x,y,d);
+}
+
+template<>
+inline double distance_hamming<unsigned char>(
+		unsigned char * x,
+		unsigned char * y,
+		int d) {
+	return simd_hamming_u8(x,y,d);
+}
+
+/**
+ * Calculate the inner product with two different data types
+ * @param x
+ * @param y
+ * @param d
+ * @return the inner product of x and y
+ */
+template<typename DataType1, typename DataType2>
+inline double inner_product(
+		DataType1 * x,
+		DataType2 * y,
+		int d) {
+	int i;
+	double dis = 0.0;
+	for(i = 0; i < d; i++)
+		dis += static_cast<double>(x[i]) * static_cast<double>(y[i]);
+	return dis;
+}
+
+/**
+ * Calculate the inner product
+ * @param x
+ * @param y
+ * @param d
+ * @return the inner product of x and y
+ */
+template<typename DataType>
+inline double inner_product(
+		DataType * x,
+		DataType * y,
+		int d) {
+	return inner_product<DataType,DataType>(x,y,d);
+}
+
+/**
+ * The float version of the inner product,
+ * dispatched to the best SIMD kernel of the CPU
+ * @param x
+ * @param y
+ * @param d
+ * @return the inner product of x and y
+ */
+template<>
+inline double inner_product<float,float>(
+		float * x,
+		float * y,
+		int d) {
+	return simd_dot_f32(x,y,d);
+}
+
+template<>
+inline double inner_product<float>(
+		float * x,
+		float * y,
+		int d) {
+	return simd_dot_f32(x,y,d);
+}
+
+/**
+ * Calculate the cosine distance: 1 - the cosine similarity.
+ * A zero vector has the distance 1 to every vector.
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<typename DataType1, typename DataType2>
+inline double distance_cosine(
+		DataType1 * x,
+		DataType2 * y,
+		int d) {
+	double xy = inner_product<DataType1,DataType2>(x,y,d);
+	double xx = inner_product<DataType1,DataType1>(x,x,d);
+	double yy = inner_product<DataType2,DataType2>(y,y,d);
+	if(xx <= 0.0 || yy <= 0.0) return 1.0;
+	return 1.0 - xy / sqrt(xx * yy);
+}
+
+/**
+ * Calculate the distance that is used for comparing:
+ * the squared distance for NORM_L2 and the distance itself for the others
+ * @param x
+ * @param y
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+template<typename DataType1, typename DataType2>
+inline double compare_distance(
+		DataType1 * x,
+		DataType2 * y,
+		DistanceType d_type,
+		int d) {
+	switch(d_type) {
+	case DistanceType::NORM_L1:
+		return distance_l1<DataType1,DataType2>(x,y,d);
+	case DistanceType::HAMMING:
+		return distance_hamming<DataType1,DataType2>(x,y,d);
+	case DistanceType::COSINE:
+		return distance_cosine<DataType1,DataType2>(x,y,d);
+	case DistanceType::INNER_PRODUCT:
+		return -inner_product<DataType1,DataType2>(x,y,d);
+	default:
+		return distance_l2_square<DataType1,DataType2>(x,y,d);
+	}
+}
+
+/**
+ * Convert a distance that is used for comparing into the metric distance
+ * @param dis the distance returned by compare_distance
+ * @param d_type the type of distance
+ * @return the metric distance
+ */
+inline double to_metric(
+		double dis,
+		DistanceType d_type) {
+	return d_type == DistanceType::NORM_L2 ? sqrt(dis) : dis;
+}
+
+/**
+ * A distance function that is selected once for a run
+ */
+template<typename DataType1, typename DataType2>
+using DistanceFunction = double (*)(DataType1 *, DataType2 *, int);
+
+/**
+ * The negative inner product, for INNER_PRODUCT
+ */
+template<typename DataType1, typename DataType2>
+inline double negative_inner_product(
+		DataType1 * x,
+		DataType2 * y,
+		int d) {
+	return -inner_product<DataType1,DataType2>(x,y,d);
+}
+
+/**
+ * Only float vectors have fixed-dimension kernels
+ */
+template<typename DataType1, typename DataType2>
+inline DistanceFunction<DataType1,DataType2> fixed_function(
+		DistanceType d_type,
+		int d,
+		bool aligned,
+		false_type) {
+	return nullptr;
+}
+
+template<typename DataType1, typename DataType2>
+inline DistanceFunction<DataType1,DataType2> fixed_function(
+		DistanceType d_type,
+		int d,
+		bool aligned,
+		true_type) {
+	if(d_type == DistanceType::NORM_L2)
+		return simd_l2_square_f32_fixed(d,aligned);
+	else if(d_type == DistanceType::NORM_L1)
+		return simd_l1_f32_fixed(d,aligned);
+	return nullptr;
+}
+
+/**
+ * Check if the rows of an array start on SIMD_ALIGN boundaries
+ * @param x the first row
+ * @param ld the distance between the rows in elements
+ * @return true if the fixed-dimension kernels can load the rows aligned
+ */
+template<typename DataType>
+inline bool aligned_rows(
+		const DataType * x,
+		size_t ld) {
+	return reinterpret_cast<uintptr_t>(x) % SIMD_ALIGN == 0
+			&& ld * sizeof(DataType) % SIMD_ALIGN == 0;
+}
+
+/**
+ * Select the function of compare_distance once for a run:
+ * the fixed-dimension kernels when d is one of 64, 96, 128, 256 and 960,
+ * otherwise the generic ones.
+ * @param d_type the type of distance. Available options are NORM_L1, NORM_L2, HAMMING, COSINE, INNER_PRODUCT
+ * @param d the dimensions
+ * @param aligned the first argument of every call is a row that
+ * starts on a SIMD_ALIGN boundary, see aligned_rows
+ * @return the distance function
+ */
+template<typename DataType1, typename DataType2>
+inline DistanceFunction<DataType1,DataType2> compare_function(
+		DistanceType d_type,
+		int d,
+		bool aligned = false) {
+	typedef integral_constant<bool,is_same<DataType1,float>::value
+			&& is_same<DataType2,float>::value> fixed;
+	DistanceFunction<DataType1,DataType2> f =
+			fixed_function<DataType1,DataType2>(d_type,d,aligned,fixed());
+	if(f != nullptr) return f;
+	switch(d_type) {
+	case DistanceType::NORM_L1:
+		return distance_l1<DataType1,DataType2>;
+	case DistanceType::HAMMING:
+		return distance_hamming<DataType1,DataType2>;
+	case DistanceType::COSINE:
+		return distance_cosine<DataType1,DataType2>;
+	case DistanceType::INNER_PRODUCT:
+		return negative_inner_product<DataType1,DataType2>;
+	default:
+		return distance_l2_square<DataType1,DataType2>;
+	}
+}
+
+/**
+ * The block of dimensions after which the bounded distances
+ * compare the partial sum with the bound
+ */
+const int BOUND_BLOCK = 16;
+
+/**
+ * Calculate the squared L2-metric distance, abandoning as soon as
+ * the partial sum exceeds a bound. The partial sum only grows,
+ * so a candidate whose partial sum exceeds the bound can be skipped.
+ * @param x
+ * @param y
+ * @param d
+ * @param bound the bound, typically the best distance so far
+ * @return the distance, or a partial sum that is greater than bound
+ */
+template<typename DataType1, typename DataType2>
+inline double distance_l2_square_bounded(
+		DataType1 * x,
+		DataType2 * y,
+		int d,
+		double bound) {
+	int i, j, end;
+	double dis = 0.0, tmp = 0.0;
+	for(i = 0; i < d; i = end) {
+		end = min(i + BOUND_BLOCK,d);
+		for(j = i; j < end; j++) {
+			tmp = static_cast<double>(x[j])
+													- static_cast<double>(y[j]);
+			dis += tmp * tmp;
+		}
+		if(dis > bound) break;
+	}
+
+	return dis;
+}
+
+template<>
+inline double distance_l2_square_bounded<float,float>(
+		float * x,
+		float * y,
+		int d,
+		double bound) {
+	return simd_l2_square_f32_bounded(x,y,d,static_cast<float>(bound));
+}
+
+/**
+ * Calculate the L1-metric distance, abandoning as soon as
+ * the partial sum exceeds a bound
+ * @param x
+ * @param y
+ * @param d
+ * @param bound the bound, typically the best distance so far
+ * @return the distance, or a partial sum that is greater than bound
+ */
+template<typename DataType1, typename DataType2>
+inline double distance_l1_bounded(
+		DataType1 * x,
+		DataType2 * y,
+		int d,
+		double bound) {
+	int i, j, end;
+	double dis = 0.0, tmp = 0.0;
+	for(i = 0; i < d; i = end) {
+		end = min(i + BOUND_BLOCK,d);
+		for(j = i; j < end; j++) {
+			tmp = static_cast<double>(x[j])
+													- static_cast<double>(y[j]);
+			dis += fabs(tmp);
+		}
+		if(dis > bound) break;
+	}
+
+	return dis;
+}
+
+template<>
+inline double distance_l1_bounded<float,float>(
+		float * x,
+		float * y,
+		int d,
+		double bound) {
+	return simd_l1_f32_bounded(x,y,d,static_cast<float>(bound));
+}
+
+/**
+ * A distance function with early abandoning
+ */
+template<typename DataType1, typename DataType2>
+using BoundedDistanceFunction = double (*)(DataType1 *, DataType2 *, int, double);
+
+/**
+ * Select the bounded version of compare_distance.
+ * Only NORM_L1 and NORM_L2 grow monotonically with the dimensions.
+ * @param d_type the type of distance
+ * @return the bounded distance function, or nullptr if there is none for d_type
+ */
+template<typename DataType1, typename DataType2>
+inline BoundedDistanceFunction<DataType1,DataType2> bounded_function(
+		DistanceType d_type) {
+	switch(d_type) {
+	case DistanceType::NORM_L1:
+		return distance_l1_bounded<DataType1,DataType2>;
+	case DistanceType::NORM_L2:
+		return distance_l2_square_bounded<DataType1,DataType2>;
+	default:
+		return nullptr;
+	}
+}
+
+/**
+ * Order the dimensions by decreasing variance. With the dimensions
+ * permuted in this order, the bounded distances accumulate most of
+ * the distance early and abandon sooner.
+ * @param data the data, N rows of d dimensions
+ * @param N the number of rows
+ * @param d the dimensions
+ * @param order the output order of d dimensions
+ * @param scratch a buffer of 2d doubles
+ * @param ld the distance between two rows in elements, 0 for d
+ */
+template<typename DataType>
+inline void variance_order(
+		DataType * data,
+		int N,
+		int d,
+		int * order,
+		double * scratch,
+		size_t ld = 0) {
+	if(ld == 0) ld = d;
+	double * mean = scratch, * var = scratch + d, tmp;
+	int i, j;
+	fill(scratch,scratch + 2 * static_cast<size_t>(d),0.0);
+	for(i = 0; i < N; i++)
+		for(j = 0; j < d; j++)
+			mean[j] += static_cast<double>(data[static_cast<size_t>(i) * ld + j]);
+	for(j = 0; j < d && N > 0; j++)
+		mean[j] /= N;
+	for(i = 0; i < N; i++)
+		for(j = 0; j < d; j++) {
+			tmp = static_cast<double>(data[static_cast<size_t>(i) * ld + j]) - mean[j];
+			var[j] += tmp * tmp;
+		}
+	for(j = 0; j < d; j++)
+		order[j] = j;
+	// The ties keep their order, without the buffer of stable_sort
+	sort(order,order + d,
+			[var](int a, int b) { return var[a] > var[b] || (var[a] == var[b] && a < b); });
+}
+
+template<typename DataType>
+inline void variance_order(
+		DataType * data,
+		int N,
+		int d,
+		vector<int> &order,
+		size_t ld = 0) {
+	vector<double> scratch(2 * static_cast<size_t>(d));
+	order.resize(d);
+	variance_order<DataType>(data,N,d,order.data(),scratch.data(),ld);
+}
+
+/**
+ * Permute the dimensions of a vector. The L1 and L2 distances
+ * between two vectors are unchanged when both are permuted.
+ * @param x the vector
+ * @param order the order from variance_order
+ * @param d the dimensions
+ * @param out the permuted vector of d elements
+ */
+template<typename DataType1, typename DataType2>
+inline void permute_vector(
+		const DataType1 * x,
+		const int * order,
+		int d,
+		DataType2 * out) {
+	for(int j = 0; j < d; j++)
+		out[j] = static_cast<DataType2>(x[order[j]]);
+}
+
+/**
+ * Convert a vector to floats
+ * @param x the input vector
+ * @param out the output floats
+ * @param d the dimensions
+ */
+template<typename DataType>
+inline void convert_to_float(
+		DataType * x,
+		float * out,
+		int d) {
+	for(int i = 0; i < d; i++)
+		out[i] = static_cast<float>(x[i]);
+}
+
+template<>
+inline void convert_to_float<half_t>(
+		half_t * x,
+		float * out,
+		int d) {
+	simd_f16_to_f32(reinterpret_cast<const uint16_t *>(x),out,d);
+}
+
+template<>
+inline void convert_to_float<bfloat16_t>(
+		bfloat16_t * x,
+		float * out,
+		int d) {
+	simd_bf16_to_f32(reinterpret_cast<const uint16_t *>(x),out,d);
+}
+
 /**
  * Initialize an 1-D array.
  * @param arr the input array
@@ -342,6 +1199,54 @@ inline bool init_array_2(
 	return true;
 }
 
+/**
+ * Initialize a 2-D array whose rows are views into one contiguous block,
+ * so the rows can also be walked as one flat array of M * N elements.
+ * The array must be freed by free_contiguous_2.
+ * @param M the size of the input array
+ * @param N the size of the input array
+ * @return true if the array was initialized successfully, otherwise return false.
+ */
+template<typename DataType>
+inline bool init_contiguous_2(
+		DataType **& arr,
+		int M,
+		int N) {
+	if(M <= 0 || N <= 0)
+		return false;
+	try {
+		arr = (DataType **)::operator  new(M * sizeof(DataType *));
+	} catch(exception& e) {
+		cerr << "Got an exception: " << e.what() << endl;
+		return false;
+	}
+	try {
+		arr[0] = (DataType *)::operator new(static_cast<size_t>(M) * N * sizeof(DataType));
+	} catch(exception& e) {
+		cerr << "Got an exception: " << e.what() << endl;
+		::operator delete(arr);
+		arr = nullptr;
+		return false;
+	}
+	for(int i = 1; i < M; i++)
+		arr[i] = arr[0] + static_cast<size_t>(i) * N;
+
+	return true;
+}
+
+/**
+ * Free a 2-D array from init_contiguous_2
+ * @param arr the array
+ */
+template<typename DataType>
+inline void free_contiguous_2(
+		DataType **& arr) {
+	if(arr == nullptr) return;
+	::operator delete(arr[0]);
+	::operator delete(arr);
+	arr = nullptr;
+}
+
 /**
  * Copy an array.
  * @param from The input array
@@ -353,7 +1258,7 @@ template<typename DataType>
 inline bool copy_array(
 		DataType * from,
 		DataType *& to,
-		int N) {
+		size_t N) {
 	if(from == nullptr || to == nullptr)
 		return false;
 	memcpy(to,from,N*sizeof(DataType));
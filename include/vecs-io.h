@@ -0,0 +1,435 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  vecs-io.h
+ *
+ *  Created on: 2014/11/01
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef VECS_IO_H_
+#define VECS_IO_H_
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "utilities.h"
+#include "k-means.h"
+#include "kd-tree.h"
+#include "flat-kd-tree.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * A dataset in the .fvecs (float), .ivecs (int) or .bvecs (unsigned char)
+ * format: every row is a 32-bit dimension d followed by its d elements.
+ * The file is mapped read-only, so opening it costs nothing and its pages
+ * are loaded on demand; the rows are used in place, stride() elements apart,
+ * by the k-means methods (through their row stride), the linear search and
+ * the kd-tree builders (through the table of the row pointers).
+ */
+template<typename DataType>
+class VecsFile {
+private:
+	void * map; // the mapped file, or its copy where there is no mmap
+	size_t bytes;
+	DataType * first; // the first element of the first row
+	DataType ** table; // built on the first call of row_table
+	int n_rows, n_cols;
+	size_t n_stride;
+
+	VecsFile(const VecsFile<DataType>&) = delete;
+	VecsFile& operator= (const VecsFile<DataType>&) = delete;
+public:
+	/**
+	 * The default constructor: no file
+	 */
+	VecsFile() {
+		map = nullptr;
+		bytes = 0;
+		first = nullptr;
+		table = nullptr;
+		n_rows = n_cols = 0;
+		n_stride = 0;
+	}
+
+	/**
+	 * Open a file
+	 * @param path the path of the file
+	 */
+	VecsFile(const string& path) : VecsFile() {
+		open(path);
+	}
+
+	/**
+	 * The destructor
+	 */
+	virtual ~VecsFile() {
+		close();
+	}
+
+	/**
+	 * Map a file. Only the dimensions of the first and the last rows are
+	 * checked, so that no other page is read.
+	 * @param path the path of the file
+	 * @return true if the file was opened successfully, otherwise return false.
+	 */
+	bool open(const string& path) {
+		close();
+		static_assert(sizeof(int32_t) % sizeof(DataType) == 0,
+				"The rows must be aligned to their elements");
+#ifndef _WIN32
+		int fd = ::open(path.c_str(),O_RDONLY);
+		if(fd < 0) {
+			cerr << "Cannot open " << path << endl;
+			return false;
+		}
+		struct stat st;
+		if(fstat(fd,&st) != 0 || st.st_size < static_cast<off_t>(sizeof(int32_t))) {
+			cerr << "Empty file " << path << endl;
+			::close(fd);
+			return false;
+		}
+		bytes = static_cast<size_t>(st.st_size);
+		map = mmap(nullptr,bytes,PROT_READ,MAP_PRIVATE,fd,0);
+		::close(fd);
+		if(map == MAP_FAILED) {
+			cerr << "Cannot map " << path << endl;
+			map = nullptr;
+			bytes = 0;
+			return false;
+		}
+#else
+		FILE * f = fopen(path.c_str(),"rb");
+		if(f == nullptr) {
+			cerr << "Cannot open " << path << endl;
+			return false;
+		}
+		fseek(f,0,SEEK_END);
+		bytes = static_cast<size_t>(ftell(f));
+		fseek(f,0,SEEK_SET);
+		try {
+			map = ::operator new(bytes > 0 ? bytes : 1);
+		} catch(exception& e) {
+			cerr << "Got an exception: " << e.what() << endl;
+			fclose(f);
+			bytes = 0;
+			return false;
+		}
+		bytes = fread(map,1,bytes,f);
+		fclose(f);
+#endif
+		int32_t d;
+		memcpy(&d,map,sizeof(int32_t));
+		size_t row_bytes = sizeof(int32_t) + static_cast<size_t>(d) * sizeof(DataType);
+		int32_t d_last = -1;
+		if(d > 0 && bytes % row_bytes == 0)
+			memcpy(&d_last,static_cast<char *>(map) + bytes - row_bytes,sizeof(int32_t));
+		if(d_last != d) {
+			cerr << "Wrong format of " << path << endl;
+			close();
+			return false;
+		}
+		n_cols = d;
+		n_rows = static_cast<int>(bytes / row_bytes);
+		n_stride = row_bytes / sizeof(DataType);
+		first = reinterpret_cast<DataType *>(static_cast<char *>(map) + sizeof(int32_t));
+		return true;
+	}
+
+	/**
+	 * Unmap the file
+	 */
+	void close() {
+#ifndef _WIN32
+		if(map != nullptr)
+			munmap(map,bytes);
+#else
+		::operator delete(map);
+#endif
+		::operator delete(table);
+		map = nullptr;
+		bytes = 0;
+		first = nullptr;
+		table = nullptr;
+		n_rows = n_cols = 0;
+		n_stride = 0;
+	}
+
+	/**
+	 * Tell the kernel how the rows will be read
+	 * @param sequential true for one pass over the rows (read ahead),
+	 * false for random rows (no read ahead)
+	 */
+	void advise(bool sequential) const {
+#ifndef _WIN32
+		if(map != nullptr)
+			madvise(map,bytes,sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+	}
+
+	/**
+	 * Check whether a file is open
+	 */
+	bool is_open() const {
+		return first != nullptr;
+	}
+
+	/**
+	 * Get the number of rows
+	 */
+	int rows() const {
+		return n_rows;
+	}
+
+	/**
+	 * Get the dimensions of the rows
+	 */
+	int cols() const {
+		return n_cols;
+	}
+
+	/**
+	 * Get the distance between two rows in elements: the dimensions
+	 * and the 32-bit header of the next row
+	 */
+	size_t stride() const {
+		return n_stride;
+	}
+
+	/**
+	 * Get the first element of the first row
+	 */
+	DataType * data() const {
+		return first;
+	}
+
+	/**
+	 * Get a row
+	 * @param i the index of the row
+	 */
+	DataType * row(int i) const {
+		return first + static_cast<size_t>(i) * n_stride;
+	}
+
+	DataType * operator[] (int i) const {
+		return row(i);
+	}
+
+	/**
+	 * Get the table of the row pointers, for the linear search and
+	 * the kd-tree. It is built on the first call; the rows are not copied.
+	 */
+	DataType ** row_table() {
+		if(table == nullptr && n_rows > 0) {
+			table = (DataType **)::operator new(n_rows * sizeof(DataType *));
+			for(int i = 0; i < n_rows; i++)
+				table[i] = row(i);
+		}
+		return table;
+	}
+};
+
+/**
+ * Write rows in the .fvecs, .ivecs or .bvecs format
+ * @param path the path of the file
+ * @param data N rows of d elements, one after another
+ * @param N the number of rows
+ * @param d the dimensions
+ * @return true if the file was written successfully, otherwise return false.
+ */
+template<typename DataType>
+inline bool write_vecs(
+		const string& path,
+		const DataType * data,
+		int N,
+		int d) {
+	FILE * f = fopen(path.c_str(),"wb");
+	if(f == nullptr) {
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	int32_t d32 = d;
+	bool ok = true;
+	for(int i = 0; i < N && ok; i++) {
+		ok = fwrite(&d32,sizeof(int32_t),1,f) == 1 &&
+				fwrite(data + static_cast<size_t>(i) * d,sizeof(DataType),d,f) == static_cast<size_t>(d);
+	}
+	if(fclose(f) != 0) ok = false;
+	if(!ok)
+		cerr << "Cannot write " << path << endl;
+	return ok;
+}
+
+/**
+ * Write the centers in the .fvecs format
+ * @param path the path of the file
+ * @param centers the k centers
+ * @param k the number of centers
+ * @param d the dimensions
+ * @return true if the file was written successfully, otherwise return false.
+ */
+inline bool write_centers(
+		const string& path,
+		const float * centers,
+		int k,
+		int d) {
+	return write_vecs<float>(path,centers,k,d);
+}
+
+/**
+ * Write the labels in the .ivecs format, one row of one label per point
+ * @param path the path of the file
+ * @param labels the N labels
+ * @param N the number of labels
+ * @return true if the file was written successfully, otherwise return false.
+ */
+inline bool write_labels(
+		const string& path,
+		const int * labels,
+		int N) {
+	return write_vecs<int>(path,labels,N,1);
+}
+
+/**
+ * Greg's k-means on the rows of a mapped file, in place
+ * @param data the file
+ * @see greg_kmeans
+ */
+template<typename DataType, typename LabelType = int>
+inline void greg_kmeans(
+		const VecsFile<DataType>& data,
+		float *& centers,
+		LabelType *& label,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int k,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr) {
+	greg_kmeans<DataType,LabelType>(data.data(),centers,label,seeds,type,criteria,
+			d_type,ea,data.rows(),k,data.cols(),n_thread,verbose,ws,data.stride());
+}
+
+/**
+ * The k-means method on the rows of a mapped file, in place
+ * @param data the file
+ * @see simple_kmeans
+ */
+template<typename DataType>
+inline void simple_kmeans(
+		const VecsFile<DataType>& data,
+		float *& centers,
+		int *& labels,
+		float *& seeds,
+		KmeansType type,
+		KmeansAssignType assign,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int k,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr) {
+	simple_kmeans<DataType>(data.data(),centers,labels,seeds,type,assign,criteria,
+			d_type,ea,data.rows(),k,data.cols(),n_thread,verbose,ws,data.stride());
+}
+
+/**
+ * A linear solution for NNS over the rows of a mapped file
+ * @param data the database
+ * @see linear_search
+ */
+template<typename DataType>
+inline void linear_search(
+		VecsFile<DataType>& data,
+		DataType * query,
+		DistanceType d_type,
+		int& best,
+		double& best_dist,
+		bool verbose) {
+	linear_search<DataType>(data.row_table(),query,d_type,best,best_dist,
+			data.rows(),data.cols(),verbose);
+}
+
+/**
+ * Create a balanced kd-tree over the rows of a mapped file
+ * @param root the root node of the tree
+ * @param data the file
+ * @param level the cut-plane level
+ * @param base the base index to be added
+ * @param verbose just for debugging
+ */
+template<typename DataType>
+inline void make_balanced_tree(
+		KDNode<DataType> *& root,
+		VecsFile<DataType>& data,
+		int level,
+		int base,
+		bool verbose) {
+	make_balanced_tree<DataType>(root,data.row_table(),data.rows(),
+			data.cols(),level,base,verbose);
+}
+
+/**
+ * Create a random kd-tree over the rows of a mapped file
+ * @param root the root node of the tree
+ * @param data the file
+ * @param base the base index to be added
+ * @param verbose just for debugging
+ */
+template<typename DataType>
+inline void make_random_tree(
+		KDNode<DataType> *& root,
+		VecsFile<DataType>& data,
+		int base,
+		bool verbose) {
+	make_random_tree<DataType>(root,data.row_table(),data.rows(),
+			data.cols(),base,verbose);
+}
+
+/**
+ * Build a flat kd-tree over the rows of a mapped file
+ * @param tree the tree
+ * @param data the file
+ * @param leaf_size the maximum number of points in a leaf
+ * @return true if the tree was built successfully, otherwise return false.
+ */
+template<typename DataType>
+inline bool build_tree(
+		FlatKDTree<DataType>& tree,
+		VecsFile<DataType>& data,
+		int leaf_size = KD_LEAF_SIZE) {
+	return tree.build(data.row_table(),data.rows(),data.cols(),leaf_size);
+}
+}
+
+#endif /* VECS_IO_H_ */
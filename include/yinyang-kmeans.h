@@ -0,0 +1,408 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  yinyang-kmeans.h
+ *
+ *  Created on: 2014/11/05
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#ifndef YINYANG_KMEANS_H_
+#define YINYANG_KMEANS_H_
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include "utilities.h"
+#include "k-means.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimpleCluster {
+
+/**
+ * The number of centers per group of the Yinyang k-means by default
+ */
+const int YINYANG_GROUP_SIZE = 10;
+
+/**
+ * Group the centers by a few iterations of k-means over them
+ * @param centers the k centers
+ * @param k the number of centers
+ * @param d the dimensions
+ * @param t the number of groups
+ * @param d_type the type of distance
+ * @param group_of the group of each center
+ * @param members the centers ordered by group
+ * @param start the first member of each group, t + 1 entries
+ */
+inline void group_centers(
+		float * centers,
+		int k,
+		int d,
+		int t,
+		DistanceType d_type,
+		int * group_of,
+		int * members,
+		int * start) {
+	if(t <= 1) {
+		fill(group_of,group_of + k,0);
+	} else {
+		float * g_centers = nullptr, * g_seeds = nullptr;
+		init_array<float>(g_centers,static_cast<size_t>(t) * d);
+		KmeansCriteria criteria = {1.0,1e-3,5};
+		simple_kmeans<float>(centers,g_centers,group_of,g_seeds,KmeansType::KMEANS_PLUS_SEEDS,
+				KmeansAssignType::LINEAR,criteria,
+				d_type == DistanceType::NORM_L1 ? d_type : DistanceType::NORM_L2,
+				EmptyActs::SINGLETON,k,t,d,1,false);
+		::operator delete(g_centers);
+		::operator delete(g_seeds);
+	}
+	// A counting sort of the centers by group
+	fill(start,start + t + 1,0);
+	for(int i = 0; i < k; i++)
+		start[group_of[i] + 1]++;
+	for(int g = 0; g < t; g++)
+		start[g + 1] += start[g];
+	for(int i = 0, * pos = start; i < k; i++)
+		members[pos[group_of[i]]++] = i;
+	for(int g = t; g > 0; g--)
+		start[g] = start[g - 1];
+	start[0] = 0;
+}
+
+/**
+ * The Yinyang k-means: the centers are grouped once and every point keeps
+ * an upper bound on the distance to its center and a lower bound per group.
+ * The smallest group bound filters the whole point (global filter), a group
+ * bound filters its group (group filter) and the old group bound minus the
+ * drift of a center filters that center (local filter). With about k/10
+ * groups it keeps far fewer bounds than Elkan's k-means and prunes far more
+ * than Hamerly's for large k.
+ * @param groups the number of groups, 0 for k / YINYANG_GROUP_SIZE
+ * @see greg_kmeans for the other parameters
+ */
+template<typename DataType, typename LabelType = int>
+inline void yinyang_kmeans(
+		DataType * data,
+		float *& centers,
+		LabelType *& label,
+		float *& seeds,
+		KmeansType type,
+		KmeansCriteria criteria,
+		DistanceType d_type,
+		EmptyActs ea,
+		int N,
+		int k,
+		int d,
+		int n_thread,
+		bool verbose,
+		KmeansWorkspace * ws = nullptr,
+		size_t ld = 0,
+		int groups = 0) {
+	if(ld == 0) ld = d;
+	if(n_thread < 1) n_thread = 1;
+	if(packed_hamming<DataType>(d_type)) {
+		cerr << "Packed binary data are clustered by kmajority" << endl;
+		return;
+	}
+	// Too few points or inner products: Hamerly's method
+	if(N < k || d_type == DistanceType::INNER_PRODUCT) {
+		greg_kmeans<DataType,LabelType>(data,centers,label,seeds,type,criteria,
+				d_type,ea,N,k,d,n_thread,verbose,ws,ld);
+		return;
+	}
+	if(!label_fits<LabelType>(k)) {
+		cerr << "The label type cannot hold " << k << " clusters" << endl;
+		return;
+	}
+	int t = groups > 0 ? std::min(groups,k) : std::max(1,k / YINYANG_GROUP_SIZE);
+	KmeansWorkspace local;
+	if(ws == nullptr) ws = &local;
+	// The chordal distance on the unit sphere, as in greg_kmeans
+	DistanceType b_type = d_type == DistanceType::COSINE ? DistanceType::NORM_L2 : d_type;
+	DistanceFunction<DataType,float> p_dis =
+			compare_function<DataType,float>(b_type,d,aligned_rows(data,ld));
+
+	if(seeds == nullptr) {
+		init_array<float>(seeds,static_cast<size_t>(k) * d);
+	}
+
+	// Seeding
+	if (type == KmeansType::RANDOM_SEEDS) {
+		random_seeds<DataType>(data,seeds,d,N,k,n_thread,verbose,ld);
+	} else if(type == KmeansType::KMEANS_PLUS_SEEDS || type == KmeansType::KMEANS_PAR_SEEDS) {
+		NormCache * cache = nullptr;
+		if(b_type == DistanceType::NORM_L2) {
+			ws->norms.set_data<DataType>(data,N,d,n_thread,ld);
+			cache = &ws->norms;
+		}
+		if(type == KmeansType::KMEANS_PLUS_SEEDS)
+			kmeans_pp_seeds<DataType>(data,seeds,b_type,d,N,k,n_thread,verbose,cache,ws,ld);
+		else
+			kmeans_par_seeds<DataType>(data,seeds,b_type,d,N,k,n_thread,verbose,cache,ws,ld);
+	}
+
+	if(verbose)
+		cout << "Finished seeding" << endl;
+
+	// Criteria's setup
+	int it = 0, count = 0;
+	float e = criteria.accuracy;
+
+	// Variables for the Yinyang method
+	float * c_sum = ws->sum.get<float>(static_cast<size_t>(k) * d);
+	float * moved = ws->moved.get<float>(k);
+	float * drift = ws->closest.get<float>(k); // the largest move in each group
+	float * upper = ws->upper.get<float>(N);
+	float * lower = ws->group_lower.get<float>(static_cast<size_t>(N) * t);
+	int * size = ws->size.get<int>(k);
+	int * new_label = ws->new_label.get<int>(N);
+	int * group_of = ws->groups.get<int>(2 * static_cast<size_t>(k) + t + 1);
+	int * members = group_of + k, * start = members + k;
+	// The groups that a point examined, their two smallest bounds and nearest center, per thread
+	float * scratch = ws->tiles.get<float>(static_cast<size_t>(4) * t * n_thread);
+
+	int i0, i, j, g;
+	size_t p = N / n_thread, row, base1, base2;
+
+	// Initialize and group the centers
+	copy_array<float>(seeds,centers,static_cast<size_t>(k) * d);
+	if(d_type == DistanceType::COSINE)
+		normalize_rows(centers,k,d);
+	group_centers(centers,k,d,t,b_type,group_of,members,start);
+	if(verbose)
+		cout << "Grouped " << k << " centers into " << t << " groups" << endl;
+
+	// The first assignment computes every distance
+#ifdef _OPENMP
+	omp_set_num_threads(n_thread);
+#pragma omp parallel
+	{
+#pragma omp for private(j,g)
+#endif
+		for(i0 = 0; i0 < n_thread; i0++) {
+			size_t s0 = p * i0;
+			size_t end = s0 + p;
+			if(end > static_cast<size_t>(N) || i0 == n_thread - 1) end = N;
+			for(size_t x = s0; x < end; x++) {
+				DataType * dt = data + x * ld;
+				float * lb = lower + x * t, best = FLT_MAX, v;
+				int b = 0, gb = 0;
+				float m2b = FLT_MAX;
+				for(g = 0; g < t; g++) {
+					float m1 = FLT_MAX, m2 = FLT_MAX;
+					int id1 = -1;
+					for(j = start[g]; j < start[g + 1]; j++) {
+						v = to_metric(p_dis(dt,centers + static_cast<size_t>(members[j]) * d,d),b_type);
+						if(v < m1) {
+							m2 = m1;
+							m1 = v;
+							id1 = members[j];
+						} else if(v < m2) {
+							m2 = v;
+						}
+					}
+					lb[g] = m1;
+					if(m1 < best) {
+						best = m1;
+						b = id1;
+						gb = g;
+						m2b = m2;
+					}
+				}
+				// The group of the center keeps the bound of its other members
+				lb[gb] = m2b;
+				new_label[x] = b;
+				upper[x] = best;
+			}
+		}
+#ifdef _OPENMP
+	}
+#endif
+	memset(size,0,k * sizeof(int));
+	memset(c_sum,0,static_cast<size_t>(k) * d * sizeof(float));
+	for(i = 0; i < N; i++) {
+		label[i] = static_cast<LabelType>(new_label[i]);
+		size[new_label[i]]++;
+		base1 = static_cast<size_t>(new_label[i]) * d;
+		row = static_cast<size_t>(i) * ld;
+		for(j = 0; j < d; j++)
+			c_sum[base1++] += static_cast<float>(data[row++]);
+	}
+
+	// Move the centers of the empty clusters onto points. A moved center
+	// can be anywhere, so the bounds of its group drop to -FLT_MAX, which
+	// the local filter cannot raise by adding back the drift of the group.
+	// The bounds of the moved point left out its old center, so they all drop.
+	auto reset_bounds = [&](int fst, int c) {
+		upper[fst] = 0.0f;
+		for(size_t x = 0; x < static_cast<size_t>(N); x++)
+			lower[x * t + group_of[c]] = -FLT_MAX;
+		fill(lower + static_cast<size_t>(fst) * t,lower + static_cast<size_t>(fst + 1) * t,-FLT_MAX);
+	};
+	move_empty_centers<DataType,LabelType>(data,centers,c_sum,size,label,
+			b_type,ea,N,k,d,verbose,ld,reset_bounds);
+	if(verbose)
+		cout << "Finished initialization" << endl;
+
+	// Nothing has moved before the first iteration
+	fill(moved,moved + k,0.0f);
+	fill(drift,drift + t,0.0f);
+
+	while (1) {
+		// Assign the data through the global, group and local filters
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel
+		{
+#pragma omp for private(j,g)
+#endif
+			for(i0 = 0; i0 < n_thread; i0++) {
+				size_t s0 = p * i0;
+				size_t end = s0 + p;
+				if(end > static_cast<size_t>(N) || i0 == n_thread - 1) end = N;
+				float * ex_m1 = scratch + static_cast<size_t>(4) * t * i0;
+				float * ex_m2 = ex_m1 + t;
+				int * ex_g = reinterpret_cast<int *>(ex_m2 + t);
+				int * ex_id = ex_g + t;
+				for(size_t x = s0; x < end; x++) {
+					int a = static_cast<int>(label[x]);
+					float * lb = lower + x * t, glb = FLT_MAX;
+					float u = upper[x];
+					for(g = 0; g < t; g++)
+						if(lb[g] < glb) glb = lb[g];
+					new_label[x] = a;
+					// Global filter
+					if(u <= glb) continue;
+					DataType * dt = data + x * ld;
+					u = to_metric(p_dis(dt,centers + static_cast<size_t>(a) * d,d),b_type);
+					upper[x] = u;
+					if(u <= glb) continue;
+					float best = u, v;
+					int b = a, ga = group_of[a], n_ex = 0;
+					bool ga_seen = false;
+					for(g = 0; g < t; g++) {
+						// Group filter
+						if(lb[g] >= best) continue;
+						float old = lb[g] + drift[g], m1 = FLT_MAX, m2 = FLT_MAX;
+						int id1 = -1;
+						for(j = start[g]; j < start[g + 1]; j++) {
+							int c = members[j];
+							if(c == a) {
+								v = u;
+							} else {
+								// Local filter: the old bound minus the move of the center
+								v = old - moved[c];
+								if(v < best) {
+									v = to_metric(p_dis(dt,centers + static_cast<size_t>(c) * d,d),b_type);
+									if(v < best) {
+										best = v;
+										b = c;
+									}
+								}
+							}
+							if(v < m1) {
+								m2 = m1;
+								m1 = v;
+								id1 = c;
+							} else if(v < m2) {
+								m2 = v;
+							}
+						}
+						if(g == ga) ga_seen = true;
+						ex_g[n_ex] = g;
+						ex_m1[n_ex] = m1;
+						ex_m2[n_ex] = m2;
+						ex_id[n_ex++] = id1;
+					}
+					// The bound of a group covers all its members but the center
+					for(j = 0; j < n_ex; j++)
+						lb[ex_g[j]] = ex_id[j] == b ? ex_m2[j] : ex_m1[j];
+					if(b != a && !ga_seen && lb[ga] > u)
+						lb[ga] = u;
+					upper[x] = best;
+					new_label[x] = b;
+				}
+			}
+#ifdef _OPENMP
+		}
+#endif
+
+		// Update the sizes and the vector sums of the points that moved
+		for(i = 0; i < N; i++) {
+			int l = static_cast<int>(label[i]), tmp = new_label[i];
+			if(l == tmp) continue;
+			label[i] = static_cast<LabelType>(tmp);
+			size[tmp]++;
+			size[l]--;
+			if(size[l] == 0) {
+				if(verbose)
+					cout << "An empty cluster was found!"
+					" label = " << l << endl;
+			}
+			row = static_cast<size_t>(i) * ld;
+			base1 = static_cast<size_t>(tmp) * d;
+			base2 = static_cast<size_t>(l) * d;
+			for(j = 0; j < d; j++) {
+				c_sum[base1++] += static_cast<float>(data[row]);
+				c_sum[base2++] -= static_cast<float>(data[row++]);
+			}
+		}
+		// Check for empty clusters
+		move_empty_centers<DataType,LabelType>(data,centers,c_sum,size,label,
+				b_type,ea,N,k,d,verbose,ld,reset_bounds);
+		// Move the centers and find the largest move in each group
+		update_center(c_sum,size,centers,moved,d_type,k,d,n_thread,nullptr,ws);
+		for(g = 0; g < t; g++) {
+			drift[g] = 0.0f;
+			for(j = start[g]; j < start[g + 1]; j++)
+				drift[g] = std::max(drift[g],moved[members[j]]);
+		}
+		// Update the bounds
+#ifdef _OPENMP
+		omp_set_num_threads(n_thread);
+#pragma omp parallel for private(g)
+#endif
+		for(i = 0; i < N; i++) {
+			float * lb = lower + static_cast<size_t>(i) * t;
+			upper[i] += moved[label[i]];
+			// A negative bound stays valid, and the local filter adds
+			// the drift back to recover the bound before the move
+			for(g = 0; g < t; g++)
+				lb[g] -= drift[g];
+		}
+
+		if(verbose)
+			print_spec(it,size,k);
+		if(bound_converged(data,centers,label,moved,d_type,criteria,
+				e,count,it,N,k,d,verbose,ld)) break;
+	}
+
+	if(verbose)
+		cout << "Finished clustering with error is " <<
+		e << " after " << it << " iterations." << endl;
+}
+}
+
+#endif /* YINYANG_KMEANS_H_ */
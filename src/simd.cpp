@@ -0,0 +1,2301 @@
+/*
+ *  SIMPLE CLUSTERS: A simple library for clustering works.
+ *  Copyright (C) 2014 Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  simd.cpp
+ *
+ *  Created on: 2014/10/20
+ *      Author: Nguyen Anh Tuan <t_nguyen@hal.t.u-tokyo.ac.jp>
+ */
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include "simd.h"
+#include "half-float.h"
+
+// The vectorized kernels are compiled with per-function target attributes,
+// so the library itself can be built for the baseline instruction set
+// and still use AVX2/AVX-512 when the CPU supports them.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SC_X86_DISPATCH 1
+#include <immintrin.h>
+#define SC_TARGET(x) __attribute__((target(x)))
+#endif
+
+namespace SimpleCluster {
+
+/**
+ * The scalar kernels: used on non-x86 systems and as the reference
+ */
+static float l2_square_scalar(
+		const float * x,
+		const float * y,
+		int d) {
+	float dis = 0.0f, tmp;
+	for(int i = 0; i < d; i++) {
+		tmp = x[i] - y[i];
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+static float l1_scalar(
+		const float * x,
+		const float * y,
+		int d) {
+	float dis = 0.0f;
+	for(int i = 0; i < d; i++)
+		dis += fabsf(x[i] - y[i]);
+	return dis;
+}
+
+static float dot_scalar(
+		const float * x,
+		const float * y,
+		int d) {
+	float dis = 0.0f;
+	for(int i = 0; i < d; i++)
+		dis += x[i] * y[i];
+	return dis;
+}
+
+static void dot_tile_scalar(
+		const float * x,
+		int nx,
+		const float * c,
+		int nc,
+		int d,
+		float * out,
+		int ldo) {
+	for(int i = 0; i < nx; i++)
+		for(int j = 0; j < nc; j++)
+			out[i * ldo + j] = dot_scalar(x + i * d,c + j * d,d);
+}
+
+/**
+ * Count the set bits of a 64-bit word without any special instruction
+ */
+static inline int popcount_swar(uint64_t v) {
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+}
+
+static int hamming_scalar(
+		const unsigned char * x,
+		const unsigned char * y,
+		int n) {
+	int dis = 0, i = 0;
+	uint64_t a, b;
+	for(; i + 8 <= n; i += 8) {
+		memcpy(&a,x + i,8);
+		memcpy(&b,y + i,8);
+		dis += popcount_swar(a ^ b);
+	}
+	for(; i < n; i++)
+		dis += popcount_swar(static_cast<uint64_t>(x[i] ^ y[i]));
+	return dis;
+}
+
+static int l2_square_u8_scalar(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	int dis = 0, tmp;
+	for(int i = 0; i < d; i++) {
+		tmp = static_cast<int>(x[i]) - static_cast<int>(y[i]);
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+static int l1_u8_scalar(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	int dis = 0, tmp;
+	for(int i = 0; i < d; i++) {
+		tmp = static_cast<int>(x[i]) - static_cast<int>(y[i]);
+		dis += tmp < 0 ? -tmp : tmp;
+	}
+	return dis;
+}
+
+static float l2_square_u8f32_scalar(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	float dis = 0.0f, tmp;
+	for(int i = 0; i < d; i++) {
+		tmp = static_cast<float>(x[i]) - y[i];
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+static float l1_u8f32_scalar(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	float dis = 0.0f;
+	for(int i = 0; i < d; i++)
+		dis += fabsf(static_cast<float>(x[i]) - y[i]);
+	return dis;
+}
+
+#ifdef SC_X86_DISPATCH
+SC_TARGET("sse2")
+static inline float hsum_sse2(__m128 v) {
+	__m128 t = _mm_add_ps(v,_mm_movehl_ps(v,v));
+	t = _mm_add_ss(t,_mm_shuffle_ps(t,t,1));
+	return _mm_cvtss_f32(t);
+}
+
+SC_TARGET("sse2")
+static float l2_square_sse2(
+		const float * x,
+		const float * y,
+		int d) {
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), t0, t1;
+	int i = 0;
+	for(; i + 8 <= d; i += 8) {
+		t0 = _mm_sub_ps(_mm_loadu_ps(x + i),_mm_loadu_ps(y + i));
+		t1 = _mm_sub_ps(_mm_loadu_ps(x + i + 4),_mm_loadu_ps(y + i + 4));
+		s0 = _mm_add_ps(s0,_mm_mul_ps(t0,t0));
+		s1 = _mm_add_ps(s1,_mm_mul_ps(t1,t1));
+	}
+	if(i + 4 <= d) {
+		t0 = _mm_sub_ps(_mm_loadu_ps(x + i),_mm_loadu_ps(y + i));
+		s0 = _mm_add_ps(s0,_mm_mul_ps(t0,t0));
+		i += 4;
+	}
+	float dis = hsum_sse2(_mm_add_ps(s0,s1)), tmp;
+	for(; i < d; i++) {
+		tmp = x[i] - y[i];
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+SC_TARGET("sse2")
+static float l1_sse2(
+		const float * x,
+		const float * y,
+		int d) {
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	int i = 0;
+	for(; i + 8 <= d; i += 8) {
+		s0 = _mm_add_ps(s0,_mm_and_ps(mask,
+				_mm_sub_ps(_mm_loadu_ps(x + i),_mm_loadu_ps(y + i))));
+		s1 = _mm_add_ps(s1,_mm_and_ps(mask,
+				_mm_sub_ps(_mm_loadu_ps(x + i + 4),_mm_loadu_ps(y + i + 4))));
+	}
+	if(i + 4 <= d) {
+		s0 = _mm_add_ps(s0,_mm_and_ps(mask,
+				_mm_sub_ps(_mm_loadu_ps(x + i),_mm_loadu_ps(y + i))));
+		i += 4;
+	}
+	float dis = hsum_sse2(_mm_add_ps(s0,s1));
+	for(; i < d; i++)
+		dis += fabsf(x[i] - y[i]);
+	return dis;
+}
+
+SC_TARGET("sse2")
+static float dot_sse2(
+		const float * x,
+		const float * y,
+		int d) {
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	int i = 0;
+	for(; i + 8 <= d; i += 8) {
+		s0 = _mm_add_ps(s0,_mm_mul_ps(_mm_loadu_ps(x + i),_mm_loadu_ps(y + i)));
+		s1 = _mm_add_ps(s1,_mm_mul_ps(_mm_loadu_ps(x + i + 4),_mm_loadu_ps(y + i + 4)));
+	}
+	if(i + 4 <= d) {
+		s0 = _mm_add_ps(s0,_mm_mul_ps(_mm_loadu_ps(x + i),_mm_loadu_ps(y + i)));
+		i += 4;
+	}
+	float dis = hsum_sse2(_mm_add_ps(s0,s1));
+	for(; i < d; i++)
+		dis += x[i] * y[i];
+	return dis;
+}
+
+SC_TARGET("sse2")
+static void dot_tile_sse2(
+		const float * x,
+		int nx,
+		const float * c,
+		int nc,
+		int d,
+		float * out,
+		int ldo) {
+	for(int i = 0; i < nx; i++)
+		for(int j = 0; j < nc; j++)
+			out[i * ldo + j] = dot_sse2(x + i * d,c + j * d,d);
+}
+
+SC_TARGET("sse2")
+static inline int hsum_epi32_sse2(__m128i v) {
+	v = _mm_add_epi32(v,_mm_shuffle_epi32(v,_MM_SHUFFLE(1,0,3,2)));
+	v = _mm_add_epi32(v,_mm_shuffle_epi32(v,_MM_SHUFFLE(2,3,0,1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+SC_TARGET("sse2")
+static int l2_square_u8_sse2(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	const __m128i z = _mm_setzero_si128();
+	__m128i s = _mm_setzero_si128(), a, b, t0, t1;
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+		b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+		// Widen to 16 bits, subtract and let pmaddwd square and add the pairs
+		t0 = _mm_sub_epi16(_mm_unpacklo_epi8(a,z),_mm_unpacklo_epi8(b,z));
+		t1 = _mm_sub_epi16(_mm_unpackhi_epi8(a,z),_mm_unpackhi_epi8(b,z));
+		s = _mm_add_epi32(s,_mm_madd_epi16(t0,t0));
+		s = _mm_add_epi32(s,_mm_madd_epi16(t1,t1));
+	}
+	int dis = hsum_epi32_sse2(s), tmp;
+	for(; i < d; i++) {
+		tmp = static_cast<int>(x[i]) - static_cast<int>(y[i]);
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+SC_TARGET("sse2")
+static int l1_u8_sse2(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	__m128i s = _mm_setzero_si128();
+	int i = 0;
+	for(; i + 16 <= d; i += 16)
+		s = _mm_add_epi64(s,_mm_sad_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i))));
+	int dis = _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(s,s)), tmp;
+	for(; i < d; i++) {
+		tmp = static_cast<int>(x[i]) - static_cast<int>(y[i]);
+		dis += tmp < 0 ? -tmp : tmp;
+	}
+	return dis;
+}
+
+/**
+ * Load 8 bytes and convert them into two registers of 4 floats
+ */
+SC_TARGET("sse2")
+static inline void load_u8_sse2(
+		const unsigned char * x,
+		__m128& lo,
+		__m128& hi) {
+	const __m128i z = _mm_setzero_si128();
+	__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x)),z);
+	lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v,z));
+	hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v,z));
+}
+
+SC_TARGET("sse2")
+static float l2_square_u8f32_sse2(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), lo, hi;
+	int i = 0;
+	for(; i + 8 <= d; i += 8) {
+		load_u8_sse2(x + i,lo,hi);
+		lo = _mm_sub_ps(lo,_mm_loadu_ps(y + i));
+		hi = _mm_sub_ps(hi,_mm_loadu_ps(y + i + 4));
+		s0 = _mm_add_ps(s0,_mm_mul_ps(lo,lo));
+		s1 = _mm_add_ps(s1,_mm_mul_ps(hi,hi));
+	}
+	float dis = hsum_sse2(_mm_add_ps(s0,s1)), tmp;
+	for(; i < d; i++) {
+		tmp = static_cast<float>(x[i]) - y[i];
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+SC_TARGET("sse2")
+static float l1_u8f32_sse2(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), lo, hi;
+	int i = 0;
+	for(; i + 8 <= d; i += 8) {
+		load_u8_sse2(x + i,lo,hi);
+		s0 = _mm_add_ps(s0,_mm_and_ps(mask,_mm_sub_ps(lo,_mm_loadu_ps(y + i))));
+		s1 = _mm_add_ps(s1,_mm_and_ps(mask,_mm_sub_ps(hi,_mm_loadu_ps(y + i + 4))));
+	}
+	float dis = hsum_sse2(_mm_add_ps(s0,s1));
+	for(; i < d; i++)
+		dis += fabsf(static_cast<float>(x[i]) - y[i]);
+	return dis;
+}
+
+SC_TARGET("popcnt")
+static int hamming_popcnt(
+		const unsigned char * x,
+		const unsigned char * y,
+		int n) {
+	// Four independent counters hide the latency of popcnt
+	uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0, a[4], b[4];
+	int i = 0;
+	for(; i + 32 <= n; i += 32) {
+		memcpy(a,x + i,32);
+		memcpy(b,y + i,32);
+		s0 += __builtin_popcountll(a[0] ^ b[0]);
+		s1 += __builtin_popcountll(a[1] ^ b[1]);
+		s2 += __builtin_popcountll(a[2] ^ b[2]);
+		s3 += __builtin_popcountll(a[3] ^ b[3]);
+	}
+	for(; i + 8 <= n; i += 8) {
+		memcpy(a,x + i,8);
+		memcpy(b,y + i,8);
+		s0 += __builtin_popcountll(a[0] ^ b[0]);
+	}
+	for(; i < n; i++)
+		s1 += __builtin_popcount(static_cast<unsigned int>(x[i] ^ y[i]));
+	return static_cast<int>(s0 + s1 + s2 + s3);
+}
+
+SC_TARGET("avx2,fma")
+static inline float hsum_avx2(__m256 v) {
+	__m128 t = _mm_add_ps(_mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1));
+	t = _mm_add_ps(t,_mm_movehl_ps(t,t));
+	t = _mm_add_ss(t,_mm_shuffle_ps(t,t,1));
+	return _mm_cvtss_f32(t);
+}
+
+SC_TARGET("avx2,fma")
+static float l2_square_avx2(
+		const float * x,
+		const float * y,
+		int d) {
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(),
+			s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps(), t0, t1, t2, t3;
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		t0 = _mm256_sub_ps(_mm256_loadu_ps(x + i),_mm256_loadu_ps(y + i));
+		t1 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 8),_mm256_loadu_ps(y + i + 8));
+		t2 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 16),_mm256_loadu_ps(y + i + 16));
+		t3 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 24),_mm256_loadu_ps(y + i + 24));
+		s0 = _mm256_fmadd_ps(t0,t0,s0);
+		s1 = _mm256_fmadd_ps(t1,t1,s1);
+		s2 = _mm256_fmadd_ps(t2,t2,s2);
+		s3 = _mm256_fmadd_ps(t3,t3,s3);
+	}
+	for(; i + 8 <= d; i += 8) {
+		t0 = _mm256_sub_ps(_mm256_loadu_ps(x + i),_mm256_loadu_ps(y + i));
+		s0 = _mm256_fmadd_ps(t0,t0,s0);
+	}
+	float dis = hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0,s1),
+			_mm256_add_ps(s2,s3))), tmp;
+	for(; i < d; i++) {
+		tmp = x[i] - y[i];
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+SC_TARGET("avx2,fma")
+static float l1_avx2(
+		const float * x,
+		const float * y,
+		int d) {
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(),
+			s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,
+				_mm256_sub_ps(_mm256_loadu_ps(x + i),_mm256_loadu_ps(y + i))));
+		s1 = _mm256_add_ps(s1,_mm256_and_ps(mask,
+				_mm256_sub_ps(_mm256_loadu_ps(x + i + 8),_mm256_loadu_ps(y + i + 8))));
+		s2 = _mm256_add_ps(s2,_mm256_and_ps(mask,
+				_mm256_sub_ps(_mm256_loadu_ps(x + i + 16),_mm256_loadu_ps(y + i + 16))));
+		s3 = _mm256_add_ps(s3,_mm256_and_ps(mask,
+				_mm256_sub_ps(_mm256_loadu_ps(x + i + 24),_mm256_loadu_ps(y + i + 24))));
+	}
+	for(; i + 8 <= d; i += 8) {
+		s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,
+				_mm256_sub_ps(_mm256_loadu_ps(x + i),_mm256_loadu_ps(y + i))));
+	}
+	float dis = hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0,s1),
+			_mm256_add_ps(s2,s3)));
+	for(; i < d; i++)
+		dis += fabsf(x[i] - y[i]);
+	return dis;
+}
+
+/**
+ * The mask of the first n lanes of a AVX2 register
+ */
+SC_TARGET("avx2,fma")
+static inline __m256i tail_mask_avx2(int n) {
+	return _mm256_cmpgt_epi32(_mm256_set1_epi32(n),
+			_mm256_setr_epi32(0,1,2,3,4,5,6,7));
+}
+
+SC_TARGET("avx2,fma")
+static float dot_avx2(
+		const float * x,
+		const float * y,
+		int d) {
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i),_mm256_loadu_ps(y + i),s0);
+		s1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8),_mm256_loadu_ps(y + i + 8),s1);
+	}
+	for(; i + 8 <= d; i += 8)
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i),_mm256_loadu_ps(y + i),s0);
+	if(i < d) {
+		__m256i m = tail_mask_avx2(d - i);
+		s1 = _mm256_fmadd_ps(_mm256_maskload_ps(x + i,m),_mm256_maskload_ps(y + i,m),s1);
+	}
+	return hsum_avx2(_mm256_add_ps(s0,s1));
+}
+
+/**
+ * The register-blocked dot products of 4 rows of x against 2 rows of c:
+ * every load of c is reused by 4 rows and every load of x by 2 centers.
+ */
+SC_TARGET("avx2,fma")
+static void dot_tile_avx2(
+		const float * x,
+		int nx,
+		const float * c,
+		int nc,
+		int d,
+		float * out,
+		int ldo) {
+	int i = 0, j, t;
+	__m256i m = tail_mask_avx2(d & 7);
+	for(; i + 4 <= nx; i += 4) {
+		const float * x0 = x + i * d, * x1 = x0 + d, * x2 = x1 + d, * x3 = x2 + d;
+		for(j = 0; j + 2 <= nc; j += 2) {
+			const float * c0 = c + j * d, * c1 = c0 + d;
+			__m256 a00 = _mm256_setzero_ps(), a01 = _mm256_setzero_ps(),
+					a10 = _mm256_setzero_ps(), a11 = _mm256_setzero_ps(),
+					a20 = _mm256_setzero_ps(), a21 = _mm256_setzero_ps(),
+					a30 = _mm256_setzero_ps(), a31 = _mm256_setzero_ps(),
+					v0, v1, u;
+			for(t = 0; t + 8 <= d; t += 8) {
+				v0 = _mm256_loadu_ps(c0 + t);
+				v1 = _mm256_loadu_ps(c1 + t);
+				u = _mm256_loadu_ps(x0 + t);
+				a00 = _mm256_fmadd_ps(u,v0,a00); a01 = _mm256_fmadd_ps(u,v1,a01);
+				u = _mm256_loadu_ps(x1 + t);
+				a10 = _mm256_fmadd_ps(u,v0,a10); a11 = _mm256_fmadd_ps(u,v1,a11);
+				u = _mm256_loadu_ps(x2 + t);
+				a20 = _mm256_fmadd_ps(u,v0,a20); a21 = _mm256_fmadd_ps(u,v1,a21);
+				u = _mm256_loadu_ps(x3 + t);
+				a30 = _mm256_fmadd_ps(u,v0,a30); a31 = _mm256_fmadd_ps(u,v1,a31);
+			}
+			if(t < d) {
+				v0 = _mm256_maskload_ps(c0 + t,m);
+				v1 = _mm256_maskload_ps(c1 + t,m);
+				u = _mm256_maskload_ps(x0 + t,m);
+				a00 = _mm256_fmadd_ps(u,v0,a00); a01 = _mm256_fmadd_ps(u,v1,a01);
+				u = _mm256_maskload_ps(x1 + t,m);
+				a10 = _mm256_fmadd_ps(u,v0,a10); a11 = _mm256_fmadd_ps(u,v1,a11);
+				u = _mm256_maskload_ps(x2 + t,m);
+				a20 = _mm256_fmadd_ps(u,v0,a20); a21 = _mm256_fmadd_ps(u,v1,a21);
+				u = _mm256_maskload_ps(x3 + t,m);
+				a30 = _mm256_fmadd_ps(u,v0,a30); a31 = _mm256_fmadd_ps(u,v1,a31);
+			}
+			float * o = out + i * ldo + j;
+			o[0] = hsum_avx2(a00); o[1] = hsum_avx2(a01); o += ldo;
+			o[0] = hsum_avx2(a10); o[1] = hsum_avx2(a11); o += ldo;
+			o[0] = hsum_avx2(a20); o[1] = hsum_avx2(a21); o += ldo;
+			o[0] = hsum_avx2(a30); o[1] = hsum_avx2(a31);
+		}
+		for(; j < nc; j++) {
+			const float * c0 = c + j * d;
+			out[i * ldo + j] = dot_avx2(x0,c0,d);
+			out[(i + 1) * ldo + j] = dot_avx2(x1,c0,d);
+			out[(i + 2) * ldo + j] = dot_avx2(x2,c0,d);
+			out[(i + 3) * ldo + j] = dot_avx2(x3,c0,d);
+		}
+	}
+	for(; i < nx; i++)
+		for(j = 0; j < nc; j++)
+			out[i * ldo + j] = dot_avx2(x + i * d,c + j * d,d);
+}
+
+SC_TARGET("avx2,fma")
+static int l2_square_u8_avx2(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	__m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256(), t0, t1;
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		t0 = _mm256_sub_epi16(
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i))),
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i))));
+		t1 = _mm256_sub_epi16(
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i + 16))),
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i + 16))));
+		s0 = _mm256_add_epi32(s0,_mm256_madd_epi16(t0,t0));
+		s1 = _mm256_add_epi32(s1,_mm256_madd_epi16(t1,t1));
+	}
+	if(i + 16 <= d) {
+		t0 = _mm256_sub_epi16(
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i))),
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i))));
+		s0 = _mm256_add_epi32(s0,_mm256_madd_epi16(t0,t0));
+		i += 16;
+	}
+	s0 = _mm256_add_epi32(s0,s1);
+	int dis = hsum_epi32_sse2(_mm_add_epi32(_mm256_castsi256_si128(s0),
+			_mm256_extracti128_si256(s0,1))), tmp;
+	for(; i < d; i++) {
+		tmp = static_cast<int>(x[i]) - static_cast<int>(y[i]);
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+SC_TARGET("avx2,fma")
+static int l1_u8_avx2(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	__m256i s = _mm256_setzero_si256();
+	int i = 0;
+	for(; i + 32 <= d; i += 32)
+		s = _mm256_add_epi64(s,_mm256_sad_epu8(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + i))));
+	__m128i t = _mm_add_epi64(_mm256_castsi256_si128(s),_mm256_extracti128_si256(s,1));
+	if(i + 16 <= d) {
+		t = _mm_add_epi64(t,_mm_sad_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i))));
+		i += 16;
+	}
+	int dis = _mm_cvtsi128_si32(t) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(t,t)), tmp;
+	for(; i < d; i++) {
+		tmp = static_cast<int>(x[i]) - static_cast<int>(y[i]);
+		dis += tmp < 0 ? -tmp : tmp;
+	}
+	return dis;
+}
+
+SC_TARGET("avx2,fma")
+static float l2_square_u8f32_avx2(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), t0, t1;
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		// The bytes are converted in registers, never stored as floats
+		t0 = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i)))),
+				_mm256_loadu_ps(y + i));
+		t1 = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i + 8)))),
+				_mm256_loadu_ps(y + i + 8));
+		s0 = _mm256_fmadd_ps(t0,t0,s0);
+		s1 = _mm256_fmadd_ps(t1,t1,s1);
+	}
+	if(i + 8 <= d) {
+		t0 = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i)))),
+				_mm256_loadu_ps(y + i));
+		s0 = _mm256_fmadd_ps(t0,t0,s0);
+		i += 8;
+	}
+	float dis = hsum_avx2(_mm256_add_ps(s0,s1)), tmp;
+	for(; i < d; i++) {
+		tmp = static_cast<float>(x[i]) - y[i];
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+SC_TARGET("avx2,fma")
+static float l1_u8f32_avx2(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,_mm256_sub_ps(
+				_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+						_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i)))),
+				_mm256_loadu_ps(y + i))));
+		s1 = _mm256_add_ps(s1,_mm256_and_ps(mask,_mm256_sub_ps(
+				_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+						_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i + 8)))),
+				_mm256_loadu_ps(y + i + 8))));
+	}
+	if(i + 8 <= d) {
+		s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,_mm256_sub_ps(
+				_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+						_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i)))),
+				_mm256_loadu_ps(y + i))));
+		i += 8;
+	}
+	float dis = hsum_avx2(_mm256_add_ps(s0,s1));
+	for(; i < d; i++)
+		dis += fabsf(static_cast<float>(x[i]) - y[i]);
+	return dis;
+}
+
+SC_TARGET("avx512f")
+static float l2_square_avx512(
+		const float * x,
+		const float * y,
+		int d) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), t0, t1;
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		t0 = _mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i));
+		t1 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 16),_mm512_loadu_ps(y + i + 16));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+		s1 = _mm512_fmadd_ps(t1,t1,s1);
+	}
+	for(; i + 16 <= d; i += 16) {
+		t0 = _mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+	}
+	if(i < d) {
+		// The remainder is handled with a masked load, no scalar loop
+		__mmask16 m = static_cast<__mmask16>((1u << (d - i)) - 1u);
+		t0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m,x + i),_mm512_maskz_loadu_ps(m,y + i));
+		s1 = _mm512_fmadd_ps(t0,t0,s1);
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+}
+
+SC_TARGET("avx512f")
+static float l1_avx512(
+		const float * x,
+		const float * y,
+		int d) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(
+				_mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i))));
+		s1 = _mm512_add_ps(s1,_mm512_abs_ps(
+				_mm512_sub_ps(_mm512_loadu_ps(x + i + 16),_mm512_loadu_ps(y + i + 16))));
+	}
+	for(; i + 16 <= d; i += 16) {
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(
+				_mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i))));
+	}
+	if(i < d) {
+		__mmask16 m = static_cast<__mmask16>((1u << (d - i)) - 1u);
+		s1 = _mm512_add_ps(s1,_mm512_abs_ps(
+				_mm512_sub_ps(_mm512_maskz_loadu_ps(m,x + i),_mm512_maskz_loadu_ps(m,y + i))));
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+}
+
+SC_TARGET("avx512f")
+static float dot_avx512(
+		const float * x,
+		const float * y,
+		int d) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i),s0);
+		s1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 16),_mm512_loadu_ps(y + i + 16),s1);
+	}
+	for(; i + 16 <= d; i += 16)
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i),s0);
+	if(i < d) {
+		__mmask16 m = static_cast<__mmask16>((1u << (d - i)) - 1u);
+		s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m,x + i),_mm512_maskz_loadu_ps(m,y + i),s1);
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+}
+
+/**
+ * The AVX-512 version of the 4x2 register-blocked dot products
+ */
+SC_TARGET("avx512f")
+static void dot_tile_avx512(
+		const float * x,
+		int nx,
+		const float * c,
+		int nc,
+		int d,
+		float * out,
+		int ldo) {
+	int i = 0, j, t;
+	__mmask16 m = static_cast<__mmask16>((1u << (d & 15)) - 1u);
+	for(; i + 4 <= nx; i += 4) {
+		const float * x0 = x + i * d, * x1 = x0 + d, * x2 = x1 + d, * x3 = x2 + d;
+		for(j = 0; j + 2 <= nc; j += 2) {
+			const float * c0 = c + j * d, * c1 = c0 + d;
+			__m512 a00 = _mm512_setzero_ps(), a01 = _mm512_setzero_ps(),
+					a10 = _mm512_setzero_ps(), a11 = _mm512_setzero_ps(),
+					a20 = _mm512_setzero_ps(), a21 = _mm512_setzero_ps(),
+					a30 = _mm512_setzero_ps(), a31 = _mm512_setzero_ps(),
+					v0, v1, u;
+			for(t = 0; t + 16 <= d; t += 16) {
+				v0 = _mm512_loadu_ps(c0 + t);
+				v1 = _mm512_loadu_ps(c1 + t);
+				u = _mm512_loadu_ps(x0 + t);
+				a00 = _mm512_fmadd_ps(u,v0,a00); a01 = _mm512_fmadd_ps(u,v1,a01);
+				u = _mm512_loadu_ps(x1 + t);
+				a10 = _mm512_fmadd_ps(u,v0,a10); a11 = _mm512_fmadd_ps(u,v1,a11);
+				u = _mm512_loadu_ps(x2 + t);
+				a20 = _mm512_fmadd_ps(u,v0,a20); a21 = _mm512_fmadd_ps(u,v1,a21);
+				u = _mm512_loadu_ps(x3 + t);
+				a30 = _mm512_fmadd_ps(u,v0,a30); a31 = _mm512_fmadd_ps(u,v1,a31);
+			}
+			if(t < d) {
+				v0 = _mm512_maskz_loadu_ps(m,c0 + t);
+				v1 = _mm512_maskz_loadu_ps(m,c1 + t);
+				u = _mm512_maskz_loadu_ps(m,x0 + t);
+				a00 = _mm512_fmadd_ps(u,v0,a00); a01 = _mm512_fmadd_ps(u,v1,a01);
+				u = _mm512_maskz_loadu_ps(m,x1 + t);
+				a10 = _mm512_fmadd_ps(u,v0,a10); a11 = _mm512_fmadd_ps(u,v1,a11);
+				u = _mm512_maskz_loadu_ps(m,x2 + t);
+				a20 = _mm512_fmadd_ps(u,v0,a20); a21 = _mm512_fmadd_ps(u,v1,a21);
+				u = _mm512_maskz_loadu_ps(m,x3 + t);
+				a30 = _mm512_fmadd_ps(u,v0,a30); a31 = _mm512_fmadd_ps(u,v1,a31);
+			}
+			float * o = out + i * ldo + j;
+			o[0] = _mm512_reduce_add_ps(a00); o[1] = _mm512_reduce_add_ps(a01); o += ldo;
+			o[0] = _mm512_reduce_add_ps(a10); o[1] = _mm512_reduce_add_ps(a11); o += ldo;
+			o[0] = _mm512_reduce_add_ps(a20); o[1] = _mm512_reduce_add_ps(a21); o += ldo;
+			o[0] = _mm512_reduce_add_ps(a30); o[1] = _mm512_reduce_add_ps(a31);
+		}
+		for(; j < nc; j++) {
+			const float * c0 = c + j * d;
+			out[i * ldo + j] = dot_avx512(x0,c0,d);
+			out[(i + 1) * ldo + j] = dot_avx512(x1,c0,d);
+			out[(i + 2) * ldo + j] = dot_avx512(x2,c0,d);
+			out[(i + 3) * ldo + j] = dot_avx512(x3,c0,d);
+		}
+	}
+	for(; i < nx; i++)
+		for(j = 0; j < nc; j++)
+			out[i * ldo + j] = dot_avx512(x + i * d,c + j * d,d);
+}
+
+/**
+ * The squared differences of 64 bytes, widened to 16 bits and
+ * accumulated by pmaddwd, or by the VNNI dot product vpdpwssd
+ */
+SC_TARGET("avx512f,avx512bw")
+static int l2_square_u8_avx512bw(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	__m512i s = _mm512_setzero_si512(), a, b, t0, t1;
+	int i = 0;
+	for(; i < d; i += 64) {
+		__mmask64 m = (d - i) >= 64 ? ~0ULL : ((1ULL << (d - i)) - 1ULL);
+		a = _mm512_maskz_loadu_epi8(m,x + i);
+		b = _mm512_maskz_loadu_epi8(m,y + i);
+		t0 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm512_castsi512_si256(a)),
+				_mm512_cvtepu8_epi16(_mm512_castsi512_si256(b)));
+		t1 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(a,1)),
+				_mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(b,1)));
+		s = _mm512_add_epi32(s,_mm512_madd_epi16(t0,t0));
+		s = _mm512_add_epi32(s,_mm512_madd_epi16(t1,t1));
+	}
+	return _mm512_reduce_add_epi32(s);
+}
+
+SC_TARGET("avx512f,avx512bw,avx512vnni")
+static int l2_square_u8_avx512vnni(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	__m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512(), a, b, t0, t1;
+	int i = 0;
+	for(; i < d; i += 64) {
+		__mmask64 m = (d - i) >= 64 ? ~0ULL : ((1ULL << (d - i)) - 1ULL);
+		a = _mm512_maskz_loadu_epi8(m,x + i);
+		b = _mm512_maskz_loadu_epi8(m,y + i);
+		t0 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm512_castsi512_si256(a)),
+				_mm512_cvtepu8_epi16(_mm512_castsi512_si256(b)));
+		t1 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(a,1)),
+				_mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(b,1)));
+		s0 = _mm512_dpwssd_epi32(s0,t0,t0);
+		s1 = _mm512_dpwssd_epi32(s1,t1,t1);
+	}
+	return _mm512_reduce_add_epi32(_mm512_add_epi32(s0,s1));
+}
+
+SC_TARGET("avx512f,avx512bw")
+static int l1_u8_avx512(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	__m512i s = _mm512_setzero_si512();
+	int i = 0;
+	for(; i < d; i += 64) {
+		__mmask64 m = (d - i) >= 64 ? ~0ULL : ((1ULL << (d - i)) - 1ULL);
+		s = _mm512_add_epi64(s,_mm512_sad_epu8(
+				_mm512_maskz_loadu_epi8(m,x + i),_mm512_maskz_loadu_epi8(m,y + i)));
+	}
+	return static_cast<int>(_mm512_reduce_add_epi64(s));
+}
+
+SC_TARGET("avx512f")
+static float l2_square_u8f32_avx512(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), t0;
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		t0 = _mm512_sub_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)))),
+				_mm512_loadu_ps(y + i));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+	}
+	if(i < d) {
+		unsigned char buf[16] = {0};
+		memcpy(buf,x + i,d - i);
+		__mmask16 m = static_cast<__mmask16>((1u << (d - i)) - 1u);
+		t0 = _mm512_sub_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(buf)))),
+				_mm512_maskz_loadu_ps(m,y + i));
+		s1 = _mm512_fmadd_ps(t0,t0,s1);
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+}
+
+SC_TARGET("avx512f")
+static float l1_u8f32_avx512(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(_mm512_sub_ps(
+				_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+						_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)))),
+				_mm512_loadu_ps(y + i))));
+	}
+	if(i < d) {
+		unsigned char buf[16] = {0};
+		memcpy(buf,x + i,d - i);
+		__mmask16 m = static_cast<__mmask16>((1u << (d - i)) - 1u);
+		s1 = _mm512_abs_ps(_mm512_sub_ps(
+				_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+						_mm_loadu_si128(reinterpret_cast<const __m128i *>(buf)))),
+				_mm512_maskz_loadu_ps(m,y + i)));
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+}
+
+SC_TARGET("avx512f,avx512bw,avx512vpopcntdq")
+static int hamming_avx512(
+		const unsigned char * x,
+		const unsigned char * y,
+		int n) {
+	__m512i s = _mm512_setzero_si512();
+	int i = 0;
+	for(; i + 64 <= n; i += 64)
+		s = _mm512_add_epi64(s,_mm512_popcnt_epi64(_mm512_xor_si512(
+				_mm512_loadu_si512(x + i),_mm512_loadu_si512(y + i))));
+	if(i < n) {
+		// 256-bit descriptors and the remainder are loaded with a byte mask
+		__mmask64 m = (n - i) >= 64 ? ~0ULL : ((1ULL << (n - i)) - 1ULL);
+		s = _mm512_add_epi64(s,_mm512_popcnt_epi64(_mm512_xor_si512(
+				_mm512_maskz_loadu_epi8(m,x + i),_mm512_maskz_loadu_epi8(m,y + i))));
+	}
+	return static_cast<int>(_mm512_reduce_add_epi64(s));
+}
+#endif
+
+/**
+ * The storage formats of the converting kernels.
+ * Half precision data are converted to floats in registers,
+ * while the centers stay in float.
+ */
+struct FmtF32 {
+	typedef float T;
+};
+struct FmtF16 {
+	typedef uint16_t T;
+};
+struct FmtBF16 {
+	typedef uint16_t T;
+};
+
+static inline float scalar_at(FmtF32, const float * p) {
+	return *p;
+}
+static inline float scalar_at(FmtF16, const uint16_t * p) {
+	return half_to_float(*p);
+}
+static inline float scalar_at(FmtBF16, const uint16_t * p) {
+	return bfloat16_to_float(*p);
+}
+
+template<class FX, class FY>
+static float l2_square_cvt_scalar(
+		const typename FX::T * x,
+		const typename FY::T * y,
+		int d) {
+	float dis = 0.0f, tmp;
+	for(int i = 0; i < d; i++) {
+		tmp = scalar_at(FX(),x + i) - scalar_at(FY(),y + i);
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+template<class FX, class FY>
+static float l1_cvt_scalar(
+		const typename FX::T * x,
+		const typename FY::T * y,
+		int d) {
+	float dis = 0.0f;
+	for(int i = 0; i < d; i++)
+		dis += fabsf(scalar_at(FX(),x + i) - scalar_at(FY(),y + i));
+	return dis;
+}
+
+template<class F>
+static void convert_scalar(
+		const typename F::T * x,
+		float * out,
+		int n) {
+	for(int i = 0; i < n; i++)
+		out[i] = scalar_at(F(),x + i);
+}
+
+#ifdef SC_X86_DISPATCH
+SC_TARGET("avx2,fma,f16c")
+static inline __m256 load8(FmtF32, const float * p) {
+	return _mm256_loadu_ps(p);
+}
+SC_TARGET("avx2,fma,f16c")
+static inline __m256 load8(FmtF16, const uint16_t * p) {
+	return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+SC_TARGET("avx2,fma,f16c")
+static inline __m256 load8(FmtBF16, const uint16_t * p) {
+	// A bfloat16 is the upper half of a float
+	return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))),16));
+}
+
+template<class FX, class FY>
+SC_TARGET("avx2,fma,f16c")
+static float l2_square_cvt_avx2(
+		const typename FX::T * x,
+		const typename FY::T * y,
+		int d) {
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), t0, t1;
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		t0 = _mm256_sub_ps(load8(FX(),x + i),load8(FY(),y + i));
+		t1 = _mm256_sub_ps(load8(FX(),x + i + 8),load8(FY(),y + i + 8));
+		s0 = _mm256_fmadd_ps(t0,t0,s0);
+		s1 = _mm256_fmadd_ps(t1,t1,s1);
+	}
+	if(i + 8 <= d) {
+		t0 = _mm256_sub_ps(load8(FX(),x + i),load8(FY(),y + i));
+		s0 = _mm256_fmadd_ps(t0,t0,s0);
+		i += 8;
+	}
+	float dis = hsum_avx2(_mm256_add_ps(s0,s1)), tmp;
+	for(; i < d; i++) {
+		tmp = scalar_at(FX(),x + i) - scalar_at(FY(),y + i);
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+template<class FX, class FY>
+SC_TARGET("avx2,fma,f16c")
+static float l1_cvt_avx2(
+		const typename FX::T * x,
+		const typename FY::T * y,
+		int d) {
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,
+				_mm256_sub_ps(load8(FX(),x + i),load8(FY(),y + i))));
+		s1 = _mm256_add_ps(s1,_mm256_and_ps(mask,
+				_mm256_sub_ps(load8(FX(),x + i + 8),load8(FY(),y + i + 8))));
+	}
+	if(i + 8 <= d) {
+		s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,
+				_mm256_sub_ps(load8(FX(),x + i),load8(FY(),y + i))));
+		i += 8;
+	}
+	float dis = hsum_avx2(_mm256_add_ps(s0,s1));
+	for(; i < d; i++)
+		dis += fabsf(scalar_at(FX(),x + i) - scalar_at(FY(),y + i));
+	return dis;
+}
+
+template<class F>
+SC_TARGET("avx2,fma,f16c")
+static void convert_avx2(
+		const typename F::T * x,
+		float * out,
+		int n) {
+	int i = 0;
+	for(; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i,load8(F(),x + i));
+	for(; i < n; i++)
+		out[i] = scalar_at(F(),x + i);
+}
+
+SC_TARGET("avx512f")
+static inline __m512 load16(FmtF32, const float * p) {
+	return _mm512_loadu_ps(p);
+}
+SC_TARGET("avx512f")
+static inline __m512 load16(FmtF16, const uint16_t * p) {
+	return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+}
+SC_TARGET("avx512f")
+static inline __m512 load16(FmtBF16, const uint16_t * p) {
+	return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(
+			_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))),16));
+}
+
+template<class FX, class FY>
+SC_TARGET("avx512f")
+static float l2_square_cvt_avx512(
+		const typename FX::T * x,
+		const typename FY::T * y,
+		int d) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), t0, t1;
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		t0 = _mm512_sub_ps(load16(FX(),x + i),load16(FY(),y + i));
+		t1 = _mm512_sub_ps(load16(FX(),x + i + 16),load16(FY(),y + i + 16));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+		s1 = _mm512_fmadd_ps(t1,t1,s1);
+	}
+	if(i + 16 <= d) {
+		t0 = _mm512_sub_ps(load16(FX(),x + i),load16(FY(),y + i));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+		i += 16;
+	}
+	float dis = _mm512_reduce_add_ps(_mm512_add_ps(s0,s1)), tmp;
+	for(; i < d; i++) {
+		tmp = scalar_at(FX(),x + i) - scalar_at(FY(),y + i);
+		dis += tmp * tmp;
+	}
+	return dis;
+}
+
+template<class FX, class FY>
+SC_TARGET("avx512f")
+static float l1_cvt_avx512(
+		const typename FX::T * x,
+		const typename FY::T * y,
+		int d) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(
+				_mm512_sub_ps(load16(FX(),x + i),load16(FY(),y + i))));
+		s1 = _mm512_add_ps(s1,_mm512_abs_ps(
+				_mm512_sub_ps(load16(FX(),x + i + 16),load16(FY(),y + i + 16))));
+	}
+	if(i + 16 <= d) {
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(
+				_mm512_sub_ps(load16(FX(),x + i),load16(FY(),y + i))));
+		i += 16;
+	}
+	float dis = _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+	for(; i < d; i++)
+		dis += fabsf(scalar_at(FX(),x + i) - scalar_at(FY(),y + i));
+	return dis;
+}
+
+template<class F>
+SC_TARGET("avx512f")
+static void convert_avx512(
+		const typename F::T * x,
+		float * out,
+		int n) {
+	int i = 0;
+	for(; i + 16 <= n; i += 16)
+		_mm512_storeu_ps(out + i,load16(F(),x + i));
+	for(; i < n; i++)
+		out[i] = scalar_at(F(),x + i);
+}
+#endif
+
+/**
+ * The dimensions that have fixed-dimension kernels.
+ * Every one of them is a multiple of 32, so the kernels have no remainder.
+ */
+static const int fixed_dims[SIMD_FIXED_DIMS] = {64, 96, 128, 256, 960};
+
+#ifdef SC_X86_DISPATCH
+/**
+ * Load the components of a row: aligned loads when A,
+ * that is when the row starts on a SIMD_ALIGN boundary
+ */
+template<bool A>
+SC_TARGET("avx2,fma")
+static inline __m256 load_avx2(const float * p) {
+	return A ? _mm256_load_ps(p) : _mm256_loadu_ps(p);
+}
+
+template<bool A>
+SC_TARGET("avx512f")
+static inline __m512 load_avx512(const float * p) {
+	return A ? _mm512_load_ps(p) : _mm512_loadu_ps(p);
+}
+
+/**
+ * The fixed-dimension kernels take the signature of
+ * DistanceFunction<float,float>, so a run calls them directly.
+ * When A the row x is aligned, the other one is loaded unaligned.
+ */
+template<int D, bool A>
+SC_TARGET("avx2,fma")
+static double l2_square_avx2_d(
+		float * x,
+		float * y,
+		int) {
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(),
+			s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps(), t0, t1, t2, t3;
+#pragma GCC unroll 8
+	for(int i = 0; i < D; i += 32) {
+		t0 = _mm256_sub_ps(load_avx2<A>(x + i),_mm256_loadu_ps(y + i));
+		t1 = _mm256_sub_ps(load_avx2<A>(x + i + 8),_mm256_loadu_ps(y + i + 8));
+		t2 = _mm256_sub_ps(load_avx2<A>(x + i + 16),_mm256_loadu_ps(y + i + 16));
+		t3 = _mm256_sub_ps(load_avx2<A>(x + i + 24),_mm256_loadu_ps(y + i + 24));
+		s0 = _mm256_fmadd_ps(t0,t0,s0);
+		s1 = _mm256_fmadd_ps(t1,t1,s1);
+		s2 = _mm256_fmadd_ps(t2,t2,s2);
+		s3 = _mm256_fmadd_ps(t3,t3,s3);
+	}
+	return hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0,s1),_mm256_add_ps(s2,s3)));
+}
+
+template<int D, bool A>
+SC_TARGET("avx2,fma")
+static double l1_avx2_d(
+		float * x,
+		float * y,
+		int) {
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(),
+			s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+#pragma GCC unroll 8
+	for(int i = 0; i < D; i += 32) {
+		s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,
+				_mm256_sub_ps(load_avx2<A>(x + i),_mm256_loadu_ps(y + i))));
+		s1 = _mm256_add_ps(s1,_mm256_and_ps(mask,
+				_mm256_sub_ps(load_avx2<A>(x + i + 8),_mm256_loadu_ps(y + i + 8))));
+		s2 = _mm256_add_ps(s2,_mm256_and_ps(mask,
+				_mm256_sub_ps(load_avx2<A>(x + i + 16),_mm256_loadu_ps(y + i + 16))));
+		s3 = _mm256_add_ps(s3,_mm256_and_ps(mask,
+				_mm256_sub_ps(load_avx2<A>(x + i + 24),_mm256_loadu_ps(y + i + 24))));
+	}
+	return hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0,s1),_mm256_add_ps(s2,s3)));
+}
+
+template<int D, bool A>
+SC_TARGET("avx512f")
+static double l2_square_avx512_d(
+		float * x,
+		float * y,
+		int) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), t0, t1;
+#pragma GCC unroll 8
+	for(int i = 0; i < D; i += 32) {
+		t0 = _mm512_sub_ps(load_avx512<A>(x + i),_mm512_loadu_ps(y + i));
+		t1 = _mm512_sub_ps(load_avx512<A>(x + i + 16),_mm512_loadu_ps(y + i + 16));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+		s1 = _mm512_fmadd_ps(t1,t1,s1);
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+}
+
+template<int D, bool A>
+SC_TARGET("avx512f")
+static double l1_avx512_d(
+		float * x,
+		float * y,
+		int) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+#pragma GCC unroll 8
+	for(int i = 0; i < D; i += 32) {
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(
+				_mm512_sub_ps(load_avx512<A>(x + i),_mm512_loadu_ps(y + i))));
+		s1 = _mm512_add_ps(s1,_mm512_abs_ps(
+				_mm512_sub_ps(load_avx512<A>(x + i + 16),_mm512_loadu_ps(y + i + 16))));
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+}
+#endif
+
+/**
+ * The early-abandon kernels: the running sum is checked against the bound
+ * after every block of dimensions, and the partial sum is returned as soon
+ * as it exceeds the bound. The remainder after the last block is finished
+ * by the full kernel of the same instruction set.
+ */
+static float l2_square_bounded_scalar(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	float dis = 0.0f, tmp;
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		for(int j = i; j < i + 16; j++) {
+			tmp = x[j] - y[j];
+			dis += tmp * tmp;
+		}
+		if(dis > bound) return dis;
+	}
+	return dis + l2_square_scalar(x + i,y + i,d - i);
+}
+
+static float l1_bounded_scalar(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	float dis = 0.0f;
+	int i = 0;
+	for(; i + 16 <= d; i += 16) {
+		for(int j = i; j < i + 16; j++)
+			dis += fabsf(x[j] - y[j]);
+		if(dis > bound) return dis;
+	}
+	return dis + l1_scalar(x + i,y + i,d - i);
+}
+
+#ifdef SC_X86_DISPATCH
+SC_TARGET("sse2")
+static float l2_square_bounded_sse2(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	__m128 s0, s1, t0, t1;
+	float dis = 0.0f;
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		s0 = s1 = _mm_setzero_ps();
+		for(int j = i; j < i + 32; j += 8) {
+			t0 = _mm_sub_ps(_mm_loadu_ps(x + j),_mm_loadu_ps(y + j));
+			t1 = _mm_sub_ps(_mm_loadu_ps(x + j + 4),_mm_loadu_ps(y + j + 4));
+			s0 = _mm_add_ps(s0,_mm_mul_ps(t0,t0));
+			s1 = _mm_add_ps(s1,_mm_mul_ps(t1,t1));
+		}
+		dis += hsum_sse2(_mm_add_ps(s0,s1));
+		if(dis > bound) return dis;
+	}
+	return dis + l2_square_sse2(x + i,y + i,d - i);
+}
+
+SC_TARGET("sse2")
+static float l1_bounded_sse2(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 s0, s1;
+	float dis = 0.0f;
+	int i = 0;
+	for(; i + 32 <= d; i += 32) {
+		s0 = s1 = _mm_setzero_ps();
+		for(int j = i; j < i + 32; j += 8) {
+			s0 = _mm_add_ps(s0,_mm_and_ps(mask,
+					_mm_sub_ps(_mm_loadu_ps(x + j),_mm_loadu_ps(y + j))));
+			s1 = _mm_add_ps(s1,_mm_and_ps(mask,
+					_mm_sub_ps(_mm_loadu_ps(x + j + 4),_mm_loadu_ps(y + j + 4))));
+		}
+		dis += hsum_sse2(_mm_add_ps(s0,s1));
+		if(dis > bound) return dis;
+	}
+	return dis + l1_sse2(x + i,y + i,d - i);
+}
+
+SC_TARGET("avx2,fma")
+static float l2_square_bounded_avx2(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	__m256 s0, s1, t0, t1;
+	float dis = 0.0f;
+	int i = 0;
+	for(; i + 64 <= d; i += 64) {
+		s0 = s1 = _mm256_setzero_ps();
+		for(int j = i; j < i + 64; j += 16) {
+			t0 = _mm256_sub_ps(_mm256_loadu_ps(x + j),_mm256_loadu_ps(y + j));
+			t1 = _mm256_sub_ps(_mm256_loadu_ps(x + j + 8),_mm256_loadu_ps(y + j + 8));
+			s0 = _mm256_fmadd_ps(t0,t0,s0);
+			s1 = _mm256_fmadd_ps(t1,t1,s1);
+		}
+		dis += hsum_avx2(_mm256_add_ps(s0,s1));
+		if(dis > bound) return dis;
+	}
+	return dis + l2_square_avx2(x + i,y + i,d - i);
+}
+
+SC_TARGET("avx2,fma")
+static float l1_bounded_avx2(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 s0, s1;
+	float dis = 0.0f;
+	int i = 0;
+	for(; i + 64 <= d; i += 64) {
+		s0 = s1 = _mm256_setzero_ps();
+		for(int j = i; j < i + 64; j += 16) {
+			s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,
+					_mm256_sub_ps(_mm256_loadu_ps(x + j),_mm256_loadu_ps(y + j))));
+			s1 = _mm256_add_ps(s1,_mm256_and_ps(mask,
+					_mm256_sub_ps(_mm256_loadu_ps(x + j + 8),_mm256_loadu_ps(y + j + 8))));
+		}
+		dis += hsum_avx2(_mm256_add_ps(s0,s1));
+		if(dis > bound) return dis;
+	}
+	return dis + l1_avx2(x + i,y + i,d - i);
+}
+
+SC_TARGET("avx512f")
+static float l2_square_bounded_avx512(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	__m512 s0, s1, t0, t1;
+	float dis = 0.0f;
+	int i = 0;
+	for(; i + 64 <= d; i += 64) {
+		t0 = _mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i));
+		t1 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 16),_mm512_loadu_ps(y + i + 16));
+		s0 = _mm512_mul_ps(t0,t0);
+		s1 = _mm512_mul_ps(t1,t1);
+		t0 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 32),_mm512_loadu_ps(y + i + 32));
+		t1 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 48),_mm512_loadu_ps(y + i + 48));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+		s1 = _mm512_fmadd_ps(t1,t1,s1);
+		dis += _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+		if(dis > bound) return dis;
+	}
+	// The remainder stays in this function: after the vzeroupper of a call,
+	// the sum would be returned from a dirty upper register, which stalls
+	// the SSE code of the caller on every call
+	s0 = _mm512_setzero_ps();
+	for(; i + 16 <= d; i += 16) {
+		t0 = _mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+	}
+	if(i < d) {
+		__mmask16 m = static_cast<__mmask16>((1u << (d - i)) - 1u);
+		t0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m,x + i),_mm512_maskz_loadu_ps(m,y + i));
+		s0 = _mm512_fmadd_ps(t0,t0,s0);
+	}
+	return dis + _mm512_reduce_add_ps(s0);
+}
+
+SC_TARGET("avx512f")
+static float l1_bounded_avx512(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	__m512 s0, s1;
+	float dis = 0.0f;
+	int i = 0;
+	for(; i + 64 <= d; i += 64) {
+		s0 = _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i)));
+		s1 = _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(x + i + 16),_mm512_loadu_ps(y + i + 16)));
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(
+				_mm512_sub_ps(_mm512_loadu_ps(x + i + 32),_mm512_loadu_ps(y + i + 32))));
+		s1 = _mm512_add_ps(s1,_mm512_abs_ps(
+				_mm512_sub_ps(_mm512_loadu_ps(x + i + 48),_mm512_loadu_ps(y + i + 48))));
+		dis += _mm512_reduce_add_ps(_mm512_add_ps(s0,s1));
+		if(dis > bound) return dis;
+	}
+	// The remainder stays in this function, as in l2_square_bounded_avx512
+	s0 = _mm512_setzero_ps();
+	for(; i + 16 <= d; i += 16)
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(
+				_mm512_sub_ps(_mm512_loadu_ps(x + i),_mm512_loadu_ps(y + i))));
+	if(i < d) {
+		__mmask16 m = static_cast<__mmask16>((1u << (d - i)) - 1u);
+		s0 = _mm512_add_ps(s0,_mm512_abs_ps(_mm512_sub_ps(
+				_mm512_maskz_loadu_ps(m,x + i),_mm512_maskz_loadu_ps(m,y + i))));
+	}
+	return dis + _mm512_reduce_add_ps(s0);
+}
+#endif
+
+/**
+ * The kernels of the transposed center tiles: a tile keeps SIMD_CENTER_TILE
+ * centers dimension by dimension, so each element of the row is broadcast
+ * once and updates the distances to all centers of the tile in registers.
+ * A tile whose smallest distance is not below the second best is skipped
+ * without leaving the registers; otherwise the two best are updated.
+ */
+static inline void tile_top2(
+		const float * dis,
+		int nc,
+		int base,
+		float * best,
+		int * best_id) {
+	for(int c = 0; c < nc; c++) {
+		float v = dis[c];
+		if(v < best[1]) {
+			if(v < best[0]) {
+				best[1] = best[0];
+				best_id[1] = best_id[0];
+				best[0] = v;
+				best_id[0] = base + c;
+			} else {
+				best[1] = v;
+				best_id[1] = base + c;
+			}
+		}
+	}
+}
+
+template<bool L1>
+static void nearest_tile_scalar(
+		const float * x,
+		const float * tile,
+		int d,
+		int nc,
+		int base,
+		float * best,
+		int * best_id) {
+	float dis[SIMD_CENTER_TILE] = {0.0f}, tmp;
+	for(int j = 0; j < d; j++, tile += SIMD_CENTER_TILE) {
+		for(int c = 0; c < SIMD_CENTER_TILE; c++) {
+			tmp = x[j] - tile[c];
+			dis[c] += L1 ? fabsf(tmp) : tmp * tmp;
+		}
+	}
+	tile_top2(dis,nc,base,best,best_id);
+}
+
+#ifdef SC_X86_DISPATCH
+template<bool L1>
+SC_TARGET("sse2")
+static void nearest_tile_sse2(
+		const float * x,
+		const float * tile,
+		int d,
+		int nc,
+		int base,
+		float * best,
+		int * best_id) {
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(),
+			s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps(), v, t0, t1, t2, t3;
+	for(int j = 0; j < d; j++, tile += SIMD_CENTER_TILE) {
+		v = _mm_set1_ps(x[j]);
+		t0 = _mm_sub_ps(v,_mm_loadu_ps(tile));
+		t1 = _mm_sub_ps(v,_mm_loadu_ps(tile + 4));
+		t2 = _mm_sub_ps(v,_mm_loadu_ps(tile + 8));
+		t3 = _mm_sub_ps(v,_mm_loadu_ps(tile + 12));
+		if(L1) {
+			s0 = _mm_add_ps(s0,_mm_and_ps(mask,t0));
+			s1 = _mm_add_ps(s1,_mm_and_ps(mask,t1));
+			s2 = _mm_add_ps(s2,_mm_and_ps(mask,t2));
+			s3 = _mm_add_ps(s3,_mm_and_ps(mask,t3));
+		} else {
+			s0 = _mm_add_ps(s0,_mm_mul_ps(t0,t0));
+			s1 = _mm_add_ps(s1,_mm_mul_ps(t1,t1));
+			s2 = _mm_add_ps(s2,_mm_mul_ps(t2,t2));
+			s3 = _mm_add_ps(s3,_mm_mul_ps(t3,t3));
+		}
+	}
+	if(nc == SIMD_CENTER_TILE) {
+		__m128 m = _mm_min_ps(_mm_min_ps(s0,s1),_mm_min_ps(s2,s3));
+		m = _mm_min_ps(m,_mm_movehl_ps(m,m));
+		m = _mm_min_ss(m,_mm_shuffle_ps(m,m,1));
+		if(_mm_cvtss_f32(m) >= best[1]) return;
+	}
+	float dis[SIMD_CENTER_TILE];
+	_mm_storeu_ps(dis,s0);
+	_mm_storeu_ps(dis + 4,s1);
+	_mm_storeu_ps(dis + 8,s2);
+	_mm_storeu_ps(dis + 12,s3);
+	tile_top2(dis,nc,base,best,best_id);
+}
+
+template<bool L1>
+SC_TARGET("avx2,fma")
+static void nearest_tile_avx2(
+		const float * x,
+		const float * tile,
+		int d,
+		int nc,
+		int base,
+		float * best,
+		int * best_id) {
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), v, t0, t1;
+	for(int j = 0; j < d; j++, tile += SIMD_CENTER_TILE) {
+		v = _mm256_broadcast_ss(x + j);
+		t0 = _mm256_sub_ps(v,_mm256_loadu_ps(tile));
+		t1 = _mm256_sub_ps(v,_mm256_loadu_ps(tile + 8));
+		if(L1) {
+			s0 = _mm256_add_ps(s0,_mm256_and_ps(mask,t0));
+			s1 = _mm256_add_ps(s1,_mm256_and_ps(mask,t1));
+		} else {
+			s0 = _mm256_fmadd_ps(t0,t0,s0);
+			s1 = _mm256_fmadd_ps(t1,t1,s1);
+		}
+	}
+	if(nc == SIMD_CENTER_TILE) {
+		__m256 m8 = _mm256_min_ps(s0,s1);
+		__m128 m = _mm_min_ps(_mm256_castps256_ps128(m8),_mm256_extractf128_ps(m8,1));
+		m = _mm_min_ps(m,_mm_movehl_ps(m,m));
+		m = _mm_min_ss(m,_mm_shuffle_ps(m,m,1));
+		if(_mm_cvtss_f32(m) >= best[1]) return;
+	}
+	float dis[SIMD_CENTER_TILE];
+	_mm256_storeu_ps(dis,s0);
+	_mm256_storeu_ps(dis + 8,s1);
+	tile_top2(dis,nc,base,best,best_id);
+}
+
+template<bool L1>
+SC_TARGET("avx512f")
+static void nearest_tile_avx512(
+		const float * x,
+		const float * tile,
+		int d,
+		int nc,
+		int base,
+		float * best,
+		int * best_id) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), t0, t1;
+	int j = 0;
+	for(; j + 2 <= d; j += 2, tile += 2 * SIMD_CENTER_TILE) {
+		t0 = _mm512_sub_ps(_mm512_set1_ps(x[j]),_mm512_loadu_ps(tile));
+		t1 = _mm512_sub_ps(_mm512_set1_ps(x[j + 1]),_mm512_loadu_ps(tile + SIMD_CENTER_TILE));
+		if(L1) {
+			s0 = _mm512_add_ps(s0,_mm512_abs_ps(t0));
+			s1 = _mm512_add_ps(s1,_mm512_abs_ps(t1));
+		} else {
+			s0 = _mm512_fmadd_ps(t0,t0,s0);
+			s1 = _mm512_fmadd_ps(t1,t1,s1);
+		}
+	}
+	if(j < d) {
+		t0 = _mm512_sub_ps(_mm512_set1_ps(x[j]),_mm512_loadu_ps(tile));
+		s0 = L1 ? _mm512_add_ps(s0,_mm512_abs_ps(t0)) : _mm512_fmadd_ps(t0,t0,s0);
+	}
+	s0 = _mm512_add_ps(s0,s1);
+	__mmask16 m = static_cast<__mmask16>((1u << nc) - 1u);
+	if(_mm512_mask_reduce_min_ps(m,s0) >= best[1]) return;
+	float dis[SIMD_CENTER_TILE];
+	_mm512_storeu_ps(dis,s0);
+	tile_top2(dis,nc,base,best,best_id);
+}
+#endif
+
+/**
+ * The table of kernels that are currently in use
+ */
+typedef struct {
+	SimdLevel level;
+	float (*l2_square_f32)(const float *, const float *, int);
+	float (*l1_f32)(const float *, const float *, int);
+	float (*dot_f32)(const float *, const float *, int);
+	void (*dot_tile_f32)(const float *, int, const float *, int, int, float *, int);
+	int (*hamming_u8)(const unsigned char *, const unsigned char *, int);
+	int (*l2_square_u8)(const unsigned char *, const unsigned char *, int);
+	int (*l1_u8)(const unsigned char *, const unsigned char *, int);
+	float (*l2_square_u8f32)(const unsigned char *, const float *, int);
+	float (*l1_u8f32)(const unsigned char *, const float *, int);
+	float (*l2_square_f16f32)(const uint16_t *, const float *, int);
+	float (*l1_f16f32)(const uint16_t *, const float *, int);
+	float (*l2_square_f16)(const uint16_t *, const uint16_t *, int);
+	float (*l1_f16)(const uint16_t *, const uint16_t *, int);
+	void (*f16_to_f32)(const uint16_t *, float *, int);
+	float (*l2_square_bf16f32)(const uint16_t *, const float *, int);
+	float (*l1_bf16f32)(const uint16_t *, const float *, int);
+	float (*l2_square_bf16)(const uint16_t *, const uint16_t *, int);
+	float (*l1_bf16)(const uint16_t *, const uint16_t *, int);
+	void (*bf16_to_f32)(const uint16_t *, float *, int);
+	// The fixed-dimension kernels by alignment and dimensions, null below AVX2
+	SimdFixedKernel l2_square_f32_d[2][SIMD_FIXED_DIMS];
+	SimdFixedKernel l1_f32_d[2][SIMD_FIXED_DIMS];
+	float (*l2_square_bounded_f32)(const float *, const float *, int, float);
+	float (*l1_bounded_f32)(const float *, const float *, int, float);
+	void (*l2_square_tile_f32)(const float *, const float *, int, int, int, float *, int *);
+	void (*l1_tile_f32)(const float *, const float *, int, int, int, float *, int *);
+} SimdKernels;
+
+#ifdef SC_X86_DISPATCH
+/**
+ * Fill the fixed-dimension kernels of an alignment
+ * @param kernels the table to be filled
+ */
+template<bool A>
+static void fill_fixed_avx2(SimdKernels& kernels) {
+	kernels.l2_square_f32_d[A][0] = l2_square_avx2_d<64,A>;
+	kernels.l2_square_f32_d[A][1] = l2_square_avx2_d<96,A>;
+	kernels.l2_square_f32_d[A][2] = l2_square_avx2_d<128,A>;
+	kernels.l2_square_f32_d[A][3] = l2_square_avx2_d<256,A>;
+	kernels.l2_square_f32_d[A][4] = l2_square_avx2_d<960,A>;
+	kernels.l1_f32_d[A][0] = l1_avx2_d<64,A>;
+	kernels.l1_f32_d[A][1] = l1_avx2_d<96,A>;
+	kernels.l1_f32_d[A][2] = l1_avx2_d<128,A>;
+	kernels.l1_f32_d[A][3] = l1_avx2_d<256,A>;
+	kernels.l1_f32_d[A][4] = l1_avx2_d<960,A>;
+}
+
+template<bool A>
+static void fill_fixed_avx512(SimdKernels& kernels) {
+	kernels.l2_square_f32_d[A][0] = l2_square_avx512_d<64,A>;
+	kernels.l2_square_f32_d[A][1] = l2_square_avx512_d<96,A>;
+	kernels.l2_square_f32_d[A][2] = l2_square_avx512_d<128,A>;
+	kernels.l2_square_f32_d[A][3] = l2_square_avx512_d<256,A>;
+	kernels.l2_square_f32_d[A][4] = l2_square_avx512_d<960,A>;
+	kernels.l1_f32_d[A][0] = l1_avx512_d<64,A>;
+	kernels.l1_f32_d[A][1] = l1_avx512_d<96,A>;
+	kernels.l1_f32_d[A][2] = l1_avx512_d<128,A>;
+	kernels.l1_f32_d[A][3] = l1_avx512_d<256,A>;
+	kernels.l1_f32_d[A][4] = l1_avx512_d<960,A>;
+}
+#endif
+
+/**
+ * Fill the kernel table for an instruction set
+ * @param level the instruction set
+ * @param kernels the table to be filled
+ */
+static void simd_fill(
+		SimdLevel level,
+		SimdKernels& kernels) {
+	kernels.level = level;
+	kernels.l2_square_f32 = l2_square_scalar;
+	kernels.l1_f32 = l1_scalar;
+	kernels.dot_f32 = dot_scalar;
+	kernels.dot_tile_f32 = dot_tile_scalar;
+	kernels.l2_square_bounded_f32 = l2_square_bounded_scalar;
+	kernels.l1_bounded_f32 = l1_bounded_scalar;
+	kernels.l2_square_tile_f32 = nearest_tile_scalar<false>;
+	kernels.l1_tile_f32 = nearest_tile_scalar<true>;
+	kernels.hamming_u8 = hamming_scalar;
+	kernels.l2_square_u8 = l2_square_u8_scalar;
+	kernels.l1_u8 = l1_u8_scalar;
+	kernels.l2_square_u8f32 = l2_square_u8f32_scalar;
+	kernels.l1_u8f32 = l1_u8f32_scalar;
+	kernels.l2_square_f16f32 = l2_square_cvt_scalar<FmtF16,FmtF32>;
+	kernels.l1_f16f32 = l1_cvt_scalar<FmtF16,FmtF32>;
+	kernels.l2_square_f16 = l2_square_cvt_scalar<FmtF16,FmtF16>;
+	kernels.l1_f16 = l1_cvt_scalar<FmtF16,FmtF16>;
+	kernels.f16_to_f32 = convert_scalar<FmtF16>;
+	kernels.l2_square_bf16f32 = l2_square_cvt_scalar<FmtBF16,FmtF32>;
+	kernels.l1_bf16f32 = l1_cvt_scalar<FmtBF16,FmtF32>;
+	kernels.l2_square_bf16 = l2_square_cvt_scalar<FmtBF16,FmtBF16>;
+	kernels.l1_bf16 = l1_cvt_scalar<FmtBF16,FmtBF16>;
+	kernels.bf16_to_f32 = convert_scalar<FmtBF16>;
+#ifdef SC_X86_DISPATCH
+	// Every CPU with AVX2 has popcnt, older ones are checked separately
+	if(level != SimdLevel::SCALAR && __builtin_cpu_supports("popcnt"))
+		kernels.hamming_u8 = hamming_popcnt;
+	switch(level) {
+	case SimdLevel::AVX512:
+		kernels.l2_square_f32 = l2_square_avx512;
+		kernels.l1_f32 = l1_avx512;
+		kernels.dot_f32 = dot_avx512;
+		kernels.dot_tile_f32 = dot_tile_avx512;
+		kernels.l2_square_bounded_f32 = l2_square_bounded_avx512;
+		kernels.l1_bounded_f32 = l1_bounded_avx512;
+		kernels.l2_square_tile_f32 = nearest_tile_avx512<false>;
+		kernels.l1_tile_f32 = nearest_tile_avx512<true>;
+		if(__builtin_cpu_supports("avx512bw")
+				&& __builtin_cpu_supports("avx512vpopcntdq"))
+			kernels.hamming_u8 = hamming_avx512;
+		kernels.l2_square_u8f32 = l2_square_u8f32_avx512;
+		kernels.l1_u8f32 = l1_u8f32_avx512;
+		// The byte kernels need AVX512BW, otherwise they stay at AVX2
+		if(__builtin_cpu_supports("avx512bw")) {
+			kernels.l2_square_u8 = __builtin_cpu_supports("avx512vnni")
+					? l2_square_u8_avx512vnni : l2_square_u8_avx512bw;
+			kernels.l1_u8 = l1_u8_avx512;
+		} else {
+			kernels.l2_square_u8 = l2_square_u8_avx2;
+			kernels.l1_u8 = l1_u8_avx2;
+		}
+		kernels.l2_square_f16f32 = l2_square_cvt_avx512<FmtF16,FmtF32>;
+		kernels.l1_f16f32 = l1_cvt_avx512<FmtF16,FmtF32>;
+		kernels.l2_square_f16 = l2_square_cvt_avx512<FmtF16,FmtF16>;
+		kernels.l1_f16 = l1_cvt_avx512<FmtF16,FmtF16>;
+		kernels.f16_to_f32 = convert_avx512<FmtF16>;
+		kernels.l2_square_bf16f32 = l2_square_cvt_avx512<FmtBF16,FmtF32>;
+		kernels.l1_bf16f32 = l1_cvt_avx512<FmtBF16,FmtF32>;
+		kernels.l2_square_bf16 = l2_square_cvt_avx512<FmtBF16,FmtBF16>;
+		kernels.l1_bf16 = l1_cvt_avx512<FmtBF16,FmtBF16>;
+		kernels.bf16_to_f32 = convert_avx512<FmtBF16>;
+		break;
+	case SimdLevel::AVX2:
+		kernels.l2_square_f32 = l2_square_avx2;
+		kernels.l1_f32 = l1_avx2;
+		kernels.dot_f32 = dot_avx2;
+		kernels.dot_tile_f32 = dot_tile_avx2;
+		kernels.l2_square_bounded_f32 = l2_square_bounded_avx2;
+		kernels.l1_bounded_f32 = l1_bounded_avx2;
+		kernels.l2_square_tile_f32 = nearest_tile_avx2<false>;
+		kernels.l1_tile_f32 = nearest_tile_avx2<true>;
+		kernels.l2_square_u8 = l2_square_u8_avx2;
+		kernels.l1_u8 = l1_u8_avx2;
+		kernels.l2_square_u8f32 = l2_square_u8f32_avx2;
+		kernels.l1_u8f32 = l1_u8f32_avx2;
+		// The half precision kernels convert with F16C
+		if(__builtin_cpu_supports("f16c")) {
+			kernels.l2_square_f16f32 = l2_square_cvt_avx2<FmtF16,FmtF32>;
+			kernels.l1_f16f32 = l1_cvt_avx2<FmtF16,FmtF32>;
+			kernels.l2_square_f16 = l2_square_cvt_avx2<FmtF16,FmtF16>;
+			kernels.l1_f16 = l1_cvt_avx2<FmtF16,FmtF16>;
+			kernels.f16_to_f32 = convert_avx2<FmtF16>;
+			kernels.l2_square_bf16f32 = l2_square_cvt_avx2<FmtBF16,FmtF32>;
+			kernels.l1_bf16f32 = l1_cvt_avx2<FmtBF16,FmtF32>;
+			kernels.l2_square_bf16 = l2_square_cvt_avx2<FmtBF16,FmtBF16>;
+			kernels.l1_bf16 = l1_cvt_avx2<FmtBF16,FmtBF16>;
+			kernels.bf16_to_f32 = convert_avx2<FmtBF16>;
+		}
+		break;
+	case SimdLevel::SSE2:
+		kernels.l2_square_f32 = l2_square_sse2;
+		kernels.l1_f32 = l1_sse2;
+		kernels.dot_f32 = dot_sse2;
+		kernels.dot_tile_f32 = dot_tile_sse2;
+		kernels.l2_square_bounded_f32 = l2_square_bounded_sse2;
+		kernels.l1_bounded_f32 = l1_bounded_sse2;
+		kernels.l2_square_tile_f32 = nearest_tile_sse2<false>;
+		kernels.l1_tile_f32 = nearest_tile_sse2<true>;
+		kernels.l2_square_u8 = l2_square_u8_sse2;
+		kernels.l1_u8 = l1_u8_sse2;
+		kernels.l2_square_u8f32 = l2_square_u8f32_sse2;
+		kernels.l1_u8f32 = l1_u8f32_sse2;
+		break;
+	default:
+		break;
+	}
+#endif
+	// The fixed-dimension kernels, none below AVX2
+	for(int a = 0; a < 2; a++) {
+		for(int i = 0; i < SIMD_FIXED_DIMS; i++) {
+			kernels.l2_square_f32_d[a][i] = nullptr;
+			kernels.l1_f32_d[a][i] = nullptr;
+		}
+	}
+#ifdef SC_X86_DISPATCH
+	if(level == SimdLevel::AVX512) {
+		fill_fixed_avx512<false>(kernels);
+		fill_fixed_avx512<true>(kernels);
+	} else if(level == SimdLevel::AVX2) {
+		fill_fixed_avx2<false>(kernels);
+		fill_fixed_avx2<true>(kernels);
+	}
+#endif
+}
+
+/**
+ * Detect the best instruction set supported by the CPU and the OS
+ * @return the detected instruction set
+ */
+SimdLevel simd_detect() {
+#ifdef SC_X86_DISPATCH
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f"))
+		return SimdLevel::AVX512;
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SimdLevel::AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return SimdLevel::SSE2;
+#endif
+	return SimdLevel::SCALAR;
+}
+
+static SimdKernels simd_init() {
+	SimdKernels kernels;
+	simd_fill(simd_detect(),kernels);
+	return kernels;
+}
+
+/**
+ * Get the kernel table. It is filled on the first call, so the static
+ * initializers of other translation units may already compute distances.
+ */
+static SimdKernels& kernels() {
+	static SimdKernels table = simd_init();
+	return table;
+}
+
+/**
+ * Get the instruction set that is used by the distance kernels
+ */
+SimdLevel simd_level() {
+	return kernels().level;
+}
+
+/**
+ * Force the distance kernels to use an instruction set.
+ * The request is clamped to what the CPU supports.
+ * This is not thread-safe, call it before any computation starts.
+ * @param level the requested instruction set
+ * @return the instruction set that is used from now on
+ */
+SimdLevel simd_set_level(SimdLevel level) {
+	SimdLevel best = simd_detect();
+	if(static_cast<int>(level) > static_cast<int>(best))
+		level = best;
+	simd_fill(level,kernels());
+	return level;
+}
+
+/**
+ * Get the name of an instruction set
+ * @param level the instruction set
+ */
+const char * simd_level_name(SimdLevel level) {
+	switch(level) {
+	case SimdLevel::AVX512: return "AVX-512";
+	case SimdLevel::AVX2: return "AVX2";
+	case SimdLevel::SSE2: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+/**
+ * Calculate the squared L2-metric distance between two float vectors
+ * @param x
+ * @param y
+ * @param d
+ * @return the squared distance between x and y in d dimensional space
+ */
+float simd_l2_square_f32(
+		const float * x,
+		const float * y,
+		int d) {
+	return kernels().l2_square_f32(x,y,d);
+}
+
+/**
+ * Calculate the L1-metric distance between two float vectors
+ * @param x
+ * @param y
+ * @param d
+ * @return the distance between x and y in d dimensional space
+ */
+float simd_l1_f32(
+		const float * x,
+		const float * y,
+		int d) {
+	return kernels().l1_f32(x,y,d);
+}
+
+/**
+ * Calculate the inner product of two float vectors
+ * @param x
+ * @param y
+ * @param d
+ * @return the inner product of x and y
+ */
+float simd_dot_f32(
+		const float * x,
+		const float * y,
+		int d) {
+	return kernels().dot_f32(x,y,d);
+}
+
+/**
+ * Calculate the inner products between a block of rows and a block of centers.
+ * out[i * ldo + j] = x_i . c_j
+ * @param x the rows, stored contiguously
+ * @param nx the number of rows
+ * @param c the centers, stored contiguously
+ * @param nc the number of centers
+ * @param d the dimensions
+ * @param out the output
+ * @param ldo the leading dimension of the output
+ */
+void simd_dot_tile_f32(
+		const float * x,
+		int nx,
+		const float * c,
+		int nc,
+		int d,
+		float * out,
+		int ldo) {
+	kernels().dot_tile_f32(x,nx,c,nc,d,out,ldo);
+}
+
+/**
+ * Calculate the Hamming distance between two packed binary vectors
+ * @param x
+ * @param y
+ * @param n the number of bytes
+ * @return the number of different bits
+ */
+int simd_hamming_u8(
+		const unsigned char * x,
+		const unsigned char * y,
+		int n) {
+	return kernels().hamming_u8(x,y,n);
+}
+
+/**
+ * Calculate the squared L2 distance between two byte vectors.
+ * The sums are exact in 32-bit integers for d < 33025.
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @return the squared distance
+ */
+int simd_l2_square_u8(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	return kernels().l2_square_u8(x,y,d);
+}
+
+/**
+ * Calculate the L1 distance between two byte vectors
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @return the distance
+ */
+int simd_l1_u8(
+		const unsigned char * x,
+		const unsigned char * y,
+		int d) {
+	return kernels().l1_u8(x,y,d);
+}
+
+/**
+ * Calculate the squared L2 distance between a byte vector and a float vector.
+ * The bytes are converted to floats in registers.
+ * @param x the byte vector
+ * @param y the float vector
+ * @param d the dimensions
+ * @return the squared distance
+ */
+float simd_l2_square_u8f32(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	return kernels().l2_square_u8f32(x,y,d);
+}
+
+/**
+ * Calculate the L1 distance between a byte vector and a float vector
+ * @param x the byte vector
+ * @param y the float vector
+ * @param d the dimensions
+ * @return the distance
+ */
+float simd_l1_u8f32(
+		const unsigned char * x,
+		const float * y,
+		int d) {
+	return kernels().l1_u8f32(x,y,d);
+}
+
+/**
+ * Calculate the squared L2 distance between a IEEE half precision vector and a float vector
+ * @param x the IEEE half precision vector
+ * @param y the float vector
+ * @param d the dimensions
+ * @return the squared distance
+ */
+float simd_l2_square_f16f32(
+		const uint16_t * x,
+		const float * y,
+		int d) {
+	return kernels().l2_square_f16f32(x,y,d);
+}
+
+/**
+ * Calculate the L1 distance between a IEEE half precision vector and a float vector
+ * @param x the IEEE half precision vector
+ * @param y the float vector
+ * @param d the dimensions
+ * @return the distance
+ */
+float simd_l1_f16f32(
+		const uint16_t * x,
+		const float * y,
+		int d) {
+	return kernels().l1_f16f32(x,y,d);
+}
+
+/**
+ * Calculate the squared L2 distance between two IEEE half precision vectors
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @return the squared distance
+ */
+float simd_l2_square_f16(
+		const uint16_t * x,
+		const uint16_t * y,
+		int d) {
+	return kernels().l2_square_f16(x,y,d);
+}
+
+/**
+ * Calculate the L1 distance between two IEEE half precision vectors
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @return the distance
+ */
+float simd_l1_f16(
+		const uint16_t * x,
+		const uint16_t * y,
+		int d) {
+	return kernels().l1_f16(x,y,d);
+}
+
+/**
+ * Convert a IEEE half precision vector to floats
+ * @param x the IEEE half precision vector
+ * @param out the floats
+ * @param n the number of components
+ */
+void simd_f16_to_f32(
+		const uint16_t * x,
+		float * out,
+		int n) {
+	kernels().f16_to_f32(x,out,n);
+}
+
+/**
+ * Calculate the squared L2 distance between a bfloat16 vector and a float vector
+ * @param x the bfloat16 vector
+ * @param y the float vector
+ * @param d the dimensions
+ * @return the squared distance
+ */
+float simd_l2_square_bf16f32(
+		const uint16_t * x,
+		const float * y,
+		int d) {
+	return kernels().l2_square_bf16f32(x,y,d);
+}
+
+/**
+ * Calculate the L1 distance between a bfloat16 vector and a float vector
+ * @param x the bfloat16 vector
+ * @param y the float vector
+ * @param d the dimensions
+ * @return the distance
+ */
+float simd_l1_bf16f32(
+		const uint16_t * x,
+		const float * y,
+		int d) {
+	return kernels().l1_bf16f32(x,y,d);
+}
+
+/**
+ * Calculate the squared L2 distance between two bfloat16 vectors
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @return the squared distance
+ */
+float simd_l2_square_bf16(
+		const uint16_t * x,
+		const uint16_t * y,
+		int d) {
+	return kernels().l2_square_bf16(x,y,d);
+}
+
+/**
+ * Calculate the L1 distance between two bfloat16 vectors
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @return the distance
+ */
+float simd_l1_bf16(
+		const uint16_t * x,
+		const uint16_t * y,
+		int d) {
+	return kernels().l1_bf16(x,y,d);
+}
+
+/**
+ * Convert a bfloat16 vector to floats
+ * @param x the bfloat16 vector
+ * @param out the floats
+ * @param n the number of components
+ */
+void simd_bf16_to_f32(
+		const uint16_t * x,
+		float * out,
+		int n) {
+	kernels().bf16_to_f32(x,out,n);
+}
+
+/**
+ * The position of a dimension in the fixed-dimension kernel table
+ * @param d the dimensions
+ * @return the position, -1 if d has no fixed-dimension kernels
+ */
+static int fixed_slot(int d) {
+	for(int i = 0; i < SIMD_FIXED_DIMS; i++)
+		if(fixed_dims[i] == d) return i;
+	return -1;
+}
+
+/**
+ * Check if a dimension has fixed-dimension kernels at the current level
+ * @param d the dimensions
+ * @return true if d is one of 64, 96, 128, 256 and 960 and the CPU has AVX2
+ */
+bool simd_has_fixed(int d) {
+	return simd_l2_square_f32_fixed(d,false) != nullptr;
+}
+
+/**
+ * Get the kernel of the squared L2 distance between two float vectors
+ * of d dimensions, with the loops unrolled for d. The kernel is called
+ * directly by the run, as it has the signature of DistanceFunction.
+ * @param d the dimensions
+ * @param aligned the first vector starts on a SIMD_ALIGN boundary
+ * @return the kernel, nullptr if d has none at the current level
+ */
+SimdFixedKernel simd_l2_square_f32_fixed(
+		int d,
+		bool aligned) {
+	int slot = fixed_slot(d);
+	return slot < 0 ? nullptr : kernels().l2_square_f32_d[aligned ? 1 : 0][slot];
+}
+
+/**
+ * Get the kernel of the L1 distance between two float vectors
+ * of d dimensions, with the loops unrolled for d
+ * @see simd_l2_square_f32_fixed
+ */
+SimdFixedKernel simd_l1_f32_fixed(
+		int d,
+		bool aligned) {
+	int slot = fixed_slot(d);
+	return slot < 0 ? nullptr : kernels().l1_f32_d[aligned ? 1 : 0][slot];
+}
+
+/**
+ * Calculate the squared L2 distance between two float vectors,
+ * abandoning as soon as the running sum exceeds a bound
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @param bound the bound
+ * @return the squared distance, or a partial sum that exceeds the bound
+ */
+float simd_l2_square_f32_bounded(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	return kernels().l2_square_bounded_f32(x,y,d,bound);
+}
+
+/**
+ * Calculate the L1 distance between two float vectors,
+ * abandoning as soon as the running sum exceeds a bound
+ * @param x
+ * @param y
+ * @param d the dimensions
+ * @param bound the bound
+ * @return the distance, or a partial sum that exceeds the bound
+ */
+float simd_l1_f32_bounded(
+		const float * x,
+		const float * y,
+		int d,
+		float bound) {
+	return kernels().l1_bounded_f32(x,y,d,bound);
+}
+
+/**
+ * Update the two nearest centers of a row among the centers of a transposed tile
+ * @param x the row
+ * @param tile the tile: d groups of SIMD_CENTER_TILE components
+ * @param d the dimensions
+ * @param nc the number of centers in the tile, at most SIMD_CENTER_TILE
+ * @param base the index of the first center of the tile
+ * @param best the two smallest squared distances so far, updated
+ * @param best_id the two nearest centers so far, updated
+ */
+void simd_l2_square_tile_f32(
+		const float * x,
+		const float * tile,
+		int d,
+		int nc,
+		int base,
+		float * best,
+		int * best_id) {
+	kernels().l2_square_tile_f32(x,tile,d,nc,base,best,best_id);
+}
+
+/**
+ * Update the two nearest centers of a row among the centers of
+ * a transposed tile in the L1 distance
+ * @see simd_l2_square_tile_f32
+ */
+void simd_l1_tile_f32(
+		const float * x,
+		const float * tile,
+		int d,
+		int nc,
+		int base,
+		float * best,
+		int * best_id) {
+	kernels().l1_tile_f32(x,tile,d,nc,base,best,best_id);
+}
+}
@@ -86,6 +86,10 @@ void check_env() {
 	fprintf(stderr, "We tested the programs on Clang/LLVM, GNU g++, MSVC++ "
 			"so we recommend these compiler for your works.\n");
 #endif
+
+	// Check the instruction set used by the distance kernels
+	fprintf(stdout, "The distance kernels are using %s instructions\n",
+			simd_level_name(simd_level()));
 }
 
 /**
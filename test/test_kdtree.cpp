@@ -29,6 +29,8 @@
 #include <cmath>
 #include <cstdlib>
 #include "kd-tree.h"
+#include "flat-kd-tree.h"
+#include "vecs-io.h"
 #include "utilities.h"
 
 using namespace std;
@@ -211,6 +213,173 @@ TEST_F(KDTreeTest, test10) {
 	cout << "Visited " << visited << " nodes" << endl;
 }
 
+TEST_F(KDTreeTest, test11) {
+	// A tree over the padded rows of a Matrix finds the same neighbors as the linear search
+	int n = 2000, dm = 20;
+	Matrix<float> m(n,dm);
+	EXPECT_EQ(32,m.stride());
+	for(int i = 0; i < n; i++)
+		for(int j = 0; j < dm; j++)
+			m[i][j] = data[i][j];
+	KDNode<float> * root = nullptr;
+	make_balanced_tree<float>(root,m,0,0,false);
+	for(int q = 0; q < 20; q++) {
+		KDNode<float> * query = ::new KDNode<float>(dm);
+		query->add_data(data[n + q]);
+		KDNode<float> * result = nullptr;
+		double best_dist = DBL_MAX, lin_dist;
+		int visited = 0, best;
+		nn_search<float>(root,query,result,DistanceType::NORM_L2,best_dist,dm,0,visited,false);
+		linear_search<float>(m,data[n + q],DistanceType::NORM_L2,best,lin_dist,false);
+		EXPECT_NEAR(lin_dist,best_dist,lin_dist * 1e-5);
+		EXPECT_EQ(m[best],result->get_data());
+	}
+}
+
+TEST_F(KDTreeTest, test12) {
+	// The flat tree finds the same nearest neighbors as the linear search
+	// and visits as many points as the pointer-based tree, in far fewer nodes
+	unsigned long int t1, t2, t3;
+	int n_query = 100;
+	FlatKDTree<float> tree;
+	EXPECT_TRUE(tree.build(data,N,d));
+	EXPECT_LE(tree.node_count(),2 * (N / 16 + 1));
+	int visited = 0, best, lin;
+	double best_dist, lin_dist;
+	vector<float> q(n_query * d);
+	mt19937 gen(7);
+	uniform_real_distribution<float> noise(-10.0f,10.0f);
+	for(int i = 0; i < n_query; i++)
+		for(int j = 0; j < d; j++)
+			q[i * d + j] = data[i * 37][j] + noise(gen);
+	// The rows permuted by the variance of the dimensions, for the bounded scan
+	vector<float> flat(static_cast<size_t>(N) * d), permuted(flat.size());
+	vector<float *> rows(N);
+	vector<int> order;
+	for(int i = 0; i < N; i++)
+		copy(data[i],data[i] + d,flat.begin() + static_cast<size_t>(i) * d);
+	variance_order<float>(flat.data(),N,d,order);
+	for(int i = 0; i < N; i++) {
+		rows[i] = permuted.data() + static_cast<size_t>(i) * d;
+		permute_vector<float,float>(data[i],order.data(),d,rows[i]);
+	}
+	int p_lin;
+	double p_dist;
+	for(int i = 0; i < n_query; i++) {
+		float * qi = q.data() + i * d;
+		tree.nn_search(qi,DistanceType::NORM_L2,best,best_dist,visited);
+		linear_search<float>(data,qi,DistanceType::NORM_L2,lin,lin_dist,N,d,false);
+		EXPECT_NEAR(lin_dist,best_dist,lin_dist * 1e-5);
+		tree.nn_search(qi,DistanceType::NORM_L1,best,best_dist,visited);
+		linear_search<float>(data,qi,DistanceType::NORM_L1,lin,lin_dist,N,d,false);
+		EXPECT_NEAR(lin_dist,best_dist,lin_dist * 1e-5);
+		linear_search<float>(rows.data(),qi,DistanceType::NORM_L1,p_lin,p_dist,N,d,false,order.data());
+		EXPECT_NEAR(lin_dist,p_dist,lin_dist * 1e-5);
+		tree.ann_search(qi,DistanceType::NORM_L2,1.5,best,best_dist,visited);
+		linear_search<float>(data,qi,DistanceType::NORM_L2,lin,lin_dist,N,d,false);
+		EXPECT_GE(best_dist,lin_dist * (1.0 - 1e-5));
+	}
+
+	KDNode<float> * root = nullptr;
+	make_balanced_tree<float>(root,data,N,d,0,0,false);
+	int old_visited = 0;
+	visited = 0;
+	t1 = get_millisecond_time();
+	for(int i = 0; i < n_query; i++)
+		tree.nn_search(q.data() + i * d,DistanceType::NORM_L2,best,best_dist,visited);
+	t2 = get_millisecond_time();
+	for(int i = 0; i < n_query; i++) {
+		KDNode<float> query(d);
+		query.add_data(q.data() + i * d);
+		KDNode<float> * result = nullptr;
+		best_dist = DBL_MAX;
+		nn_search<float>(root,&query,result,DistanceType::NORM_L2,best_dist,d,0,old_visited,false);
+	}
+	t3 = get_millisecond_time();
+	cout << "Flat tree (" << tree.node_count() << " nodes): compared "
+			<< visited << " points in " << t2 - t1 << "[ms]" << endl;
+	cout << "Pointer tree (" << N << " nodes): visited "
+			<< old_visited << " nodes in " << t3 - t2 << "[ms]" << endl;
+
+	// Byte data and a Matrix
+	Matrix<unsigned char> bytes(2000,32);
+	for(int i = 0; i < 2000; i++)
+		for(int j = 0; j < 32; j++)
+			bytes[i][j] = static_cast<unsigned char>(static_cast<int>(data[i][j]) & 0xff);
+	FlatKDTree<unsigned char> btree;
+	EXPECT_TRUE(btree.build(bytes,16));
+	for(int i = 0; i < 20; i++) {
+		btree.nn_search(bytes[i * 97],DistanceType::NORM_L2,best,best_dist,visited);
+		EXPECT_EQ(0.0,best_dist);
+		EXPECT_EQ(0,memcmp(bytes[best],bytes[i * 97],32));
+	}
+}
+
+TEST_F(KDTreeTest, test13) {
+	// The trees and the linear search over a mapped .fvecs file find the neighbors of the rows in memory
+	int n = 2000, dm = 20;
+	float * flat;
+	init_array<float>(flat,n * dm);
+	for(int i = 0; i < n; i++)
+		for(int j = 0; j < dm; j++)
+			flat[i * dm + j] = data[i][j];
+	string path = "test_kdtree.fvecs";
+	EXPECT_TRUE(write_vecs<float>(path,flat,n,dm));
+	VecsFile<float> file(path);
+	EXPECT_TRUE(file.is_open());
+	EXPECT_EQ(n,file.rows());
+	EXPECT_EQ(dm,file.cols());
+	EXPECT_EQ(static_cast<size_t>(dm + 1),file.stride());
+	KDNode<float> * root = nullptr;
+	make_balanced_tree<float>(root,file,0,0,false);
+	FlatKDTree<float> tree;
+	EXPECT_TRUE(build_tree<float>(tree,file));
+	for(int q = 0; q < 20; q++) {
+		KDNode<float> * query = ::new KDNode<float>(dm);
+		query->add_data(data[n + q]);
+		KDNode<float> * result = nullptr;
+		double best_dist = DBL_MAX, lin_dist, flat_dist;
+		int visited = 0, best, flat_best;
+		nn_search<float>(root,query,result,DistanceType::NORM_L2,best_dist,dm,0,visited,false);
+		linear_search<float>(file,data[n + q],DistanceType::NORM_L2,best,lin_dist,false);
+		tree.nn_search(data[n + q],DistanceType::NORM_L2,flat_best,flat_dist,visited);
+		EXPECT_NEAR(lin_dist,best_dist,lin_dist * 1e-5);
+		EXPECT_NEAR(lin_dist,flat_dist,lin_dist * 1e-5);
+		EXPECT_EQ(file.row_table()[best],result->get_data());
+		EXPECT_EQ(0,memcmp(file.row_table()[best],file[flat_best],dm * sizeof(float)));
+	}
+	file.close();
+	remove(path.c_str());
+	::operator delete(flat);
+}
+
+TEST_F(KDTreeTest, test14) {
+	// A refit tree of slightly moved points finds the nearest neighbors of
+	// the linear search, and a shuffle of the points breaks its cuts
+	int n = 1000, dm = 4;
+	vector<float> pts(n * dm), q(dm);
+	vector<float *> rows(n);
+	for(int i = 0; i < n; i++) rows[i] = pts.data() + i * dm;
+	mt19937 gen(11);
+	uniform_real_distribution<float> place(0.0f,100.0f), jitter(-0.01f,0.01f);
+	for(auto& v : pts) v = place(gen);
+	FlatKDTree<float> tree;
+	EXPECT_FALSE(tree.refit(pts.data()));
+	EXPECT_TRUE(tree.build(pts.data(),n,dm,8));
+	for(auto& v : pts) v += jitter(gen);
+	EXPECT_TRUE(tree.refit(pts.data()));
+	int visited = 0, best, lin;
+	double best_dist, lin_dist;
+	for(int i = 0; i < 100; i++) {
+		for(auto& v : q) v = place(gen);
+		tree.nn_search(q.data(),DistanceType::NORM_L2,best,best_dist,visited);
+		linear_search<float>(rows.data(),q.data(),DistanceType::NORM_L2,lin,lin_dist,n,dm,false);
+		EXPECT_NEAR(lin_dist,best_dist,lin_dist * 1e-5);
+	}
+	reverse(pts.begin(),pts.end());
+	EXPECT_FALSE(tree.refit(pts.data()));
+}
+
 int main(int argc, char * argv[])
 {
 	/*The method is initializes the Google framework and must be called before RUN_ALL_TESTS */
@@ -33,7 +33,18 @@
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"*/
 #include "k-means.h"
+#include "k-majority.h"
 #include "utilities.h"
+#include "vecs-io.h"
+#include "stream-kmeans.h"
+#include "elkan-kmeans.h"
+#include "yinyang-kmeans.h"
+#include "minibatch-kmeans.h"
+#include "filter-kmeans.h"
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <new>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -45,6 +56,22 @@
 using namespace std;
 using namespace SimpleCluster;
 
+/**
+ * Count the heap allocations, to check that the runs with a workspace make none
+ */
+static atomic<size_t> n_allocs(0);
+
+void * operator new(size_t n) {
+	n_allocs++;
+	void * p = malloc(n > 0 ? n : 1);
+	if(p == nullptr) throw bad_alloc();
+	return p;
+}
+
+void operator delete(void * p) noexcept {
+	free(p);
+}
+
 /**
  * Customized test case for testing
  */
@@ -109,6 +136,84 @@ protected:
 	virtual void SetUp() { }
 	virtual void TearDown() {}
 
+	/**
+	 * Fill the rows with blobs: row i is a point of blob i % m with a
+	 * normal noise, so blobs far apart have no point near a tie
+	 * @param x the n rows of dim dimensions
+	 * @param lo the lower end of the uniform components of the blobs
+	 * @param hi the upper end of the uniform components of the blobs
+	 * @param sigma the standard deviation of the noise
+	 * @param seed the seed of the random numbers
+	 * @return the m centers of the blobs
+	 */
+	static vector<float> make_blobs(float * x, int n, int m, int dim,
+			float lo, float hi, float sigma, unsigned int seed) {
+		mt19937 gen(seed);
+		normal_distribution<float> noise(0.0f,sigma);
+		uniform_real_distribution<float> place(lo,hi);
+		vector<float> blobs(static_cast<size_t>(m) * dim);
+		for(auto& v : blobs) v = place(gen);
+		for(int i = 0; i < n; i++)
+			for(int j = 0; j < dim; j++)
+				x[static_cast<size_t>(i) * dim + j] = blobs[static_cast<size_t>(i % m) * dim + j] + noise(gen);
+		return blobs;
+	}
+
+	/**
+	 * Lloyd's k-means by brute force, in the steps of the bounded k-means:
+	 * an assignment, the move of the empty centers, then iterations that
+	 * keep a label unless a center is strictly nearer
+	 * @param centers the seeds, then the centers
+	 */
+	static void reference_kmeans(float * x, float * centers, int * label,
+			DistanceType t, EmptyActs ea, KmeansCriteria criteria, int n, int m, int dim) {
+		DistanceFunction<float,float> dis = compare_function<float,float>(t,dim);
+		vector<float> sum(static_cast<size_t>(m) * dim, 0.0f), moved(m);
+		vector<int> size(m,0);
+		auto nearest = [&](int i, int a) {
+			float * xi = x + static_cast<size_t>(i) * dim;
+			float u = a >= 0 ? to_metric(dis(xi,centers + static_cast<size_t>(a) * dim,dim),t) : FLT_MAX;
+			int b = a < 0 ? 0 : a;
+			for(int j = 0; j < m; j++) {
+				float v = to_metric(dis(xi,centers + static_cast<size_t>(j) * dim,dim),t);
+				if(j != a && v < u) {
+					u = v;
+					b = j;
+				}
+			}
+			return b;
+		};
+		for(int i = 0; i < n; i++) {
+			label[i] = nearest(i,-1);
+			size[label[i]]++;
+			for(int j = 0; j < dim; j++)
+				sum[static_cast<size_t>(label[i]) * dim + j] += x[static_cast<size_t>(i) * dim + j];
+		}
+		move_empty_centers<float,int>(x,centers,sum.data(),size.data(),label,
+				t,ea,n,m,dim,false,dim);
+		float e = criteria.accuracy;
+		int it = 0, count = 0;
+		while(1) {
+			for(int i = 0; i < n; i++) {
+				int l = label[i], b = nearest(i,l);
+				if(b == l) continue;
+				label[i] = b;
+				size[b]++;
+				size[l]--;
+				for(int j = 0; j < dim; j++) {
+					sum[static_cast<size_t>(b) * dim + j] += x[static_cast<size_t>(i) * dim + j];
+					sum[static_cast<size_t>(l) * dim + j] -= x[static_cast<size_t>(i) * dim + j];
+				}
+			}
+			move_empty_centers<float,int>(x,centers,sum.data(),size.data(),label,
+					t,ea,n,m,dim,false,dim);
+			float * c = centers, * mv = moved.data();
+			update_center(sum.data(),size.data(),c,mv,t,m,dim,1);
+			if(bound_converged(x,centers,label,moved.data(),t,criteria,
+					e,count,it,n,m,dim,false,dim)) break;
+		}
+	}
+
 public:
 	// Some expensive resource shared by all tests.
 	static float * data;
@@ -216,6 +321,235 @@ TEST_F(KmeansTest, test7) {
 	cout << endl;
 }
 
+TEST_F(KmeansTest, test8) {
+	// The blocked engine must find the same nearest and second nearest centers
+	// as the one-pair-at-a-time loop
+	int n = 1000;
+	int * best_id;
+	float * best, * second;
+	init_array(best_id,n);
+	init_array(best,n);
+	init_array(second,n);
+	blocked_assign<float>(data,nullptr,data + (N - k) * d,best_id,best,second,d,n,k,4,false);
+	for(int i = 0; i < n; i++) {
+		float min = FLT_MAX, min2 = FLT_MAX, d_tmp;
+		int tmp = -1;
+		for(int j = 0; j < k; j++) {
+			d_tmp = distance_l2_square<float>(data + i * d,data + (N - k + j) * d,d);
+			if(d_tmp < min) {
+				min2 = min;
+				min = d_tmp;
+				tmp = j;
+			} else if(d_tmp < min2) {
+				min2 = d_tmp;
+			}
+		}
+		EXPECT_EQ(tmp,best_id[i]);
+		EXPECT_FLOAT_EQ(min,best[i]);
+		EXPECT_FLOAT_EQ(min2,second[i]);
+	}
+}
+
+TEST_F(KmeansTest, test9) {
+	// Three 256-bit prototypes with a few flipped bits in each copy
+	KmeansCriteria criteria = {2.0,1.0,100};
+	int n = 300, nb = 32, m = 3;
+	random_device rd;
+	mt19937 gen(rd());
+	uniform_int_distribution<int> byte_dis(0,255), bit_dis(0,8 * nb - 1);
+	unsigned char * protos, * bin, * _centers = nullptr;
+	int * _labels = nullptr;
+	init_array(protos,m * nb);
+	init_array(bin,n * nb);
+	for(int i = 0; i < m * nb; i++)
+		protos[i] = static_cast<unsigned char>(byte_dis(gen));
+	for(int i = 0; i < n; i++) {
+		memcpy(bin + i * nb,protos + (i % m) * nb,nb);
+		for(int f = 0; f < 8; f++) {
+			int b = bit_dis(gen);
+			bin[i * nb + b / 8] ^= static_cast<unsigned char>(1 << (b % 8));
+		}
+	}
+	kmajority(bin,_centers,_labels,
+			KmeansType::KMEANS_PLUS_SEEDS,
+			criteria,
+			EmptyActs::SINGLETON,
+			n,m,nb,4,
+			false);
+	for(int i = m; i < n; i++)
+		EXPECT_EQ(_labels[i % m],_labels[i]);
+	// The majority vote recovers the prototypes
+	for(int i = 0; i < m; i++)
+		EXPECT_EQ(0.0,distance_hamming<unsigned char>(protos + i * nb,
+				_centers + _labels[i] * nb,nb));
+}
+
+TEST_F(KmeansTest, test10) {
+	// The bytes are clustered natively and must reach the same result
+	// as their float copy from the same seeds
+	KmeansCriteria criteria = {2.0,1.0,100};
+	int n = 2000, m = 32;
+	unsigned char * bytes;
+	float * fbytes, * _seeds, * _centers, * _fcenters;
+	int * _labels, * _flabels;
+	init_array(bytes,n * d);
+	init_array(fbytes,n * d);
+	init_array(_seeds,m * d);
+	init_array(_centers,m * d);
+	init_array(_fcenters,m * d);
+	init_array(_labels,n);
+	init_array(_flabels,n);
+	for(int i = 0; i < n * d; i++) {
+		bytes[i] = static_cast<unsigned char>(data[i]);
+		fbytes[i] = static_cast<float>(bytes[i]);
+	}
+	kmeans_pp_seeds<unsigned char>(bytes,_seeds,DistanceType::NORM_L2,d,n,m,4,false);
+	greg_kmeans<unsigned char>(
+			bytes,_centers,_labels,_seeds,
+			KmeansType::USER_SEEDS,
+			criteria,
+			DistanceType::NORM_L2,
+			EmptyActs::SINGLETON,
+			n,m,d,4,
+			false);
+	greg_kmeans<float>(
+			fbytes,_fcenters,_flabels,_seeds,
+			KmeansType::USER_SEEDS,
+			criteria,
+			DistanceType::NORM_L2,
+			EmptyActs::SINGLETON,
+			n,m,d,4,
+			false);
+	float e = distortion<unsigned char>(bytes,_centers,_labels,DistanceType::NORM_L2,d,n,m,false);
+	float fe = distortion<float>(fbytes,_fcenters,_flabels,DistanceType::NORM_L2,d,n,m,false);
+	EXPECT_NEAR(fe,e,fe * 1e-2);
+	simple_kmeans<unsigned char>(
+			bytes,_centers,_labels,_seeds,
+			KmeansType::USER_SEEDS,
+			KmeansAssignType::LINEAR,
+			criteria,
+			DistanceType::NORM_L1,
+			EmptyActs::SINGLETON,
+			n,m,d,4,
+			false);
+	for(int i = 0; i < n; i++) {
+		ASSERT_GE(_labels[i],0);
+		ASSERT_LT(_labels[i],m);
+	}
+	::operator delete(bytes);
+	::operator delete(fbytes);
+	::operator delete(_seeds);
+	::operator delete(_centers);
+	::operator delete(_fcenters);
+	::operator delete(_labels);
+	::operator delete(_flabels);
+}
+
+TEST_F(KmeansTest, test11) {
+	// Half precision data with float centers: the rows and the distances
+	// stay within the rounding of half precision of the float32 data, and
+	// the distortion on the float32 data is within 1% of clustering them
+	KmeansCriteria criteria = {2.0,1.0,100};
+	int n = 2000, m = 32;
+	// Half precision keeps 11 significant bits
+	const double eps = 1.0 / 2048;
+	half_t * halfs;
+	float * _seeds, * _centers, * _fcenters;
+	int * _labels, * _flabels;
+	init_array(halfs,n * d);
+	init_array(_seeds,m * d);
+	init_array(_centers,m * d);
+	init_array(_fcenters,m * d);
+	init_array(_labels,n);
+	init_array(_flabels,n);
+	for(int i = 0; i < n * d; i++) {
+		halfs[i] = data[i];
+		ASSERT_LE(fabs(static_cast<float>(halfs[i]) - data[i]),eps * fabs(data[i]));
+	}
+	kmeans_pp_seeds<float>(data,_seeds,DistanceType::NORM_L2,d,n,m,4,false);
+	for(int i = 0; i < n; i++) {
+		// |(x' - c)^2 - (x - c)^2| <= |x' - x| (2 |x - c| + |x' - x|)
+		double bound = 0.0;
+		for(int j = 0; j < d; j++) {
+			double x = data[i * d + j], e = eps * fabs(x);
+			bound += e * (2.0 * fabs(x - _seeds[j]) + e);
+		}
+		float fd = compare_distance<float,float>(data + i * d,_seeds,DistanceType::NORM_L2,d);
+		float hd = compare_distance<half_t,float>(halfs + i * d,_seeds,DistanceType::NORM_L2,d);
+		EXPECT_NEAR(fd,hd,bound + fd * 1e-5);
+	}
+	greg_kmeans<half_t>(
+			halfs,_centers,_labels,_seeds,
+			KmeansType::USER_SEEDS,
+			criteria,
+			DistanceType::NORM_L2,
+			EmptyActs::SINGLETON,
+			n,m,d,4,
+			false);
+	greg_kmeans<float>(
+			data,_fcenters,_flabels,_seeds,
+			KmeansType::USER_SEEDS,
+			criteria,
+			DistanceType::NORM_L2,
+			EmptyActs::SINGLETON,
+			n,m,d,4,
+			false);
+	float e = distortion<float>(data,_centers,_labels,DistanceType::NORM_L2,d,n,m,false);
+	float fe = distortion<float>(data,_fcenters,_flabels,DistanceType::NORM_L2,d,n,m,false);
+	EXPECT_NEAR(fe,e,fe * 1e-2);
+	::operator delete(halfs);
+	::operator delete(_seeds);
+	::operator delete(_centers);
+	::operator delete(_fcenters);
+	::operator delete(_labels);
+	::operator delete(_flabels);
+}
+
+TEST_F(KmeansTest, test12) {
+	// Four directions with random lengths: only the angles separate them
+	KmeansCriteria criteria = {2.0,1.0,100};
+	int n = 400, m = 4;
+	random_device rd;
+	mt19937 gen(rd());
+	uniform_real_distribution<float> len_dis(0.1f,100.0f), noise_dis(-0.001f,0.001f);
+	float * dirs, * points, * _seeds = nullptr, * _centers;
+	int * _labels;
+	init_array(dirs,m * d);
+	init_array(points,n * d);
+	init_array(_centers,m * d);
+	init_array(_labels,n);
+	for(int i = 0; i < m * d; i++)
+		dirs[i] = data[i] - 127.5f;
+	normalize_rows(dirs,m,d);
+	for(int i = 0; i < n; i++) {
+		float l = len_dis(gen);
+		for(int j = 0; j < d; j++)
+			points[i * d + j] = l * (dirs[(i % m) * d + j] + noise_dis(gen));
+	}
+	EXPECT_NEAR(0.0,(compare_distance<float,float>(points,points + m * d,DistanceType::COSINE,d)),0.01);
+	EXPECT_NEAR(-inner_product<float>(points,dirs,d),
+			(compare_distance<float,float>(points,dirs,DistanceType::INNER_PRODUCT,d)),1e-3);
+
+	spherical_kmeans<float>(
+			points,_centers,_labels,_seeds,
+			KmeansType::KMEANS_PLUS_SEEDS,
+			criteria,
+			EmptyActs::SINGLETON,
+			n,m,d,4,
+			false);
+	for(int i = m; i < n; i++)
+		EXPECT_EQ(_labels[i % m],_labels[i]);
+	for(int i = 0; i < m; i++) {
+		EXPECT_NEAR(1.0,inner_product<float>(_centers + i * d,_centers + i * d,d),1e-4);
+		EXPECT_GT(inner_product<float>(_centers + _labels[i] * d,dirs + i * d,d),0.99);
+	}
+	::operator delete(dirs);
+	::operator delete(points);
+	::operator delete(_seeds);
+	::operator delete(_centers);
+	::operator delete(_labels);
+}
+
 /*TEST_F(KmeansTest, test6) {
 	Mat _data;
 	convert_array_to_mat(data,_data,N,d);
@@ -242,6 +576,1088 @@ TEST_F(KmeansTest, test7) {
 	cout << "Distortion is " << sqrt(distortion) << endl;
 }*/
 
+TEST_F(KmeansTest, test13) {
+	// The cached norms give the same assignment as the recomputed ones,
+	// and the norm bound never exceeds the squared distance
+	int n = 1000;
+	float * c = data + (N - k) * d;
+	NormCache cache;
+	cache.set_data<float>(data,n,d,4);
+	cache.set_centers(c,k,d);
+	for(int i = 0; i < n; i++)
+		EXPECT_NEAR(inner_product<float>(data + i * d,data + i * d,d),
+				cache.data_sq()[i],cache.data_sq()[i] * 1e-5);
+	int * id1, * id2;
+	float * b1, * b2, * s1, * s2;
+	init_array(id1,n);
+	init_array(id2,n);
+	init_array(b1,n);
+	init_array(b2,n);
+	init_array(s1,n);
+	init_array(s2,n);
+	blocked_assign<float>(data,nullptr,c,id1,b1,s1,d,n,k,4,false);
+	blocked_assign<float>(data,nullptr,c,id2,b2,s2,d,n,k,4,false,
+			cache.data_sq(),cache.center_sq());
+	for(int i = 0; i < n; i++) {
+		EXPECT_EQ(id1[i],id2[i]);
+		EXPECT_FLOAT_EQ(b1[i],b2[i]);
+		for(int j = 0; j < k; j += 17)
+			EXPECT_LE(cache.lower_bound(i,j),
+					distance_l2_square<float>(data + i * d,c + j * d,d) * (1.0 + 1e-5));
+	}
+
+	// update_center refreshes the norms of the moved centers
+	float * cs, * moved;
+	int * size;
+	init_array(cs,k * d);
+	init_array(moved,k);
+	init_array(size,k);
+	for(int j = 0; j < k * d; j++) cs[j] = 2.0f * c[j];
+	for(int j = 0; j < k; j++) size[j] = 1;
+	float * cc;
+	init_array(cc,k * d);
+	update_center(cs,size,cc,moved,DistanceType::NORM_L2,k,d,4,&cache);
+	for(int j = 0; j < k; j++)
+		EXPECT_NEAR(4.0 * inner_product<float>(c + j * d,c + j * d,d),
+				cache.center_sq()[j],cache.center_sq()[j] * 1e-5);
+	::operator delete(id1);
+	::operator delete(id2);
+	::operator delete(b1);
+	::operator delete(b2);
+	::operator delete(s1);
+	::operator delete(s2);
+	::operator delete(cs);
+	::operator delete(cc);
+	::operator delete(moved);
+	::operator delete(size);
+}
+
+TEST_F(KmeansTest, test14) {
+	// k-means on the padded rows of a Matrix gives the centers of the flat data
+	int n = 2000, m = 16, dm = 100;
+	Matrix<float> x(n,dm);
+	float * flat, * _seeds, * s1, * s2, * c1, * c2;
+	int * l1 = nullptr, * l2 = nullptr;
+	init_array<float>(flat,n * dm);
+	init_array<float>(_seeds,m * dm);
+	init_array<float>(s1,m * dm);
+	init_array<float>(s2,m * dm);
+	init_array<float>(c1,m * dm);
+	init_array<float>(c2,m * dm);
+	init_array<int>(l1,n);
+	init_array<int>(l2,n);
+	for(int i = 0; i < n; i++)
+		for(int j = 0; j < dm; j++)
+			flat[i * dm + j] = x[i][j] = data[i * d + j];
+	kmeans_pp_seeds<float>(flat,_seeds,DistanceType::NORM_L2,dm,n,m,4,false);
+	copy(_seeds,_seeds + m * dm,s1);
+	copy(_seeds,_seeds + m * dm,s2);
+	KmeansCriteria criteria = {1.0,1.0,5};
+	greg_kmeans<float>(flat,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::NONE,n,m,dm,4,false);
+	greg_kmeans<float>(x,c2,l2,s2,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::NONE,m,4,false);
+	// The rows are clustered in place in dm dimensions, as the flat ones
+	EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+	for(int i = 0; i < m * dm; i++)
+		EXPECT_NEAR(c1[i],c2[i],1e-3);
+	EXPECT_EQ(0,memcmp(_seeds,s2,m * dm * sizeof(float)));
+	::operator delete(flat);
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(s2);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test15) {
+	// With a workspace, the runs after the first one allocate nothing
+	// and give the same clusters as the runs without one
+	int n = 2000, m = 16;
+	float * _seeds, * s1, * c1, * c2;
+	int * l1, * l2;
+	init_array<float>(_seeds,m * d);
+	init_array<float>(s1,m * d);
+	init_array<float>(c1,m * d);
+	init_array<float>(c2,m * d);
+	init_array<int>(l1,n);
+	init_array<int>(l2,n);
+	kmeans_pp_seeds<float>(data,_seeds,DistanceType::NORM_L2,d,n,m,2,false);
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	KmeansWorkspace ws;
+	size_t before, after, capacity = 0;
+	for(int r = 0; r < 3; r++) {
+		copy(_seeds,_seeds + m * d,s1);
+		before = n_allocs;
+		greg_kmeans<float>(data,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+		simple_kmeans<float>(data,c1,l1,s1,KmeansType::USER_SEEDS,KmeansAssignType::LINEAR,
+				criteria,DistanceType::NORM_L1,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+		greg_kmeans<float>(data,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				DistanceType::NORM_L2,EmptyActs::SINGLETON,n - 100,m,d,2,false,&ws);
+		after = n_allocs;
+		if(r > 0) {
+			EXPECT_EQ(before,after);
+			EXPECT_EQ(capacity,ws.capacity());
+		}
+		capacity = ws.capacity();
+	}
+	copy(_seeds,_seeds + m * d,s1);
+	greg_kmeans<float>(data,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+	copy(_seeds,_seeds + m * d,s1);
+	greg_kmeans<float>(data,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false);
+	EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+	EXPECT_EQ(0,memcmp(c1,c2,m * d * sizeof(float)));
+	ws.clear();
+	EXPECT_EQ(0u,ws.capacity());
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test16) {
+	// The placed memory is aligned and zeroed in every page mode
+	PageMode modes[] = {PageMode::DEFAULT,PageMode::TRANSPARENT_HUGE,PageMode::EXPLICIT_HUGE};
+	for(PageMode mode : modes) {
+		float * x = nullptr;
+		EXPECT_TRUE(numa_array<float>(x,1001,7,3,mode));
+		EXPECT_EQ(0u,reinterpret_cast<uintptr_t>(x) % 64);
+		int zeros = 0;
+		for(int i = 0; i < 1001 * 7; i++)
+			zeros += x[i] == 0.0f;
+		EXPECT_EQ(1001 * 7,zeros);
+		if(mode == PageMode::DEFAULT) {
+			EXPECT_TRUE(page_mode(x) == PageMode::DEFAULT);
+		}
+		x[1001 * 7 - 1] = 1.0f;
+		page_free(x);
+	}
+	EXPECT_GE(numa_node_count(),1);
+	EXPECT_GE(current_numa_node(),0);
+	EXPECT_LT(current_numa_node(),numa_node_count());
+
+	// The copies of the centers follow them
+	CenterReplicas rep;
+	rep.resize(16 * d,PageMode::TRANSPARENT_HUGE,2);
+	EXPECT_EQ(2,rep.size());
+	rep.sync(data,16 * d);
+	EXPECT_EQ(0,memcmp(rep.copy(1),data,16 * d * sizeof(float)));
+	EXPECT_EQ(rep.copy(current_numa_node()),rep.local(data));
+	// Every page of a copy is on its node, the first one with the header too
+	if(numa_node_count() > 1) {
+		CenterReplicas placed;
+		size_t n_floats = HUGE_PAGE_SIZE;
+		placed.resize(n_floats,PageMode::TRANSPARENT_HUGE);
+		for(int i = 0; i < placed.size(); i++) {
+			EXPECT_EQ(i,numa_node_of(placed.copy(i)));
+			EXPECT_EQ(i,numa_node_of(placed.copy(i) + n_floats - 1));
+		}
+	}
+	int node = numa_node_of(rep.copy(0));
+	EXPECT_TRUE(node == -1 || (node >= 0 && node < numa_node_count()));
+	rep.resize(16 * d,PageMode::DEFAULT,1);
+	EXPECT_EQ(0,rep.size());
+	EXPECT_EQ(data,rep.local(data));
+
+	// A placed Matrix and a placed workspace give the clusters of the heap
+	int n = 2000, m = 16, n_thread = 3;
+	Matrix<float> x;
+	EXPECT_TRUE(x.resize(n,d,n_thread,PageMode::TRANSPARENT_HUGE));
+	for(int i = 0; i < n; i++)
+		memcpy(x[i],data + i * d,d * sizeof(float));
+	float * _seeds, * s1, * c1, * c2;
+	int * l1, * l2;
+	init_array<float>(_seeds,m * d);
+	init_array<float>(s1,m * d);
+	init_array<float>(c1,m * d);
+	init_array<float>(c2,m * d);
+	numa_array<int>(l1,n,1,n_thread,PageMode::TRANSPARENT_HUGE);
+	init_array<int>(l2,n);
+	kmeans_pp_seeds<float>(data,_seeds,DistanceType::NORM_L2,d,n,m,2,false);
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	KmeansWorkspace ws;
+	ws.place(PageMode::TRANSPARENT_HUGE,n_thread);
+	EXPECT_TRUE(ws.placed());
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	for(DistanceType t : types) {
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(x.data(),c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,n_thread,false,&ws);
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(data,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,n_thread,false);
+		EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+		EXPECT_EQ(0,memcmp(c1,c2,m * d * sizeof(float)));
+	}
+	EXPECT_TRUE(page_mode(ws.upper.get<float>(n)) != PageMode::DEFAULT);
+	ws.place(PageMode::DEFAULT,0);
+	EXPECT_FALSE(ws.placed());
+	EXPECT_EQ(0u,ws.capacity());
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	page_free(l1);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test17) {
+	// k-means on the rows of mapped .fvecs and .bvecs files, in place,
+	// gives the clusters of the rows in memory
+	int n = 2000, m = 16;
+	string path = "test_kmeans.fvecs", b_path = "test_kmeans.bvecs",
+			c_path = "test_centers.fvecs", l_path = "test_labels.ivecs";
+	EXPECT_TRUE(write_vecs<float>(path,data,n,d));
+	VecsFile<float> file;
+	EXPECT_FALSE(file.open("no_such_file.fvecs"));
+	EXPECT_TRUE(file.open(path));
+	EXPECT_EQ(n,file.rows());
+	EXPECT_EQ(d,file.cols());
+	EXPECT_EQ(0,memcmp(file[n - 1],data + (n - 1) * d,d * sizeof(float)));
+	// A .fvecs file is not a .bvecs file
+	VecsFile<unsigned char> wrong;
+	EXPECT_FALSE(wrong.open(path));
+
+	float * _seeds, * s1, * c1, * c2;
+	int * l1, * l2;
+	init_array<float>(_seeds,m * d);
+	init_array<float>(s1,m * d);
+	init_array<float>(c1,m * d);
+	init_array<float>(c2,m * d);
+	init_array<int>(l1,n);
+	init_array<int>(l2,n);
+	kmeans_pp_seeds<float>(data,_seeds,DistanceType::NORM_L2,d,n,m,2,false);
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	for(DistanceType t : types) {
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(file,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,m,2,false);
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(data,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,2,false);
+		EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+		EXPECT_EQ(0,memcmp(c1,c2,m * d * sizeof(float)));
+	}
+	copy(_seeds,_seeds + m * d,s1);
+	simple_kmeans<float>(file,c1,l1,s1,KmeansType::USER_SEEDS,KmeansAssignType::LINEAR,
+			criteria,DistanceType::NORM_L2,EmptyActs::SINGLETON,m,2,false);
+	copy(_seeds,_seeds + m * d,s1);
+	simple_kmeans<float>(data,c2,l2,s1,KmeansType::USER_SEEDS,KmeansAssignType::LINEAR,
+			criteria,DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false);
+	EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+	EXPECT_EQ(0,memcmp(c1,c2,m * d * sizeof(float)));
+
+	// The centers and the labels are read back
+	EXPECT_TRUE(write_centers(c_path,c1,m,d));
+	EXPECT_TRUE(write_labels(l_path,l1,n));
+	VecsFile<float> c_file(c_path);
+	VecsFile<int> l_file(l_path);
+	EXPECT_EQ(m,c_file.rows());
+	EXPECT_EQ(0,memcmp(c_file[m - 1],c1 + (m - 1) * d,d * sizeof(float)));
+	EXPECT_EQ(n,l_file.rows());
+	EXPECT_EQ(1,l_file.cols());
+	int same = 0;
+	for(int i = 0; i < n; i++)
+		same += l_file[i][0] == l1[i];
+	EXPECT_EQ(n,same);
+
+	// Bytes are 4 elements apart
+	unsigned char * bytes;
+	init_array<unsigned char>(bytes,n * d);
+	for(int i = 0; i < n * d; i++)
+		bytes[i] = static_cast<unsigned char>(data[i]);
+	EXPECT_TRUE(write_vecs<unsigned char>(b_path,bytes,n,d));
+	VecsFile<unsigned char> b_file(b_path);
+	EXPECT_EQ(static_cast<size_t>(d + 4),b_file.stride());
+	copy(_seeds,_seeds + m * d,s1);
+	greg_kmeans<unsigned char>(b_file,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,m,2,false);
+	copy(_seeds,_seeds + m * d,s1);
+	greg_kmeans<unsigned char>(bytes,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false);
+	EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+	EXPECT_EQ(0,memcmp(c1,c2,m * d * sizeof(float)));
+
+	file.close();
+	c_file.close();
+	l_file.close();
+	b_file.close();
+	remove(path.c_str());
+	remove(b_path.c_str());
+	remove(c_path.c_str());
+	remove(l_path.c_str());
+	::operator delete(bytes);
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test18) {
+	// One pass per iteration over the chunks of a file or a callback
+	// gives the clusters of the k-means in memory
+	int n = 2000, m = 16, chunk = 300;
+	string path = "test_stream.fvecs", l_path = "test_stream_labels.ivecs";
+	// Blobs that are far apart, so that no point lies near a tie
+	float * x;
+	init_array<float>(x,n * d);
+	make_blobs(x,n,m,d,20.0f,235.0f,1.0f,3);
+	EXPECT_TRUE(write_vecs<float>(path,x,n,d));
+	float * _seeds, * s1, * c1, * c2;
+	int * l2 = nullptr;
+	init_array<float>(_seeds,m * d);
+	init_array<float>(s1,m * d);
+	init_array<float>(c1,m * d);
+	init_array<float>(c2,m * d);
+	copy(x,x + m * d,_seeds);
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	copy(_seeds,_seeds + m * d,s1);
+	EXPECT_TRUE(stream_kmeans<float>(path,c1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::NONE,m,chunk,2,false,l_path));
+	copy(_seeds,_seeds + m * d,s1);
+	simple_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,KmeansAssignType::LINEAR,
+			criteria,DistanceType::NORM_L2,EmptyActs::NONE,n,m,d,2,false);
+	for(int i = 0; i < m * d; i++)
+		EXPECT_NEAR(c2[i],c1[i],1e-3);
+	VecsFile<int> l_file(l_path);
+	EXPECT_EQ(n,l_file.rows());
+	for(int i = 0; i < n; i++) {
+		ASSERT_EQ(l2[i],l_file[i][0]);
+		ASSERT_EQ(i % m,l2[i]);
+	}
+
+	// The chunks of a callback, which is called for every chunk in order
+	size_t expected = 0;
+	bool in_order = true;
+	CallbackChunkReader<float> source([&](float * buf, size_t first, int rows) {
+		if(first != 0 && first != expected) in_order = false;
+		memcpy(buf,x + first * d,rows * d * sizeof(float));
+		expected = first + rows;
+		return rows;
+	},n,d);
+	copy(_seeds,_seeds + m * d,s1);
+	EXPECT_TRUE(stream_kmeans<float>(source,c1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L1,EmptyActs::SINGLETON,m,chunk,2,false));
+	EXPECT_TRUE(in_order);
+	copy(_seeds,_seeds + m * d,s1);
+	EXPECT_TRUE(stream_kmeans<float>(source,c1,s1,KmeansType::KMEANS_PLUS_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,m,chunk,2,false));
+	for(int i = 0; i < m * d; i++)
+		EXPECT_TRUE(c1[i] >= 0.0f && c1[i] <= 255.0f);
+
+	// A failed read stops the k-means
+	CallbackChunkReader<float> broken([&](float *, size_t first, int rows) {
+		return first >= 1000 ? -1 : rows;
+	},n,d);
+	EXPECT_FALSE(stream_kmeans<float>(broken,c1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::NONE,m,chunk,2,false));
+
+	l_file.close();
+	remove(path.c_str());
+	remove(l_path.c_str());
+	::operator delete(x);
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test19) {
+	// With few dimensions the assignments go over the transposed centers
+	// and give the nearest centers of a direct search
+	int n = 3000, m = 64, dt = 8, n_thread = 2;
+	EXPECT_TRUE(use_center_tiles(dt,m));
+	float * c, * best, * second;
+	int * ids, * labels, * sizes;
+	float * sums;
+	init_array<float>(c,m * dt);
+	init_array<float>(best,n);
+	init_array<float>(second,n);
+	init_array<int>(ids,n);
+	init_array<int>(labels,n);
+	init_array<int>(sizes,m);
+	init_array<float>(sums,m * dt);
+	copy(data + n * dt,data + (n + m) * dt,c);
+	blocked_assign<float>(data,nullptr,c,ids,best,second,dt,n,m,n_thread,false);
+	for(int i = 0; i < n; i++) {
+		double d1 = DBL_MAX, d2 = DBL_MAX, tmp;
+		for(int j = 0; j < m; j++) {
+			tmp = distance_l2_square<float>(data + i * dt,c + j * dt,dt);
+			if(tmp < d1) {
+				d2 = d1;
+				d1 = tmp;
+			} else if(tmp < d2) {
+				d2 = tmp;
+			}
+		}
+		EXPECT_NEAR(d1,best[i],d1 * 1e-5);
+		EXPECT_NEAR(d2,second[i],d2 * 1e-5);
+		EXPECT_NEAR(d1,distance_l2_square<float>(data + i * dt,c + ids[i] * dt,dt),d1 * 1e-5);
+	}
+	KmeansWorkspace ws;
+	fill(labels,labels + n,-1);
+	fill(sizes,sizes + m,0);
+	fill(sums,sums + m * dt,0.0f);
+	linear_assign<float>(data,c,labels,sizes,sums,DistanceType::NORM_L1,dt,n,m,n_thread,false,nullptr,&ws);
+	int total = 0;
+	for(int i = 0; i < n; i++) {
+		double d1 = DBL_MAX;
+		for(int j = 0; j < m; j++)
+			d1 = std::min(d1,distance_l1<float>(data + i * dt,c + j * dt,dt));
+		EXPECT_NEAR(d1,distance_l1<float>(data + i * dt,c + labels[i] * dt,dt),d1 * 1e-5);
+	}
+	for(int j = 0; j < m; j++)
+		total += sizes[j];
+	EXPECT_EQ(n,total);
+	EXPECT_GT(ws.center_tiles.capacity(),0u);
+	// With many dimensions the bounded L1 scan visits the dimensions
+	// in the order of the variance of the centers
+	float * wc;
+	init_array<float>(wc,m * d);
+	copy(data + n * d,data + (n + m) * d,wc);
+	fill(sizes,sizes + m,0);
+	::operator delete(sums);
+	init_array<float>(sums,m * d);
+	fill(sums,sums + m * d,0.0f);
+	linear_assign<float>(data,wc,labels,sizes,sums,DistanceType::NORM_L1,d,n,m,n_thread,false,nullptr,&ws);
+	for(int i = 0; i < n; i++) {
+		double d1 = DBL_MAX;
+		for(int j = 0; j < m; j++)
+			d1 = std::min(d1,distance_l1<float>(data + i * d,wc + j * d,d));
+		EXPECT_NEAR(d1,distance_l1<float>(data + i * d,wc + labels[i] * d,d),d1 * 1e-5);
+	}
+	EXPECT_GT(ws.permuted.capacity(),0u);
+	::operator delete(wc);
+
+	// Greg's k-means runs its candidates over the tiles in both metrics
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	for(DistanceType t : types) {
+		float * s1;
+		init_array<float>(s1,m * dt);
+		copy(data + n * dt,data + (n + m) * dt,s1);
+		greg_kmeans<float>(data,c,labels,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,dt,n_thread,false,&ws);
+		for(int i = 0; i < n; i++) {
+			EXPECT_GE(labels[i],0);
+			EXPECT_LT(labels[i],m);
+		}
+		::operator delete(s1);
+	}
+	::operator delete(c);
+	::operator delete(best);
+	::operator delete(second);
+	::operator delete(ids);
+	::operator delete(labels);
+	::operator delete(sizes);
+	::operator delete(sums);
+}
+
+TEST_F(KmeansTest, test20) {
+	// Narrow labels and unsigned point indices give the clusters of int labels
+	EXPECT_TRUE(label_fits<unsigned char>(256));
+	EXPECT_FALSE(label_fits<unsigned char>(257));
+	EXPECT_TRUE(label_fits<unsigned short>(65536));
+	EXPECT_FALSE(label_fits<short>(65536));
+	int n = 2000, m = 40;
+	float * _seeds, * s1, * c1, * c2, * c3;
+	int * l1;
+	unsigned char * l2;
+	unsigned short * l3;
+	init_array<float>(_seeds,m * d);
+	init_array<float>(s1,m * d);
+	init_array<float>(c1,m * d);
+	init_array<float>(c2,m * d);
+	init_array<float>(c3,m * d);
+	init_array<int>(l1,n);
+	init_array<unsigned char>(l2,n);
+	init_array<unsigned short>(l3,n);
+	kmeans_pp_seeds<float>(data,_seeds,DistanceType::NORM_L2,d,n,m,2,false);
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1,DistanceType::INNER_PRODUCT};
+	KmeansWorkspace ws;
+	for(DistanceType t : types) {
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(data,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(data,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float,unsigned short,unsigned>(data,c3,l3,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+		for(int i = 0; i < n; i++) {
+			EXPECT_EQ(l1[i],static_cast<int>(l2[i]));
+			EXPECT_EQ(l1[i],static_cast<int>(l3[i]));
+		}
+		EXPECT_EQ(0,memcmp(c1,c2,m * d * sizeof(float)));
+		EXPECT_EQ(0,memcmp(c1,c3,m * d * sizeof(float)));
+	}
+	// An index type too narrow for the points leaves the labels untouched
+	EXPECT_TRUE(index_fits<unsigned short>(65536));
+	EXPECT_FALSE(index_fits<signed char>(n));
+	fill(l1,l1 + n,-1);
+	copy(_seeds,_seeds + m * d,s1);
+	greg_kmeans<float,int,signed char>(data,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+	EXPECT_EQ(n,count(l1,l1 + n,-1));
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(c3);
+	::operator delete(l1);
+	::operator delete(l2);
+	::operator delete(l3);
+}
+
+TEST_F(KmeansTest, test21) {
+	// A sparse .bvecs file of more than 2^32 elements: 64 rows that are
+	// 16700 rows apart are written and clustered in place through the
+	// row stride, so the offsets of the last rows exceed 32 bits
+	const int dim = 4092, step = 16700, n = 64, m = 4;
+	const int rows = step * (n - 1) + 1;
+	string path = "test_large.bvecs";
+	int fd = open(path.c_str(),O_CREAT | O_TRUNC | O_WRONLY,0644);
+	ASSERT_GE(fd,0);
+	size_t row_bytes = sizeof(int32_t) + dim;
+	EXPECT_GT(static_cast<size_t>(rows) * dim,static_cast<size_t>(1) << 32);
+	EXPECT_EQ(0,ftruncate(fd,static_cast<off_t>(rows * row_bytes)));
+	vector<unsigned char> r(row_bytes);
+	int32_t dim32 = dim;
+	memcpy(r.data(),&dim32,sizeof(int32_t));
+	for(int i = 0; i < n; i++) {
+		// Four clusters, far apart
+		for(int j = 0; j < dim; j++)
+			r[sizeof(int32_t) + j] = static_cast<unsigned char>((i % m) * 60 + (i * 7 + j) % 5);
+		EXPECT_EQ(static_cast<ssize_t>(row_bytes),pwrite(fd,r.data(),row_bytes,
+				static_cast<off_t>(static_cast<size_t>(i) * step * row_bytes)));
+	}
+	close(fd);
+
+	VecsFile<unsigned char> file(path);
+	ASSERT_TRUE(file.is_open());
+	EXPECT_EQ(rows,file.rows());
+	EXPECT_EQ(dim,file.cols());
+	EXPECT_EQ(0,memcmp(file[rows - 1],r.data() + sizeof(int32_t),dim));
+	EXPECT_GT(static_cast<size_t>(file[rows - 1] - file.data()),static_cast<size_t>(1) << 32);
+
+	size_t ld = file.stride() * step;
+	float * c1, * s1;
+	int * l1 = nullptr;
+	init_array<float>(c1,m * dim);
+	init_array<float>(s1,m * dim);
+	init_array<int>(l1,n);
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	KmeansWorkspace ws;
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	for(DistanceType t : types) {
+		for(int i = 0; i < m * dim; i++)
+			s1[i] = static_cast<float>(file.data()[(i / dim) * ld + i % dim]);
+		greg_kmeans<unsigned char>(file.data(),c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,dim,1,false,&ws,ld);
+		for(int i = 0; i < n; i++)
+			EXPECT_EQ(i % m,l1[i]);
+		for(int i = 0; i < m * dim; i++)
+			s1[i] = static_cast<float>(file.data()[(i / dim) * ld + i % dim]);
+		simple_kmeans<unsigned char>(file.data(),c1,l1,s1,KmeansType::USER_SEEDS,
+				KmeansAssignType::LINEAR,criteria,t,EmptyActs::SINGLETON,n,m,dim,1,false,&ws,ld);
+		for(int i = 0; i < n; i++)
+			EXPECT_EQ(i % m,l1[i]);
+		float e = distortion<unsigned char>(file.data(),c1,l1,t,dim,n,m,false,ld);
+		EXPECT_GT(e,0.0f);
+		EXPECT_LT(e,1e6f);
+	}
+	// The last cluster holds the last row of the file
+	for(int j = 0; j < dim; j++)
+		EXPECT_NEAR(c1[(m - 1) * dim + j],(m - 1) * 60 + 2.0f,2.5f);
+	file.close();
+	remove(path.c_str());
+	::operator delete(c1);
+	::operator delete(s1);
+	::operator delete(l1);
+}
+
+TEST_F(KmeansTest, test22) {
+	// Elkan's k-means gives the clusters of Hamerly's method from the same
+	// seeds, and runs Hamerly's method when its bounds exceed the budget
+	int n = 3000, m = 64;
+	// Blobs that are far apart, so that no point lies near a tie
+	float * x;
+	init_array<float>(x,n * d);
+	make_blobs(x,n,m,d,20.0f,235.0f,1.0f,3);
+	float * _seeds, * s1, * c1, * c2;
+	int * l1, * l2;
+	init_array<float>(_seeds,m * d);
+	init_array<float>(s1,m * d);
+	init_array<float>(c1,m * d);
+	init_array<float>(c2,m * d);
+	init_array<int>(l1,n);
+	init_array<int>(l2,n);
+	copy(x,x + m * d,_seeds);
+	KmeansCriteria criteria = {1.0,1e-3,5};
+	KmeansWorkspace ws;
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	for(DistanceType t : types) {
+		copy(_seeds,_seeds + m * d,s1);
+		elkan_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,2,false);
+		EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+		for(int i = 0; i < n; i++)
+			ASSERT_EQ(i % m,l1[i]);
+		for(int i = 0; i < m * d; i++)
+			EXPECT_NEAR(c2[i],c1[i],1e-3);
+	}
+	EXPECT_GE(ws.elkan_lower.capacity(),static_cast<size_t>(n) * m * sizeof(float));
+
+	// Overlapping blobs in few dimensions, with far and duplicate seeds
+	// that leave clusters empty: the bounds prune over many iterations
+	// and the labels are those of Lloyd's k-means by brute force
+	int n2 = 2000, m2 = 16;
+	KmeansCriteria long_run = {1.0,0.0,30};
+	EmptyActs acts[] = {EmptyActs::SINGLETON,EmptyActs::NONE};
+	for(int dim = 1; dim <= 4; dim++) {
+		make_blobs(x,n2,6,dim,0.0f,10.0f,3.0f,dim);
+		// Four far seeds, then twice the first six points
+		for(int r = 0; r < m2; r++)
+			for(int j = 0; j < dim; j++)
+				_seeds[r * dim + j] = r < 4 ? 200.0f + 10.0f * r + j : x[((r - 4) % 6) * dim + j];
+		for(DistanceType t : types) {
+			for(EmptyActs ea : acts) {
+				copy(_seeds,_seeds + m2 * dim,s1);
+				elkan_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,long_run,
+						t,ea,n2,m2,dim,2,false,&ws);
+				copy(_seeds,_seeds + m2 * dim,c2);
+				reference_kmeans(x,c2,l2,t,ea,long_run,n2,m2,dim);
+				EXPECT_EQ(0,memcmp(l1,l2,n2 * sizeof(int)));
+			}
+		}
+	}
+
+	// A budget too small for the bounds: exactly Hamerly's method
+	copy(_seeds,_seeds + m * d,s1);
+	elkan_kmeans<float>(data,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false,nullptr,0,1024);
+	copy(_seeds,_seeds + m * d,s1);
+	greg_kmeans<float>(data,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false);
+	EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+	EXPECT_EQ(0,memcmp(c1,c2,m * d * sizeof(float)));
+
+	// k-means++ seeds and narrow labels
+	unsigned char * l3;
+	init_array<unsigned char>(l3,n);
+	elkan_kmeans<float>(data,c1,l3,s1,KmeansType::KMEANS_PLUS_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+	for(int i = 0; i < n; i++)
+		EXPECT_LT(l3[i],m);
+	::operator delete(x);
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+	::operator delete(l3);
+}
+
+TEST_F(KmeansTest, test23) {
+	// The Yinyang k-means gives the clusters of Hamerly's method from the
+	// same seeds, with the default groups, one group and a group per center
+	int n = 3000, m = 64;
+	// Blobs that are far apart, so that no point lies near a tie
+	float * x;
+	init_array<float>(x,n * d);
+	make_blobs(x,n,m,d,20.0f,235.0f,1.0f,3);
+	float * _seeds, * s1, * c1, * c2;
+	int * l1, * l2;
+	init_array<float>(_seeds,m * d);
+	init_array<float>(s1,m * d);
+	init_array<float>(c1,m * d);
+	init_array<float>(c2,m * d);
+	init_array<int>(l1,n);
+	init_array<int>(l2,n);
+	copy(x,x + m * d,_seeds);
+	KmeansCriteria criteria = {1.0,1e-3,5};
+	KmeansWorkspace ws;
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	int groups[] = {0,1,m};
+	for(DistanceType t : types) {
+		copy(_seeds,_seeds + m * d,s1);
+		greg_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,d,2,false);
+		for(int i = 0; i < n; i++)
+			ASSERT_EQ(i % m,l2[i]);
+		for(int g : groups) {
+			copy(_seeds,_seeds + m * d,s1);
+			yinyang_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+					t,EmptyActs::SINGLETON,n,m,d,2,false,&ws,0,g);
+			EXPECT_EQ(0,memcmp(l1,l2,n * sizeof(int)));
+			for(int i = 0; i < m * d; i++)
+				EXPECT_NEAR(c2[i],c1[i],1e-3);
+		}
+	}
+	EXPECT_GE(ws.group_lower.capacity(),static_cast<size_t>(n) * (m / YINYANG_GROUP_SIZE) * sizeof(float));
+
+	// Overlapping blobs in few dimensions, with far and duplicate seeds
+	// that leave clusters empty: the filters prune over many iterations
+	// and the labels are those of Elkan's k-means
+	int n2 = 2000, m2 = 16, groups2[] = {1,0,m2};
+	KmeansCriteria long_run = {1.0,0.0,30};
+	EmptyActs acts[] = {EmptyActs::SINGLETON,EmptyActs::NONE};
+	for(int dim = 1; dim <= 4; dim++) {
+		make_blobs(x,n2,6,dim,0.0f,10.0f,3.0f,dim);
+		// Four far seeds, then twice the first six points
+		for(int r = 0; r < m2; r++)
+			for(int j = 0; j < dim; j++)
+				_seeds[r * dim + j] = r < 4 ? 200.0f + 10.0f * r + j : x[((r - 4) % 6) * dim + j];
+		for(DistanceType t : types) {
+			for(EmptyActs ea : acts) {
+				copy(_seeds,_seeds + m2 * dim,s1);
+				elkan_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,long_run,
+						t,ea,n2,m2,dim,2,false,&ws);
+				for(int g : groups2) {
+					copy(_seeds,_seeds + m2 * dim,s1);
+					yinyang_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,long_run,
+							t,ea,n2,m2,dim,2,false,&ws,0,g);
+					EXPECT_EQ(0,memcmp(l1,l2,n2 * sizeof(int)));
+				}
+			}
+		}
+	}
+	// Seeds scattered around the blobs: the points that move to the empty
+	// clusters had left their old centers out of their group bounds
+	int scattered[] = {2,7,9};
+	EmptyActs moves[] = {EmptyActs::SINGLETON,EmptyActs::SINGLETON_2};
+	n2 = 1500;
+	for(int r : scattered) {
+		int dim = 1 + r % 4;
+		make_blobs(x,n2,5,dim,0.0f,10.0f,3.0f,100 + r);
+		mt19937 gen(r);
+		uniform_real_distribution<float> far(-50.0f,50.0f);
+		for(int i = 0; i < m2 * dim; i++)
+			_seeds[i] = far(gen);
+		for(DistanceType t : types) {
+			for(EmptyActs ea : moves) {
+				copy(_seeds,_seeds + m2 * dim,s1);
+				elkan_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,long_run,
+						t,ea,n2,m2,dim,2,false,&ws);
+				for(int g : groups2) {
+					copy(_seeds,_seeds + m2 * dim,s1);
+					yinyang_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,long_run,
+							t,ea,n2,m2,dim,2,false,&ws,0,g);
+					EXPECT_EQ(0,memcmp(l1,l2,n2 * sizeof(int)));
+				}
+			}
+		}
+	}
+
+	// k-means++ seeds and narrow labels
+	unsigned char * l3;
+	init_array<unsigned char>(l3,n);
+	yinyang_kmeans<float>(data,c1,l3,s1,KmeansType::KMEANS_PLUS_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,d,2,false,&ws);
+	for(int i = 0; i < n; i++)
+		EXPECT_LT(l3[i],m);
+	::operator delete(x);
+	::operator delete(_seeds);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+	::operator delete(l3);
+}
+
+TEST_F(KmeansTest, test24) {
+	// The scan of the sorted centers around the center of a point finds
+	// the two nearest centers of a full scan, from any center of the point
+	int n = 500, m = 64;
+	float * c, closest[64];
+	CenterRing * rings = new CenterRing[m * (m - 1)];
+	init_array<float>(c,m * d);
+	copy(data + 1000 * d,data + (1000 + m) * d,c);
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	for(DistanceType t : types) {
+		DistanceFunction<float,float> dis = compare_function<float,float>(t,d);
+		center_rings(c,m,d,t,closest,rings,2);
+		for(int i = 0; i < m; i++) {
+			for(int r = 1; r < m - 1; r++)
+				ASSERT_LE(rings[i * (m - 1) + r - 1].dist,rings[i * (m - 1) + r].dist);
+			EXPECT_EQ(closest[i],rings[i * (m - 1)].dist);
+		}
+		for(int x = 0; x < n; x++) {
+			float * dt = data + x * d, m1 = FLT_MAX, m2 = FLT_MAX, v, b, s;
+			int id = -1;
+			for(int j = 0; j < m; j++) {
+				v = to_metric(dis(dt,c + j * d,d),t);
+				if(v < m1) {
+					m2 = m1;
+					m1 = v;
+					id = j;
+				} else if(v < m2) {
+					m2 = v;
+				}
+			}
+			int a = x % m;
+			float u = to_metric(dis(dt,c + a * d,d),t);
+			int l = ring_nearest<float>(dt,c,rings + a * (m - 1),dis,t,a,u,m,d,b,s);
+			EXPECT_EQ(id,l);
+			EXPECT_FLOAT_EQ(m1,b);
+			EXPECT_FLOAT_EQ(m2,s);
+		}
+	}
+	delete[] rings;
+	::operator delete(c);
+}
+
+TEST_F(KmeansTest, test25) {
+	// The mini-batch k-means of well separated blobs reaches the
+	// distortion of Hamerly's method from a point of each blob
+	int n = 20000, dd = 16, m = 20;
+	float * x, * s1, * c1, * c2;
+	int * l1, * l2;
+	init_array<float>(x,n * dd);
+	init_array<float>(s1,m * dd);
+	init_array<float>(c1,m * dd);
+	init_array<float>(c2,m * dd);
+	init_array<int>(l1,n);
+	init_array<int>(l2,n);
+	make_blobs(x,n,m,dd,-50.0f,50.0f,1.0f,7);
+	KmeansCriteria criteria = {1.0,1e-3,300};
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	KmeansWorkspace ws;
+	for(DistanceType t : types) {
+		copy(x,x + m * dd,s1);
+		minibatch_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+				t,n,m,dd,256,2,false,&ws);
+		copy(x,x + m * dd,s1);
+		greg_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+				t,EmptyActs::SINGLETON,n,m,dd,2,false);
+		for(int i = 0; i < n; i++)
+			ASSERT_EQ(i % m,l1[i]);
+		EXPECT_LE(distortion<float>(x,c1,l1,t,dd,n,m,false),
+				1.01f * distortion<float>(x,c2,l2,t,dd,n,m,false));
+	}
+
+	// k-means++ seeds from a sample, without the labels
+	minibatch_kmeans<float>(x,c1,nullptr,s1,KmeansType::KMEANS_PLUS_SEEDS,criteria,
+			DistanceType::NORM_L2,n,m,dd,0,2,false,&ws);
+	for(int i = 0; i < m * dd; i++)
+		EXPECT_TRUE(std::isfinite(c1[i]));
+	::operator delete(x);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test26) {
+	// The k-means with the kd-tree of the centers assigns the points as
+	// the linear search does, and its approximate search stays close
+	int n = 20000, dd = 3, m = 200;
+	float * x, * s1, * c1, * c2;
+	int * l1 = nullptr, * l2 = nullptr;
+	init_array<float>(x,n * dd);
+	init_array<float>(s1,m * dd);
+	init_array<float>(c1,m * dd);
+	init_array<float>(c2,m * dd);
+	mt19937 gen(5);
+	uniform_real_distribution<float> place(0.0f,100.0f);
+	for(int i = 0; i < n * dd; i++) x[i] = place(gen);
+	KmeansCriteria criteria = {2.0,1e-3,10};
+	DistanceType types[] = {DistanceType::NORM_L2,DistanceType::NORM_L1};
+	for(DistanceType t : types) {
+		copy(x,x + m * dd,s1);
+		simple_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,KmeansAssignType::NN_KD_TREE,
+				criteria,t,EmptyActs::SINGLETON,n,m,dd,2,false);
+		copy(x,x + m * dd,s1);
+		simple_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,KmeansAssignType::LINEAR,
+				criteria,t,EmptyActs::SINGLETON,n,m,dd,2,false);
+		int same = 0;
+		for(int i = 0; i < n; i++)
+			same += l1[i] == l2[i];
+		EXPECT_GE(same,n * 999 / 1000);
+		float e = distortion<float>(x,c2,l2,t,dd,n,m,false);
+		EXPECT_NEAR(e,distortion<float>(x,c1,l1,t,dd,n,m,false),e * 1e-3);
+
+		copy(x,x + m * dd,s1);
+		simple_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,KmeansAssignType::ANN_KD_TREE,
+				criteria,t,EmptyActs::SINGLETON,n,m,dd,2,false);
+		EXPECT_LE(distortion<float>(x,c1,l1,t,dd,n,m,false),e * 1.1f);
+	}
+	::operator delete(x);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test27) {
+	// The filtering k-means moves the centers as Lloyd's k-means does,
+	// and runs greg_kmeans for the distances other than NORM_L2
+	int n = 20000, dd = 3, m = 100;
+	float * x, * s1, * c1, * c2;
+	int * l1 = nullptr, * l2 = nullptr;
+	init_array<float>(x,n * dd);
+	init_array<float>(s1,m * dd);
+	init_array<float>(c1,m * dd);
+	init_array<float>(c2,m * dd);
+	init_array<int>(l2,n);
+	make_blobs(x,n,m,dd,-50.0f,50.0f,2.0f,9);
+	KmeansCriteria criteria = {1.0,0.0,20};
+	KmeansWorkspace ws;
+	copy(x,x + m * dd,s1);
+	filter_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::NONE,n,m,dd,2,false,&ws);
+	copy(x,x + m * dd,s1);
+	simple_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,KmeansAssignType::LINEAR,
+			criteria,DistanceType::NORM_L2,EmptyActs::NONE,n,m,dd,2,false);
+	for(int i = 0; i < m * dd; i++)
+		ASSERT_NEAR(c2[i],c1[i],1e-3);
+	// The labels are those of the final centers
+	for(int i = 0; i < n; i++) {
+		double best = FLT_MAX;
+		for(int j = 0; j < m; j++)
+			best = std::min(best,distance_l2_square<float>(x + i * dd,c1 + j * dd,dd));
+		ASSERT_NEAR(best,distance_l2_square<float>(x + i * dd,c1 + l1[i] * dd,dd),1e-3);
+	}
+
+	// The fallback
+	copy(x,x + m * dd,s1);
+	filter_kmeans<float>(x,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L1,EmptyActs::SINGLETON,n,m,dd,2,false,&ws);
+	copy(x,x + m * dd,s1);
+	greg_kmeans<float>(x,c2,l2,s1,KmeansType::USER_SEEDS,criteria,
+			DistanceType::NORM_L1,EmptyActs::SINGLETON,n,m,dd,2,false);
+	for(int i = 0; i < n; i++)
+		ASSERT_EQ(l2[i],l1[i]);
+
+	// k-means++ seeds
+	filter_kmeans<float>(x,c1,l1,s1,KmeansType::KMEANS_PLUS_SEEDS,criteria,
+			DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,dd,2,false,&ws);
+	for(int i = 0; i < m * dd; i++)
+		EXPECT_TRUE(std::isfinite(c1[i]));
+	for(int i = 0; i < n; i++) {
+		ASSERT_GE(l1[i],0);
+		ASSERT_LT(l1[i],m);
+	}
+	::operator delete(x);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(c2);
+	::operator delete(l1);
+	::operator delete(l2);
+}
+
+TEST_F(KmeansTest, test28) {
+	// The k-means|| seeds find all blobs that are far apart, in
+	// simple_kmeans and greg_kmeans, and every seed is finite
+	int n = 20000, dd = 8, m = 8;
+	float * x, * s1 = nullptr, * c1;
+	int * l1 = nullptr;
+	init_array<float>(x,n * dd);
+	init_array<float>(c1,m * dd);
+	init_array<int>(l1,n);
+	vector<float> blobs = make_blobs(x,n,m,dd,-50.0f,50.0f,1.0f,13);
+	KmeansCriteria criteria = {1.0,1e-3,100};
+	KmeansWorkspace ws;
+	for(int r = 0; r < 2; r++) {
+		if(r == 0)
+			simple_kmeans<float>(x,c1,l1,s1,KmeansType::KMEANS_PAR_SEEDS,KmeansAssignType::LINEAR,
+					criteria,DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,dd,2,false,&ws);
+		else
+			greg_kmeans<float>(x,c1,l1,s1,KmeansType::KMEANS_PAR_SEEDS,criteria,
+					DistanceType::NORM_L2,EmptyActs::SINGLETON,n,m,dd,2,false,&ws);
+		// The points of a blob share a label
+		for(int i = m; i < n; i++)
+			ASSERT_EQ(l1[i % m],l1[i]);
+		for(int i = 0; i < m; i++)
+			for(int j = i + 1; j < m; j++)
+				ASSERT_NE(l1[i],l1[j]);
+	}
+
+	// Other distances
+	kmeans_par_seeds<float>(x,s1,DistanceType::NORM_L1,dd,n,m,2,false);
+	for(int i = 0; i < m * dd; i++)
+		EXPECT_TRUE(std::isfinite(s1[i]));
+
+	// Binary data: the weighted majority keeps the seeds binary
+	mt19937 gen(13);
+	for(int i = 0; i < n * dd; i++)
+		x[i] = static_cast<float>(gen() & 1);
+	kmeans_par_seeds<float>(x,s1,DistanceType::HAMMING,dd,n,m,2,false,nullptr,&ws);
+	for(int i = 0; i < m * dd; i++)
+		EXPECT_TRUE(s1[i] == 0.0f || s1[i] == 1.0f);
+
+	// Fewer distinct points than seeds: the seeds are data points, up to
+	// the rounding of the float sums of update_center
+	for(int i = 0; i < n; i++)
+		copy(blobs.begin() + (i % 3) * dd,blobs.begin() + (i % 3 + 1) * dd,x + i * dd);
+	kmeans_par_seeds<float>(x,s1,DistanceType::NORM_L2,dd,n,m,2,false,nullptr,&ws);
+	auto close = [](float a, float b) { return fabs(a - b) <= 1e-5f * std::max(1.0f,fabs(b)); };
+	for(int i = 0; i < m; i++) {
+		bool found = false;
+		for(int j = 0; j < 3; j++)
+			found = found || equal(s1 + i * dd,s1 + (i + 1) * dd,blobs.begin() + j * dd,close);
+		EXPECT_TRUE(found);
+	}
+	::operator delete(x);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(l1);
+}
+
+TEST_F(KmeansTest, test29) {
+	// Packed binary data are left to kmajority: the float k-means
+	// do not touch the centers or the labels
+	int n = 200, dd = 4, m = 4;
+	unsigned char * x;
+	float * s1, * c1;
+	int * l1;
+	init_array<unsigned char>(x,n * dd);
+	init_array<float>(s1,m * dd);
+	init_array<float>(c1,m * dd);
+	init_array<int>(l1,n);
+	for(int i = 0; i < n * dd; i++) x[i] = static_cast<unsigned char>(i * 37);
+	for(int i = 0; i < m * dd; i++) s1[i] = x[i];
+	KmeansCriteria criteria = {1.0,1e-3,10};
+	for(int r = 0; r < 2; r++) {
+		fill(c1,c1 + m * dd,-1.0f);
+		fill(l1,l1 + n,-1);
+		if(r == 0)
+			simple_kmeans<unsigned char>(x,c1,l1,s1,KmeansType::USER_SEEDS,KmeansAssignType::LINEAR,
+					criteria,DistanceType::HAMMING,EmptyActs::SINGLETON,n,m,dd,1,false);
+		else
+			greg_kmeans<unsigned char>(x,c1,l1,s1,KmeansType::USER_SEEDS,criteria,
+					DistanceType::HAMMING,EmptyActs::SINGLETON,n,m,dd,1,false);
+		for(int i = 0; i < m * dd; i++)
+			ASSERT_EQ(-1.0f,c1[i]);
+		for(int i = 0; i < n; i++)
+			ASSERT_EQ(-1,l1[i]);
+	}
+	::operator delete(x);
+	::operator delete(s1);
+	::operator delete(c1);
+	::operator delete(l1);
+}
+
 int main(int argc, char * argv[])
 {
 	/*The method is initializes the Google framework and must be called before RUN_ALL_TESTS */
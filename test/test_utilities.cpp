@@ -27,7 +27,11 @@
 #include <gtest/gtest.h>
 #include <cmath>
 #include <cstdlib>
+#include <cfloat>
+#include <algorithm>
 #include "utilities.h"
+#include "matrix.h"
+#include "center-tiles.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -48,6 +52,13 @@ int compare_float(const float * _a, const float * _b) {
 	else return 0;
 }
 
+/**
+ * A distance that is computed by a static initializer, which may run
+ * before the static initializers of the library
+ */
+static const float static_x[] = {1.0f, 2.0f, 3.0f, 4.0f}, static_y[] = {0.0f, 0.0f, 0.0f, 0.0f};
+static const float static_dist = simd_l2_square_f32(static_x,static_y,4);
+
 /**
  * Customized test case for testing
  */
@@ -133,6 +144,14 @@ TEST_F(UtilTest, test4) {
 TEST_F(UtilTest, test5) {
 	float ** t;
 	EXPECT_TRUE(init_array_2<float>(t,1000,200) && t!=nullptr);
+	for(int i = 0; i < 1000; i++)
+		::operator delete(t[i]);
+	::operator delete(t);
+	// The rows of init_contiguous_2 are one contiguous block
+	EXPECT_TRUE(init_contiguous_2<float>(t,1000,200) && t!=nullptr);
+	EXPECT_EQ(t[0] + 999 * 200,t[999]);
+	free_contiguous_2<float>(t);
+	EXPECT_TRUE(t == nullptr);
 }
 
 TEST_F(UtilTest, test7) {
@@ -141,6 +160,306 @@ TEST_F(UtilTest, test7) {
 	EXPECT_LT(0.0,distance_l2<unsigned char>(x,y,3));
 }
 
+TEST_F(UtilTest, test8) {
+	// Every instruction set must agree with the double precision loop
+	int dims[] = {1, 7, 13, 31, 64, 100, 128};
+	SimdLevel best = simd_detect();
+	for(int l = 0; l <= static_cast<int>(best); l++) {
+		simd_set_level(static_cast<SimdLevel>(l));
+		for(int t = 0; t < 7; t++) {
+			double l2 = 0.0, l1 = 0.0, tmp;
+			for(int i = 0; i < dims[t]; i++) {
+				tmp = static_cast<double>(data[0][i]) - data[1][i];
+				l2 += tmp * tmp;
+				l1 += fabs(tmp);
+			}
+			EXPECT_NEAR(l2,distance_l2_square<float>(data[0],data[1],dims[t]),l2 * 1e-5);
+			EXPECT_NEAR(l1,distance_l1<float>(data[0],data[1],dims[t]),l1 * 1e-5);
+			EXPECT_NEAR(sqrt(l2),(distance_l2<float,float>(data[0],data[1],dims[t])),sqrt(l2) * 1e-5);
+		}
+	}
+	simd_set_level(best);
+	EXPECT_EQ(best,simd_level());
+}
+
+TEST_F(UtilTest, test9) {
+	// The popcount kernels of every instruction set against the generic loop
+	unsigned char x[77], y[77];
+	for(int i = 0; i < 77; i++) {
+		x[i] = static_cast<unsigned char>(static_cast<int>(data[2][i]) & 0xff);
+		y[i] = static_cast<unsigned char>(static_cast<int>(data[3][i]) & 0xff);
+	}
+	int expected[3] = {0, 0, 0}, lens[3] = {5, 32, 77};
+	for(int t = 0; t < 3; t++)
+		for(int i = 0; i < lens[t]; i++)
+			for(int b = 0; b < 8; b++)
+				expected[t] += ((x[i] ^ y[i]) >> b) & 1;
+	SimdLevel best = simd_detect();
+	for(int l = 0; l <= static_cast<int>(best); l++) {
+		simd_set_level(static_cast<SimdLevel>(l));
+		for(int t = 0; t < 3; t++)
+			EXPECT_EQ(expected[t],distance_hamming<unsigned char>(x,y,lens[t]));
+	}
+	simd_set_level(best);
+
+	// Real numbers and mixed types are compared component by component
+	float a[4] = {0.0f, 1.0f, 1.0f, 0.0f};
+	float b[4] = {1.0f, 1.0f, 0.0f, 0.0f};
+	unsigned char c[4] = {0, 1, 1, 1};
+	EXPECT_EQ(2.0,distance_hamming<float>(a,b,4));
+	EXPECT_EQ(1.0,(distance_hamming<unsigned char,float>(c,a,4)));
+	EXPECT_EQ(2.0,(compare_distance<float,float>(a,b,DistanceType::HAMMING,4)));
+}
+
+TEST_F(UtilTest, test10) {
+	// The byte kernels are exact in integers, the byte-float ones
+	// must agree with the double precision loop
+	unsigned char x[200], y[200];
+	for(int i = 0; i < 200; i++) {
+		x[i] = static_cast<unsigned char>(static_cast<int>(data[4][i % 128]) & 0xff);
+		y[i] = static_cast<unsigned char>(static_cast<int>(data[5][i % 128]) & 0xff);
+	}
+	x[0] = 255; y[0] = 0; // the largest difference
+	int dims[] = {1, 15, 31, 33, 64, 100, 128, 200};
+	SimdLevel best = simd_detect();
+	for(int l = 0; l <= static_cast<int>(best); l++) {
+		simd_set_level(static_cast<SimdLevel>(l));
+		for(int t = 0; t < 8; t++) {
+			int l2 = 0, l1 = 0, tmp;
+			double fl2 = 0.0, fl1 = 0.0, ftmp;
+			for(int i = 0; i < dims[t]; i++) {
+				tmp = static_cast<int>(x[i]) - static_cast<int>(y[i]);
+				l2 += tmp * tmp;
+				l1 += abs(tmp);
+				ftmp = static_cast<double>(x[i]) - data[6][i % 128];
+				fl2 += ftmp * ftmp;
+				fl1 += fabs(ftmp);
+			}
+			EXPECT_EQ(l2,distance_l2_square<unsigned char>(x,y,dims[t]));
+			EXPECT_EQ(l1,distance_l1<unsigned char>(x,y,dims[t]));
+			if(dims[t] <= 128) {
+				EXPECT_NEAR(fl2,(distance_l2_square<unsigned char,float>(x,data[6],dims[t])),fl2 * 1e-5);
+				EXPECT_NEAR(fl1,(distance_l1<float,unsigned char>(data[6],x,dims[t])),fl1 * 1e-5);
+			}
+		}
+	}
+	simd_set_level(best);
+}
+
+TEST_F(UtilTest, test11) {
+	// A half keeps 11 significant bits and a bfloat16 keeps 8
+	half_t h[200];
+	bfloat16_t b[200];
+	for(int i = 0; i < 200; i++) {
+		float v = data[7][i % 128] - static_cast<float>(N / 2);
+		h[i] = v;
+		b[i] = v;
+		EXPECT_NEAR(v,static_cast<float>(h[i]),fabs(v) * 0.00049f);
+		EXPECT_NEAR(v,static_cast<float>(b[i]),fabs(v) * 0.0040f);
+	}
+	EXPECT_EQ(0x3c00,half_t(1.0f).bits);
+	EXPECT_EQ(65504.0f,static_cast<float>(half_t(65504.0f)));
+	EXPECT_EQ(5.9604645e-8f,half_to_float(1)); // the smallest subnormal
+
+	// The converting kernels of every instruction set against the double precision loop
+	int dims[] = {1, 7, 16, 31, 64, 100, 128, 200};
+	SimdLevel best = simd_detect();
+	for(int l = 0; l <= static_cast<int>(best); l++) {
+		simd_set_level(static_cast<SimdLevel>(l));
+		for(int t = 0; t < 8; t++) {
+			int n = dims[t] < 128 ? dims[t] : 128;
+			double hl2 = 0.0, hl1 = 0.0, bl2 = 0.0, bl1 = 0.0, tmp;
+			for(int i = 0; i < n; i++) {
+				tmp = static_cast<double>(h[i]) - data[8][i];
+				hl2 += tmp * tmp;
+				hl1 += fabs(tmp);
+				tmp = static_cast<double>(b[i]) - static_cast<double>(b[i + 1]);
+				bl2 += tmp * tmp;
+				bl1 += fabs(tmp);
+			}
+			EXPECT_NEAR(hl2,(distance_l2_square<half_t,float>(h,data[8],n)),hl2 * 1e-5);
+			EXPECT_NEAR(hl1,(distance_l1<float,half_t>(data[8],h,n)),hl1 * 1e-5);
+			EXPECT_NEAR(bl2,distance_l2_square<bfloat16_t>(b,b + 1,n),bl2 * 1e-5 + 1e-3);
+			EXPECT_NEAR(bl1,distance_l1<bfloat16_t>(b,b + 1,n),bl1 * 1e-5 + 1e-3);
+		}
+	}
+	simd_set_level(best);
+}
+
+TEST_F(UtilTest, test12) {
+	// The fixed-dimension kernels of every instruction set against the double precision loop
+	int dims[] = {64, 96, 128, 256, 960, 100};
+	vector<float> x(960), y(960);
+	for(int i = 0; i < 960; i++) {
+		x[i] = data[9 + i / 128][i % 128];
+		y[i] = data[20 + i / 128][i % 128];
+	}
+	// A copy of x that starts on a SIMD_ALIGN boundary, for the aligned kernels
+	vector<float> buf(960 + SIMD_ALIGN / sizeof(float));
+	float * ax = buf.data() + (SIMD_ALIGN - reinterpret_cast<uintptr_t>(buf.data()) % SIMD_ALIGN)
+			% SIMD_ALIGN / sizeof(float);
+	copy(x.begin(),x.end(),ax);
+	ASSERT_TRUE(aligned_rows(ax,SIMD_ALIGN / sizeof(float)));
+	DistanceFunction<float,float> generic = distance_l2_square<float,float>;
+	SimdLevel best = simd_detect();
+	for(int l = 0; l <= static_cast<int>(best); l++) {
+		simd_set_level(static_cast<SimdLevel>(l));
+		for(int t = 0; t < 6; t++) {
+			double l2 = 0.0, l1 = 0.0, tmp;
+			for(int i = 0; i < dims[t]; i++) {
+				tmp = static_cast<double>(x[i]) - y[i];
+				l2 += tmp * tmp;
+				l1 += fabs(tmp);
+			}
+			DistanceFunction<float,float> f2 = compare_function<float,float>(DistanceType::NORM_L2,dims[t]);
+			DistanceFunction<float,float> f1 = compare_function<float,float>(DistanceType::NORM_L1,dims[t]);
+			EXPECT_EQ(simd_has_fixed(dims[t]),f2 != generic);
+			EXPECT_NEAR(l2,f2(x.data(),y.data(),dims[t]),l2 * 1e-5);
+			EXPECT_NEAR(l1,f1(x.data(),y.data(),dims[t]),l1 * 1e-5);
+			f2 = compare_function<float,float>(DistanceType::NORM_L2,dims[t],true);
+			f1 = compare_function<float,float>(DistanceType::NORM_L1,dims[t],true);
+			EXPECT_NEAR(l2,f2(ax,y.data(),dims[t]),l2 * 1e-5);
+			EXPECT_NEAR(l1,f1(ax,y.data(),dims[t]),l1 * 1e-5);
+		}
+	}
+	simd_set_level(best);
+}
+
+TEST_F(UtilTest, test13) {
+	// The bounded kernels of every instruction set: the full distance under
+	// an infinite bound, and a partial sum above the bound when they abandon
+	int dims[] = {1, 15, 16, 33, 64, 100, 128, 200, 960};
+	vector<float> x(960), y(960);
+	for(int i = 0; i < 960; i++) {
+		x[i] = data[9 + i / 128][i % 128];
+		y[i] = data[20 + i / 128][i % 128];
+	}
+	SimdLevel best = simd_detect();
+	for(int l = 0; l <= static_cast<int>(best); l++) {
+		simd_set_level(static_cast<SimdLevel>(l));
+		for(int t = 0; t < 9; t++) {
+			double l2 = 0.0, l1 = 0.0, tmp;
+			for(int i = 0; i < dims[t]; i++) {
+				tmp = static_cast<double>(x[i]) - y[i];
+				l2 += tmp * tmp;
+				l1 += fabs(tmp);
+			}
+			EXPECT_NEAR(l2,(distance_l2_square_bounded<float,float>(x.data(),y.data(),dims[t],DBL_MAX)),l2 * 1e-5);
+			EXPECT_NEAR(l1,(distance_l1_bounded<float,float>(x.data(),y.data(),dims[t],DBL_MAX)),l1 * 1e-5);
+			EXPECT_GT((distance_l2_square_bounded<float,float>(x.data(),y.data(),dims[t],l2 * 0.5)),l2 * 0.5);
+			EXPECT_GT((distance_l1_bounded<float,float>(x.data(),y.data(),dims[t],l1 * 0.5)),l1 * 0.5);
+		}
+	}
+	simd_set_level(best);
+	unsigned char u[40], v[40];
+	for(int i = 0; i < 40; i++) {
+		u[i] = static_cast<unsigned char>(i * 7);
+		v[i] = static_cast<unsigned char>(255 - i * 3);
+	}
+	double ul2 = distance_l2_square<unsigned char>(u,v,40);
+	EXPECT_EQ(ul2,(distance_l2_square_bounded<unsigned char,unsigned char>(u,v,40,DBL_MAX)));
+	EXPECT_GT((distance_l2_square_bounded<unsigned char,unsigned char>(u,v,40,1.0)),1.0);
+	EXPECT_TRUE((bounded_function<float,float>(DistanceType::COSINE) == nullptr));
+
+	// The distances are unchanged when the dimensions of both vectors are permuted
+	vector<int> order;
+	vector<float> flat(100 * 128), a(128), b(128);
+	for(int i = 0; i < 100; i++)
+		copy(data[i],data[i] + 128,flat.begin() + i * 128);
+	variance_order<float>(flat.data(),100,128,order);
+	double before = distance_l2_square<float>(x.data(),y.data(),128);
+	permute_vector<float,float>(x.data(),order.data(),128,a.data());
+	permute_vector<float,float>(y.data(),order.data(),128,b.data());
+	EXPECT_NEAR(before,distance_l2_square<float>(a.data(),b.data(),128),before * 1e-5);
+	vector<bool> seen(128,false);
+	for(int j = 0; j < 128; j++) seen[order[j]] = true;
+	EXPECT_EQ(128,count(seen.begin(),seen.end(),true));
+}
+
+TEST_F(UtilTest, test14) {
+	// The rows of a Matrix are aligned, padded with zeros and stride elements apart
+	Matrix<float> m(data[0],1,d);
+	EXPECT_EQ(128,m.stride());
+	EXPECT_FALSE(m.padded());
+	Matrix<float> f(100,100);
+	Matrix<unsigned char> u(10,100);
+	Matrix<half_t> h(10,100);
+	EXPECT_EQ(112,f.stride());
+	EXPECT_EQ(128,u.stride());
+	EXPECT_EQ(128,h.stride());
+	for(int i = 0; i < 100; i++) {
+		EXPECT_EQ(0u,reinterpret_cast<uintptr_t>(f[i]) % MATRIX_ALIGN);
+		EXPECT_EQ(f.row_table()[i],f.row(i));
+		for(int j = 0; j < 100; j++)
+			f[i][j] = data[i][j];
+		for(int j = 100; j < f.stride(); j++)
+			EXPECT_EQ(0.0f,f[i][j]);
+	}
+	EXPECT_EQ(0u,reinterpret_cast<uintptr_t>(u[3]) % MATRIX_ALIGN);
+	// The padding adds nothing to the distances
+	double unpadded = distance_l2_square<float>(data[0],data[1],100);
+	EXPECT_NEAR(unpadded,distance_l2_square<float>(f[0],f[1],f.stride()),1e-5 * unpadded);
+	vector<float> flat(100 * 100);
+	unpad_rows<float>(f.data(),flat.data(),100,100,f.stride());
+	Matrix<float> g(flat.data(),100,100);
+	EXPECT_EQ(0,memcmp(f.data(),g.data(),100 * f.stride() * sizeof(float)));
+	for(int j = 0; j < 128; j++)
+		EXPECT_EQ(data[0][j],m[0][j]);
+}
+
+TEST_F(UtilTest, test15) {
+	// The transposed centers give the two nearest centers of a direct search
+	// in every instruction set, including a last tile that is not full
+	int dims[] = {2, 3, 8, 17, 32}, k = 45;
+	vector<float> centers(k * 32), tiles(center_tiles_size(k,32));
+	SimdLevel best = simd_detect();
+	for(int l = 0; l <= static_cast<int>(best); l++) {
+		simd_set_level(static_cast<SimdLevel>(l));
+		for(int t = 0; t < 5; t++) {
+			int dt = dims[t];
+			for(int i = 0; i < k; i++)
+				for(int j = 0; j < dt; j++)
+					centers[i * dt + j] = data[i][j];
+			transpose_centers(centers.data(),k,dt,tiles.data());
+			for(int r = 50; r < 100; r++) {
+				for(int m = 0; m < 2; m++) {
+					DistanceType type = m == 0 ? DistanceType::NORM_L2 : DistanceType::NORM_L1;
+					double d1 = DBL_MAX, d2 = DBL_MAX, tmp;
+					for(int i = 0; i < k; i++) {
+						tmp = m == 0 ? distance_l2_square<float>(data[r],&centers[i * dt],dt)
+								: distance_l1<float>(data[r],&centers[i * dt],dt);
+						if(tmp < d1) {
+							d2 = d1;
+							d1 = tmp;
+						} else if(tmp < d2) {
+							d2 = tmp;
+						}
+					}
+					float b[2];
+					int id[2];
+					nearest_in_tiles(data[r],tiles.data(),k,dt,type,b,id);
+					EXPECT_NEAR(d1,b[0],d1 * 1e-5 + 1e-6);
+					EXPECT_NEAR(d2,b[1],d2 * 1e-5 + 1e-6);
+					tmp = m == 0 ? distance_l2_square<float>(data[r],&centers[id[0] * dt],dt)
+							: distance_l1<float>(data[r],&centers[id[0] * dt],dt);
+					EXPECT_NEAR(d1,tmp,d1 * 1e-5 + 1e-6);
+					EXPECT_NE(id[0],id[1]);
+				}
+			}
+		}
+	}
+	simd_set_level(best);
+	EXPECT_TRUE(use_center_tiles(16,256));
+	EXPECT_FALSE(use_center_tiles(64,256));
+	EXPECT_FALSE(use_center_tiles(16,8));
+}
+
+TEST_F(UtilTest, test16) {
+	// The kernels are ready for the static initializers
+	EXPECT_FLOAT_EQ(30.0f,static_dist);
+	EXPECT_FLOAT_EQ(30.0f,simd_l2_square_f32(static_x,static_y,4));
+}
+
 int main(int argc, char * argv[])
 {
 	/*The method is initializes the Google framework and must be called before RUN_ALL_TESTS */